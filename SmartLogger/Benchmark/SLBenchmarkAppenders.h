@@ -0,0 +1,46 @@
+//
+//  SLBenchmarkAppenders.h
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/4.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#import "SLAbstractLogAppender.h"
+#import "SLHistogram.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * Formats and encodes like a real appender, then discards the bytes.
+ */
+@interface SLNullLogAppender : SLAbstractLogAppender
+@end
+
+/**
+ * Writes formatted lines into a memory mapped file, wraps around when full.
+ */
+@interface SLMmapLogAppender : SLAbstractLogAppender
+- (nullable instancetype)initWithFilePath:(NSString *)filePath size:(size_t)size NS_DESIGNATED_INITIALIZER;
+- (instancetype)init NS_UNAVAILABLE;
+@end
+
+/**
+ * Forwards to another appender and records end to end latency,
+ * from message creation until the inner appender returns.
+ */
+@interface SLMeasuringLogAppender : SLAbstractLogAppender
+{
+@public
+    SLHistogram _endToEndLatency;
+}
+@property (nonatomic, strong, readonly) id <SLLogAppender> appender;
+/// Messages delivered to inner appender
+@property (nonatomic, readonly) uint64_t deliveredCount;
+
+- (instancetype)initWithAppender:(id <SLLogAppender>)appender NS_DESIGNATED_INITIALIZER;
+- (instancetype)init NS_UNAVAILABLE;
+- (void)reset;
+@end
+
+NS_ASSUME_NONNULL_END
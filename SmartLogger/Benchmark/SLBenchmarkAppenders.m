@@ -0,0 +1,157 @@
+//
+//  SLBenchmarkAppenders.m
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/4.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#import "SLBenchmarkAppenders.h"
+#import "SLLogFormatter.h"
+#import "SLLogMessage.h"
+#import "SLLogClock.h"
+
+#import <fcntl.h>
+#import <sys/mman.h>
+#import <unistd.h>
+
+@implementation SLNullLogAppender
+
+- (void)logMessage:(SLLogMessage *)logMessage
+{
+    SLLogLine *line = [self lineForLogMessage:logMessage];
+    (void)line;
+}
+
+- (NSString *)appenderName
+{
+    return @"com.yy.athlog.nullappender";
+}
+
+@end
+
+@implementation SLMmapLogAppender
+{
+    int _fd;
+    char *_base;
+    size_t _size;
+    size_t _offset;
+}
+
+- (instancetype)initWithFilePath:(NSString *)filePath size:(size_t)size
+{
+    if ((self = [super init])) {
+        _size = MAX(size, (size_t)getpagesize());
+        _fd = open(filePath.fileSystemRepresentation, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (_fd < 0) {
+            return nil;
+        }
+        if (ftruncate(_fd, (off_t)_size) != 0) {
+            close(_fd);
+            return nil;
+        }
+        _base = mmap(NULL, _size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+        if (_base == MAP_FAILED) {
+            close(_fd);
+            return nil;
+        }
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    if (_base && _base != MAP_FAILED) {
+        munmap(_base, _size);
+    }
+    if (_fd >= 0) {
+        close(_fd);
+    }
+}
+
+- (void)logMessage:(SLLogMessage *)logMessage
+{
+    SLLogLine *line = [self lineForLogMessage:logMessage];
+    if (line == nil) {
+        return;
+    }
+
+    NSUInteger length = line->_length;
+    if (length > _size) {
+        return;
+    }
+    if (_offset + length > _size) {
+        _offset = 0;
+    }
+
+    memcpy(_base + _offset, line->_bytes, length);
+    _offset += length;
+}
+
+- (void)flush
+{
+    msync(_base, _size, MS_ASYNC);
+}
+
+- (NSString *)appenderName
+{
+    return @"com.yy.athlog.mmapappender";
+}
+
+@end
+
+@implementation SLMeasuringLogAppender
+{
+    uint64_t _deliveredCount;
+}
+
+- (instancetype)initWithAppender:(id<SLLogAppender>)appender
+{
+    if ((self = [super init])) {
+        _appender = appender;
+        SLHistogramInit(&_endToEndLatency);
+    }
+    return self;
+}
+
+- (void)setLogFormatter:(id<SLLogFormatter>)logFormatter
+{
+    [super setLogFormatter:logFormatter];
+    _appender.logFormatter = logFormatter;
+}
+
+- (void)logMessage:(SLLogMessage *)logMessage
+{
+    [_appender logMessage:logMessage];
+
+    uint64_t now = SLLogClockNow();
+    if (logMessage->_ticks && now > logMessage->_ticks) {
+        SLHistogramRecord(&_endToEndLatency, SLLogClockNanos(now - logMessage->_ticks));
+    }
+    __atomic_fetch_add(&_deliveredCount, 1, __ATOMIC_RELEASE);
+}
+
+- (uint64_t)deliveredCount
+{
+    return __atomic_load_n(&_deliveredCount, __ATOMIC_ACQUIRE);
+}
+
+- (void)reset
+{
+    SLHistogramInit(&_endToEndLatency);
+    __atomic_store_n(&_deliveredCount, 0, __ATOMIC_RELEASE);
+}
+
+- (void)flush
+{
+    if ([_appender respondsToSelector:@selector(flush)]) {
+        [_appender flush];
+    }
+}
+
+- (NSString *)appenderName
+{
+    return [NSString stringWithFormat:@"com.yy.athlog.measuring.%@", _appender.appenderName];
+}
+
+@end
@@ -0,0 +1,281 @@
+//
+//  SLBenchmarkCore.c
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/4.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#include "SLBenchmarkCore.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __APPLE__
+#include <mach/mach_time.h>
+#endif
+
+uint64_t SLBenchNow(void) {
+#ifdef __APPLE__
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0) {
+        mach_timebase_info(&timebase);
+    }
+    return mach_absolute_time() * timebase.numer / timebase.denom;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+uint64_t SLBenchCPUTime(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Runner
+
+typedef struct SLBenchShared_ {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int ready;
+    int go;
+    int threads;
+    uint64_t operationsPerThread;
+    int recordLatency;
+    SLBenchOperation operation;
+    void *context;
+    SLHistogram *latency;
+} SLBenchShared;
+
+typedef struct SLBenchThread_ {
+    SLBenchShared *shared;
+    int index;
+} SLBenchThread;
+
+static void *sl_bench_thread_main(void *arg) {
+    SLBenchThread *thread = (SLBenchThread *)arg;
+    SLBenchShared *shared = thread->shared;
+
+    // Start barrier, so every producer begins together.
+    pthread_mutex_lock(&shared->mutex);
+    shared->ready++;
+    pthread_cond_broadcast(&shared->cond);
+    while (!shared->go) {
+        pthread_cond_wait(&shared->cond, &shared->mutex);
+    }
+    pthread_mutex_unlock(&shared->mutex);
+
+    SLBenchOperation operation = shared->operation;
+    void *context = shared->context;
+    if (shared->recordLatency) {
+        for (uint64_t i = 0; i < shared->operationsPerThread; i++) {
+            uint64_t start = SLBenchNow();
+            operation(context, thread->index, i);
+            SLHistogramRecord(shared->latency, SLBenchNow() - start);
+        }
+    } else {
+        for (uint64_t i = 0; i < shared->operationsPerThread; i++) {
+            operation(context, thread->index, i);
+        }
+    }
+    return NULL;
+}
+
+int SLBenchRun(SLBenchResult *result,
+               const char *name,
+               int threads,
+               uint64_t operationsPerThread,
+               int recordLatency,
+               SLBenchOperation operation,
+               SLBenchDrain drain,
+               void *context) {
+    if (threads <= 0 || operation == NULL) {
+        return -1;
+    }
+
+    memset(result, 0, sizeof(SLBenchResult));
+    result->name = name;
+    result->threads = threads;
+    result->operations = operationsPerThread * (uint64_t)threads;
+    SLHistogramInit(&result->callLatency);
+
+    SLBenchShared shared;
+    memset(&shared, 0, sizeof(shared));
+    pthread_mutex_init(&shared.mutex, NULL);
+    pthread_cond_init(&shared.cond, NULL);
+    shared.threads = threads;
+    shared.operationsPerThread = operationsPerThread;
+    shared.recordLatency = recordLatency;
+    shared.operation = operation;
+    shared.context = context;
+    shared.latency = &result->callLatency;
+
+    pthread_t *tids = (pthread_t *)calloc((size_t)threads, sizeof(pthread_t));
+    SLBenchThread *args = (SLBenchThread *)calloc((size_t)threads, sizeof(SLBenchThread));
+    if (tids == NULL || args == NULL) {
+        free(tids);
+        free(args);
+        return -1;
+    }
+
+    int started = 0;
+    for (; started < threads; started++) {
+        args[started].shared = &shared;
+        args[started].index = started;
+        if (pthread_create(&tids[started], NULL, sl_bench_thread_main, &args[started]) != 0) {
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&shared.mutex);
+    while (shared.ready < started) {
+        pthread_cond_wait(&shared.cond, &shared.mutex);
+    }
+    uint64_t start = SLBenchNow();
+    shared.go = 1;
+    pthread_cond_broadcast(&shared.cond);
+    pthread_mutex_unlock(&shared.mutex);
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(tids[i], NULL);
+    }
+
+    uint64_t drainStart = SLBenchNow();
+    if (drain) {
+        drain(context);
+    }
+    uint64_t end = SLBenchNow();
+
+    result->threads = started;
+    result->operations = operationsPerThread * (uint64_t)started;
+    result->elapsedNanos = end - start;
+    result->drainNanos = end - drainStart;
+
+    pthread_cond_destroy(&shared.cond);
+    pthread_mutex_destroy(&shared.mutex);
+    free(tids);
+    free(args);
+
+    return started == threads ? 0 : -1;
+}
+
+double SLBenchThroughput(const SLBenchResult *result) {
+    if (result->elapsedNanos == 0) {
+        return 0;
+    }
+    return (double)result->operations * 1e9 / (double)result->elapsedNanos;
+}
+
+// Report
+
+struct SLBenchReport_ {
+    char *buffer;
+    size_t length;
+    size_t capacity;
+    int count;
+    int closed;
+};
+
+static void sl_bench_report_append(SLBenchReport *report, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+static void sl_bench_report_append(SLBenchReport *report, const char *format, ...) {
+    va_list args;
+    for (;;) {
+        va_start(args, format);
+        int needed = vsnprintf(report->buffer + report->length, report->capacity - report->length, format, args);
+        va_end(args);
+        if (needed < 0) {
+            return;
+        }
+        if (report->length + (size_t)needed < report->capacity) {
+            report->length += (size_t)needed;
+            return;
+        }
+        size_t capacity = (report->capacity + (size_t)needed) * 2;
+        char *buffer = (char *)realloc(report->buffer, capacity);
+        if (buffer == NULL) {
+            return;
+        }
+        report->buffer = buffer;
+        report->capacity = capacity;
+    }
+}
+
+SLBenchReport *SLBenchReportCreate(const char *suite) {
+    SLBenchReport *report = (SLBenchReport *)calloc(1, sizeof(SLBenchReport));
+    if (report == NULL) {
+        return NULL;
+    }
+    report->capacity = 4096;
+    report->buffer = (char *)malloc(report->capacity);
+    if (report->buffer == NULL) {
+        free(report);
+        return NULL;
+    }
+    report->buffer[0] = '\0';
+    sl_bench_report_append(report, "{\"benchmark\":\"%s\",\"results\":[", suite ? suite : "");
+    return report;
+}
+
+void SLBenchReportAdd(SLBenchReport *report, const SLBenchResult *result, const char *extra) {
+    if (report == NULL || report->closed) {
+        return;
+    }
+    char histogram[512];
+    SLHistogramPrintJSON(&result->callLatency, histogram, sizeof(histogram));
+    sl_bench_report_append(report,
+                           "%s{\"name\":\"%s\",\"threads\":%d,\"operations\":%" PRIu64
+                           ",\"elapsed_ns\":%" PRIu64 ",\"drain_ns\":%" PRIu64
+                           ",\"ops_per_sec\":%.1f,\"call_latency_ns\":%s",
+                           report->count ? "," : "",
+                           result->name ? result->name : "",
+                           result->threads,
+                           result->operations,
+                           result->elapsedNanos,
+                           result->drainNanos,
+                           SLBenchThroughput(result),
+                           histogram);
+    if (extra && extra[0]) {
+        sl_bench_report_append(report, ",\"extra\":%s", extra);
+    }
+    sl_bench_report_append(report, "}");
+    report->count++;
+}
+
+const char *SLBenchReportJSON(SLBenchReport *report) {
+    if (report == NULL) {
+        return NULL;
+    }
+    if (!report->closed) {
+        sl_bench_report_append(report, "]}");
+        report->closed = 1;
+    }
+    return report->buffer;
+}
+
+int SLBenchReportWrite(SLBenchReport *report, const char *path) {
+    const char *json = SLBenchReportJSON(report);
+    FILE *file = json ? fopen(path, "w") : NULL;
+    if (file == NULL) {
+        return -1;
+    }
+    size_t length = strlen(json);
+    int ok = fwrite(json, 1, length, file) == length;
+    ok = (fputc('\n', file) != EOF) && ok;
+    return (fclose(file) == 0 && ok) ? 0 : -1;
+}
+
+void SLBenchReportFree(SLBenchReport *report) {
+    if (report) {
+        free(report->buffer);
+        free(report);
+    }
+}
@@ -0,0 +1,76 @@
+//
+//  SLBenchmarkCore.h
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/4.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#ifndef SLBenchmarkCore_h
+#define SLBenchmarkCore_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "SLHistogram.h"
+
+#if __cplusplus
+extern "C" {
+#endif
+
+// Portable part of the logging benchmark: timing, multi-threaded drivers and the JSON report.
+// Plain C + pthreads, builds on Darwin and Linux, the pipeline under test is plugged in through
+// SLBenchOperation.
+
+// Monotonic clock in nanoseconds.
+uint64_t SLBenchNow(void);
+
+// CPU time of the process (all threads) in nanoseconds.
+uint64_t SLBenchCPUTime(void);
+
+// One measured operation, eg. a single log call. `index` is unique per thread.
+typedef void (*SLBenchOperation)(void *context, int thread, uint64_t index);
+
+// Waits until all operations reached the sink, eg. flush the logger. May be NULL.
+typedef void (*SLBenchDrain)(void *context);
+
+typedef struct SLBenchResult_ {
+    const char *name;
+    int threads;
+    uint64_t operations;
+    uint64_t elapsedNanos;    // From first call until drained.
+    uint64_t drainNanos;      // Time spent in SLBenchDrain only.
+    SLHistogram callLatency;  // Per call latency seen by the producer.
+} SLBenchResult;
+
+// Runs `operationsPerThread` calls on each of `threads` producer threads, all started together.
+// Records every call latency when `recordLatency` is nonzero.
+int SLBenchRun(SLBenchResult *result,
+               const char *name,
+               int threads,
+               uint64_t operationsPerThread,
+               int recordLatency,
+               SLBenchOperation operation,
+               SLBenchDrain drain,
+               void *context);
+
+// Operations per second, 0 if nothing measured.
+double SLBenchThroughput(const SLBenchResult *result);
+
+// Machine readable report, one JSON object per result inside `{"benchmark":"...","results":[...]}`.
+typedef struct SLBenchReport_ SLBenchReport;
+
+SLBenchReport *SLBenchReportCreate(const char *suite);
+// `extra` is an optional JSON object appended to the result as "extra", eg. an end to end histogram.
+void SLBenchReportAdd(SLBenchReport *report, const SLBenchResult *result, const char *extra);
+// Returns the report, valid until SLBenchReportFree.
+const char *SLBenchReportJSON(SLBenchReport *report);
+// Writes the report to path, returns 0 on success.
+int SLBenchReportWrite(SLBenchReport *report, const char *path);
+void SLBenchReportFree(SLBenchReport *report);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SLBenchmarkCore_h */
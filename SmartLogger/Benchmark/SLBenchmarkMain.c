@@ -0,0 +1,176 @@
+//
+//  SLBenchmarkMain.c
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/4.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+// Linux driver of the portable benchmark parts, see Makefile. SLLogBenchmark drives the real
+// pipeline on Darwin; here the measured operation formats a line the way the formatter does and
+// writes it to a file, as a synchronous file appender would. One run is recorded as a workload trace
+// (SLLogTrace.h), loaded again and replayed at recorded timing and back to back.
+//
+//   SLBenchmark [report.json]
+
+#include "SLBenchmarkCore.h"
+#include "SLLogTraceReplay.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SL_BENCH_OPERATIONS 20000
+#define SL_BENCH_MAX_THREADS 4
+#define SL_BENCH_TRACED_OPERATIONS 5000
+#define SL_BENCH_FLAG_INFO (1 << 2)   // SLLogFlagInfo
+
+static int s_failures = 0;
+
+#define SL_EXPECT(condition, ...) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+        fprintf(stderr, __VA_ARGS__); \
+        fprintf(stderr, "\n"); \
+        s_failures++; \
+    } \
+} while (0)
+
+typedef struct SLBenchFileContext_ {
+    int fd;
+} SLBenchFileContext;
+
+static const char *s_tags[] = { "Network", "Database", "UI", "Benchmark" };
+
+// Tags are told apart by identity, as SLLogger's NSString tags are
+static const char *sl_bench_tag_name(const void *tag) {
+    return (const char *)tag;
+}
+
+static void sl_bench_file_log(void *context, int thread, uint64_t index) {
+    SLBenchFileContext *ctx = (SLBenchFileContext *)context;
+    const char *tag = s_tags[index % 4];
+    uint32_t site = 40 + (uint32_t)(index % 4);
+    char message[128];
+    int messageLength = snprintf(message, sizeof(message), "benchmark message thread=%d index=%llu payload=%s",
+                                 thread, (unsigned long long)index, "0123456789abcdef");
+    if (SLLogTraceEnabled()) {
+        SLLogTraceRecord(__FILE__, site, tag, sl_bench_tag_name, SL_BENCH_FLAG_INFO, 1, (uint32_t)messageLength);
+    }
+    char line[256];
+    uint64_t now = SLBenchNow();
+    int length = snprintf(line, sizeof(line), "%02u:%02u:%02u.%03u [%s] [SLBenchmarkMain.c(line:%u)] %s\n",
+                          (unsigned)(now / 3600000000000ull % 24), (unsigned)(now / 60000000000ull % 60),
+                          (unsigned)(now / 1000000000ull % 60), (unsigned)(now / 1000000ull % 1000),
+                          tag, site, message);
+    if (length > 0 && write(ctx->fd, line, (size_t)length < sizeof(line) ? (size_t)length : sizeof(line) - 1) < 0) {
+        perror("write");
+    }
+}
+
+static void sl_bench_print(const SLBenchResult *result) {
+    printf("%-16s %d threads, %8.0f ops/s, p50 %6llu ns, p99 %7llu ns\n", result->name, result->threads,
+           SLBenchThroughput(result),
+           (unsigned long long)SLHistogramPercentile(&result->callLatency, 50),
+           (unsigned long long)SLHistogramPercentile(&result->callLatency, 99));
+}
+
+int main(int argc, char **argv) {
+    char directory[] = "/tmp/sl-benchmark-XXXXXX";
+    if (mkdtemp(directory) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    char logPath[256];
+    snprintf(logPath, sizeof(logPath), "%s/benchmark.log", directory);
+    SLBenchFileContext file = { open(logPath, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644) };
+    SL_EXPECT(file.fd >= 0, "open %s", logPath);
+
+    SLBenchReport *report = SLBenchReportCreate("SmartLogger-Linux");
+
+    // Thread sweep of the synthetic scenario
+    for (int threads = 1; threads <= SL_BENCH_MAX_THREADS; threads <<= 1) {
+        char name[32];
+        snprintf(name, sizeof(name), "file_sweep_%d", threads);
+        SLBenchResult result;
+        SL_EXPECT(SLBenchRun(&result, name, threads, SL_BENCH_OPERATIONS, 1, sl_bench_file_log, NULL, &file) == 0,
+                  "%s failed", name);
+        SL_EXPECT(result.operations == (uint64_t)threads * SL_BENCH_OPERATIONS, "%s ran %llu operations", name,
+                  (unsigned long long)result.operations);
+        sl_bench_print(&result);
+        SLBenchReportAdd(report, &result, "{\"appender\":\"file\",\"async\":false}");
+    }
+
+    // Record the 4 thread run, then replay it into another file
+    char tracePath[256], replayPath[256];
+    snprintf(tracePath, sizeof(tracePath), "%s/benchmark.sltrace", directory);
+    snprintf(replayPath, sizeof(replayPath), "%s/replay.log", directory);
+    SL_EXPECT(SLLogTraceStart(tracePath) == 0, "can't record %s", tracePath);
+    SLBenchResult recorded;
+    SLBenchRun(&recorded, "file_traced", SL_BENCH_MAX_THREADS, SL_BENCH_TRACED_OPERATIONS, 1, sl_bench_file_log,
+               NULL, &file);
+    SLLogTraceStop();
+    sl_bench_print(&recorded);
+    SLBenchReportAdd(report, &recorded, "{\"appender\":\"file\",\"async\":false,\"traced\":true}");
+
+    SLLogTraceData trace;
+    memset(&trace, 0, sizeof(trace));
+    int loaded = SLLogTraceLoad(tracePath, &trace) == 0;
+    SL_EXPECT(loaded, "can't load %s", tracePath);
+    if (loaded) {
+        // 4 sites and 4 tags, [0] of each is the empty name
+        SL_EXPECT(trace.count == (size_t)SL_BENCH_MAX_THREADS * SL_BENCH_TRACED_OPERATIONS, "trace has %zu calls",
+                  trace.count);
+        SL_EXPECT(trace.threadCount == SL_BENCH_MAX_THREADS, "trace has %u threads", trace.threadCount);
+        SL_EXPECT(trace.siteCount == 5 && trace.tagCount == 5, "trace has %u sites, %u tags", trace.siteCount,
+                  trace.tagCount);
+        SL_EXPECT(trace.count > 0 && trace.events[0].flag == SL_BENCH_FLAG_INFO && trace.events[0].synchronous &&
+                  strncmp(trace.sites[trace.events[0].site], "SLBenchmarkMain.c:4", 19) == 0,
+                  "first call recorded as flag %u at %s", trace.count ? trace.events[0].flag : 0,
+                  trace.count ? trace.sites[trace.events[0].site] : "");
+
+        SLLogTraceWriteSink sink = { open(replayPath, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644) };
+        SL_EXPECT(sink.fd >= 0, "open %s", replayPath);
+        uint64_t start = SLBenchNow();
+        SL_EXPECT(SLLogTraceReplayRun(report, "trace_replay", &trace, 1, SLLogTraceWriteSinkLog, NULL, &sink) == 0,
+                  "replay failed");
+        uint64_t timed = SLBenchNow() - start;
+        start = SLBenchNow();
+        SL_EXPECT(SLLogTraceReplayRun(report, "trace_replay_max", &trace, 0, SLLogTraceWriteSinkLog, NULL, &sink) == 0,
+                  "back to back replay failed");
+        uint64_t backToBack = SLBenchNow() - start;
+        printf("trace: %zu calls on %u threads over %.1f ms, replayed in %.1f ms, back to back in %.1f ms\n",
+               trace.count, trace.threadCount,
+               trace.count ? (double)trace.events[trace.count - 1].time / 1e6 : 0.0,
+               (double)timed / 1e6, (double)backToBack / 1e6);
+        if (sink.fd >= 0) {
+            close(sink.fd);
+        }
+        SLLogTraceFree(&trace);
+    }
+
+    const char *json = SLBenchReportJSON(report);
+    SL_EXPECT(json != NULL && strstr(json, "\"file_sweep_4\"") != NULL && strstr(json, "\"trace_replay\"") != NULL &&
+              strstr(json, "\"schedule_lag_ns\"") != NULL, "report: %s", json ? json : "NULL");
+    if (argc > 1) {
+        SL_EXPECT(SLBenchReportWrite(report, argv[1]) == 0, "can't write %s", argv[1]);
+    }
+    SLBenchReportFree(report);
+
+    if (file.fd >= 0) {
+        close(file.fd);
+    }
+    unlink(logPath);
+    unlink(tracePath);
+    unlink(replayPath);
+    rmdir(directory);
+
+    if (s_failures > 0) {
+        fprintf(stderr, "SLBenchmark: %d failures\n", s_failures);
+        return 1;
+    }
+    printf("SLBenchmark: ok\n");
+    return 0;
+}
@@ -0,0 +1,64 @@
+//
+//  SLBinaryFormatBenchmark.cpp
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/6.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#include "SLBinaryFormatBenchmark.h"
+#include "SLBinaryFormat.hpp"
+
+#include <cstdio>
+
+#define SL_BENCH_FORMAT "request %s took %.3f ms, status %d, bytes %llu"
+
+namespace {
+
+const char *kSLBenchURL = "https://example.com/api/v1/items";
+
+// Keeps the compiler from dropping the work
+volatile size_t s_sink;
+
+void SLBenchSnprintf(void *, int thread, uint64_t index) {
+    char buffer[SL_BINARY_LOG_CAPACITY];
+    s_sink = (size_t)snprintf(buffer, sizeof(buffer), SL_BENCH_FORMAT,
+                              kSLBenchURL, (double)index * 0.25, thread, (unsigned long long)index);
+}
+
+void SLBenchCapture(void *, int thread, uint64_t index) {
+    SL_BINARY_FORMAT_CHECK(SL_BENCH_FORMAT, kSLBenchURL, 0.0, thread, (unsigned long long)index);
+    uint8_t buffer[SL_BINARY_LOG_CAPACITY];
+    s_sink = SLBinaryCapture(buffer, sizeof(buffer), kSLBenchURL, (double)index * 0.25, thread, (unsigned long long)index);
+}
+
+void SLBenchDecodeSink(void *context, const char *, size_t length) {
+    *static_cast<size_t *>(context) += length;
+}
+
+void SLBenchDecode(void *context, int, uint64_t) {
+    const uint8_t *payload = static_cast<const uint8_t *>(context);
+    size_t length = 0;
+    SLBinaryDecode(SL_BENCH_FORMAT, payload + sizeof(size_t), *(const size_t *)payload, SLBenchDecodeSink, &length);
+    s_sink = length;
+}
+
+} // namespace
+
+void SLBinaryFormatBenchmarkRun(SLBenchReport *report, int threads, uint64_t operationsPerThread) {
+    SLBenchResult result;
+
+    SLBenchRun(&result, "format_snprintf", threads, operationsPerThread, 1, SLBenchSnprintf, NULL, NULL);
+    SLBenchReportAdd(report, &result, NULL);
+
+    SLBenchRun(&result, "format_binary_capture", threads, operationsPerThread, 1, SLBenchCapture, NULL, NULL);
+    SLBenchReportAdd(report, &result, NULL);
+
+    // [size_t length][payload], decoded repeatedly
+    uint8_t payload[sizeof(size_t) + SL_BINARY_LOG_CAPACITY];
+    size_t length = SLBinaryCapture(payload + sizeof(size_t), SL_BINARY_LOG_CAPACITY,
+                                    kSLBenchURL, 12.5, 200, 4096ull);
+    memcpy(payload, &length, sizeof(length));
+    SLBenchRun(&result, "format_binary_decode", threads, operationsPerThread, 1, SLBenchDecode, NULL, payload);
+    SLBenchReportAdd(report, &result, NULL);
+}
@@ -0,0 +1,26 @@
+//
+//  SLBinaryFormatBenchmark.h
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/6.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#ifndef SLBinaryFormatBenchmark_h
+#define SLBinaryFormatBenchmark_h
+
+#include "SLBenchmarkCore.h"
+
+#if __cplusplus
+extern "C" {
+#endif
+
+// Compares caller side cost of snprintf against binary capture, and the deferred decode.
+// Plain C++, no Foundation dependency, runs on Linux as well.
+void SLBinaryFormatBenchmarkRun(SLBenchReport *report, int threads, uint64_t operationsPerThread);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SLBinaryFormatBenchmark_h */
@@ -0,0 +1,203 @@
+//
+//  SLCompressionBenchmark.c
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/10.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#include "SLCompressionBenchmark.h"
+#include "SLLogDictionary.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#define SL_BENCH_PATH_MAX 1024
+
+typedef struct SLCompressionBenchContext_ {
+    const char *input;
+    char output[SL_BENCH_PATH_MAX];
+    const void *dictionary;
+    size_t dictionaryLength;
+    int failed;
+} SLCompressionBenchContext;
+
+static long long sl_bench_file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (long long)st.st_size : -1;
+}
+
+// Same stream setup as -[SLCompressLogFileManager compressInBackground:]: gzip container,
+// default level, sync flush per 2 KB chunk.
+static int sl_bench_gzip_file(const char *inputPath, const char *outputPath) {
+    FILE *input = fopen(inputPath, "rb");
+    FILE *output = input ? fopen(outputPath, "wb") : NULL;
+    int result = -1;
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    if (output && deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK) {
+        unsigned char in[2048];
+        unsigned char out[1024];
+        int flush;
+        do {
+            strm.avail_in = (uInt)fread(in, 1, sizeof(in), input);
+            flush = feof(input) ? Z_FINISH : Z_SYNC_FLUSH;
+            strm.next_in = in;
+            do {
+                strm.next_out = out;
+                strm.avail_out = sizeof(out);
+                deflate(&strm, flush);
+                fwrite(out, 1, sizeof(out) - strm.avail_out, output);
+            } while (strm.avail_out == 0);
+        } while (flush != Z_FINISH && !ferror(input));
+        result = ferror(input) ? -1 : 0;
+        deflateEnd(&strm);
+    }
+    if (output) {
+        fclose(output);
+    }
+    if (input) {
+        fclose(input);
+    }
+    return result;
+}
+
+static void sl_bench_gzip(void *context, int thread, uint64_t index) {
+    (void)thread;
+    (void)index;
+    SLCompressionBenchContext *bench = (SLCompressionBenchContext *)context;
+    bench->failed |= sl_bench_gzip_file(bench->input, bench->output);
+}
+
+static void sl_bench_dictionary(void *context, int thread, uint64_t index) {
+    (void)thread;
+    (void)index;
+    SLCompressionBenchContext *bench = (SLCompressionBenchContext *)context;
+    bench->failed |= SLLogDictionaryCompressFile(bench->input, bench->output,
+                                                 bench->dictionary, bench->dictionaryLength,
+                                                 Z_DEFAULT_COMPRESSION);
+}
+
+static void sl_bench_add(SLBenchReport *report, SLBenchResult *result, SLCompressionBenchContext *bench) {
+    long long inputBytes = sl_bench_file_size(bench->input);
+    long long outputBytes = sl_bench_file_size(bench->output);
+    double seconds = result->elapsedNanos / 1e9;
+    char extra[256];
+    snprintf(extra, sizeof(extra),
+             "{\"input\":\"%s\",\"input_bytes\":%lld,\"output_bytes\":%lld,\"ratio\":%.4f,\"mb_per_sec\":%.2f,\"failed\":%d}",
+             bench->input, inputBytes, outputBytes,
+             inputBytes > 0 ? (double)outputBytes / (double)inputBytes : 0,
+             seconds > 0 ? (double)inputBytes * (double)result->operations / seconds / (1024.0 * 1024.0) : 0,
+             bench->failed);
+    SLBenchReportAdd(report, result, extra);
+}
+
+void SLCompressionBenchmarkRun(SLBenchReport *report,
+                               const char *trainingPath,
+                               const char *const *corpusPaths,
+                               int count,
+                               int iterations,
+                               const char *workDirectory) {
+    // Training is part of the cost, measured once
+    FILE *file = fopen(trainingPath, "rb");
+    if (file == NULL) {
+        return;
+    }
+    size_t capacity = 4 * 1024 * 1024;
+    char *samples = (char *)malloc(capacity);
+    size_t length = samples ? fread(samples, 1, capacity, file) : 0;
+    fclose(file);
+
+    char dictionary[SL_LOG_DICTIONARY_MAX_SIZE];
+    uint64_t start = SLBenchNow();
+    size_t dictionaryLength = SLLogDictionaryTrain(samples, length, dictionary, SL_LOG_DICTIONARY_DEFAULT_SIZE);
+    uint64_t trainNanos = SLBenchNow() - start;
+    free(samples);
+
+    SLBenchResult result;
+    memset(&result, 0, sizeof(result));
+    SLHistogramInit(&result.callLatency);
+    SLHistogramRecord(&result.callLatency, trainNanos);
+    result.name = "dictionary_train";
+    result.threads = 1;
+    result.operations = 1;
+    result.elapsedNanos = trainNanos;
+    char extra[128];
+    snprintf(extra, sizeof(extra), "{\"sample_bytes\":%zu,\"dictionary_bytes\":%zu}", length, dictionaryLength);
+    SLBenchReportAdd(report, &result, extra);
+
+    for (int i = 0; i < count; i++) {
+        SLCompressionBenchContext bench;
+        memset(&bench, 0, sizeof(bench));
+        bench.input = corpusPaths[i];
+        bench.dictionary = dictionary;
+        bench.dictionaryLength = dictionaryLength;
+
+        snprintf(bench.output, sizeof(bench.output), "%s/bench-%d.gz", workDirectory, i);
+        SLBenchRun(&result, "compress_gzip", 1, (uint64_t)iterations, 1, sl_bench_gzip, NULL, &bench);
+        sl_bench_add(report, &result, &bench);
+        remove(bench.output);
+
+        bench.failed = 0;
+        snprintf(bench.output, sizeof(bench.output), "%s/bench-%d.zd", workDirectory, i);
+        SLBenchRun(&result, "compress_dictionary", 1, (uint64_t)iterations, 1, sl_bench_dictionary, NULL, &bench);
+        sl_bench_add(report, &result, &bench);
+        remove(bench.output);
+    }
+}
+
+// Corpus
+
+static const char *const s_tags[] = { "Network", "UI", "Player", "Login", "Cache", "Socket", "Render", "IM" };
+static const char *const s_queues[] = { "main", "com.yy.network", "com.yy.im.queue", "8231", "com.apple.NSURLSession-work" };
+static const char *const s_files[] = { "SLPlayerController", "YYNetworkManager", "LoginViewController",
+                                       "IMSessionService", "CacheManager", "ChannelRoomViewModel" };
+static const char *const s_paths[] = { "room", "user", "gift", "msg" };
+
+#define SL_BENCH_COUNT(array) (sizeof(array) / sizeof(array[0]))
+
+int SLCompressionBenchmarkWriteCorpus(const char *path, size_t bytes, unsigned int seed) {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        return -1;
+    }
+    srand(seed);
+    size_t written = 0;
+    unsigned long long millis = 0;
+    while (written < bytes) {
+        millis += (unsigned long long)(rand() % 900 + 1);
+        unsigned fileIndex = (unsigned)rand() % SL_BENCH_COUNT(s_files);
+        char message[160];
+        switch (rand() % 5) {
+            case 0:
+                snprintf(message, sizeof(message), "request /api/v%d/%s finished with status %d in %d ms",
+                         rand() % 3 + 1, s_paths[rand() % SL_BENCH_COUNT(s_paths)], rand() % 2 ? 200 : 404, rand() % 3000);
+                break;
+            case 1:
+                snprintf(message, sizeof(message), "user %d entered channel %d", rand() % 100000, rand() % 1000);
+                break;
+            case 2:
+                snprintf(message, sizeof(message), "cache miss for key /api/v1/%s/%d", s_paths[rand() % SL_BENCH_COUNT(s_paths)], rand() % 10000);
+                break;
+            case 3:
+                snprintf(message, sizeof(message), "socket reconnect attempt %d", rand() % 10);
+                break;
+            default:
+                snprintf(message, sizeof(message), "render frame dropped %d", rand() % 100);
+                break;
+        }
+        int length = fprintf(file, "2019-09-10 %02llu:%02llu:%02llu:%03llu(+0800) [%s] [%s(line:%u)] [%s] %s\n",
+                             (millis / 3600000) % 24, (millis / 60000) % 60, (millis / 1000) % 60, millis % 1000,
+                             s_queues[rand() % SL_BENCH_COUNT(s_queues)],
+                             s_files[fileIndex], 40 + fileIndex * 53 + (unsigned)rand() % 4,
+                             s_tags[rand() % SL_BENCH_COUNT(s_tags)], message);
+        if (length < 0) {
+            break;
+        }
+        written += (size_t)length;
+    }
+    return fclose(file) == 0 && written >= bytes ? 0 : -1;
+}
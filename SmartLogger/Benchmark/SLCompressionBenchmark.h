@@ -0,0 +1,38 @@
+//
+//  SLCompressionBenchmark.h
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/10.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#ifndef SLCompressionBenchmark_h
+#define SLCompressionBenchmark_h
+
+#include "SLBenchmarkCore.h"
+
+#if __cplusplus
+extern "C" {
+#endif
+
+// Compares the gzip archive path of SLCompressLogFileManager against dictionary compression
+// (SLLogDictionary.h) on rolled log files. The dictionary is trained once from `trainingPath`,
+// then every corpus file is compressed `iterations` times with each mode. Each result carries
+// {"input_bytes","output_bytes","ratio","mb_per_sec"} as extra. Temporary files go to
+// `workDirectory`. Plain C + zlib, runs on Linux as well.
+void SLCompressionBenchmarkRun(SLBenchReport *report,
+                               const char *trainingPath,
+                               const char *const *corpusPaths,
+                               int count,
+                               int iterations,
+                               const char *workDirectory);
+
+// Writes `bytes` of formatter-like log lines (timestamp, queue, file:line, tag, message with
+// varying arguments) to `path`, for runs without real logs at hand. Returns 0 on success.
+int SLCompressionBenchmarkWriteCorpus(const char *path, size_t bytes, unsigned int seed);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SLCompressionBenchmark_h */
@@ -0,0 +1,66 @@
+//
+//  SLLogBenchmark.h
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/4.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+typedef NS_ENUM(NSUInteger, SLLogBenchmarkAppender) {
+    /// Format and discard
+    SLLogBenchmarkAppenderNull = 0,
+    /// SLLogFileAppender in a temporary directory
+    SLLogBenchmarkAppenderFile,
+    /// Memory mapped file
+    SLLogBenchmarkAppenderMmap,
+};
+
+/**
+ * 日志管线基准测试.
+ *
+ * 场景:
+ *  - async / sync 调用延迟 (producer 侧)
+ *  - 端到端延迟 (消息创建 -> appender 写完)
+ *  - 线程数扫描 1, 2, 4, ... maxThreads
+ *  - 饱和突发: 10 倍队列容量的消息一次性写入
+ *  - fan-out: 2 / 4 个不设 formatter 的 appender (和默认 appender 一样共用 SLLogger 的 formatter), 每条消息的 CPU 时间和管线内存分配次数
+ *  - trace 回放: 设置 tracePath 时, 按 `+[SLLogger startRecordingTraceAtPath:]` 录制的真实负载回放
+ *  - 二进制格式: snprintf 对比二进制参数捕获, 以及延后的解码, 见 SLBinaryFormatBenchmark.h
+ *  - 归档压缩: 生成的日志上对比 gzip 和训练字典, 见 SLCompressionBenchmark.h
+ *
+ * 运行期间会替换 SLLogger 的全部 appender，结束后恢复.
+ * 结果为 JSON，可用于 CI 对比.
+ */
+@interface SLLogBenchmark : NSObject
+
+/// Default SLLogBenchmarkAppenderNull
+@property (nonatomic, assign) SLLogBenchmarkAppender appender;
+/// Messages per thread for latency and sweep scenarios, default 10000
+@property (nonatomic, assign) NSUInteger messagesPerThread;
+/// Upper bound of thread sweep, default 64
+@property (nonatomic, assign) NSUInteger maxThreads;
+/// Messages of saturation burst, default 10 times queue capacity
+@property (nonatomic, assign) NSUInteger burstMessages;
+/// Workload trace to replay, see SLLogTrace.h. Default nil, no replay
+@property (nonatomic, copy, nullable) NSString *tracePath;
+/// 1 - recorded timing, 0 - as fast as possible, see SLLogTraceReplayRun. Default 1
+@property (nonatomic, assign) double traceSpeed;
+
+/**
+ * Run all scenarios.
+ *  @return JSON report
+ */
+- (NSString *)run;
+
+/**
+ * Run all scenarios and write JSON report to path.
+ */
+- (BOOL)runAndWriteReportToPath:(NSString *)path;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,333 @@
+//
+//  SLLogBenchmark.m
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/4.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#import "SLLogBenchmark.h"
+#import "SLBenchmarkCore.h"
+#import "SLBenchmarkAppenders.h"
+#import "SLLogTraceReplay.h"
+#import "SLCompressionBenchmark.h"
+#import "SLBinaryFormatBenchmark.h"
+#import "SLLogger.h"
+#import "SLLogThrottle.h"
+#import "SLLogFileAppender.h"
+#import "SLDefaultLogFileManager.h"
+#import "SLLogMetrics.h"
+
+/// Same as _MAX_QUEUE_SIZE in SLLogger.m
+#define SL_BENCHMARK_QUEUE_CAPACITY 1000
+
+@interface SLLogger ()
++ (NSArray<id<SLLogAppender>> *)allAppenders;
+@end
+
+typedef struct SLLogBenchmarkContext {
+    BOOL asynchronous;
+    SLLogFlag flag;
+} SLLogBenchmarkContext;
+
+static void SLLogBenchmarkOperation(void *context, int thread, uint64_t index)
+{
+    SLLogBenchmarkContext *ctx = (SLLogBenchmarkContext *)context;
+    @autoreleasepool {
+        [SLLogger log:ctx->asynchronous
+                level:SLLogLevelAll
+                 flag:ctx->flag
+                 file:__FILE__
+             function:__PRETTY_FUNCTION__
+                 line:__LINE__
+                  tag:@"Benchmark"
+               format:@"benchmark message thread=%d index=%llu payload=%s", thread, index, "0123456789abcdef"];
+    }
+}
+
+/// Messages and buffers allocated by the pipeline itself, see SLLogCounterStringAllocations
+static uint64_t SLLogBenchmarkAllocations(void)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < SL_METRICS_SHARDS; i++) {
+        total += __atomic_load_n(&SLLogMetricsShards[i].counters[SLLogCounterMessageAllocations], __ATOMIC_RELAXED);
+        total += __atomic_load_n(&SLLogMetricsShards[i].counters[SLLogCounterStringAllocations], __ATOMIC_RELAXED);
+    }
+    return total;
+}
+
+typedef struct SLLogBenchmarkReplayContext {
+    CFArrayRef tags;
+    NSUInteger *lines;
+} SLLogBenchmarkReplayContext;
+
+/// Recorded call through the real entry point, the site name stands in for the file
+static void SLLogBenchmarkReplayOperation(void *context, const SLLogTraceData *trace,
+                                          const SLLogTraceEvent *event, const char *message)
+{
+    SLLogBenchmarkReplayContext *ctx = (SLLogBenchmarkReplayContext *)context;
+    NSString *tag = event->tag ? (__bridge NSString *)CFArrayGetValueAtIndex(ctx->tags, event->tag) : nil;
+    @autoreleasepool {
+        [SLLogger log:!event->synchronous
+                level:SLLogLevelAll
+                 flag:event->flag
+                 file:trace->sites[event->site]
+             function:__PRETTY_FUNCTION__
+                 line:ctx->lines[event->site]
+                  tag:tag
+               format:@"%s", message];
+    }
+}
+
+static void SLLogBenchmarkDrain(void *context __attribute__((unused)))
+{
+    // Every log block is queued on the serial global queue, an empty sync block
+    // returns after all of them are done.
+    dispatch_sync([SLLogger globalLoggingQueue], ^{});
+    [SLLogger flush];
+}
+
+@implementation SLLogBenchmark
+{
+    SLMeasuringLogAppender *_measuring;
+    NSString *_workingDirectory;
+}
+
+- (instancetype)init
+{
+    if ((self = [super init])) {
+        _appender = SLLogBenchmarkAppenderNull;
+        _messagesPerThread = 10000;
+        _maxThreads = 64;
+        _burstMessages = SL_BENCHMARK_QUEUE_CAPACITY * 10;
+        _traceSpeed = 1;
+    }
+    return self;
+}
+
+#pragma mark - Setup
+
+- (id<SLLogAppender>)createAppender
+{
+    if (_workingDirectory == nil) {
+        _workingDirectory = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                             [NSString stringWithFormat:@"SmartLoggerBenchmark-%@", [NSUUID UUID].UUIDString]];
+    }
+    // Own directory per appender, fan-out scenarios attach several
+    NSString *directory = [_workingDirectory stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+    [[NSFileManager defaultManager] createDirectoryAtPath:directory
+                              withIntermediateDirectories:YES
+                                               attributes:nil
+                                                    error:NULL];
+
+    switch (_appender) {
+        case SLLogBenchmarkAppenderFile: {
+            SLDefaultLogFileManager *fm = [[SLDefaultLogFileManager alloc] initWithLogsDirectory:directory];
+            return [[SLLogFileAppender alloc] initWithLogFileManager:fm];
+        }
+        case SLLogBenchmarkAppenderMmap: {
+            NSString *path = [directory stringByAppendingPathComponent:@"benchmark.mmap"];
+            SLMmapLogAppender *appender = [[SLMmapLogAppender alloc] initWithFilePath:path size:64 << 20];
+            if (appender) {
+                return appender;
+            }
+            // Fall through
+        }
+        case SLLogBenchmarkAppenderNull:
+        default:
+            return [[SLNullLogAppender alloc] init];
+    }
+}
+
+- (NSString *)appenderKindName
+{
+    switch (_appender) {
+        case SLLogBenchmarkAppenderFile: return @"file";
+        case SLLogBenchmarkAppenderMmap: return @"mmap";
+        default: return @"null";
+    }
+}
+
+#pragma mark - Scenarios
+
+- (void)runScenario:(const char *)name
+            threads:(int)threads
+         operations:(uint64_t)operationsPerThread
+       asynchronous:(BOOL)asynchronous
+               flag:(SLLogFlag)flag
+             report:(SLBenchReport *)report
+{
+    SLLogBenchmarkContext context = { asynchronous, flag };
+    SLBenchResult result;
+
+    [_measuring reset];
+    SLBenchRun(&result, name, threads, operationsPerThread, 1,
+               SLLogBenchmarkOperation, SLLogBenchmarkDrain, &context);
+
+    char latency[512];
+    SLHistogramPrintJSON(&_measuring->_endToEndLatency, latency, sizeof(latency));
+    NSString *extra = [NSString stringWithFormat:
+                       @"{\"appender\":\"%@\",\"async\":%s,\"delivered\":%llu,\"pressure\":%ld,\"end_to_end_latency_ns\":%s}",
+                       [self appenderKindName],
+                       asynchronous ? "true" : "false",
+                       _measuring.deliveredCount,
+                       (long)[SLLogThrottle pressure],
+                       latency];
+    SLBenchReportAdd(report, &result, extra.UTF8String);
+}
+
+/// Several appenders added without a formatter, as the default ones are, they share SLLogger's.
+/// Per message CPU time and pipeline allocations.
+- (void)runFanoutScenario:(NSUInteger)appenderCount report:(SLBenchReport *)report
+{
+    [SLLogger removeAllAppenders];
+    for (NSUInteger i = 0; i < appenderCount; i++) {
+        [SLLogger addAppender:[self createAppender]];
+    }
+    SLLogBenchmarkDrain(NULL);
+
+    char name[32];
+    snprintf(name, sizeof(name), "fanout_%lu", (unsigned long)appenderCount);
+    SLLogBenchmarkContext context = { YES, SLLogFlagInfo };
+    SLBenchResult result;
+    uint64_t cpuStart = SLBenchCPUTime();
+    uint64_t allocationsStart = SLLogBenchmarkAllocations();
+    SLBenchRun(&result, name, 1, _messagesPerThread, 0, SLLogBenchmarkOperation, SLLogBenchmarkDrain, &context);
+    double messages = (double)MAX(_messagesPerThread, (NSUInteger)1);
+    double cpu = (double)(SLBenchCPUTime() - cpuStart) / messages;
+    double allocations = (double)(SLLogBenchmarkAllocations() - allocationsStart) / messages;
+
+    NSString *extra = [NSString stringWithFormat:
+                       @"{\"appender\":\"%@\",\"appenders\":%lu,\"cpu_ns_per_message\":%.1f,\"allocations_per_message\":%.3f}",
+                       [self appenderKindName], (unsigned long)appenderCount, cpu, allocations];
+    SLBenchReportAdd(report, &result, extra.UTF8String);
+
+    [SLLogger removeAllAppenders];
+    [SLLogger addAppender:_measuring];
+}
+
+/// Recorded traffic, with the throttle as configured by the caller
+- (void)runTraceReplayScenario:(SLBenchReport *)report
+{
+    SLLogTraceData trace;
+    if (SLLogTraceLoad(_tracePath.fileSystemRepresentation, &trace) != 0) {
+        NSLog(@"SLLogBenchmark: can't load trace %@", _tracePath);
+        return;
+    }
+
+    // Tags and lines resolved once, the replayed calls only look them up
+    NSMutableArray<NSString *> *tags = [NSMutableArray arrayWithCapacity:trace.tagCount];
+    for (uint32_t i = 0; i < trace.tagCount; i++) {
+        [tags addObject:@(trace.tags[i]) ?: @""];
+    }
+    NSUInteger *lines = calloc(trace.siteCount, sizeof(NSUInteger));
+    for (uint32_t i = 0; lines && i < trace.siteCount; i++) {
+        const char *colon = strrchr(trace.sites[i], ':');
+        lines[i] = colon ? strtoul(colon + 1, NULL, 10) : 0;
+    }
+
+    if (lines) {
+        SLLogBenchmarkReplayContext context = { (__bridge CFArrayRef)tags, lines };
+        [_measuring reset];
+        SLLogTraceReplayRun(report, "trace_replay", &trace, _traceSpeed,
+                            SLLogBenchmarkReplayOperation, SLLogBenchmarkDrain, &context);
+    }
+    free(lines);
+    SLLogTraceFree(&trace);
+}
+
+/// Archive compression, gzip against the trained dictionary on generated logs
+- (void)runCompressionScenario:(SLBenchReport *)report
+{
+    NSString *directory = [_workingDirectory stringByAppendingPathComponent:@"compression"];
+    [[NSFileManager defaultManager] createDirectoryAtPath:directory
+                              withIntermediateDirectories:YES
+                                               attributes:nil
+                                                    error:NULL];
+    NSString *training = [directory stringByAppendingPathComponent:@"training.log"];
+    NSString *corpus[3];
+    const char *corpusPaths[3];
+    BOOL written = SLCompressionBenchmarkWriteCorpus(training.fileSystemRepresentation, 1 << 20, 1) == 0;
+    for (int i = 0; i < 3; i++) {
+        corpus[i] = [directory stringByAppendingPathComponent:[NSString stringWithFormat:@"rolled-%d.log", i]];
+        corpusPaths[i] = corpus[i].fileSystemRepresentation;
+        written = written && SLCompressionBenchmarkWriteCorpus(corpusPaths[i], 1 << 20, (unsigned int)i + 2) == 0;
+    }
+    if (!written) {
+        NSLog(@"SLLogBenchmark: can't write compression corpus to %@", directory);
+        return;
+    }
+    SLCompressionBenchmarkRun(report, training.fileSystemRepresentation, corpusPaths, 3, 3,
+                              directory.fileSystemRepresentation);
+}
+
+- (NSString *)run
+{
+    NSArray<id<SLLogAppender>> *previousAppenders = [SLLogger allAppenders];
+    BOOL throttleEnabled = [SLLogThrottle enabled];
+
+    [SLLogger removeAllAppenders];
+    _measuring = [[SLMeasuringLogAppender alloc] initWithAppender:[self createAppender]];
+    [SLLogger addAppender:_measuring];
+
+    SLBenchReport *report = SLBenchReportCreate("SmartLogger");
+
+    // Latency, measure the pipeline itself without sampling
+    [SLLogThrottle setEnabled:NO];
+    [self runScenario:"async_latency" threads:1 operations:_messagesPerThread asynchronous:YES flag:SLLogFlagInfo report:report];
+    [self runScenario:"sync_latency" threads:1 operations:_messagesPerThread asynchronous:NO flag:SLLogFlagInfo report:report];
+
+    // Thread sweep
+    for (NSUInteger threads = 1; threads <= MAX(_maxThreads, (NSUInteger)1); threads <<= 1) {
+        char name[32];
+        snprintf(name, sizeof(name), "sweep_%lu", (unsigned long)threads);
+        [self runScenario:name threads:(int)threads operations:_messagesPerThread asynchronous:YES flag:SLLogFlagInfo report:report];
+    }
+
+    // Saturation, backpressure is part of what is measured
+    [SLLogThrottle setEnabled:YES];
+    int burstThreads = 8;
+    [self runScenario:"saturation_burst"
+              threads:burstThreads
+           operations:MAX(_burstMessages / burstThreads, (NSUInteger)1)
+         asynchronous:YES
+                 flag:SLLogFlagInfo
+               report:report];
+
+    // Format once fan-out, the same formatter attached to 2 and 4 appenders
+    [SLLogThrottle setEnabled:NO];
+    [self runFanoutScenario:2 report:report];
+    [self runFanoutScenario:4 report:report];
+
+    if (_tracePath) {
+        [SLLogThrottle setEnabled:throttleEnabled];
+        [self runTraceReplayScenario:report];
+    }
+
+    // Caller side cost of snprintf against binary capture, and the deferred decode
+    SLBinaryFormatBenchmarkRun(report, 1, _messagesPerThread);
+
+    [self runCompressionScenario:report];
+
+    NSString *json = [NSString stringWithUTF8String:SLBenchReportJSON(report)];
+    SLBenchReportFree(report);
+
+    // Restore
+    [SLLogThrottle setEnabled:throttleEnabled];
+    [SLLogger removeAllAppenders];
+    for (id<SLLogAppender> appender in previousAppenders) {
+        [SLLogger addAppender:appender];
+    }
+    _measuring = nil;
+    [[NSFileManager defaultManager] removeItemAtPath:_workingDirectory error:NULL];
+
+    return json;
+}
+
+- (BOOL)runAndWriteReportToPath:(NSString *)path
+{
+    NSString *json = [self run];
+    return [json writeToFile:path atomically:YES encoding:NSUTF8StringEncoding error:NULL];
+}
+
+@end
@@ -0,0 +1,37 @@
+//
+//  SLLogStartupBenchmark.h
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/12.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * 日志启动基准测试.
+ *
+ * 在默认日志目录中预先放入大量旧日志文件, 然后测量:
+ *  - first_call_ns: 第一次日志调用 (包括 SLLogger 初始化) 返回的耗时
+ *  - first_byte_ns: 从调用开始到第一条日志写入日志文件的耗时
+ *  - startup_ns:    后台创建默认 appender 的耗时, 见 `SLLogLatencyStartup`
+ *
+ * SLLogger 每个进程只初始化一次, 必须在进程中第一次使用 SLLogger 之前调用, 每次测量需要新进程.
+ * 预置的文件在结束后删除. 结果为 JSON.
+ */
+@interface SLLogStartupBenchmark : NSObject
+
+/// Old log files put into the logs directory, default 1000
+@property (nonatomic, assign) NSUInteger existingFiles;
+/// Size of each old file, default 16 KB
+@property (nonatomic, assign) NSUInteger existingFileSize;
+/// Give up waiting for the first byte after this, default 10 seconds
+@property (nonatomic, assign) NSTimeInterval timeout;
+
+- (NSString *)run;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,115 @@
+//
+//  SLLogStartupBenchmark.m
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/12.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#import "SLLogStartupBenchmark.h"
+#import "SLBenchmarkCore.h"
+#import "SLDefaultLogFileManager.h"
+#import "SLLogMetrics.h"
+#import "SLLogger.h"
+
+#import <unistd.h>
+
+/// Dated long before any real log file, used to find and remove them again
+static NSString * const SLLogStartupBenchmarkDay = @"2000-01-01";
+
+@implementation SLLogStartupBenchmark
+
+- (instancetype)init
+{
+    if ((self = [super init])) {
+        _existingFiles = 1000;
+        _existingFileSize = 16 * 1024;
+        _timeout = 10;
+    }
+    return self;
+}
+
+/// Same as -[SLDefaultLogFileManager applicationName]
+static NSString *SLLogStartupBenchmarkAppName(void)
+{
+    NSString *appName = [[NSBundle mainBundle] objectForInfoDictionaryKey:@"CFBundleIdentifier"];
+    return appName ?: ([[NSProcessInfo processInfo] processName] ?: @"");
+}
+
+- (void)createExistingFilesInDirectory:(NSString *)directory
+{
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    [fileManager createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:NULL];
+
+    NSMutableData *content = [NSMutableData dataWithLength:_existingFileSize];
+    memset(content.mutableBytes, 'x', content.length);
+    NSString *appName = SLLogStartupBenchmarkAppName();
+    // Older than the rolling frequency, the logger starts a file of its own instead of reusing one
+    NSDate *date = [NSDate dateWithTimeIntervalSinceNow:-7 * 24 * 3600];
+    for (NSUInteger i = 0; i < _existingFiles; i++) {
+        NSString *name = [NSString stringWithFormat:@"%@ %@--%02lu-%02lu-%02lu.log", appName, SLLogStartupBenchmarkDay,
+                          (unsigned long)(i / 3600) % 24, (unsigned long)(i / 60) % 60, (unsigned long)i % 60];
+        NSString *path = [directory stringByAppendingPathComponent:name];
+        [content writeToFile:path atomically:NO];
+        NSDate *fileDate = [date dateByAddingTimeInterval:i];
+        [fileManager setAttributes:@{NSFileCreationDate: fileDate, NSFileModificationDate: fileDate}
+                      ofItemAtPath:path
+                             error:NULL];
+    }
+}
+
+- (void)removeExistingFilesInDirectory:(NSString *)directory
+{
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    for (NSString *name in [fileManager contentsOfDirectoryAtPath:directory error:NULL]) {
+        // Archived or compressed copies keep the name
+        if ([name containsString:[SLLogStartupBenchmarkDay stringByAppendingString:@"--"]]) {
+            [fileManager removeItemAtPath:[directory stringByAppendingPathComponent:name] error:NULL];
+        }
+    }
+}
+
+- (NSString *)run
+{
+    // Only the directory, the manager itself is thrown away
+    NSString *directory = [[SLDefaultLogFileManager alloc] initWithLogsDirectory:nil].logsDirectory;
+    [self createExistingFilesInDirectory:directory];
+
+    // Counted by the file appender right after each write
+    SLLogAppenderMetrics *fileMetrics = SLLogMetricsForAppender(@"com.yy.athlog.fileLogger");
+    uint64_t bytesBefore = __atomic_load_n(&fileMetrics->bytes, __ATOMIC_ACQUIRE);
+
+    uint64_t start = SLBenchNow();
+    [SLLogger log:YES
+            level:SLLogLevelAll
+             flag:SLLogFlagInfo
+             file:__FILE__
+         function:__PRETTY_FUNCTION__
+             line:__LINE__
+              tag:@"Benchmark"
+           format:@"startup benchmark, %lu existing files", (unsigned long)_existingFiles];
+    uint64_t firstCall = SLBenchNow() - start;
+
+    uint64_t firstByte = 0;
+    uint64_t deadline = start + (uint64_t)(_timeout * NSEC_PER_SEC);
+    while (SLBenchNow() < deadline) {
+        if (__atomic_load_n(&fileMetrics->bytes, __ATOMIC_ACQUIRE) > bytesBefore) {
+            firstByte = SLBenchNow() - start;
+            break;
+        }
+        usleep(50);
+    }
+
+    // Waits for startup as well
+    [SLLogger flush];
+    uint64_t startup = SLHistogramPercentile(&SLLogMetricsLatencies[SLLogLatencyStartup], 100);
+    [self removeExistingFilesInDirectory:directory];
+
+    return [NSString stringWithFormat:
+            @"{\"benchmark\":\"SmartLoggerStartup\",\"existing_files\":%lu,\"existing_file_size\":%lu,"
+            @"\"first_call_ns\":%llu,\"first_byte_ns\":%llu,\"startup_ns\":%llu}",
+            (unsigned long)_existingFiles, (unsigned long)_existingFileSize,
+            firstCall, firstByte, startup];
+}
+
+@end
@@ -0,0 +1,228 @@
+//
+//  SLLogTraceReplay.c
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/12.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#include "SLLogTraceReplay.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+
+#define SL_REPLAY_SPIN_NANOS 100000     // Last stretch before a call is spun, sleeping is too coarse
+
+typedef struct SLReplayShared_ {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int ready;
+    int go;
+    uint64_t start;
+    double speed;
+    const SLLogTraceData *trace;
+    const char *filler;
+    SLLogTraceSink sink;
+    void *context;
+    SLHistogram *latency;
+    SLHistogram *lag;
+} SLReplayShared;
+
+typedef struct SLReplayThread_ {
+    SLReplayShared *shared;
+    const SLLogTraceEvent **events;
+    size_t count;
+    uint64_t bytes;
+} SLReplayThread;
+
+static void sl_replay_wait_until(uint64_t target) {
+    for (;;) {
+        uint64_t now = SLBenchNow();
+        if (now >= target) {
+            return;
+        }
+        uint64_t remaining = target - now;
+        if (remaining > 2 * SL_REPLAY_SPIN_NANOS) {
+            uint64_t sleep = remaining - SL_REPLAY_SPIN_NANOS;
+            struct timespec ts = { (time_t)(sleep / 1000000000ull), (long)(sleep % 1000000000ull) };
+            nanosleep(&ts, NULL);
+        }
+    }
+}
+
+static void *sl_replay_thread_main(void *arg) {
+    SLReplayThread *thread = (SLReplayThread *)arg;
+    SLReplayShared *shared = thread->shared;
+
+    // Start barrier, the schedule is relative to the same start for all threads.
+    pthread_mutex_lock(&shared->mutex);
+    shared->ready++;
+    pthread_cond_broadcast(&shared->cond);
+    while (!shared->go) {
+        pthread_cond_wait(&shared->cond, &shared->mutex);
+    }
+    pthread_mutex_unlock(&shared->mutex);
+
+    for (size_t i = 0; i < thread->count; i++) {
+        const SLLogTraceEvent *event = thread->events[i];
+        uint64_t start = SLBenchNow();
+        if (shared->speed > 0) {
+            uint64_t target = shared->start + (uint64_t)((double)event->time / shared->speed);
+            sl_replay_wait_until(target);
+            start = SLBenchNow();
+            SLHistogramRecord(shared->lag, start - target);
+        }
+        shared->sink(shared->context, shared->trace, event, shared->filler + (shared->trace->maxLength - event->length));
+        SLHistogramRecord(shared->latency, SLBenchNow() - start);
+        thread->bytes += event->length;
+    }
+    return NULL;
+}
+
+int SLLogTraceReplayRun(SLBenchReport *report,
+                        const char *name,
+                        const SLLogTraceData *trace,
+                        double speed,
+                        SLLogTraceSink sink,
+                        SLBenchDrain drain,
+                        void *context) {
+    if (trace == NULL || sink == NULL || trace->threadCount == 0) {
+        return -1;
+    }
+
+    uint32_t threads = trace->threadCount;
+    SLReplayThread *args = (SLReplayThread *)calloc(threads, sizeof(SLReplayThread));
+    const SLLogTraceEvent **events = (const SLLogTraceEvent **)malloc(trace->count * sizeof(*events));
+    pthread_t *tids = (pthread_t *)calloc(threads, sizeof(pthread_t));
+    // Every message is a suffix of the same filler, nothing is built per call
+    char *filler = (char *)malloc((size_t)trace->maxLength + 1);
+    SLHistogram *lag = (SLHistogram *)malloc(sizeof(SLHistogram));
+    if (args == NULL || events == NULL || tids == NULL || filler == NULL || lag == NULL) {
+        free(args);
+        free(events);
+        free(tids);
+        free(filler);
+        free(lag);
+        return -1;
+    }
+    for (uint32_t i = 0; i < trace->maxLength; i++) {
+        filler[i] = (char)('a' + i % 26);
+    }
+    filler[trace->maxLength] = '\0';
+    SLHistogramInit(lag);
+
+    // Events grouped by thread, in recorded order
+    for (size_t i = 0; i < trace->count; i++) {
+        args[trace->events[i].thread].count++;
+    }
+    size_t offset = 0;
+    for (uint32_t t = 0; t < threads; t++) {
+        args[t].events = events + offset;
+        offset += args[t].count;
+        args[t].count = 0;
+    }
+    for (size_t i = 0; i < trace->count; i++) {
+        SLReplayThread *thread = &args[trace->events[i].thread];
+        thread->events[thread->count++] = &trace->events[i];
+    }
+
+    SLBenchResult result;
+    memset(&result, 0, sizeof(result));
+    result.name = name;
+    SLHistogramInit(&result.callLatency);
+
+    SLReplayShared shared;
+    memset(&shared, 0, sizeof(shared));
+    pthread_mutex_init(&shared.mutex, NULL);
+    pthread_cond_init(&shared.cond, NULL);
+    shared.speed = speed;
+    shared.trace = trace;
+    shared.filler = filler;
+    shared.sink = sink;
+    shared.context = context;
+    shared.latency = &result.callLatency;
+    shared.lag = lag;
+
+    uint32_t started = 0;
+    for (; started < threads; started++) {
+        args[started].shared = &shared;
+        if (pthread_create(&tids[started], NULL, sl_replay_thread_main, &args[started]) != 0) {
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&shared.mutex);
+    while (shared.ready < (int)started) {
+        pthread_cond_wait(&shared.cond, &shared.mutex);
+    }
+    shared.start = SLBenchNow();
+    shared.go = 1;
+    pthread_cond_broadcast(&shared.cond);
+    pthread_mutex_unlock(&shared.mutex);
+
+    uint64_t bytes = 0;
+    for (uint32_t i = 0; i < started; i++) {
+        pthread_join(tids[i], NULL);
+        bytes += args[i].bytes;
+        result.operations += args[i].count;
+    }
+
+    uint64_t drainStart = SLBenchNow();
+    if (drain) {
+        drain(context);
+    }
+    uint64_t end = SLBenchNow();
+
+    result.threads = (int)started;
+    result.elapsedNanos = end - shared.start;
+    result.drainNanos = end - drainStart;
+
+    char histogram[512];
+    char extra[768];
+    SLHistogramPrintJSON(lag, histogram, sizeof(histogram));
+    snprintf(extra, sizeof(extra),
+             "{\"calls\":%zu,\"threads\":%u,\"trace_ns\":%" PRIu64 ",\"speed\":%.2f,\"bytes\":%" PRIu64
+             ",\"schedule_lag_ns\":%s}",
+             trace->count, threads, trace->count ? trace->events[trace->count - 1].time : 0,
+             speed, bytes, histogram);
+    SLBenchReportAdd(report, &result, extra);
+
+    pthread_cond_destroy(&shared.cond);
+    pthread_mutex_destroy(&shared.mutex);
+    free(args);
+    free(events);
+    free(tids);
+    free(filler);
+    free(lag);
+
+    return started == threads ? 0 : -1;
+}
+
+void SLLogTraceWriteSinkLog(void *context, const SLLogTraceData *trace, const SLLogTraceEvent *event,
+                            const char *message) {
+    SLLogTraceWriteSink *sink = (SLLogTraceWriteSink *)context;
+    // Recorded wall clock, the lines look like the captured ones
+    uint64_t wall = trace->wallStart + event->time;
+    time_t seconds = (time_t)(wall / 1000000000ull);
+    struct tm tm;
+    localtime_r(&seconds, &tm);
+
+    char header[512];
+    int length = snprintf(header, sizeof(header), "%02d:%02d:%02d.%03u [%s] [%s] ",
+                          tm.tm_hour, tm.tm_min, tm.tm_sec, (unsigned)(wall / 1000000ull % 1000),
+                          trace->tags[event->tag], trace->sites[event->site]);
+    if (length < 0) {
+        return;
+    }
+    struct iovec iov[3] = {
+        { header, (size_t)length < sizeof(header) ? (size_t)length : sizeof(header) - 1 },
+        { (void *)message, event->length },
+        { "\n", 1 },
+    };
+    writev(sink->fd, iov, 3);
+}
@@ -0,0 +1,53 @@
+//
+//  SLLogTraceReplay.h
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/12.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#ifndef SLLogTraceReplay_h
+#define SLLogTraceReplay_h
+
+#include "SLBenchmarkCore.h"
+#include "SLLogTrace.h"
+
+#if __cplusplus
+extern "C" {
+#endif
+
+// Replays a workload trace (SLLogTrace.h) against any pipeline: one thread per recorded thread,
+// every call issued at its recorded time, so concurrency and bursts are the same as captured.
+// Messages are filler of the recorded length. Plain C + pthreads, runs on Linux as well.
+
+// One replayed call, `message` holds event->length bytes of filler and is NUL terminated.
+typedef void (*SLLogTraceSink)(void *context, const SLLogTraceData *trace, const SLLogTraceEvent *event,
+                               const char *message);
+
+// `speed` 1 replays at recorded timing, 2 twice as fast, 0 issues calls back to back (per thread
+// order is kept). Adds one result to report with call latency, and as extra
+// {"calls","threads","trace_ns","speed","bytes","schedule_lag_ns"}: how late calls were issued
+// against the schedule, large values mean the sink couldn't keep up with the recorded rate.
+// Returns 0 on success.
+int SLLogTraceReplayRun(SLBenchReport *report,
+                        const char *name,
+                        const SLLogTraceData *trace,
+                        double speed,
+                        SLLogTraceSink sink,
+                        SLBenchDrain drain,
+                        void *context);
+
+// Sink writing formatter-like lines ("time [tag] [site] message") to a file descriptor, for runs
+// without Foundation. Writes synchronously whatever the recorded call was.
+typedef struct SLLogTraceWriteSink_ {
+    int fd;
+} SLLogTraceWriteSink;
+
+void SLLogTraceWriteSinkLog(void *context, const SLLogTraceData *trace, const SLLogTraceEvent *event,
+                            const char *message);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SLLogTraceReplay_h */
@@ -8,6 +8,7 @@
 
 #import "SLDefaultLogFileManager.h"
 #import "SLInterfaces.h"
+#import "SLLogSearch.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
@@ -16,6 +17,54 @@ NS_ASSUME_NONNULL_BEGIN
 @property (nonatomic, copy) SLLogArchiveCompressBlock compressBlock;
 /// switch
 @property (nonatomic, assign) BOOL on;
+
+/**
+ * 字典压缩 (zlib + 训练出来的字典, 扩展名 .zd), 默认 NO 使用 gzip.
+ * 滚动日志文件小且高度重复 (formatter 前缀、文件名、tag), 预置字典能明显提高压缩率.
+ *
+ * 字典从最近的日志训练, 以 "dictionary-<adler32>.sldict" 保存在 logsDirectory 里,
+ * 归档文件头里记录了字典的 adler32, 读取时自动找到对应版本, 见 `SLLogDictionary.h`.
+ * 不再被任何归档引用的旧字典会被删除. 上传时需要一起上传对应的字典文件.
+ * compressBlock 设置时优先使用 compressBlock.
+ */
+@property (nonatomic, assign) BOOL useDictionary;
+/// Archives compressed with one dictionary before it is retrained from recent logs, default 50
+@property (nonatomic, assign) NSUInteger dictionaryMaxUses;
+
+/**
+ * 归档时建立搜索索引, 默认 NO.
+ * 归档按 64 KB 分块压缩, 每块一个 n-gram Bloom filter, 以 "index-<archive>.slidx" 保存在归档旁边,
+ * 搜索时不包含关键字的块不需要解压, 见 `SLLogSearch.h`. 归档仍然是普通的 .gz / .zd 文件,
+ * 索引大小约为归档的 1/8. compressBlock 压缩的归档没有索引.
+ * 代价: 每块都重新开始 deflate 历史, useDictionary 的字典也只对第一块有效. 生成的 1 MB 日志上
+ * (SLCompressionBenchmarkWriteCorpus) .gz 和 .zd 归档都大约变大 9%.
+ */
+@property (nonatomic, assign) BOOL searchIndex;
+
+/**
+ * Decompress a .gz or .zd archive, the dictionary is looked up next to the archive.
+ *  @return NO if data is corrupted or the dictionary is missing
+ */
++ (BOOL)decompressArchiveAtPath:(NSString *)archivePath toPath:(NSString *)outputPath;
+
+/**
+ * Search log files and archives, using their index if there is one.
+ *  @param maxResults   0 for no limit
+ *  @param stats        Accumulated, may be NULL
+ *  @return Matching lines, in file order
+ */
++ (NSArray<NSString *> *)searchString:(NSString *)string
+                              inFiles:(NSArray<NSString *> *)paths
+                           maxResults:(NSUInteger)maxResults
+                                stats:(nullable SLLogSearchStats *)stats;
+
+/**
+ * Export log files and archives to one columnar file for analysis, see `SLLogColumnar.h`.
+ * 日志级别需要 formatter 打开 `SLLogQueueFormatter.includesLevel`, 否则 level 列为 0.
+ *  @param paths    In time order, oldest first
+ *  @return NO if a file can't be read or the output can't be written
+ */
++ (BOOL)exportFiles:(NSArray<NSString *> *)paths toColumnarFileAtPath:(NSString *)outputPath;
 @end
 
 NS_ASSUME_NONNULL_END
@@ -9,9 +9,24 @@
 #import "SLCompressLogFileManager.h"
 #import "SLLogFileInfo.h"
 #import "SLLogger.h"
+#import "SLLogMetrics.h"
+#import "SLLogDictionary.h"
+#import "SLLogSearch.h"
+#import "SLLogColumnar.h"
 
 #import <zlib.h>
 
+static NSString * const SLLogDictionaryPrefix = @"dictionary-";
+static NSString * const SLLogDictionaryExtension = @"sldict";
+static NSString * const SLLogIndexPrefix = @"index-";
+static NSString * const SLLogIndexExtension = @"slidx";
+
+static NSString *SLLogIndexPath(NSString *archivePath)
+{
+    NSString *fileName = [NSString stringWithFormat:@"%@%@.%@", SLLogIndexPrefix, archivePath.lastPathComponent, SLLogIndexExtension];
+    return [archivePath.stringByDeletingLastPathComponent stringByAppendingPathComponent:fileName];
+}
+
 @interface SLLogFileInfo (Compress)
 @property (nonatomic, readonly) BOOL isCompressed;
 
@@ -23,6 +38,11 @@
 {
     BOOL mUpToDate;
     BOOL mIsCompressing;
+    
+    // Only accessed while compressing, one file at a time: a file archived during a
+    // compression is left to -compressNext
+    NSData *mDictionary;
+    NSUInteger mDictionaryUses;
 }
 
 - (instancetype)init
@@ -36,6 +56,8 @@
     {
         mUpToDate = NO;
         _on = YES;
+        _dictionaryMaxUses = 50;
+        _searchIndex = NO;
         [self performSelector:@selector(compressNext) withObject:nil afterDelay:5.0];
     }
     return self;
@@ -49,10 +71,12 @@
 - (void)didArchiveLogFile:(NSString *)logFilePath
 {
     NSLog(@"ATHLogCompressFileManager: didArchiveLogFile: %@", [logFilePath lastPathComponent]);
+    [super didArchiveLogFile:logFilePath];
     if (!self.on) {
         return;
     }
-    if (mUpToDate) {
+    SLLogMetricsAddGauge(SLLogGaugeCompressionBacklog, 1);
+    if (mUpToDate && !mIsCompressing) {
         [self compressLogFile:[SLLogFileInfo logFileWithPath:logFilePath]];
     }
 }
@@ -60,10 +84,12 @@
 - (void)didRollAndArchiveLogFile:(NSString *)logFilePath
 {
     NSLog(@"ATHLogCompressFileManager: didRollAndArchiveLogFile: %@", [logFilePath lastPathComponent]);
+    [super didRollAndArchiveLogFile:logFilePath];
     if (!self.on) {
         return;
     }
-    if (mUpToDate) {
+    SLLogMetricsAddGauge(SLLogGaugeCompressionBacklog, 1);
+    if (mUpToDate && !mIsCompressing) {
         [self compressLogFile:[SLLogFileInfo logFileWithPath:logFilePath]];
     }
 }
@@ -96,19 +122,24 @@
     NSUInteger count = [sortedLogFileInfos count];
     if (count == 0) {
         // Nothing to compress
+        SLLogMetricsSetGauge(SLLogGaugeCompressionBacklog, 0);
         mUpToDate = YES;
         return;
     }
     
     NSUInteger i = count;
+    NSInteger backlog = 0;
     while (i > 0) {
         SLLogFileInfo *logFileInfo = [sortedLogFileInfos objectAtIndex:(i - 1)];
         if (logFileInfo.isArchived && !logFileInfo.isCompressed) {
-            [self compressLogFile:logFileInfo];
-            break;
+            if (backlog == 0) {
+                [self compressLogFile:logFileInfo];
+            }
+            backlog++;
         }
         i--;
     }
+    SLLogMetricsSetGauge(SLLogGaugeCompressionBacklog, backlog);
     
     mUpToDate = YES;
 }
@@ -117,6 +148,7 @@
 {
     NSLog(@"ATHLogCompressFileManager: compressionDidSucceed: %@", logFile.fileName);
     mIsCompressing = NO;
+    [self deleteUnusedIndexes];
     [self compressNext];
 }
 
@@ -137,13 +169,24 @@
     
     @autoreleasepool {
         
-        void(^onSuccess)(NSString *) = ^(NSString *tempPath){
+        void(^onSuccess)(NSString *, NSString *) = ^(NSString *tempPath, NSString *extension){
             SLLogFileInfo *compressedLogFile = [SLLogFileInfo logFileWithPath:tempPath];
             compressedLogFile.isArchived = YES;
             
-            NSString *outputFileName = [logFile fileNameByAppendingPathExtension:@"gz"];
+            NSString *outputFileName = [logFile fileNameByAppendingPathExtension:extension];
             [compressedLogFile renameFile:outputFileName];
             
+            // Takes the place and levels of the original in retention
+            [self didReplaceLogFile:logFile.filePath withLogFile:compressedLogFile.filePath];
+            
+            // Index follows its archive
+            NSString *tempIndexPath = SLLogIndexPath(tempPath);
+            if ([[NSFileManager defaultManager] fileExistsAtPath:tempIndexPath]) {
+                NSString *indexPath = SLLogIndexPath(compressedLogFile.filePath);
+                [[NSFileManager defaultManager] removeItemAtPath:indexPath error:nil];
+                [[NSFileManager defaultManager] moveItemAtPath:tempIndexPath toPath:indexPath error:nil];
+            }
+            
             // Report success to class via logging thread/queue
             dispatch_async([SLLogger globalLoggingQueue], ^{ @autoreleasepool {
                 [self compressionDidSucceed:compressedLogFile];
@@ -173,9 +216,23 @@
                 if (!ok) {
                     NSLog(@"Warning: failed to remove original file %@ after compression: %@", logFile.filePath, error);
                 }
-                onSuccess(matchFilePath);
+                onSuccess(matchFilePath, @"gz");
+                return;
+            }
+        }
+        
+        if (self.useDictionary) {
+            NSData *dictionary = [self dictionaryForLogFile:logFile];
+            if (dictionary != nil) {
+                [self compressLogFile:logFile withDictionary:dictionary onSuccess:onSuccess];
                 return;
             }
+            // Not enough logs to train, gzip this one
+        }
+        
+        if (self.searchIndex) {
+            [self compressLogFile:logFile withDictionary:nil onSuccess:onSuccess];
+            return;
         }
         
         // Steps:
@@ -430,12 +487,278 @@
             // considered a log file while it was only partially complete.
             // Only files that begin with "log-" are considered log files.
             
-            onSuccess(tempOutputFilePath);
+            onSuccess(tempOutputFilePath, @"gz");
         }
         
     } // end @autoreleasepool
 }
 
+#pragma mark - Dictionary
+
+- (NSString *)dictionaryPathForID:(uint32_t)dictionaryID
+{
+    NSString *fileName = [NSString stringWithFormat:@"%@%08x.%@", SLLogDictionaryPrefix, dictionaryID, SLLogDictionaryExtension];
+    return [[self logsDirectory] stringByAppendingPathComponent:fileName];
+}
+
+- (NSArray<NSString *> *)dictionaryPaths
+{
+    NSString *logsDirectory = [self logsDirectory];
+    NSMutableArray *paths = [NSMutableArray array];
+    for (NSString *fileName in [[NSFileManager defaultManager] contentsOfDirectoryAtPath:logsDirectory error:nil]) {
+        if ([fileName hasPrefix:SLLogDictionaryPrefix] && [fileName.pathExtension isEqualToString:SLLogDictionaryExtension]) {
+            [paths addObject:[logsDirectory stringByAppendingPathComponent:fileName]];
+        }
+    }
+    return paths;
+}
+
+/// Current dictionary, trained again from `logFile` once it has been used `dictionaryMaxUses` times
+- (NSData *)dictionaryForLogFile:(SLLogFileInfo *)logFile
+{
+    if (mDictionary == nil) {
+        // Newest one on disk, eg. after relaunch
+        NSDate *newest = nil;
+        for (NSString *path in [self dictionaryPaths]) {
+            NSDate *date = [[NSFileManager defaultManager] attributesOfItemAtPath:path error:nil].fileModificationDate;
+            if (newest == nil || [date compare:newest] == NSOrderedDescending) {
+                NSData *data = [NSData dataWithContentsOfFile:path];
+                if (data.length > 0) {
+                    newest = date;
+                    mDictionary = data;
+                }
+            }
+        }
+    }
+    
+    if (mDictionary == nil || mDictionaryUses >= MAX(self.dictionaryMaxUses, (NSUInteger)1)) {
+        NSData *samples = [NSData dataWithContentsOfFile:logFile.filePath options:NSDataReadingMappedIfSafe error:nil];
+        NSMutableData *dictionary = [NSMutableData dataWithLength:SL_LOG_DICTIONARY_DEFAULT_SIZE];
+        size_t length = SLLogDictionaryTrain(samples.bytes, samples.length, dictionary.mutableBytes, dictionary.length);
+        if (length > 0) {
+            dictionary.length = length;
+            NSString *path = [self dictionaryPathForID:SLLogDictionaryID(dictionary.bytes, length)];
+            if ([dictionary writeToFile:path atomically:YES]) {
+                NSLog(@"ATHLogCompressFileManager: trained dictionary %@", path.lastPathComponent);
+                mDictionary = dictionary;
+                mDictionaryUses = 0;
+                [self deleteUnusedDictionaries];
+            }
+        }
+    }
+    
+    if (mDictionary != nil) {
+        mDictionaryUses++;
+    }
+    return mDictionary;
+}
+
+/// Keeps the current dictionary and every dictionary still referenced by an archive
+- (void)deleteUnusedDictionaries
+{
+    NSMutableSet<NSString *> *used = [NSMutableSet set];
+    if (mDictionary) {
+        [used addObject:[self dictionaryPathForID:SLLogDictionaryID(mDictionary.bytes, mDictionary.length)]];
+    }
+    for (NSString *path in [self unsortedLogFilePaths]) {
+        if (![path.pathExtension isEqualToString:@"zd"]) {
+            continue;
+        }
+        // zlib header: CMF, FLG (FDICT = 0x20), then DICTID big endian
+        NSFileHandle *handle = [NSFileHandle fileHandleForReadingAtPath:path];
+        NSData *header = [handle readDataOfLength:6];
+        [handle closeFile];
+        const uint8_t *bytes = header.bytes;
+        if (header.length == 6 && (bytes[1] & 0x20)) {
+            uint32_t dictionaryID = ((uint32_t)bytes[2] << 24) | ((uint32_t)bytes[3] << 16) | ((uint32_t)bytes[4] << 8) | bytes[5];
+            [used addObject:[self dictionaryPathForID:dictionaryID]];
+        }
+    }
+    for (NSString *path in [self dictionaryPaths]) {
+        if (![used containsObject:path]) {
+            [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+        }
+    }
+}
+
+/// gzip if dictionary is nil, only used with searchIndex
+- (void)compressLogFile:(SLLogFileInfo *)logFile
+         withDictionary:(NSData *)dictionary
+              onSuccess:(void(^)(NSString *, NSString *))onSuccess
+{
+    NSString *extension = dictionary ? @"zd" : @"gz";
+    NSString *inputFilePath = logFile.filePath;
+    NSString *tempOutputFilePath = [logFile tempFilePathByAppendingPathExtension:extension];
+    NSString *tempIndexPath = SLLogIndexPath(tempOutputFilePath);
+    
+#if TARGET_OS_IPHONE
+    // Same protection as the original file, see gzip path
+    NSString* protection = logFile.fileAttributes[NSFileProtectionKey];
+    NSDictionary* attributes = protection == nil ? nil : @{NSFileProtectionKey: protection};
+    [[NSFileManager defaultManager] createFileAtPath:tempOutputFilePath contents:nil attributes:attributes];
+#endif
+    
+    NSError *error = nil;
+    int result;
+    if (self.searchIndex) {
+        result = SLLogArchiveCompressFile(inputFilePath.fileSystemRepresentation, tempOutputFilePath.fileSystemRepresentation,
+                                          tempIndexPath.fileSystemRepresentation,
+                                          dictionary ? SLLogArchiveFormatZlib : SLLogArchiveFormatGzip,
+                                          dictionary.bytes, dictionary.length, Z_DEFAULT_COMPRESSION);
+    } else {
+        result = SLLogDictionaryCompressFile(inputFilePath.fileSystemRepresentation, tempOutputFilePath.fileSystemRepresentation,
+                                             dictionary.bytes, dictionary.length, Z_DEFAULT_COMPRESSION);
+    }
+    if (result != 0) {
+        NSLog(@"Compression of %@ failed", inputFilePath);
+        [[NSFileManager defaultManager] removeItemAtPath:tempIndexPath error:nil];
+        BOOL ok = [[NSFileManager defaultManager] removeItemAtPath:tempOutputFilePath error:&error];
+        if (!ok)
+            NSLog(@"Failed to clean up %@ after failed compression: %@", tempOutputFilePath, error);
+        
+        dispatch_async([SLLogger globalLoggingQueue], ^{ @autoreleasepool {
+            [self compressionDidFail:logFile];
+        }});
+        return;
+    }
+    
+    BOOL ok = [[NSFileManager defaultManager] removeItemAtPath:inputFilePath error:&error];
+    if (!ok)
+        NSLog(@"Warning: failed to remove original file %@ after compression: %@", inputFilePath, error);
+    
+    onSuccess(tempOutputFilePath, extension);
+}
+
+#pragma mark - Search Index
+
+/// Archives are deleted by quota without knowing about their index
+- (void)deleteUnusedIndexes
+{
+    NSString *logsDirectory = [self logsDirectory];
+    NSArray<NSString *> *fileNames = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:logsDirectory error:nil];
+    for (NSString *fileName in fileNames) {
+        if (![fileName hasPrefix:SLLogIndexPrefix] || ![fileName.pathExtension isEqualToString:SLLogIndexExtension]) {
+            continue;
+        }
+        NSString *archiveName = [fileName.stringByDeletingPathExtension substringFromIndex:SLLogIndexPrefix.length];
+        if (![[NSFileManager defaultManager] fileExistsAtPath:[logsDirectory stringByAppendingPathComponent:archiveName]]) {
+            [[NSFileManager defaultManager] removeItemAtPath:[logsDirectory stringByAppendingPathComponent:fileName] error:nil];
+        }
+    }
+}
+
+typedef struct SLLogDictionaryLookupContext {
+    const char *directory;
+    CFDataRef dictionary;   // Retained, released by caller
+} SLLogDictionaryLookupContext;
+
+static const void *SLCompressLogFileManagerLookup(uint32_t dictionaryID, size_t *length, void *context)
+{
+    SLLogDictionaryLookupContext *lookup = (SLLogDictionaryLookupContext *)context;
+    NSString *fileName = [NSString stringWithFormat:@"%@%08x.%@", SLLogDictionaryPrefix, dictionaryID, SLLogDictionaryExtension];
+    NSString *path = [@(lookup->directory) stringByAppendingPathComponent:fileName];
+    NSData *data = [NSData dataWithContentsOfFile:path];
+    if (data == nil || SLLogDictionaryID(data.bytes, data.length) != dictionaryID) {
+        return NULL;
+    }
+    if (lookup->dictionary) {
+        CFRelease(lookup->dictionary);
+    }
+    lookup->dictionary = CFBridgingRetain(data);
+    *length = data.length;
+    return data.bytes;
+}
+
++ (BOOL)decompressArchiveAtPath:(NSString *)archivePath toPath:(NSString *)outputPath
+{
+    SLLogDictionaryLookupContext context = { archivePath.stringByDeletingLastPathComponent.fileSystemRepresentation, NULL };
+    int result = SLLogDictionaryDecompressFile(archivePath.fileSystemRepresentation, outputPath.fileSystemRepresentation,
+                                               SLCompressLogFileManagerLookup, &context);
+    if (context.dictionary) {
+        CFRelease(context.dictionary);
+    }
+    if (result == -2) {
+        NSLog(@"ATHLogCompressFileManager: dictionary for %@ not found", archivePath.lastPathComponent);
+    }
+    return result == 0;
+}
+
+typedef struct SLLogSearchResults {
+    __unsafe_unretained NSMutableArray<NSString *> *lines;
+    NSUInteger maxResults;
+} SLLogSearchResults;
+
+static int SLCompressLogFileManagerMatch(const char *line, size_t length, void *context)
+{
+    SLLogSearchResults *results = (SLLogSearchResults *)context;
+    NSString *string = [[NSString alloc] initWithBytes:line length:length encoding:NSUTF8StringEncoding];
+    if (string == nil) {
+        // Line split inside a character
+        string = [[NSString alloc] initWithBytes:line length:length encoding:NSISOLatin1StringEncoding];
+    }
+    [results->lines addObject:string];
+    return results->maxResults > 0 && results->lines.count >= results->maxResults;
+}
+
++ (NSArray<NSString *> *)searchString:(NSString *)string
+                              inFiles:(NSArray<NSString *> *)paths
+                           maxResults:(NSUInteger)maxResults
+                                stats:(SLLogSearchStats *)stats
+{
+    NSMutableArray<NSString *> *lines = [NSMutableArray array];
+    SLLogSearchResults results = { lines, maxResults };
+    NSData *pattern = [string dataUsingEncoding:NSUTF8StringEncoding];
+    for (NSString *path in paths) {
+        SLLogDictionaryLookupContext context = { path.stringByDeletingLastPathComponent.fileSystemRepresentation, NULL };
+        int result = SLLogSearchFile(path.fileSystemRepresentation, SLLogIndexPath(path).fileSystemRepresentation,
+                                     pattern.bytes, pattern.length,
+                                     SLCompressLogFileManagerLookup, &context,
+                                     SLCompressLogFileManagerMatch, &results, stats);
+        if (context.dictionary) {
+            CFRelease(context.dictionary);
+        }
+        if (result != 0) {
+            NSLog(@"ATHLogCompressFileManager: search %@ failed: %d", path.lastPathComponent, result);
+        }
+        if (maxResults > 0 && lines.count >= maxResults) {
+            break;
+        }
+    }
+    return lines;
+}
+
+#pragma mark - Export
+
++ (BOOL)exportFiles:(NSArray<NSString *> *)paths toColumnarFileAtPath:(NSString *)outputPath
+{
+    SLLogColumnarWriter *writer = SLLogColumnarWriterOpen(outputPath.fileSystemRepresentation, 0);
+    if (writer == NULL) {
+        NSLog(@"ATHLogCompressFileManager: failed to create %@", outputPath);
+        return NO;
+    }
+    BOOL success = YES;
+    for (NSString *path in paths) {
+        SLLogDictionaryLookupContext context = { path.stringByDeletingLastPathComponent.fileSystemRepresentation, NULL };
+        int result = SLLogColumnarWriterAddFile(writer, path.fileSystemRepresentation,
+                                                SLCompressLogFileManagerLookup, &context);
+        if (context.dictionary) {
+            CFRelease(context.dictionary);
+        }
+        if (result != 0) {
+            NSLog(@"ATHLogCompressFileManager: export %@ failed: %d", path.lastPathComponent, result);
+            success = NO;
+            break;
+        }
+    }
+    if (SLLogColumnarWriterClose(writer) != 0) {
+        success = NO;
+    }
+    if (!success) {
+        [[NSFileManager defaultManager] removeItemAtPath:outputPath error:nil];
+    }
+    return success;
+}
+
 @end
 
 @implementation SLLogFileInfo (Compress)
@@ -443,7 +766,8 @@
 
 - (BOOL)isCompressed
 {
-    return [[[self fileName] pathExtension] isEqualToString:@"gz"];
+    NSString *extension = [[self fileName] pathExtension];
+    return [extension isEqualToString:@"gz"] || [extension isEqualToString:@"zd"];
 }
 
 - (NSString *)tempFilePathByAppendingPathExtension:(NSString *)newExt
@@ -23,6 +23,33 @@ NS_ASSUME_NONNULL_BEGIN
 - (instancetype)initWithLogsDirectory:(nullable NSString *)logsDirectory NS_DESIGNATED_INITIALIZER;
 - (BOOL)isLogFile:(NSString *)fileName;
 
+/**
+ * 按级别保留日志.
+ *
+ * 文件 appender 写入时记录每个文件包含的级别 (扩展属性, 见 `SLLogFileInfo.levelFlags`),
+ * 文件的重要性由它包含的最高级别决定, 没有记录的旧文件按 Info 处理.
+ *  - 归档文件距最后一次写入超过该级别的保留时间后删除, 0 - 不按时间删除 (默认)
+ *  - 超过 logFilesDiskQuota / maximumNumberOfLogFiles 时, 先删除最不重要的, 同级别先删除最旧的
+ * 当前文件不会被删除.
+ *
+ * 例如 Error 保留 7 天, Debug 保留 1 小时:
+ *   [manager setRetentionPeriod:7 * 24 * 3600 forFlag:SLLogFlagError];
+ *   [manager setRetentionPeriod:3600 forFlag:SLLogFlagDebug];
+ *
+ * 占用的字节数在写入、滚动、压缩时增量更新, 只在初始化时扫描一次目录, 每删除一个文件 O(log n), 见 `SLLogRetention.h`.
+ */
+- (void)setRetentionPeriod:(NSTimeInterval)period forFlag:(SLLogFlag)flag;
+- (NSTimeInterval)retentionPeriodForFlag:(SLLogFlag)flag;
+
+/// Bytes of all log files including the current one, as accounted by retention
+@property (nonatomic, readonly) unsigned long long usedDiskSpace;
+
+/**
+ * Subclasses that replace an archived file by another one (e.g. compression) report it,
+ * the new file takes its place and levels in retention.
+ */
+- (void)didReplaceLogFile:(NSString *)logFilePath withLogFile:(NSString *)newLogFilePath;
+
 @end
 
 NS_ASSUME_NONNULL_END
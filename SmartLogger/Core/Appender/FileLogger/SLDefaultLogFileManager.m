@@ -9,17 +9,55 @@
 #import "SLDefaultLogFileManager.h"
 #import "SLLogger.h"
 #import "SLLogFileInfo.h"
+#import "SLLogMetrics.h"
+#import "SLLogRetention.h"
+
+#import <pthread.h>
+
+/// Leeway of the expiry timer, retention periods are hours or days
+#define SL_RETENTION_TIMER_LEEWAY (60ull * NSEC_PER_SEC)
 
 @interface SLDefaultLogFileManager () {
     NSUInteger _maximumNumberOfLogFiles;
     unsigned long long _logFilesDiskQuota;
     NSString *_logsDirectory;
+    
+    // Rolled files, guarded by _retentionMutex
+    pthread_mutex_t _retentionMutex;
+    SLLogRetention *_retention;
+    NSMutableDictionary<NSString *, NSValue *> *_retentionFiles;   // path -> SLLogRetentionFile *
+    dispatch_source_t _expiryTimer;
+    // Read without lock on the write path
+    uint64_t _retainedBytes;
+    uint64_t _retainedCount;
+    
+    // Current file, only touched on the file appender's queue
+    NSString *_activeFilePath;      // Compared by pointer, the appender passes the same string
+    SLLogFileInfo *_activeFile;
+    NSUInteger _activeFlags;
+    uint64_t _activeBytes;
 }
 
 - (void)deleteOldLogFiles;
 - (NSString *)defaultLogsDirectory;
 
 @end
+
+/// Retention rank of the most important level in `flags`, untagged files count as Info
+static uint32_t SLLogRetentionRankForFlags(NSUInteger flags)
+{
+    if (flags & SLLogFlagError) {
+        return 3;
+    }
+    if (flags & SLLogFlagWarning) {
+        return 2;
+    }
+    if ((flags & SLLogFlagInfo) || flags == 0) {
+        return 1;
+    }
+    return 0;
+}
+
 @implementation SLDefaultLogFileManager
 @synthesize maximumNumberOfLogFiles = _maximumNumberOfLogFiles;
 @synthesize logFilesDiskQuota = _logFilesDiskQuota;
@@ -46,8 +84,22 @@
         [self addObserver:self forKeyPath:NSStringFromSelector(@selector(maximumNumberOfLogFiles)) options:kvoOptions context:nil];
         [self addObserver:self forKeyPath:NSStringFromSelector(@selector(logFilesDiskQuota)) options:kvoOptions context:nil];
         
+        pthread_mutex_init(&_retentionMutex, NULL);
+        _retention = SLLogRetentionCreate();
+        _retentionFiles = [NSMutableDictionary dictionary];
+        
+        __weak __typeof(self) weakSelf = self;
+        _expiryTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, [SLLogger globalLoggingQueue]);
+        dispatch_source_set_event_handler(_expiryTimer, ^{ @autoreleasepool {
+            [weakSelf deleteOldLogFiles];
+        } });
+        dispatch_source_set_timer(_expiryTimer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, SL_RETENTION_TIMER_LEEWAY);
+        dispatch_resume(_expiryTimer);
+        
         NSLog(@"ATHLogDefaultFileManager: logsDirectory:\n%@", [self logsDirectory]);
-        NSLog(@"ATHLogDefaultFileManager: sortedLogFileNames:\n%@", [self sortedLogFileNames]);
+        
+        // The only directory scan, retention is kept up to date from here on
+        [self loadRetention];
     }
     
     return self;
@@ -73,6 +125,18 @@
         [self removeObserver:self forKeyPath:NSStringFromSelector(@selector(logFilesDiskQuota))];
     } @catch (NSException *exception) {
     }
+    
+    if (_expiryTimer) {
+        dispatch_source_cancel(_expiryTimer);
+        _expiryTimer = NULL;
+    }
+    
+    for (NSValue *value in _retentionFiles.allValues) {
+        SLLogRetentionFile *file = value.pointerValue;
+        CFRelease(file->context);
+    }
+    SLLogRetentionDestroy(_retention);
+    pthread_mutex_destroy(&_retentionMutex);
 }
 
 #pragma mark - Configuration
@@ -100,62 +164,257 @@
     }
 }
 
-#pragma mark - File Deleting
+#pragma mark - Retention
 
-- (void)deleteOldLogFiles
+- (void)setRetentionPeriod:(NSTimeInterval)period forFlag:(SLLogFlag)flag
 {
-    NSLog(@"ATHLogDefaultFileManager: deleteOldLogFiles");
+    pthread_mutex_lock(&_retentionMutex);
+    SLLogRetentionSetPeriod(_retention, SLLogRetentionRankForFlags(flag), period);
+    pthread_mutex_unlock(&_retentionMutex);
     
-    NSArray *sortedLogFileInfos = [self sortedLogFileInfos];
+    dispatch_async([SLLogger globalLoggingQueue], ^{ @autoreleasepool {
+        [self deleteOldLogFiles];
+    } });
+}
+
+- (NSTimeInterval)retentionPeriodForFlag:(SLLogFlag)flag
+{
+    pthread_mutex_lock(&_retentionMutex);
+    NSTimeInterval period = SLLogRetentionPeriod(_retention, SLLogRetentionRankForFlags(flag));
+    pthread_mutex_unlock(&_retentionMutex);
     
-    NSUInteger firstIndexToDelete = NSNotFound;
+    return period;
+}
+
+- (unsigned long long)usedDiskSpace
+{
+    return __atomic_load_n(&_retainedBytes, __ATOMIC_RELAXED) + __atomic_load_n(&_activeBytes, __ATOMIC_RELAXED);
+}
+
+- (void)loadRetention
+{
+    NSArray<SLLogFileInfo *> *sortedLogFileInfos = [self sortedLogFileInfos];
     
-    const unsigned long long diskQuota = self.logFilesDiskQuota;
-    const NSUInteger maxNumLogFiles = self.maximumNumberOfLogFiles;
+    NSLog(@"ATHLogDefaultFileManager: sortedLogFileNames:\n%@", [sortedLogFileInfos valueForKey:NSStringFromSelector(@selector(fileName))]);
     
-    if (diskQuota) {
-        unsigned long long used = 0;
-        
-        for (NSUInteger i = 0; i < sortedLogFileInfos.count; i++) {
-            SLLogFileInfo *info = sortedLogFileInfos[i];
-            used += info.fileSize;
-            
-            if (used > diskQuota) {
-                firstIndexToDelete = i;
-                break;
-            }
+    pthread_mutex_lock(&_retentionMutex);
+    [sortedLogFileInfos enumerateObjectsUsingBlock:^(SLLogFileInfo *logFileInfo, NSUInteger idx, BOOL *stop) {
+        // Resumed or archived by the file appender later
+        if (idx == 0 && !logFileInfo.isArchived) {
+            return;
         }
+        [self retainLogFile:logFileInfo.filePath
+                      bytes:logFileInfo.fileSize
+                       time:logFileInfo.modificationDate.timeIntervalSinceReferenceDate
+                      flags:logFileInfo.levelFlags];
+    }];
+    [self updateRetainedTotals];
+    pthread_mutex_unlock(&_retentionMutex);
+}
+
+/// Locked
+- (void)retainLogFile:(NSString *)logFilePath bytes:(unsigned long long)bytes time:(NSTimeInterval)time flags:(NSUInteger)flags
+{
+    if (_retentionFiles[logFilePath] != nil) {
+        return;
+    }
+    SLLogRetentionFile *file = SLLogRetentionAdd(_retention, bytes, time, SLLogRetentionRankForFlags(flags), (uint32_t)flags,
+                                                 (void *)CFBridgingRetain(logFilePath));
+    if (file == NULL) {
+        CFRelease((__bridge CFTypeRef)logFilePath);
+        return;
     }
+    _retentionFiles[logFilePath] = [NSValue valueWithPointer:file];
+}
+
+/// Locked
+- (void)releaseLogFile:(SLLogRetentionFile *)file
+{
+    NSString *logFilePath = CFBridgingRelease(file->context);
+    [_retentionFiles removeObjectForKey:logFilePath];
+    SLLogRetentionRemove(_retention, file);
+}
+
+/// Locked
+- (void)updateRetainedTotals
+{
+    __atomic_store_n(&_retainedBytes, SLLogRetentionBytes(_retention), __ATOMIC_RELAXED);
+    __atomic_store_n(&_retainedCount, (uint64_t)SLLogRetentionCount(_retention), __ATOMIC_RELAXED);
+}
+
+/// Locked
+- (void)deleteLogFile:(SLLogRetentionFile *)file
+{
+    NSString *logFilePath = (__bridge NSString *)file->context;
     
-    if (maxNumLogFiles) {
-        if (firstIndexToDelete == NSNotFound) {
-            firstIndexToDelete = maxNumLogFiles;
-        } else {
-            firstIndexToDelete = MIN(firstIndexToDelete, maxNumLogFiles);
+    NSLog(@"ATHLogDefaultFileManager: Deleting file: %@", logFilePath.lastPathComponent);
+    
+    [[NSFileManager defaultManager] removeItemAtPath:logFilePath error:nil];
+    [self releaseLogFile:file];
+}
+
+- (void)archiveLogFile:(NSString *)logFilePath
+{
+    pthread_mutex_lock(&_retentionMutex);
+    if (logFilePath == _activeFilePath || [logFilePath isEqualToString:_activeFilePath]) {
+        // Levels are already in the extended attribute
+        [self retainLogFile:logFilePath
+                      bytes:[SLLogFileInfo logFileWithPath:logFilePath].fileSize
+                       time:[NSDate timeIntervalSinceReferenceDate]
+                      flags:_activeFlags];
+        _activeFile = nil;
+        _activeFilePath = nil;
+        _activeFlags = 0;
+        __atomic_store_n(&_activeBytes, 0, __ATOMIC_RELAXED);
+    } else if (_retentionFiles[logFilePath] == nil) {
+        SLLogFileInfo *logFileInfo = [SLLogFileInfo logFileWithPath:logFilePath];
+        if (logFileInfo.fileAttributes == nil) {
+            // Gone already
+            pthread_mutex_unlock(&_retentionMutex);
+            return;
         }
+        [self retainLogFile:logFilePath
+                      bytes:logFileInfo.fileSize
+                       time:logFileInfo.modificationDate.timeIntervalSinceReferenceDate
+                      flags:logFileInfo.levelFlags];
     }
+    [self updateRetainedTotals];
+    pthread_mutex_unlock(&_retentionMutex);
     
-    if (firstIndexToDelete == 0) {
-        // don't delete first file
-        if (sortedLogFileInfos.count > 0) {
-            SLLogFileInfo *logFileInfo = sortedLogFileInfos[0];
-            
-            if (!logFileInfo.isArchived) {
-                // Don't delete active file.
-                ++firstIndexToDelete;
-            }
+    // A rolled file can expire before anything the timer waits for
+    [self deleteOldLogFiles];
+}
+
+- (void)didArchiveLogFile:(NSString *)logFilePath
+{
+    [self archiveLogFile:logFilePath];
+}
+
+- (void)didRollAndArchiveLogFile:(NSString *)logFilePath
+{
+    [self archiveLogFile:logFilePath];
+}
+
+- (void)activateLogFile:(NSString *)logFilePath
+{
+    SLLogFileInfo *logFileInfo = [SLLogFileInfo logFileWithPath:logFilePath];
+    
+    pthread_mutex_lock(&_retentionMutex);
+    // Switched without rolling, e.g. another appender on this manager
+    if (_activeFilePath) {
+        [self retainLogFile:_activeFilePath
+                      bytes:__atomic_load_n(&_activeBytes, __ATOMIC_RELAXED)
+                       time:[NSDate timeIntervalSinceReferenceDate]
+                      flags:_activeFlags];
+    }
+    // Resumed file
+    SLLogRetentionFile *file = [_retentionFiles[logFilePath] pointerValue];
+    if (file) {
+        [self releaseLogFile:file];
+    }
+    [self updateRetainedTotals];
+    _activeFile = logFileInfo;
+    _activeFilePath = logFilePath;
+    _activeFlags = logFileInfo.levelFlags;
+    // Already includes the write being reported
+    __atomic_store_n(&_activeBytes, logFileInfo.fileSize, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&_retentionMutex);
+}
+
+- (void)didWriteBytes:(NSUInteger)length flag:(SLLogFlag)flag toLogFile:(NSString *)logFilePath
+{
+    if (logFilePath == _activeFilePath) {
+        __atomic_fetch_add(&_activeBytes, length, __ATOMIC_RELAXED);
+    } else {
+        [self activateLogFile:logFilePath];
+    }
+    
+    // At most once per level and file
+    if ((_activeFlags & flag) != flag) {
+        _activeFlags |= flag;
+        _activeFile.levelFlags = _activeFlags;
+    }
+    
+    unsigned long long diskQuota = _logFilesDiskQuota;
+    if (diskQuota > 0 &&
+        __atomic_load_n(&_retainedCount, __ATOMIC_RELAXED) > 0 &&
+        __atomic_load_n(&_retainedBytes, __ATOMIC_RELAXED) + __atomic_load_n(&_activeBytes, __ATOMIC_RELAXED) > diskQuota) {
+        [self deleteOldLogFiles];
+    }
+}
+
+- (void)didReplaceLogFile:(NSString *)logFilePath withLogFile:(NSString *)newLogFilePath
+{
+    SLLogFileInfo *newLogFileInfo = [SLLogFileInfo logFileWithPath:newLogFilePath];
+    
+    pthread_mutex_lock(&_retentionMutex);
+    SLLogRetentionFile *file = [_retentionFiles[logFilePath] pointerValue];
+    if (file) {
+        NSUInteger flags = file->flags;
+        NSTimeInterval time = file->time;
+        [self releaseLogFile:file];
+        if (flags != 0) {
+            newLogFileInfo.levelFlags = flags;
         }
+        [self retainLogFile:newLogFilePath bytes:newLogFileInfo.fileSize time:time flags:flags];
+    } else {
+        // Deleted while it was being replaced, or never seen
+        [self retainLogFile:newLogFilePath
+                      bytes:newLogFileInfo.fileSize
+                       time:newLogFileInfo.modificationDate.timeIntervalSinceReferenceDate
+                      flags:newLogFileInfo.levelFlags];
     }
+    [self updateRetainedTotals];
+    pthread_mutex_unlock(&_retentionMutex);
+}
+
+#pragma mark - File Deleting
+
+- (void)deleteOldLogFiles
+{
+    NSLog(@"ATHLogDefaultFileManager: deleteOldLogFiles");
     
-    if (firstIndexToDelete != NSNotFound) {
-        // removing all logfiles starting with firstIndexToDelete
-        for (NSUInteger i = firstIndexToDelete; i < sortedLogFileInfos.count; i++) {
-            SLLogFileInfo *logFileInfo = sortedLogFileInfos[i];
-            
-            NSLog(@"ATHLogDefaultFileManager: Deleting file: %@", logFileInfo.fileName);
-            
-            [[NSFileManager defaultManager] removeItemAtPath:logFileInfo.filePath error:nil];
+    const unsigned long long diskQuota = self.logFilesDiskQuota;
+    const NSUInteger maxNumLogFiles = self.maximumNumberOfLogFiles;
+    NSUInteger deletedCount = 0;
+    
+    pthread_mutex_lock(&_retentionMutex);
+    
+    // Expired first, whatever the quota
+    NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+    SLLogRetentionFile *file;
+    while ((file = SLLogRetentionNextExpired(_retention, now)) != NULL) {
+        [self deleteLogFile:file];
+        deletedCount++;
+    }
+    
+    // Then least important and oldest, the current file counts but is never deleted
+    while ((file = SLLogRetentionNextVictim(_retention)) != NULL) {
+        unsigned long long used = SLLogRetentionBytes(_retention) + __atomic_load_n(&_activeBytes, __ATOMIC_RELAXED);
+        NSUInteger count = SLLogRetentionCount(_retention) + 1;
+        
+        if (!(diskQuota && used > diskQuota) && !(maxNumLogFiles && count > maxNumLogFiles)) {
+            break;
         }
+        [self deleteLogFile:file];
+        deletedCount++;
+    }
+    
+    [self updateRetainedTotals];
+    NSTimeInterval nextExpiry = SLLogRetentionNextExpiry(_retention);
+    pthread_mutex_unlock(&_retentionMutex);
+    
+    if (nextExpiry > 0) {
+        NSTimeInterval delay = MAX(nextExpiry - now, 0);
+        dispatch_source_set_timer(_expiryTimer, dispatch_walltime(NULL, (int64_t)(delay * NSEC_PER_SEC)),
+                                  DISPATCH_TIME_FOREVER, SL_RETENTION_TIMER_LEEWAY);
+    } else {
+        dispatch_source_set_timer(_expiryTimer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, SL_RETENTION_TIMER_LEEWAY);
+    }
+    
+    // Who filled the quota
+    if (deletedCount > 0) {
+        [SLLogMetrics writeSiteReport:[NSString stringWithFormat:@"deleted %lu log files", (unsigned long)deletedCount]];
     }
 }
 
@@ -0,0 +1,335 @@
+//
+//  SLLogDictionary.c
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/10.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#include "SLLogDictionary.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#define SL_DICT_DMER 8                          // Substring length that is counted
+#define SL_DICT_SEGMENT 64                      // Bytes taken per epoch
+#define SL_DICT_HASH_BITS 18
+#define SL_DICT_CHUNK (64 * 1024)
+
+typedef struct SLDictSegment_ {
+    size_t offset;
+    uint64_t score;
+} SLDictSegment;
+
+// Training
+
+static inline uint32_t sl_dict_hash(const unsigned char *p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return (uint32_t)((value * 0x9E3779B97F4A7C15ull) >> (64 - SL_DICT_HASH_BITS));
+}
+
+static int sl_dict_segment_compare(const void *a, const void *b) {
+    const SLDictSegment *left = (const SLDictSegment *)a;
+    const SLDictSegment *right = (const SLDictSegment *)b;
+    if (left->score != right->score) {
+        return left->score < right->score ? -1 : 1;
+    }
+    return left->offset < right->offset ? -1 : (left->offset > right->offset);
+}
+
+size_t SLLogDictionaryTrain(const void *samples, size_t length, void *dictionary, size_t capacity) {
+    const unsigned char *data = (const unsigned char *)samples;
+    if (capacity > SL_LOG_DICTIONARY_MAX_SIZE) {
+        capacity = SL_LOG_DICTIONARY_MAX_SIZE;
+    }
+    size_t epochs = capacity / SL_DICT_SEGMENT;
+    if (epochs == 0 || length < SL_DICT_SEGMENT * 4) {
+        return 0;
+    }
+    size_t epochSize = length / epochs;
+    if (epochSize < SL_DICT_SEGMENT) {
+        epochs = length / SL_DICT_SEGMENT;
+        epochSize = SL_DICT_SEGMENT;
+    }
+
+    uint32_t *frequency = (uint32_t *)calloc((size_t)1 << SL_DICT_HASH_BITS, sizeof(uint32_t));
+    SLDictSegment *segments = (SLDictSegment *)calloc(epochs, sizeof(SLDictSegment));
+    if (frequency == NULL || segments == NULL) {
+        free(frequency);
+        free(segments);
+        return 0;
+    }
+
+    size_t dmers = length - SL_DICT_DMER + 1;
+    for (size_t i = 0; i < dmers; i++) {
+        frequency[sl_dict_hash(data + i)]++;
+    }
+
+    size_t count = 0;
+    for (size_t epoch = 0; epoch < epochs; epoch++) {
+        size_t begin = epoch * epochSize;
+        size_t end = begin + epochSize;
+        if (end + SL_DICT_DMER > length) {
+            end = length - SL_DICT_DMER + 1;
+        }
+        if (begin + SL_DICT_SEGMENT > end) {
+            break;
+        }
+
+        // Sliding window over d-mers starting in [start, start + SEGMENT - DMER]
+        size_t window = SL_DICT_SEGMENT - SL_DICT_DMER + 1;
+        uint64_t score = 0;
+        for (size_t i = begin; i < begin + window; i++) {
+            score += frequency[sl_dict_hash(data + i)];
+        }
+        uint64_t bestScore = score;
+        size_t best = begin;
+        for (size_t start = begin + 1; start + window <= end; start++) {
+            score -= frequency[sl_dict_hash(data + start - 1)];
+            score += frequency[sl_dict_hash(data + start + window - 1)];
+            if (score > bestScore) {
+                bestScore = score;
+                best = start;
+            }
+        }
+        // Only frequent content is worth the space
+        if (bestScore <= window) {
+            continue;
+        }
+
+        segments[count].offset = best;
+        segments[count].score = bestScore;
+        count++;
+        for (size_t i = best; i < best + window; i++) {
+            frequency[sl_dict_hash(data + i)] = 0;
+        }
+    }
+
+    qsort(segments, count, sizeof(SLDictSegment), sl_dict_segment_compare);
+    size_t written = 0;
+    for (size_t i = 0; i < count && written + SL_DICT_SEGMENT <= capacity; i++) {
+        memcpy((char *)dictionary + written, data + segments[i].offset, SL_DICT_SEGMENT);
+        written += SL_DICT_SEGMENT;
+    }
+
+    free(frequency);
+    free(segments);
+    return written;
+}
+
+uint32_t SLLogDictionaryID(const void *dictionary, size_t length) {
+    uLong adler = adler32(0L, Z_NULL, 0);
+    return (uint32_t)adler32(adler, (const Bytef *)dictionary, (uInt)length);
+}
+
+// Streams
+
+static int sl_dict_write(FILE *output, const unsigned char *buffer, size_t length) {
+    return fwrite(buffer, 1, length, output) == length ? 0 : -1;
+}
+
+int SLLogDictionaryCompressFile(const char *inputPath, const char *outputPath,
+                                const void *dictionary, size_t length, int level) {
+    FILE *input = fopen(inputPath, "rb");
+    FILE *output = input ? fopen(outputPath, "wb") : NULL;
+    unsigned char *in = (unsigned char *)malloc(SL_DICT_CHUNK);
+    unsigned char *out = (unsigned char *)malloc(SL_DICT_CHUNK);
+    int result = -1;
+
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    if (output == NULL || in == NULL || out == NULL ||
+        deflateInit2(&strm, level, Z_DEFLATED, 15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        goto done;
+    }
+    if (dictionary && length > 0 &&
+        deflateSetDictionary(&strm, (const Bytef *)dictionary, (uInt)length) != Z_OK) {
+        deflateEnd(&strm);
+        goto done;
+    }
+
+    int flush;
+    do {
+        strm.avail_in = (uInt)fread(in, 1, SL_DICT_CHUNK, input);
+        if (ferror(input)) {
+            break;
+        }
+        flush = feof(input) ? Z_FINISH : Z_NO_FLUSH;
+        strm.next_in = in;
+        do {
+            strm.next_out = out;
+            strm.avail_out = SL_DICT_CHUNK;
+            deflate(&strm, flush);
+            if (sl_dict_write(output, out, SL_DICT_CHUNK - strm.avail_out) != 0) {
+                flush = -1;
+                break;
+            }
+        } while (strm.avail_out == 0);
+    } while (flush == Z_NO_FLUSH);
+    result = flush == Z_FINISH ? 0 : -1;
+    deflateEnd(&strm);
+
+done:
+    if (output && fclose(output) != 0) {
+        result = -1;
+    }
+    if (input) {
+        fclose(input);
+    }
+    free(in);
+    free(out);
+    return result;
+}
+
+int SLLogDictionaryDecompressFile(const char *inputPath, const char *outputPath,
+                                  SLLogDictionaryLookup lookup, void *context) {
+    FILE *input = fopen(inputPath, "rb");
+    FILE *output = input ? fopen(outputPath, "wb") : NULL;
+    unsigned char *in = (unsigned char *)malloc(SL_DICT_CHUNK);
+    unsigned char *out = (unsigned char *)malloc(SL_DICT_CHUNK);
+    int result = -1;
+
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    // 15 + 32: zlib or gzip header, detected automatically
+    if (output == NULL || in == NULL || out == NULL || inflateInit2(&strm, 15 + 32) != Z_OK) {
+        goto done;
+    }
+
+    int status = Z_OK;
+    while (status != Z_STREAM_END) {
+        strm.avail_in = (uInt)fread(in, 1, SL_DICT_CHUNK, input);
+        if (ferror(input) || strm.avail_in == 0) {
+            break;
+        }
+        strm.next_in = in;
+        do {
+            strm.next_out = out;
+            strm.avail_out = SL_DICT_CHUNK;
+            status = inflate(&strm, Z_NO_FLUSH);
+            if (status == Z_NEED_DICT) {
+                size_t length = 0;
+                const void *dictionary = lookup ? lookup((uint32_t)strm.adler, &length, context) : NULL;
+                if (dictionary == NULL) {
+                    result = -2;
+                    break;
+                }
+                status = inflateSetDictionary(&strm, (const Bytef *)dictionary, (uInt)length);
+                if (status == Z_OK) {
+                    status = inflate(&strm, Z_NO_FLUSH);
+                }
+            }
+            if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) {
+                break;
+            }
+            if (sl_dict_write(output, out, SL_DICT_CHUNK - strm.avail_out) != 0) {
+                status = Z_ERRNO;
+                break;
+            }
+        } while (strm.avail_out == 0 && status != Z_STREAM_END);
+        if (result == -2 || (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR)) {
+            break;
+        }
+    }
+    if (status == Z_STREAM_END) {
+        result = 0;
+    }
+    inflateEnd(&strm);
+
+done:
+    if (output && fclose(output) != 0 && result == 0) {
+        result = -1;
+    }
+    if (input) {
+        fclose(input);
+    }
+    free(in);
+    free(out);
+    return result;
+}
+
+// Reader
+
+struct SLLogArchiveReader_ {
+    FILE *input;
+    int compressed;
+    int finished;
+    z_stream strm;
+    unsigned char in[SL_DICT_CHUNK];
+    SLLogDictionaryLookup lookup;
+    void *context;
+};
+
+SLLogArchiveReader *SLLogArchiveReaderOpen(const char *path, SLLogDictionaryLookup lookup, void *context) {
+    SLLogArchiveReader *reader = (SLLogArchiveReader *)calloc(1, sizeof(SLLogArchiveReader));
+    if (reader == NULL || (reader->input = fopen(path, "rb")) == NULL) {
+        free(reader);
+        return NULL;
+    }
+    reader->lookup = lookup;
+    reader->context = context;
+
+    size_t length = fread(reader->in, 1, 2, reader->input);
+    int gzip = length == 2 && reader->in[0] == 0x1f && reader->in[1] == 0x8b;
+    int zlib = length == 2 && (reader->in[0] & 0x0f) == Z_DEFLATED && ((reader->in[0] << 8) | reader->in[1]) % 31 == 0;
+    rewind(reader->input);
+    if (gzip || zlib) {
+        // 15 + 32: zlib or gzip header
+        if (inflateInit2(&reader->strm, 15 + 32) != Z_OK) {
+            fclose(reader->input);
+            free(reader);
+            return NULL;
+        }
+        reader->compressed = 1;
+    }
+    return reader;
+}
+
+long SLLogArchiveReaderRead(SLLogArchiveReader *reader, void *buffer, size_t length) {
+    if (!reader->compressed) {
+        size_t read = fread(buffer, 1, length, reader->input);
+        return ferror(reader->input) ? -1 : (long)read;
+    }
+
+    z_stream *strm = &reader->strm;
+    strm->next_out = (Bytef *)buffer;
+    strm->avail_out = (uInt)length;
+    while (strm->avail_out > 0 && !reader->finished) {
+        if (strm->avail_in == 0) {
+            strm->avail_in = (uInt)fread(reader->in, 1, SL_DICT_CHUNK, reader->input);
+            strm->next_in = reader->in;
+            if (strm->avail_in == 0) {
+                // Truncated archive
+                return -1;
+            }
+        }
+        int status = inflate(strm, Z_NO_FLUSH);
+        if (status == Z_NEED_DICT) {
+            size_t dictionaryLength = 0;
+            const void *dictionary = reader->lookup ? reader->lookup((uint32_t)strm->adler, &dictionaryLength, reader->context) : NULL;
+            if (dictionary == NULL) {
+                return -2;
+            }
+            status = inflateSetDictionary(strm, (const Bytef *)dictionary, (uInt)dictionaryLength);
+        }
+        if (status == Z_STREAM_END) {
+            reader->finished = 1;
+        } else if (status != Z_OK && status != Z_BUF_ERROR) {
+            return -1;
+        }
+    }
+    return (long)(length - strm->avail_out);
+}
+
+void SLLogArchiveReaderClose(SLLogArchiveReader *reader) {
+    if (reader) {
+        if (reader->compressed) {
+            inflateEnd(&reader->strm);
+        }
+        fclose(reader->input);
+        free(reader);
+    }
+}
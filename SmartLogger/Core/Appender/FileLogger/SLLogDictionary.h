@@ -0,0 +1,71 @@
+//
+//  SLLogDictionary.h
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/10.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#ifndef SLLogDictionary_h
+#define SLLogDictionary_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if __cplusplus
+extern "C" {
+#endif
+
+// Dictionary compression for small, repetitive rolled log files, on top of zlib.
+//
+// A dictionary is trained from recent logs and preloaded into deflate with
+// deflateSetDictionary(). Archives use the zlib container, whose header carries the adler32 of
+// the dictionary (the dictionary ID), so a reader can always find the right dictionary version:
+// inflate stops with Z_NEED_DICT and reports the ID, SLLogDictionaryDecompressFile() asks the
+// lookup callback for it. Plain gzip archives are read by the same function.
+//
+// Training is a reduced COVER: the samples are split into epochs, from each epoch the segment
+// whose 8-byte substrings are most frequent over all samples is taken, and substrings already
+// taken stop counting. Best segments are placed last, deflate reaches closer bytes cheaper.
+//
+// Plain C, zlib only.
+#define SL_LOG_DICTIONARY_MAX_SIZE (32 * 1024)     // deflate window
+#define SL_LOG_DICTIONARY_DEFAULT_SIZE (16 * 1024)
+
+// Trains a dictionary of at most `capacity` bytes (clamped to SL_LOG_DICTIONARY_MAX_SIZE).
+// Returns the number of bytes written, 0 if samples are too small or memory is short.
+size_t SLLogDictionaryTrain(const void *samples, size_t length, void *dictionary, size_t capacity);
+
+// adler32 of the dictionary, as stored in zlib headers.
+uint32_t SLLogDictionaryID(const void *dictionary, size_t length);
+
+// Compresses `inputPath` into `outputPath` (zlib container) against the dictionary.
+// Returns 0 on success, -1 otherwise (the output file may be partially written).
+int SLLogDictionaryCompressFile(const char *inputPath, const char *outputPath,
+                                const void *dictionary, size_t length, int level);
+
+// Returns the dictionary with `dictionaryID`, or NULL if unknown. Memory must stay valid until
+// SLLogDictionaryDecompressFile() returns.
+typedef const void *(*SLLogDictionaryLookup)(uint32_t dictionaryID, size_t *length, void *context);
+
+// Decompresses a dictionary (zlib) or plain gzip archive. `lookup` may be NULL for gzip.
+// Returns 0 on success, -1 on I/O or data error, -2 if the dictionary was not found.
+int SLLogDictionaryDecompressFile(const char *inputPath, const char *outputPath,
+                                  SLLogDictionaryLookup lookup, void *context);
+
+// Streaming reader over a plain log file, a gzip or a dictionary archive (detected from content),
+// for consumers that parse the content instead of writing it out.
+typedef struct SLLogArchiveReader_ SLLogArchiveReader;
+
+// Returns NULL if the file can't be opened. `lookup` may be NULL for gzip and plain files.
+SLLogArchiveReader *SLLogArchiveReaderOpen(const char *path, SLLogDictionaryLookup lookup, void *context);
+// Reads up to `length` raw bytes. Returns the number of bytes, 0 at the end, -1 on I/O or data
+// error, -2 if the dictionary was not found.
+long SLLogArchiveReaderRead(SLLogArchiveReader *reader, void *buffer, size_t length);
+void SLLogArchiveReaderClose(SLLogArchiveReader *reader);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SLLogDictionary_h */
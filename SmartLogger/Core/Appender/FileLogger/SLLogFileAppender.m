@@ -11,6 +11,7 @@
 #import "SLLogger.h"
 #import "SLLogMessage.h"
 #import "SLLogFormatter.h"
+#import "SLLogMetrics.h"
 
 #if TARGET_OS_IPHONE
 /**
@@ -50,6 +51,10 @@ unsigned long long const kSLDefaultLogFilesDiskQuota   = 50 * 1024 * 1024; // 50
     
     unsigned long long _maximumFileSize;
     NSTimeInterval _rollingFrequency;
+    
+    SLLogAppenderMetrics *_metrics;
+    // Manager accounts every write, see -[SLLogFileManager didWriteBytes:flag:toLogFile:]
+    BOOL _reportsWrites;
 }
 
 - (void)rollLogFileNow;
@@ -74,6 +79,7 @@ unsigned long long const kSLDefaultLogFilesDiskQuota   = 50 * 1024 * 1024; // 50
         _automaticallyAppendNewlineForCustomFormatters = YES;
         
         logFileManager = aLogFileManager;
+        _reportsWrites = [aLogFileManager respondsToSelector:@selector(didWriteBytes:flag:toLogFile:)];
     }
     
     return self;
@@ -408,30 +414,31 @@ unsigned long long const kSLDefaultLogFilesDiskQuota   = 50 * 1024 * 1024; // 50
 static int exception_count = 0;
 - (void)logMessage:(SLLogMessage *)logMessage
 {
-    NSString *message = logMessage->_message;
-    BOOL isFormatted = NO;
-    
-    if (_logFormatter) {
-        message = [_logFormatter formatLogMessage:logMessage];
-        isFormatted = message != logMessage->_message;
-    }
+    // Formatted and encoded once, shared with other appenders using the same formatter
+    SLLogLine *line = [self lineForLogMessage:logMessage];
     
-    if (message) {
-        if ((!isFormatted || _automaticallyAppendNewlineForCustomFormatters) &&
-            (![message hasSuffix:@"\n"])) {
-            message = [message stringByAppendingString:@"\n"];
-        }
-        
-        NSData *logData = [message dataUsingEncoding:NSUTF8StringEncoding];
+    if (line) {
+        NSData *logData = [line dataWithNewline:(!line->_formatted || _automaticallyAppendNewlineForCustomFormatters)];
         
         @try {
             [self willLogMessage];
             
             [[self currentLogFileHandle] writeData:logData];
             
+            if (_metrics == NULL) {
+                _metrics = SLLogMetricsForAppender(self.appenderName);
+            }
+            __atomic_fetch_add(&_metrics->bytes, logData.length, __ATOMIC_RELAXED);
+            
+            // Before rolling, the bytes belong to this file
+            if (_reportsWrites) {
+                [logFileManager didWriteBytes:logData.length flag:logMessage->_flag toLogFile:_currentLogFileInfo.filePath];
+            }
+            
             [self didLogMessage];
         } @catch (NSException *exception) {
             exception_count++;
+            SLLogMetricsIncrement(SLLogCounterExceptions, 1);
             
             if (exception_count <= 10) {
                 NSLog(@"ATHLogFileAppender.logMessage: %@", exception);
@@ -25,6 +25,8 @@ NS_ASSUME_NONNULL_BEGIN
 @property (nonatomic, readonly) unsigned long long fileSize;
 @property (nonatomic, readonly) NSTimeInterval age;
 @property (nonatomic, readwrite) BOOL isArchived;
+/// SLLogFlag bits of the messages written into the file, kept in an extended attribute, 0 if unknown
+@property (nonatomic, readwrite) NSUInteger levelFlags;
 
 + (instancetype)logFileWithPath:(NSString *)filePath;
 
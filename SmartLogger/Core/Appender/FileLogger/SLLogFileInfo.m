@@ -15,6 +15,8 @@ static NSString * const kSLXAttrArchivedName = @"archived";
 static NSString * const kSLXAttrArchivedName = @"smartlogger.log.archived";
 #endif
 
+static const char * const kSLXAttrLevelFlagsName = "smartlogger.log.levels";
+
 @interface SLLogFileInfo () {
     __strong NSString *_filePath;
     __strong NSString *_fileName;
@@ -39,6 +41,7 @@ static NSString * const kSLXAttrArchivedName = @"smartlogger.log.archived";
 @dynamic fileSize;
 @dynamic age;
 @dynamic isArchived;
+@dynamic levelFlags;
 
 + (instancetype)logFileWithPath:(NSString *)aFilePath
 {
@@ -154,6 +157,30 @@ static NSString * const kSLXAttrArchivedName = @"smartlogger.log.archived";
 #endif
 }
 
+#pragma mark - Levels
+
+- (NSUInteger)levelFlags
+{
+    uint32_t flags = 0;
+    ssize_t result = getxattr([filePath UTF8String], kSLXAttrLevelFlagsName, &flags, sizeof(flags), 0, 0);
+    
+    return result == sizeof(flags) ? flags : 0;
+}
+
+- (void)setLevelFlags:(NSUInteger)levelFlags
+{
+    // Value attribute, not renamed into the file name on simulator
+    uint32_t flags = (uint32_t)levelFlags;
+    int result = setxattr([filePath UTF8String], kSLXAttrLevelFlagsName, &flags, sizeof(flags), 0, 0);
+    
+    if (result < 0) {
+        NSLog(@"ATHLogFileInfo: setxattr(%s, %@): error = %s",
+              kSLXAttrLevelFlagsName,
+              filePath,
+              strerror(errno));
+    }
+}
+
 #pragma mark - Changes
 
 - (void)reset
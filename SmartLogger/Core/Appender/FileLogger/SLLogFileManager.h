@@ -10,6 +10,7 @@
 #define SLLogFileManager_h
 
 #import <Foundation/Foundation.h>
+#import "SLInterfaces.h"
 
 // Default configurations
 extern unsigned long long const kSLDefaultLogMaxFileSize;
@@ -81,6 +82,12 @@ extern BOOL sl_doesAppRunInBackground(void);
 - (void)didArchiveLogFile:(NSString *)logFilePath;
 - (void)didRollAndArchiveLogFile:(NSString *)logFilePath;
 
+/**
+ * Called by the file appender after every write into `logFilePath` (the current file),
+ * `flag` is the level of the message. Keep it FAST.
+ */
+- (void)didWriteBytes:(NSUInteger)length flag:(SLLogFlag)flag toLogFile:(NSString *)logFilePath;
+
 @end
 
 #endif /* SLLogFileManager_h */
@@ -0,0 +1,218 @@
+//
+//  SLLogRetention.c
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/12.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#include "SLLogRetention.h"
+
+#include <stdlib.h>
+
+typedef struct SLLogRetentionHeap {
+    SLLogRetentionFile **files;
+    size_t count;
+    size_t capacity;
+} SLLogRetentionHeap;
+
+struct SLLogRetention_ {
+    SLLogRetentionHeap heaps[SL_LOG_RETENTION_RANKS];
+    double periods[SL_LOG_RETENTION_RANKS];
+    uint64_t bytes;
+    size_t count;
+};
+
+// Heap by time, one per rank
+
+static void SLLogRetentionHeapSet(SLLogRetentionHeap *heap, size_t i, SLLogRetentionFile *file)
+{
+    heap->files[i] = file;
+    file->heapIndex = i;
+}
+
+static void SLLogRetentionHeapUp(SLLogRetentionHeap *heap, size_t i)
+{
+    SLLogRetentionFile *file = heap->files[i];
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (heap->files[parent]->time <= file->time) {
+            break;
+        }
+        SLLogRetentionHeapSet(heap, i, heap->files[parent]);
+        i = parent;
+    }
+    SLLogRetentionHeapSet(heap, i, file);
+}
+
+static void SLLogRetentionHeapDown(SLLogRetentionHeap *heap, size_t i)
+{
+    SLLogRetentionFile *file = heap->files[i];
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= heap->count) {
+            break;
+        }
+        if (child + 1 < heap->count && heap->files[child + 1]->time < heap->files[child]->time) {
+            child++;
+        }
+        if (file->time <= heap->files[child]->time) {
+            break;
+        }
+        SLLogRetentionHeapSet(heap, i, heap->files[child]);
+        i = child;
+    }
+    SLLogRetentionHeapSet(heap, i, file);
+}
+
+static int SLLogRetentionHeapPush(SLLogRetentionHeap *heap, SLLogRetentionFile *file)
+{
+    if (heap->count == heap->capacity) {
+        size_t capacity = heap->capacity ? heap->capacity * 2 : 16;
+        SLLogRetentionFile **files = realloc(heap->files, capacity * sizeof(*files));
+        if (files == NULL) {
+            return -1;
+        }
+        heap->files = files;
+        heap->capacity = capacity;
+    }
+    heap->files[heap->count++] = file;
+    SLLogRetentionHeapUp(heap, heap->count - 1);
+    return 0;
+}
+
+static void SLLogRetentionHeapRemove(SLLogRetentionHeap *heap, SLLogRetentionFile *file)
+{
+    size_t i = file->heapIndex;
+    SLLogRetentionFile *last = heap->files[--heap->count];
+    if (i == heap->count) {
+        return;
+    }
+    SLLogRetentionHeapSet(heap, i, last);
+    if (i > 0 && heap->files[(i - 1) / 2]->time > last->time) {
+        SLLogRetentionHeapUp(heap, i);
+    } else {
+        SLLogRetentionHeapDown(heap, i);
+    }
+}
+
+SLLogRetention *SLLogRetentionCreate(void)
+{
+    return calloc(1, sizeof(SLLogRetention));
+}
+
+void SLLogRetentionDestroy(SLLogRetention *retention)
+{
+    if (retention == NULL) {
+        return;
+    }
+    for (uint32_t rank = 0; rank < SL_LOG_RETENTION_RANKS; rank++) {
+        SLLogRetentionHeap *heap = &retention->heaps[rank];
+        for (size_t i = 0; i < heap->count; i++) {
+            free(heap->files[i]);
+        }
+        free(heap->files);
+    }
+    free(retention);
+}
+
+void SLLogRetentionSetPeriod(SLLogRetention *retention, uint32_t rank, double period)
+{
+    if (rank < SL_LOG_RETENTION_RANKS) {
+        retention->periods[rank] = period > 0 ? period : 0;
+    }
+}
+
+double SLLogRetentionPeriod(const SLLogRetention *retention, uint32_t rank)
+{
+    return rank < SL_LOG_RETENTION_RANKS ? retention->periods[rank] : 0;
+}
+
+SLLogRetentionFile *SLLogRetentionAdd(SLLogRetention *retention, uint64_t bytes, double time,
+                                      uint32_t rank, uint32_t flags, void *context)
+{
+    SLLogRetentionFile *file = malloc(sizeof(SLLogRetentionFile));
+    if (file == NULL) {
+        return NULL;
+    }
+    file->bytes = bytes;
+    file->time = time;
+    file->rank = rank < SL_LOG_RETENTION_RANKS ? rank : SL_LOG_RETENTION_RANKS - 1;
+    file->flags = flags;
+    file->context = context;
+    if (SLLogRetentionHeapPush(&retention->heaps[file->rank], file) != 0) {
+        free(file);
+        return NULL;
+    }
+    retention->bytes += bytes;
+    retention->count++;
+    return file;
+}
+
+void SLLogRetentionRemove(SLLogRetention *retention, SLLogRetentionFile *file)
+{
+    SLLogRetentionHeapRemove(&retention->heaps[file->rank], file);
+    retention->bytes -= file->bytes;
+    retention->count--;
+    free(file);
+}
+
+void SLLogRetentionResize(SLLogRetention *retention, SLLogRetentionFile *file, uint64_t bytes)
+{
+    retention->bytes = retention->bytes - file->bytes + bytes;
+    file->bytes = bytes;
+}
+
+uint64_t SLLogRetentionBytes(const SLLogRetention *retention)
+{
+    return retention->bytes;
+}
+
+size_t SLLogRetentionCount(const SLLogRetention *retention)
+{
+    return retention->count;
+}
+
+SLLogRetentionFile *SLLogRetentionNextExpired(const SLLogRetention *retention, double now)
+{
+    SLLogRetentionFile *expired = NULL;
+    for (uint32_t rank = 0; rank < SL_LOG_RETENTION_RANKS; rank++) {
+        const SLLogRetentionHeap *heap = &retention->heaps[rank];
+        double period = retention->periods[rank];
+        if (heap->count == 0 || period <= 0) {
+            continue;
+        }
+        SLLogRetentionFile *oldest = heap->files[0];
+        if (oldest->time + period <= now && (expired == NULL || oldest->time < expired->time)) {
+            expired = oldest;
+        }
+    }
+    return expired;
+}
+
+SLLogRetentionFile *SLLogRetentionNextVictim(const SLLogRetention *retention)
+{
+    for (uint32_t rank = 0; rank < SL_LOG_RETENTION_RANKS; rank++) {
+        if (retention->heaps[rank].count > 0) {
+            return retention->heaps[rank].files[0];
+        }
+    }
+    return NULL;
+}
+
+double SLLogRetentionNextExpiry(const SLLogRetention *retention)
+{
+    double next = 0;
+    for (uint32_t rank = 0; rank < SL_LOG_RETENTION_RANKS; rank++) {
+        const SLLogRetentionHeap *heap = &retention->heaps[rank];
+        double period = retention->periods[rank];
+        if (heap->count == 0 || period <= 0) {
+            continue;
+        }
+        double expiry = heap->files[0]->time + period;
+        if (next == 0 || expiry < next) {
+            next = expiry;
+        }
+    }
+    return next;
+}
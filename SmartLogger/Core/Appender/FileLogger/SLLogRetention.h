@@ -0,0 +1,73 @@
+//
+//  SLLogRetention.h
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/12.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#ifndef SLLogRetention_h
+#define SLLogRetention_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if __cplusplus
+extern "C" {
+#endif
+
+// Retention index over the rolled log files of one directory.
+//
+// Every file has a rank, the most important level it contains (0 least important), and the time
+// of its last write. Files of one rank are kept in a min-heap by time, so with a fixed number of
+// ranks:
+//  - the next expired file is the oldest of one of the heaps (time + period of its rank <= now),
+//  - the next victim under quota is the oldest file of the lowest non-empty rank,
+// both found in O(1), added and removed in O(log n). Periods can change at any time, the order
+// inside a rank does not depend on them.
+//
+// The byte total is kept incrementally, nothing is rescanned. Not thread safe, plain C.
+#define SL_LOG_RETENTION_RANKS 4
+
+typedef struct SLLogRetentionFile_ {
+    uint64_t bytes;
+    double time;        // Last write, any clock as long as it is the same for all files
+    uint32_t rank;      // < SL_LOG_RETENTION_RANKS
+    uint32_t flags;     // Caller data, e.g. the levels found in the file
+    void *context;      // Caller data, e.g. the path
+    size_t heapIndex;
+} SLLogRetentionFile;
+
+typedef struct SLLogRetention_ SLLogRetention;
+
+SLLogRetention *SLLogRetentionCreate(void);
+// Frees the entries, not their context.
+void SLLogRetentionDestroy(SLLogRetention *retention);
+
+// 0 - files of this rank don't expire (default).
+void SLLogRetentionSetPeriod(SLLogRetention *retention, uint32_t rank, double period);
+double SLLogRetentionPeriod(const SLLogRetention *retention, uint32_t rank);
+
+// Returns NULL if memory is short. Ranks out of range are clamped.
+SLLogRetentionFile *SLLogRetentionAdd(SLLogRetention *retention, uint64_t bytes, double time,
+                                      uint32_t rank, uint32_t flags, void *context);
+// Frees the entry, its context is left to the caller.
+void SLLogRetentionRemove(SLLogRetention *retention, SLLogRetentionFile *file);
+// Size changed, e.g. compressed.
+void SLLogRetentionResize(SLLogRetention *retention, SLLogRetentionFile *file, uint64_t bytes);
+
+uint64_t SLLogRetentionBytes(const SLLogRetention *retention);
+size_t SLLogRetentionCount(const SLLogRetention *retention);
+
+// Oldest file whose period is over at `now`, NULL if none.
+SLLogRetentionFile *SLLogRetentionNextExpired(const SLLogRetention *retention, double now);
+// Oldest file of the lowest rank, NULL if empty.
+SLLogRetentionFile *SLLogRetentionNextVictim(const SLLogRetention *retention);
+// Earliest time a file expires, 0 if none ever does.
+double SLLogRetentionNextExpiry(const SLLogRetention *retention);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SLLogRetention_h */
@@ -7,6 +7,7 @@
 //
 
 #import "SLLogAppender.h"
+#import "SLLogLine.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
@@ -15,6 +16,8 @@ NS_ASSUME_NONNULL_BEGIN
 @public
     id <SLLogFormatter> _logFormatter;
     dispatch_queue_t _loggingQueue;
+    /// `_logFormatter` as seen by global logging queue, only accessed there
+    id <SLLogFormatter> _fanOutFormatter;
 }
 
 @property (nonatomic, strong, nullable) id <SLLogFormatter> logFormatter;
@@ -24,6 +27,14 @@ NS_ASSUME_NONNULL_BEGIN
 // thread safety
 @property (nonatomic, readonly, getter=isOnGlobalLoggingQueue)  BOOL onGlobalLoggingQueue;
 @property (nonatomic, readonly, getter=isOnInternalLoggerQueue) BOOL onInternalLoggerQueue;
+
+/**
+ * Message formatted by `logFormatter` and encoded as UTF-8. Shared with the other appenders
+ * using the same formatter if SLLogger rendered it before fan-out, otherwise rendered into a
+ * line owned by this appender. nil if the formatter dropped the message.
+ * Only on the appender's logging queue, valid until `logMessage:` returns.
+ */
+- (SLLogLine * __nullable)lineForLogMessage:(SLLogMessage *)logMessage;
 @end
 
 NS_ASSUME_NONNULL_END
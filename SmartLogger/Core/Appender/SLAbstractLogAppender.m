@@ -12,6 +12,9 @@
 #import "SLLogger.h"
 
 @implementation SLAbstractLogAppender
+{
+    SLLogLine *_line;
+}
 
 - (instancetype)init
 {
@@ -37,6 +40,19 @@
     // Override me
 }
 
+- (SLLogLine *)lineForLogMessage:(SLLogMessage *)logMessage
+{
+    SLLogLine *line = [logMessage lineForFormatter:_logFormatter];
+    if (line == nil) {
+        if (_line == nil) {
+            _line = [[SLLogLine alloc] init];
+        }
+        line = _line;
+        SLLogLineRender(line, logMessage, _logFormatter);
+    }
+    return line->_dropped ? nil : line;
+}
+
 - (id <SLLogFormatter>)logFormatter
 {
     // This method must be thread safe and intuitive.
@@ -72,8 +88,10 @@
         }
     };
     
+    // -[SLLogger mf_log:] reads its own copy on global queue, the appender queue is never waited on
     dispatch_queue_t globalLoggingQueue = [SLLogger globalLoggingQueue];
     dispatch_async(globalLoggingQueue, ^{
+        self->_fanOutFormatter = logFormatter;
         dispatch_async(self->_loggingQueue, block);
     });
 }
@@ -22,6 +22,7 @@
 /// for debugging
 @property (nonatomic, readonly) NSString *appenderName;
 
+/// Message is recycled after all appenders return, copy it if it must be kept
 - (void)logMessage:(SLLogMessage *)logMessage;
 
 @optional
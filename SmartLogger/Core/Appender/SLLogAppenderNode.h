@@ -8,6 +8,7 @@
 
 #import "SLLogAppender.h"
 #import "SLInterfaces.h"
+#import "SLLogMetrics.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
@@ -17,6 +18,9 @@ NS_ASSUME_NONNULL_BEGIN
     id <SLLogAppender> _appender;
     SLLogLevel _level;
     dispatch_queue_t _loggingQueue;
+    SLLogAppenderMetrics *_metrics;
+    /// SLAbstractLogAppender, its formatter can share lines with other appenders
+    BOOL _sharesLines;
 }
 
 @property (nonatomic, readonly) id <SLLogAppender> appender;
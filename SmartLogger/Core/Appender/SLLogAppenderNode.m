@@ -7,6 +7,7 @@
 //
 
 #import "SLLogAppenderNode.h"
+#import "SLAbstractLogAppender.h"
 
 @implementation SLLogAppenderNode
 
@@ -20,6 +21,8 @@
         }
         
         _level = level;
+        _metrics = SLLogMetricsForAppender(appender.appenderName);
+        _sharesLines = [appender isKindOfClass:[SLAbstractLogAppender class]];
     }
     return self;
 }
@@ -7,6 +7,8 @@
 //
 
 #import "SLInterfaces.h"
+#import "SLLogLabel.h"
+#import "SLLogLine.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
@@ -21,11 +23,27 @@ NS_ASSUME_NONNULL_BEGIN
     NSString *_function;
     NSUInteger _line;
     NSString *_tag;
-    NSDate *_timestamp;
+    /// Monotonic timestamp (SLLogClock.h), 0 for brief messages
+    uint64_t _ticks;
     NSString *_threadID;
     NSString *_threadName;
     NSString *_queueLabel;
     BOOL _noFormatter;
+    NSUInteger _sampleRate;
+    BOOL _pooled;
+    NSMutableString *_buffer;
+    const char *_binaryFormat;
+    NSMutableData *_payload;
+    /// NULL if label capacity is exhausted
+    SLLogLabel *_internedThreadName;
+    SLLogLabel *_internedQueueLabel;
+    /// Crash flush record, 0 if crash flush is not installed
+    uint64_t _crashSequence;
+    /// Lines shared by appenders, rendered on global logging queue before fan-out
+    SLLogLine *_lines[SL_LOG_LINE_SLOTS];
+    NSUInteger _lineCount;
+    /// Bytes charged to SLLogMemoryGovernor while queued, 0 if not charged
+    NSUInteger _memoryCost;
 }
 
 - (instancetype)init NS_DESIGNATED_INITIALIZER;
@@ -48,6 +66,65 @@ NS_ASSUME_NONNULL_BEGIN
 - (instancetype)initWithMessage:(NSString *)message
                             tag:(NSString * __nullable)tag NS_DESIGNATED_INITIALIZER;
 
+/**
+ * 日志热路径使用的可复用消息.
+ *
+ * 消息从线程本地的空闲链表中取出，message 直接格式化到消息自带的缓冲区;
+ * thread ID / thread name / queue label 每个线程只计算一次, file / function 按字面量地址缓存.
+ * 稳定状态下每次日志调用不需要额外的内存分配.
+ *
+ * 消息在所有 appender 处理完成后由 `-recycle` 归还，appender 如果需要在 `logMessage:` 之后
+ * 继续持有消息，必须 copy.
+ */
++ (instancetype)messageWithLevel:(SLLogLevel)level
+                            flag:(SLLogFlag)flag
+                            file:(const char *)file
+                        function:(const char * __nullable)function
+                            line:(NSUInteger)line
+                             tag:(NSString * __nullable)tag
+                          format:(NSString *)format
+                       arguments:(va_list)arguments;
+
+/**
+ * Same as above, arguments are captured by SLBinaryCapture (SLBinaryFormat.hpp) and
+ * formatted later by `-decodeBinaryPayload` on global logging queue.
+ *  @param format   printf style format literal
+ *  @param payload  captured arguments, copied into message
+ */
++ (instancetype)messageWithLevel:(SLLogLevel)level
+                            flag:(SLLogFlag)flag
+                            file:(const char *)file
+                        function:(const char * __nullable)function
+                            line:(NSUInteger)line
+                             tag:(NSString * __nullable)tag
+                    binaryFormat:(const char *)format
+                         payload:(const void *)payload
+                          length:(NSUInteger)length;
+
+/**
+ * Render binary payload into `message`, no-op for formatted messages.
+ */
+- (void)decodeBinaryPayload;
+
+/**
+ * Format and encode message once for all appenders using formatter, see SLLogLine.h.
+ * Only called on global logging queue before the message is handed to appenders.
+ *  @return NO if all slots are taken
+ */
+- (BOOL)renderLineForFormatter:(id <SLLogFormatter> __nullable)formatter;
+
+/**
+ * Line rendered by `-renderLineForFormatter:`, nil if there is none for formatter.
+ * Read only while appenders run, safe on any appender queue.
+ */
+- (SLLogLine * __nullable)lineForFormatter:(id <SLLogFormatter> __nullable)formatter;
+
+/**
+ * Return message to pool, no-op for messages not created by pool.
+ * Only called on global logging queue after all appenders are done.
+ */
+- (void)recycle;
+
 /**
  *  The log message
  */
@@ -59,11 +136,14 @@ NS_ASSUME_NONNULL_BEGIN
 @property (readonly, nonatomic) NSString * __nullable function;
 @property (readonly, nonatomic) NSUInteger line;
 @property (readonly, nonatomic) NSString * __nullable tag;
+/// Wall clock time of `_ticks`, a new date on every call
 @property (readonly, nonatomic) NSDate *timestamp;
 @property (readonly, nonatomic) NSString *threadID; // ID as it appears in NSLog calculated from the machThreadID
 @property (readonly, nonatomic) NSString *threadName;
 @property (readonly, nonatomic) NSString *queueLabel;
 @property (readonly, nonatomic) BOOL noFormatter;
+/// 1 - not sampled, N - only 1-in-N messages of this kind are kept under pressure
+@property (readonly, nonatomic) NSUInteger sampleRate;
 
 @end
 
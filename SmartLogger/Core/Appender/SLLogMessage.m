@@ -7,6 +7,10 @@
 //
 
 #import "SLLogMessage.h"
+#import "SLLogMetrics.h"
+#import "SLBinaryFormat.h"
+#import "SLLogLabel.h"
+#import "SLLogClock.h"
 
 #import <pthread.h>
 #import <dispatch/dispatch.h>
@@ -15,6 +19,7 @@
 #import <mach/host_info.h>
 #import <libkern/OSAtomic.h>
 #import <Availability.h>
+#import <stdatomic.h>
 #if TARGET_OS_IOS
 #import <UIKit/UIDevice.h>
 #endif
@@ -129,8 +134,234 @@ static __inline__ __attribute__((__always_inline__)) void _dispatch_queue_label_
 
 #endif /* if TARGET_OS_IOS */
 
+#pragma mark - Pool
+
+#define SL_MESSAGE_POOL_CAPACITY    1024    // Slightly above logger queue size
+#define SL_MESSAGE_THREAD_CACHE     32
+#define SL_MESSAGE_INLINE_CAPACITY  1024    // Bigger buffers are dropped on recycle
+#define SL_MESSAGE_INTERN_SLOTS     512     // Should be power of 2
+#define SL_MESSAGE_LABEL_MAX        64
+
+typedef struct SLLogMessageThreadState {
+    void *cache[SL_MESSAGE_THREAD_CACHE];   // Retained SLLogMessage
+    NSUInteger cacheCount;
+    CFStringRef threadID;
+    SLLogLabel *threadName;
+    char threadNameC[SL_MESSAGE_LABEL_MAX];
+    SLLogLabel *queueLabel;
+    const char *queueLabelC;
+    char queueLabelCopy[SL_MESSAGE_LABEL_MAX];
+} SLLogMessageThreadState;
+
+typedef struct SLLogMessageInternSlot {
+    _Atomic(const char *) key;  // Copy, never freed
+    _Atomic(void *) value;      // Retained NSString, never released
+} SLLogMessageInternSlot;
+
+static void *s_pool[SL_MESSAGE_POOL_CAPACITY];
+static NSUInteger s_poolCount = 0;
+static atomic_flag s_poolLock = ATOMIC_FLAG_INIT;
+
+static pthread_key_t s_threadKey;
+static __thread SLLogMessageThreadState *t_state = NULL;
+
+static SLLogMessageInternSlot s_fileNames[SL_MESSAGE_INTERN_SLOTS];
+static SLLogMessageInternSlot s_functions[SL_MESSAGE_INTERN_SLOTS];
+
+static void SLLogMessagePoolPush(void *message)
+{
+    BOOL pushed = NO;
+    while (atomic_flag_test_and_set_explicit(&s_poolLock, memory_order_acquire)) {}
+    if (s_poolCount < SL_MESSAGE_POOL_CAPACITY) {
+        s_pool[s_poolCount++] = message;
+        pushed = YES;
+    }
+    atomic_flag_clear_explicit(&s_poolLock, memory_order_release);
+
+    if (!pushed) {
+        CFRelease(message);
+    }
+}
+
+static void SLLogMessageThreadExit(void *value)
+{
+    SLLogMessageThreadState *state = (SLLogMessageThreadState *)value;
+    for (NSUInteger i = 0; i < state->cacheCount; i++) {
+        SLLogMessagePoolPush(state->cache[i]);
+    }
+    if (state->threadID) CFRelease(state->threadID);
+    // Later TLS destructors may still log, they get a fresh state
+    t_state = NULL;
+    free(state);
+}
+
+static SLLogMessageThreadState *SLLogMessageCurrentThreadState(void)
+{
+    SLLogMessageThreadState *state = t_state;
+    if (__builtin_expect(state != NULL, 1)) {
+        return state;
+    }
+
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        pthread_key_create(&s_threadKey, SLLogMessageThreadExit);
+    });
+
+    state = (SLLogMessageThreadState *)calloc(1, sizeof(SLLogMessageThreadState));
+    pthread_setspecific(s_threadKey, state);
+    t_state = state;
+
+    // Thread ID never changes
+    NSString *threadID;
+    if (USE_PTHREAD_THREADID_NP) {
+        __uint64_t tid;
+        pthread_threadid_np(NULL, &tid);
+        threadID = [[NSString alloc] initWithFormat:@"%llu", tid];
+    } else {
+        threadID = [[NSString alloc] initWithFormat:@"%x", pthread_mach_thread_np(pthread_self())];
+    }
+    state->threadID = (CFStringRef)CFBridgingRetain(threadID);
+    SLLogMetricsIncrement(SLLogCounterStringAllocations, 1);
+
+    return state;
+}
+
+/// Thread name may be changed at any time, pthread name is compared without allocation
+static void SLLogMessageSetThreadName(SLLogMessage *message, SLLogMessageThreadState *state)
+{
+    char name[SL_MESSAGE_LABEL_MAX];
+    if (pthread_getname_np(pthread_self(), name, sizeof(name)) != 0) {
+        name[0] = '\0';
+    }
+    if (state->threadName == NULL || strncmp(name, state->threadNameC, sizeof(name)) != 0) {
+        state->threadName = SLLogLabelIntern(name);
+        strlcpy(state->threadNameC, name, sizeof(state->threadNameC));
+    }
+    
+    if (state->threadName) {
+        message->_internedThreadName = state->threadName;
+        message->_threadName = state->threadName->string;
+    } else {
+        // Out of label capacity
+        message->_internedThreadName = NULL;
+        message->_threadName = [[NSString alloc] initWithUTF8String:name];
+        SLLogMetricsIncrement(SLLogCounterStringAllocations, 1);
+    }
+}
+
+static const char *SLLogMessageCurrentQueueLabel(void)
+{
+    const char *label = NULL;
+    if (USE_DISPATCH_CURRENT_QUEUE_LABEL) {
+        label = dispatch_queue_get_label(DISPATCH_CURRENT_QUEUE_LABEL);
+    } else if (USE_DISPATCH_GET_CURRENT_QUEUE) {
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdeprecated-declarations"
+        label = dispatch_queue_get_label(dispatch_get_current_queue());
+#pragma clang diagnostic pop
+    } else {
+        label = ""; // iOS 6.x only
+    }
+    return label ?: "";
+}
+
+static void SLLogMessageSetQueueLabel(SLLogMessage *message, SLLogMessageThreadState *state)
+{
+    const char *label = SLLogMessageCurrentQueueLabel();
+
+    // Label memory belongs to the queue, compare content as well as address
+    if (state->queueLabel == NULL ||
+        label != state->queueLabelC ||
+        strncmp(label, state->queueLabelCopy, sizeof(state->queueLabelCopy) - 1) != 0) {
+        state->queueLabel = SLLogLabelIntern(label);
+        state->queueLabelC = label;
+        strlcpy(state->queueLabelCopy, label, sizeof(state->queueLabelCopy));
+    }
+    
+    if (state->queueLabel) {
+        message->_internedQueueLabel = state->queueLabel;
+        message->_queueLabel = state->queueLabel->string;
+    } else {
+        message->_internedQueueLabel = NULL;
+        message->_queueLabel = [[NSString alloc] initWithUTF8String:label];
+        SLLogMetricsIncrement(SLLogCounterStringAllocations, 1);
+    }
+}
+
+/// "/path/File.m" -> "File", points into the key when the key is never freed
+static NSString *SLLogMessageCreateFileName(const char *file, BOOL persistent)
+{
+    const char *start = strrchr(file, '/');
+    start = start ? start + 1 : file;
+    const char *dot = strrchr(start, '.');
+    size_t length = dot ? (size_t)(dot - start) : strlen(start);
+    if (!persistent) {
+        return [[NSString alloc] initWithBytes:start length:length encoding:NSUTF8StringEncoding];
+    }
+    return [[NSString alloc] initWithBytesNoCopy:(void *)start
+                                          length:length
+                                        encoding:NSUTF8StringEncoding
+                                    freeWhenDone:NO];
+}
+
+static NSString *SLLogMessageCreateFunction(const char *function, BOOL persistent)
+{
+    (void)persistent;
+    return [[NSString alloc] initWithUTF8String:function];
+}
+
+/// Strings keyed by content, built once. +log: is public so file and function are not always
+/// literals, keys are copied and never freed.
+static NSString *SLLogMessageIntern(SLLogMessageInternSlot *slots, const char *cstr, NSString *(*create)(const char *, BOOL))
+{
+    if (cstr == NULL) {
+        return nil;
+    }
+
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (const char *c = cstr; *c; c++) {
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    }
+    NSUInteger index = (NSUInteger)hash & (SL_MESSAGE_INTERN_SLOTS - 1);
+
+    for (int probe = 0; probe < 8; probe++) {
+        SLLogMessageInternSlot *slot = &slots[(index + probe) & (SL_MESSAGE_INTERN_SLOTS - 1)];
+        const char *key = atomic_load_explicit(&slot->key, memory_order_acquire);
+        if (key == NULL) {
+            char *copy = strdup(cstr);
+            const char *expected = NULL;
+            if (copy && atomic_compare_exchange_strong(&slot->key, &expected, copy)) {
+                NSString *string = create(copy, YES);
+                SLLogMetricsIncrement(SLLogCounterStringAllocations, 1);
+                atomic_store_explicit(&slot->value, (void *)CFBridgingRetain(string), memory_order_release);
+                return string;
+            }
+            free(copy);
+            key = expected;
+            if (key == NULL) {
+                break; // Out of memory
+            }
+        }
+        if (strcmp(key, cstr) == 0) {
+            void *value = atomic_load_explicit(&slot->value, memory_order_acquire);
+            if (value) {
+                return (__bridge NSString *)value;
+            }
+            break; // Being published by another thread
+        }
+    }
+
+    SLLogMetricsIncrement(SLLogCounterStringAllocations, 1);
+    return create(cstr, NO);
+}
+
+#pragma mark - Init
+
 - (instancetype)init {
-    self = [super init];
+    if ((self = [super init])) {
+        _sampleRate = 1;
+    }
     return self;
 }
 
@@ -150,7 +381,9 @@ static __inline__ __attribute__((__always_inline__)) void _dispatch_queue_label_
         _function     = function;
         _line         = line;
         _tag          = tag;
-        _timestamp    = timestamp ?: [NSDate new];
+        _ticks        = timestamp ? SLLogClockTicksFromWallNanos((uint64_t)MAX(timestamp.timeIntervalSince1970 * NSEC_PER_SEC, 0.0))
+                                  : SLLogClockNow();
+        _sampleRate   = 1;
         
         if (USE_PTHREAD_THREADID_NP) {
             __uint64_t tid;
@@ -169,18 +402,10 @@ static __inline__ __attribute__((__always_inline__)) void _dispatch_queue_label_
             _fileName = [_fileName substringToIndex:dotLocation];
         }
         
-        // Try to get the current queue's label
-        if (USE_DISPATCH_CURRENT_QUEUE_LABEL) {
-            _queueLabel = [[NSString alloc] initWithFormat:@"%s", dispatch_queue_get_label(DISPATCH_CURRENT_QUEUE_LABEL)];
-        } else if (USE_DISPATCH_GET_CURRENT_QUEUE) {
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wdeprecated-declarations"
-            dispatch_queue_t currentQueue = dispatch_get_current_queue();
-#pragma clang diagnostic pop
-            _queueLabel = [[NSString alloc] initWithFormat:@"%s", dispatch_queue_get_label(currentQueue)];
-        } else {
-            _queueLabel = @""; // iOS 6.x only
-        }
+        // Try to get the current queue's label, interned so no string is built per message
+        const char *label = SLLogMessageCurrentQueueLabel();
+        _internedQueueLabel = SLLogLabelIntern(label);
+        _queueLabel = _internedQueueLabel ? _internedQueueLabel->string : [[NSString alloc] initWithUTF8String:label];
     }
     return self;
 }
@@ -192,14 +417,225 @@ static __inline__ __attribute__((__always_inline__)) void _dispatch_queue_label_
         _message = message;
         _tag = tag;
         _noFormatter = YES;
+        _sampleRate = 1;
     }
     return self;
 }
 
+static SLLogMessage *SLLogMessageDequeue(SLLogMessageThreadState *state)
+{
+    if (state->cacheCount == 0) {
+        // Refill half of the cache in one go
+        while (atomic_flag_test_and_set_explicit(&s_poolLock, memory_order_acquire)) {}
+        while (s_poolCount > 0 && state->cacheCount < SL_MESSAGE_THREAD_CACHE / 2) {
+            state->cache[state->cacheCount++] = s_pool[--s_poolCount];
+        }
+        atomic_flag_clear_explicit(&s_poolLock, memory_order_release);
+    }
+    
+    SLLogMessage *message;
+    if (state->cacheCount > 0) {
+        message = (SLLogMessage *)CFBridgingRelease(state->cache[--state->cacheCount]);
+    } else {
+        message = [[SLLogMessage alloc] init];
+        message->_pooled = YES;
+        SLLogMetricsIncrement(SLLogCounterMessageAllocations, 1);
+    }
+    
+    if (message->_buffer == nil) {
+        message->_buffer = [[NSMutableString alloc] initWithCapacity:128];
+        SLLogMetricsIncrement(SLLogCounterStringAllocations, 1);
+    }
+    CFMutableStringRef buffer = (__bridge CFMutableStringRef)message->_buffer;
+    CFStringDelete(buffer, CFRangeMake(0, CFStringGetLength(buffer)));
+    
+    return message;
+}
+
+static void SLLogMessageFill(SLLogMessage *message,
+                             SLLogMessageThreadState *state,
+                             SLLogLevel level,
+                             SLLogFlag flag,
+                             const char *file,
+                             const char *function,
+                             NSUInteger line,
+                             NSString *tag)
+{
+    message->_level         = level;
+    message->_flag          = flag;
+    message->_fileName      = SLLogMessageIntern(s_fileNames, file, SLLogMessageCreateFileName);
+    message->_file          = message->_fileName;
+    message->_function      = SLLogMessageIntern(s_functions, function, SLLogMessageCreateFunction);
+    message->_line          = line;
+    message->_tag           = tag;
+    message->_ticks         = SLLogClockNow();
+    message->_threadID      = (__bridge NSString *)state->threadID;
+    SLLogMessageSetThreadName(message, state);
+    SLLogMessageSetQueueLabel(message, state);
+    message->_noFormatter   = NO;
+    message->_sampleRate    = 1;
+    message->_crashSequence = 0;
+    message->_binaryFormat  = NULL;
+}
+
++ (instancetype)messageWithLevel:(SLLogLevel)level
+                            flag:(SLLogFlag)flag
+                            file:(const char *)file
+                        function:(const char *)function
+                            line:(NSUInteger)line
+                             tag:(NSString *)tag
+                          format:(NSString *)format
+                       arguments:(va_list)arguments {
+    SLLogMessageThreadState *state = SLLogMessageCurrentThreadState();
+    SLLogMessage *message = SLLogMessageDequeue(state);
+    
+    CFStringAppendFormatAndArguments((__bridge CFMutableStringRef)message->_buffer, NULL, (__bridge CFStringRef)format, arguments);
+    message->_message = message->_buffer;
+    SLLogMessageFill(message, state, level, flag, file, function, line, tag);
+    
+    return message;
+}
+
++ (instancetype)messageWithLevel:(SLLogLevel)level
+                            flag:(SLLogFlag)flag
+                            file:(const char *)file
+                        function:(const char *)function
+                            line:(NSUInteger)line
+                             tag:(NSString *)tag
+                    binaryFormat:(const char *)format
+                         payload:(const void *)payload
+                          length:(NSUInteger)length {
+    SLLogMessageThreadState *state = SLLogMessageCurrentThreadState();
+    SLLogMessage *message = SLLogMessageDequeue(state);
+    
+    if (message->_payload == nil) {
+        message->_payload = [[NSMutableData alloc] initWithCapacity:SL_BINARY_LOG_CAPACITY];
+        SLLogMetricsIncrement(SLLogCounterStringAllocations, 1);
+    }
+    [message->_payload setLength:0];
+    [message->_payload appendBytes:payload length:length];
+    
+    SLLogMessageFill(message, state, level, flag, file, function, line, tag);
+    message->_binaryFormat = format;
+    message->_message = message->_buffer;
+    
+    return message;
+}
+
+typedef struct SLLogMessageDecodeBuffer {
+    char *data;
+    size_t length;
+    size_t capacity;
+    BOOL onHeap;
+} SLLogMessageDecodeBuffer;
+
+static void SLLogMessageDecodeSink(void *context, const char *bytes, size_t length)
+{
+    SLLogMessageDecodeBuffer *buffer = (SLLogMessageDecodeBuffer *)context;
+    if (buffer->length + length + 1 > buffer->capacity) {
+        size_t capacity = MAX(buffer->capacity * 2, buffer->length + length + 1);
+        char *data = buffer->onHeap ? realloc(buffer->data, capacity) : malloc(capacity);
+        if (data == NULL) {
+            return;
+        }
+        if (!buffer->onHeap) {
+            memcpy(data, buffer->data, buffer->length);
+        }
+        buffer->data = data;
+        buffer->capacity = capacity;
+        buffer->onHeap = YES;
+        SLLogMetricsIncrement(SLLogCounterStringAllocations, 1);
+    }
+    memcpy(buffer->data + buffer->length, bytes, length);
+    buffer->length += length;
+}
+
+/// Render binary payload and append to string
+static void SLLogMessageRenderBinary(const char *format, NSData *payload, CFMutableStringRef string)
+{
+    char stack[SL_MESSAGE_INLINE_CAPACITY];
+    SLLogMessageDecodeBuffer buffer = { stack, 0, sizeof(stack), NO };
+    SLBinaryDecode(format, payload.bytes, payload.length, SLLogMessageDecodeSink, &buffer);
+    buffer.data[buffer.length] = '\0';
+    CFStringAppendCString(string, buffer.data, kCFStringEncodingUTF8);
+    if (buffer.onHeap) {
+        free(buffer.data);
+    }
+}
+
+- (void)decodeBinaryPayload {
+    if (_binaryFormat == NULL) {
+        return;
+    }
+    
+    CFMutableStringRef buffer = (__bridge CFMutableStringRef)_buffer;
+    CFStringDelete(buffer, CFRangeMake(0, CFStringGetLength(buffer)));
+    SLLogMessageRenderBinary(_binaryFormat, _payload, buffer);
+    _message = _buffer;
+    _binaryFormat = NULL;
+}
+
+- (BOOL)renderLineForFormatter:(id <SLLogFormatter>)formatter {
+    if (_lineCount == SL_LOG_LINE_SLOTS) {
+        return NO;
+    }
+    
+    // Line objects and their buffers stay with the pooled message
+    SLLogLine *line = _lines[_lineCount];
+    if (line == nil) {
+        line = [[SLLogLine alloc] init];
+        _lines[_lineCount] = line;
+    }
+    SLLogLineRender(line, self, formatter);
+    _lineCount++;
+    return YES;
+}
+
+- (SLLogLine *)lineForFormatter:(id <SLLogFormatter>)formatter {
+    for (NSUInteger i = 0; i < _lineCount; i++) {
+        if (_lines[i]->_formatter == formatter) {
+            return _lines[i];
+        }
+    }
+    return nil;
+}
+
+- (NSDate *)timestamp {
+    // Only built when asked for, producers just read the counter
+    return _ticks ? [NSDate dateWithTimeIntervalSince1970:SLLogClockWallSeconds(_ticks)] : nil;
+}
+
+- (void)recycle {
+    _lineCount = 0;
+    if (!_pooled) {
+        return;
+    }
+    
+    if (_buffer.length > SL_MESSAGE_INLINE_CAPACITY) {
+        // Oversized message, don't keep the big buffer around
+        _buffer = nil;
+    }
+    if (_payload.length > SL_BINARY_LOG_CAPACITY) {
+        _payload = nil;
+    }
+    _message = nil;
+    _tag = nil;
+    _ticks = 0;
+    
+    SLLogMessagePoolPush((void *)CFBridgingRetain(self));
+}
+
 - (id)copyWithZone:(NSZone * __attribute__((unused)))zone {
     SLLogMessage *newMessage = [SLLogMessage new];
     
-    newMessage->_message = _message;
+    // Pooled buffer is reused, copy is never pooled
+    if (_binaryFormat) {
+        NSMutableString *message = [NSMutableString string];
+        SLLogMessageRenderBinary(_binaryFormat, _payload, (__bridge CFMutableStringRef)message);
+        newMessage->_message = [message copy];
+    } else {
+        newMessage->_message = _message == _buffer ? [_message copy] : _message;
+    }
     newMessage->_level = _level;
     newMessage->_flag = _flag;
     newMessage->_file = _file;
@@ -207,11 +643,14 @@ static __inline__ __attribute__((__always_inline__)) void _dispatch_queue_label_
     newMessage->_function = _function;
     newMessage->_line = _line;
     newMessage->_tag = _tag;
-    newMessage->_timestamp = _timestamp;
+    newMessage->_ticks = _ticks;
     newMessage->_threadID = _threadID;
     newMessage->_threadName = _threadName;
     newMessage->_queueLabel = _queueLabel;
+    newMessage->_internedThreadName = _internedThreadName;
+    newMessage->_internedQueueLabel = _internedQueueLabel;
     newMessage->_noFormatter = _noFormatter;
+    newMessage->_sampleRate = _sampleRate;
     
     return newMessage;
 }
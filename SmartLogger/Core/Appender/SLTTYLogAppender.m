@@ -9,6 +9,8 @@
 #import "SLTTYLogAppender.h"
 #import "SLLogMessage.h"
 #import "SLLogFormatter.h"
+#import "SLLogClock.h"
+#import "SLLogMetrics.h"
 
 #import <unistd.h>
 #import <sys/uio.h>
@@ -21,6 +23,8 @@
     NSString *_processID;
     char *_pid;
     size_t _pidLen;
+    
+    SLLogAppenderMetrics *_metrics;
 }
 @end
 
@@ -93,65 +97,19 @@ static BOOL ttyAppenderEnable;
     if (!self.class.enable) {
         return;
     }
-    NSString *logMsg = logMessage->_message;
-    BOOL isFormatted = NO;
-    
-    if (_logFormatter) {
-        logMsg = [_logFormatter formatLogMessage:logMessage];
-        isFormatted = logMsg != logMessage->_message;
-    }
+    // Formatted and encoded once, shared with other appenders using the same formatter
+    SLLogLine *line = [self lineForLogMessage:logMessage];
     
-    if (logMsg) {
-        // Convert log message to C string.
-        //
-        // We use the stack instead of the heap for speed if possible.
-        // But we're extra cautious to avoid a stack overflow.
-        
-        NSUInteger msgLen = [logMsg lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
-        const BOOL useStack = msgLen < (1024 * 4);
-        
-        char msgStack[useStack ? (msgLen + 1) : 1]; // Analyzer doesn't like zero-size array, hence the 1
-        char *msg = useStack ? msgStack : (char *)malloc(msgLen + 1);
-        
-        if (msg == NULL) {
-            return;
-        }
-        
-        BOOL logMsgEnc = [logMsg getCString:msg maxLength:(msgLen + 1) encoding:NSUTF8StringEncoding];
-        
-        if (!logMsgEnc) {
-            if (!useStack && msg != NULL) {
-                free(msg);
-            }
-            
-            return;
-        }
+    if (line) {
+        const char *msg = line->_bytes;
+        BOOL isFormatted = line->_formatted;
         
         // Write the log message to STDERR
         
+        ssize_t written;
         if (isFormatted) {
             // The log message has already been formatted.
-            int iovec_len = (_automaticallyAppendNewlineForCustomFormatters) ? 5 : 4;
-            struct iovec v[iovec_len];
-            
-            v[0].iov_base = "";
-            v[0].iov_len = 0;
-            
-            v[1].iov_base = "";
-            v[1].iov_len = 0;
-            
-            v[iovec_len - 1].iov_base = "";
-            v[iovec_len - 1].iov_len = 0;
-            
-            v[2].iov_base = (char *)msg;
-            v[2].iov_len = msgLen;
-            
-            if (iovec_len == 5) {
-                v[3].iov_base = "\n";
-                v[3].iov_len = (msg[msgLen] == '\n') ? 0 : 1;
-            }
-            
-            writev(STDERR_FILENO, v, iovec_len);
+            written = write(STDERR_FILENO, msg, [line lengthWithNewline:_automaticallyAppendNewlineForCustomFormatters]);
         } else {
             // The log message is unformatted, so apply standard NSLog style formatting.
             
@@ -161,12 +119,12 @@ static BOOL ttyAppenderEnable;
             
             // Calculate timestamp.
             // The technique below is faster than using NSDateFormatter.
-            if (logMessage->_timestamp) {
-                NSTimeInterval epoch = [logMessage->_timestamp timeIntervalSince1970];
+            if (logMessage->_ticks) {
+                uint64_t epoch = SLLogClockWallNanos(logMessage->_ticks);
                 struct tm tm;
-                time_t time = (time_t)epoch;
+                time_t time = (time_t)(epoch / NSEC_PER_SEC);
                 (void)localtime_r(&time, &tm);
-                int milliseconds = (int)((epoch - floor(epoch)) * 1000.0);
+                int milliseconds = (int)(epoch / NSEC_PER_MSEC % 1000);
                 
                 len = snprintf(ts, 24, "%04d-%02d-%02d %02d:%02d:%02d:%03d", // yyyy-MM-dd HH:mm:ss:SSS
                                tm.tm_year + 1900,
@@ -229,17 +187,21 @@ static BOOL ttyAppenderEnable;
             v[9].iov_base = "] ";
             v[9].iov_len = 2;
             
+            // Line always ends with '\n'
             v[10].iov_base = (char *)msg;
-            v[10].iov_len = msgLen;
+            v[10].iov_len = line->_length;
             
-            v[11].iov_base = "\n";
-            v[11].iov_len = (msg[msgLen] == '\n') ? 0 : 1;
+            v[11].iov_base = "";
+            v[11].iov_len = 0;
             
-            writev(STDERR_FILENO, v, 13);
+            written = writev(STDERR_FILENO, v, 13);
         }
         
-        if (!useStack) {
-            free(msg);
+        if (written > 0) {
+            if (_metrics == NULL) {
+                _metrics = SLLogMetricsForAppender(self.appenderName);
+            }
+            __atomic_fetch_add(&_metrics->bytes, (uint64_t)written, __ATOMIC_RELAXED);
         }
     }
 }
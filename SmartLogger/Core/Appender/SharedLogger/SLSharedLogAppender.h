@@ -0,0 +1,47 @@
+//
+//  SLSharedLogAppender.h
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/9.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#import "SLAbstractLogAppender.h"
+#import "SLLogFileAppender.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * 多进程共享日志.
+ *
+ * App、Extension、辅助进程共用同一个 logsDirectory 时，每个进程的 file appender 都会
+ * 创建/删除日志文件，互相竞争，写出来的日志也是交错无序的.
+ *
+ * 使用共享 ring 之后，所有进程把格式化后的日志写入共享内存 ring 文件 (见 `SLSharedLogRing.h`),
+ * 只有被选举出来的 writer 进程把 ring 中的日志按顺序写入 `fileAppender` 的滚动日志文件.
+ * writer 退出或崩溃后，其他进程会在下一次 drain 时接管.
+ *
+ * 每行日志以 "[<process name>:<pid>] " 开头.
+ */
+@interface SLSharedLogAppender : SLAbstractLogAppender
+
+/**
+ *  @param ringPath     共享 ring 文件路径, 所有进程必须一致 (例如 App Group 容器)
+ *  @param fileAppender 只在 writer 进程里使用, 不要再添加到 SLLogger. formatter 会被清空,
+ *                      日志在写入 ring 之前已经格式化过
+ */
+- (nullable instancetype)initWithRingPath:(NSString *)ringPath
+                             fileAppender:(SLLogFileAppender *)fileAppender NS_DESIGNATED_INITIALIZER;
+- (instancetype)init NS_UNAVAILABLE;
+
+@property (nonatomic, strong, readonly) SLLogFileAppender *fileAppender;
+/// YES if this process currently drains the ring
+@property (atomic, readonly) BOOL isWriter;
+/// Default 0.2 seconds
+@property (nonatomic, assign) NSTimeInterval drainInterval;
+/// Records dropped because ring was full, all processes
+@property (nonatomic, readonly) uint64_t droppedCount;
+
+@end
+
+NS_ASSUME_NONNULL_END
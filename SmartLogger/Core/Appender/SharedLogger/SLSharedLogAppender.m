@@ -0,0 +1,175 @@
+//
+//  SLSharedLogAppender.m
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/9.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#import "SLSharedLogAppender.h"
+#import "SLSharedLogRing.h"
+#import "SLLogMessage.h"
+#import "SLLogFormatter.h"
+#import "SLLogMetrics.h"
+
+#define SL_SHARED_LINE_STACK_SIZE 2048
+/// A record reserved by a process that died is skipped after this
+#define SL_SHARED_STALL_TIMEOUT (2 * NSEC_PER_SEC)
+
+@interface SLSharedLogAppender ()
+@property (atomic, readwrite) BOOL isWriter;
+@end
+
+@implementation SLSharedLogAppender
+{
+    SLSharedLogRing *_ring;
+    /// "[process:pid] " in UTF-8
+    NSData *_prefix;
+    dispatch_source_t _drainTimer;
+    SLLogAppenderMetrics *_metrics;
+}
+
+- (instancetype)initWithRingPath:(NSString *)ringPath fileAppender:(SLLogFileAppender *)fileAppender
+{
+    if ((self = [super init])) {
+        _ring = SLSharedLogRingOpen(ringPath.fileSystemRepresentation, SL_SHARED_RING_DEFAULT_CAPACITY);
+        if (_ring == NULL) {
+            NSLog(@"SLSharedLogAppender: can't open ring %@, errno %d", ringPath, errno);
+            return nil;
+        }
+        _fileAppender = fileAppender;
+        _fileAppender.logFormatter = nil;
+        _prefix = [[NSString stringWithFormat:@"[%@:%d] ", NSProcessInfo.processInfo.processName, getpid()]
+                   dataUsingEncoding:NSUTF8StringEncoding];
+        _drainInterval = 0.2;
+        [self startDrainTimer];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    if (_drainTimer) {
+        dispatch_source_cancel(_drainTimer);
+    }
+    SLSharedLogRingClose(_ring);
+}
+
+#pragma mark - Producer
+
+- (void)logMessage:(SLLogMessage *)logMessage
+{
+    // Formatted and encoded once, shared with other appenders using the same formatter
+    SLLogLine *line = [self lineForLogMessage:logMessage];
+    if (line == nil) {
+        return;
+    }
+
+    // Single record without the newline, no intermediate NSString / NSData for common lengths
+    NSUInteger prefixLength = _prefix.length;
+    size_t length = prefixLength + [line lengthWithNewline:NO];
+    char stackBuffer[SL_SHARED_LINE_STACK_SIZE];
+    char *record = length <= sizeof(stackBuffer) ? stackBuffer : malloc(length);
+    if (record == NULL) {
+        return;
+    }
+    memcpy(record, _prefix.bytes, prefixLength);
+    memcpy(record + prefixLength, line->_bytes, length - prefixLength);
+    int status = SLSharedLogRingWrite(_ring, record, length);
+    if (record != stackBuffer) {
+        free(record);
+    }
+
+    // Dropped records when the ring is full are not counted
+    if (status == 0) {
+        if (_metrics == NULL) {
+            _metrics = SLLogMetricsForAppender(self.appenderName);
+        }
+        __atomic_fetch_add(&_metrics->bytes, length, __ATOMIC_RELAXED);
+    }
+}
+
+#pragma mark - Writer
+
+static void SLSharedLogAppenderSink(const char *data, size_t length, void *context)
+{
+    SLLogFileAppender *fileAppender = (__bridge SLLogFileAppender *)context;
+    NSString *line = [[NSString alloc] initWithBytes:data length:length encoding:NSUTF8StringEncoding];
+    if (line == nil) {
+        // Truncated in the middle of a multi-byte character
+        line = [[NSString alloc] initWithBytes:data length:length encoding:NSISOLatin1StringEncoding];
+    }
+    @autoreleasepool {
+        [fileAppender logMessage:[[SLLogMessage alloc] initWithMessage:line tag:@""]];
+    }
+}
+
+/// Runs on file appender's queue
+- (void)drain
+{
+    // Election is retried on every tick, the writer lock is dropped when its process dies
+    BOOL isWriter = SLSharedLogRingTryBecomeWriter(_ring) != 0;
+    if (isWriter != self.isWriter) {
+        self.isWriter = isWriter;
+    }
+    if (isWriter) {
+        SLSharedLogRingDrain(_ring, SLSharedLogAppenderSink, (__bridge void *)_fileAppender, SL_SHARED_STALL_TIMEOUT);
+    }
+}
+
+- (void)startDrainTimer
+{
+    __weak typeof(self) weakSelf = self;
+    _drainTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _fileAppender.loggingQueue);
+    dispatch_source_set_event_handler(_drainTimer, ^{ @autoreleasepool {
+        [weakSelf drain];
+    } });
+    dispatch_source_set_timer(_drainTimer,
+                              dispatch_time(DISPATCH_TIME_NOW, (int64_t)(_drainInterval * NSEC_PER_SEC)),
+                              (uint64_t)(_drainInterval * NSEC_PER_SEC),
+                              (uint64_t)(_drainInterval * NSEC_PER_SEC / 10));
+    dispatch_resume(_drainTimer);
+}
+
+- (void)setDrainInterval:(NSTimeInterval)drainInterval
+{
+    _drainInterval = MAX(drainInterval, 0.01);
+    dispatch_source_set_timer(_drainTimer,
+                              dispatch_time(DISPATCH_TIME_NOW, (int64_t)(_drainInterval * NSEC_PER_SEC)),
+                              (uint64_t)(_drainInterval * NSEC_PER_SEC),
+                              (uint64_t)(_drainInterval * NSEC_PER_SEC / 10));
+}
+
+- (uint64_t)droppedCount
+{
+    return SLSharedLogRingDropped(_ring);
+}
+
+#pragma mark - SLLogAppender
+
+- (void)flush
+{
+    dispatch_sync(_fileAppender.loggingQueue, ^{ @autoreleasepool {
+        [self drain];
+        if (self.isWriter) {
+            [self->_fileAppender flush];
+        }
+    } });
+}
+
+- (void)willRemoveAppender
+{
+    dispatch_source_cancel(_drainTimer);
+    dispatch_async(_fileAppender.loggingQueue, ^{ @autoreleasepool {
+        [self drain];
+        SLSharedLogRingResignWriter(self->_ring);
+        self.isWriter = NO;
+    } });
+}
+
+- (NSString *)appenderName
+{
+    return @"com.yy.athlog.sharedLogger";
+}
+
+@end
@@ -0,0 +1,371 @@
+//
+//  SLSharedLogRing.c
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/9.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#include "SLSharedLogRing.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#include <mach/mach_time.h>
+#endif
+
+#define SL_SHARED_RING_MAGIC 0x534C5247u      // "SLRG"
+#define SL_SHARED_RING_VERSION 1
+#define SL_SHARED_RING_HEADER_SIZE 4096     // Fixed, processes with different page sizes must agree
+#define SL_SHARED_RING_MIN_CAPACITY 4096
+
+#define SL_SHARED_RECORD_DATA 1u
+#define SL_SHARED_RECORD_PADDING 2u
+
+// Shared by all processes, lives at offset 0 of the file
+typedef struct SLSharedRingHeader_ {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+    uint64_t dropped;
+    uint32_t writerPid;
+    uint64_t head __attribute__((aligned(64)));     // Reserved up to, producers CAS
+    uint64_t tail __attribute__((aligned(64)));     // Drained up to, writer only
+} SLSharedRingHeader;
+
+typedef struct SLSharedRecord_ {
+    uint32_t header;    // 0 until published
+    uint32_t length;    // Payload bytes, stored right after reservation
+    char bytes[];
+} SLSharedRecord;
+
+// Process local
+struct SLSharedLogRing_ {
+    int fd;
+    int writerFd;
+    int isWriter;
+    size_t mappedSize;
+    SLSharedRingHeader *header;
+    char *data;
+    uint64_t capacity;
+    uint64_t mask;
+    uint64_t stallTail;
+    uint64_t stallSince;
+};
+
+static inline uint64_t sl_ring_now(void) {
+#ifdef __APPLE__
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0) {
+        mach_timebase_info(&timebase);
+    }
+    return mach_absolute_time() * timebase.numer / timebase.denom;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static inline uint64_t sl_ring_record_size(uint64_t length) {
+    return (sizeof(SLSharedRecord) + length + 7) & ~(uint64_t)7;
+}
+
+static inline SLSharedRecord *sl_ring_record_at(SLSharedLogRing *ring, uint64_t position) {
+    return (SLSharedRecord *)(ring->data + (position & ring->mask));
+}
+
+// Open / close
+
+// Creates an initialized ring next to `path` and renames it over `path`. Caller holds the lock
+// on the file being replaced.
+static int sl_ring_replace(const char *path, uint64_t capacity) {
+    char newPath[4096];
+    if (snprintf(newPath, sizeof(newPath), "%s.%d.new", path, (int)getpid()) >= (int)sizeof(newPath)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    int fd = open(newPath, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    SLSharedRingHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SL_SHARED_RING_MAGIC;
+    header.version = SL_SHARED_RING_VERSION;
+    header.capacity = capacity;
+    int result = -1;
+    if (ftruncate(fd, (off_t)(SL_SHARED_RING_HEADER_SIZE + capacity)) == 0 &&
+        pwrite(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+        rename(newPath, path) == 0) {
+        result = 0;
+    }
+    int error = errno;
+    close(fd);
+    if (result != 0) {
+        unlink(newPath);
+        errno = error;
+    }
+    return result;
+}
+
+SLSharedLogRing *SLSharedLogRingOpen(const char *path, size_t capacity) {
+    if (path == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    uint64_t size = SL_SHARED_RING_MIN_CAPACITY;
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    SLSharedLogRing *ring = (SLSharedLogRing *)calloc(1, sizeof(SLSharedLogRing));
+    if (ring == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    ring->writerFd = -1;
+
+    char writerPath[4096];
+    if (snprintf(writerPath, sizeof(writerPath), "%s.writer", path) >= (int)sizeof(writerPath)) {
+        free(ring);
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+
+    // Creation is serialized by a short exclusive lock on the ring file itself
+    struct stat st;
+    SLSharedRingHeader existing;
+    int valid;
+    for (;;) {
+        ring->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (ring->fd < 0) {
+            free(ring);
+            return NULL;
+        }
+        flock(ring->fd, LOCK_EX);
+        struct stat current;
+        if (fstat(ring->fd, &st) != 0 || stat(path, &current) != 0 ||
+            st.st_ino != current.st_ino || st.st_dev != current.st_dev) {
+            // Replaced while waiting for the lock, open the new one
+            flock(ring->fd, LOCK_UN);
+            close(ring->fd);
+            continue;
+        }
+        valid = (uint64_t)st.st_size >= SL_SHARED_RING_HEADER_SIZE &&
+                pread(ring->fd, &existing, sizeof(existing), 0) == (ssize_t)sizeof(existing) &&
+                existing.magic == SL_SHARED_RING_MAGIC &&
+                existing.version == SL_SHARED_RING_VERSION &&
+                existing.capacity >= SL_SHARED_RING_MIN_CAPACITY &&
+                (existing.capacity & (existing.capacity - 1)) == 0 &&
+                (uint64_t)st.st_size >= SL_SHARED_RING_HEADER_SIZE + existing.capacity;
+        if (valid || st.st_size == 0) {
+            break;
+        }
+        // Another version or garbage. Other processes may have it mapped without holding any
+        // lock, shrinking it would fault them: a new ring replaces the file, they keep the old one.
+        int replaced = sl_ring_replace(path, size);
+        int error = errno;
+        flock(ring->fd, LOCK_UN);
+        close(ring->fd);
+        if (replaced != 0) {
+            free(ring);
+            errno = error;
+            return NULL;
+        }
+    }
+    if (valid) {
+        size = existing.capacity;
+    } else if (ftruncate(ring->fd, (off_t)(SL_SHARED_RING_HEADER_SIZE + size)) != 0) {
+        // Just created, nobody else has mapped it
+        int error = errno;
+        flock(ring->fd, LOCK_UN);
+        close(ring->fd);
+        free(ring);
+        errno = error;
+        return NULL;
+    }
+
+    ring->mappedSize = (size_t)(SL_SHARED_RING_HEADER_SIZE + size);
+    void *base = mmap(NULL, ring->mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, 0);
+    if (base == MAP_FAILED) {
+        int error = errno;
+        flock(ring->fd, LOCK_UN);
+        close(ring->fd);
+        free(ring);
+        errno = error;
+        return NULL;
+    }
+    ring->header = (SLSharedRingHeader *)base;
+    ring->data = (char *)base + SL_SHARED_RING_HEADER_SIZE;
+    ring->capacity = size;
+    ring->mask = size - 1;
+
+    if (!valid) {
+        // Created empty above, data area is all zero
+        ring->header->version = SL_SHARED_RING_VERSION;
+        ring->header->capacity = size;
+        __atomic_store_n(&ring->header->magic, SL_SHARED_RING_MAGIC, __ATOMIC_RELEASE);
+    }
+    flock(ring->fd, LOCK_UN);
+
+    ring->writerFd = open(writerPath, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    return ring;
+}
+
+void SLSharedLogRingClose(SLSharedLogRing *ring) {
+    if (ring == NULL) {
+        return;
+    }
+    SLSharedLogRingResignWriter(ring);
+    if (ring->writerFd >= 0) {
+        close(ring->writerFd);
+    }
+    munmap(ring->header, ring->mappedSize);
+    close(ring->fd);
+    free(ring);
+}
+
+// Producer
+
+int SLSharedLogRingWrite(SLSharedLogRing *ring, const void *data, size_t length) {
+    SLSharedRingHeader *header = ring->header;
+    uint64_t maxLength = ring->capacity / 4 - sizeof(SLSharedRecord);
+    if (length > maxLength) {
+        length = (size_t)maxLength;
+    }
+    uint64_t need = sl_ring_record_size(length);
+
+    uint64_t head = __atomic_load_n(&header->head, __ATOMIC_RELAXED);
+    uint64_t padding;
+    for (;;) {
+        uint64_t tail = __atomic_load_n(&header->tail, __ATOMIC_ACQUIRE);
+        uint64_t offset = head & ring->mask;
+        // Never split a record across the end of the data area
+        padding = offset + need > ring->capacity ? ring->capacity - offset : 0;
+        if (head + padding + need - tail > ring->capacity) {
+            __atomic_fetch_add(&header->dropped, 1, __ATOMIC_RELAXED);
+            return -1;
+        }
+        if (__atomic_compare_exchange_n(&header->head, &head, head + padding + need,
+                                        1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    // Reserved space was zeroed by the writer before it advanced the tail
+    if (padding) {
+        SLSharedRecord *pad = sl_ring_record_at(ring, head);
+        __atomic_store_n(&pad->length, (uint32_t)(padding - sizeof(SLSharedRecord)), __ATOMIC_RELAXED);
+        __atomic_store_n(&pad->header, SL_SHARED_RECORD_PADDING, __ATOMIC_RELEASE);
+    }
+    SLSharedRecord *record = sl_ring_record_at(ring, head + padding);
+    __atomic_store_n(&record->length, (uint32_t)length, __ATOMIC_RELAXED);
+    memcpy(record->bytes, data, length);
+    __atomic_store_n(&record->header, SL_SHARED_RECORD_DATA, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// Writer
+
+int SLSharedLogRingTryBecomeWriter(SLSharedLogRing *ring) {
+    if (ring->isWriter) {
+        return 1;
+    }
+    if (ring->writerFd < 0 || flock(ring->writerFd, LOCK_EX | LOCK_NB) != 0) {
+        return 0;
+    }
+    ring->isWriter = 1;
+    ring->stallTail = UINT64_MAX;
+    __atomic_store_n(&ring->header->writerPid, (uint32_t)getpid(), __ATOMIC_RELAXED);
+    return 1;
+}
+
+void SLSharedLogRingResignWriter(SLSharedLogRing *ring) {
+    if (!ring->isWriter) {
+        return;
+    }
+    __atomic_store_n(&ring->header->writerPid, 0, __ATOMIC_RELAXED);
+    flock(ring->writerFd, LOCK_UN);
+    ring->isWriter = 0;
+}
+
+// Zeroes [tail, tail + size) so it can be reserved again, then publishes the new tail
+static void sl_ring_release(SLSharedLogRing *ring, uint64_t tail, uint64_t size) {
+    uint64_t offset = tail & ring->mask;
+    uint64_t first = size < ring->capacity - offset ? size : ring->capacity - offset;
+    memset(ring->data + offset, 0, (size_t)first);
+    if (size > first) {
+        memset(ring->data, 0, (size_t)(size - first));
+    }
+    __atomic_store_n(&ring->header->tail, tail + size, __ATOMIC_RELEASE);
+}
+
+long SLSharedLogRingDrain(SLSharedLogRing *ring, SLSharedLogRingSink sink, void *context, uint64_t stallTimeoutNanos) {
+    if (!ring->isWriter) {
+        return -1;
+    }
+
+    SLSharedRingHeader *header = ring->header;
+    uint64_t tail = __atomic_load_n(&header->tail, __ATOMIC_RELAXED);
+    long count = 0;
+
+    for (;;) {
+        uint64_t head = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+        if (tail == head) {
+            break;
+        }
+
+        SLSharedRecord *record = sl_ring_record_at(ring, tail);
+        uint32_t type = __atomic_load_n(&record->header, __ATOMIC_ACQUIRE);
+        uint64_t length = __atomic_load_n(&record->length, __ATOMIC_RELAXED);
+        uint64_t size = sl_ring_record_size(length);
+
+        if (type == 0) {
+            // Reserved, not published yet. Wait unless the producer is gone.
+            uint64_t now = sl_ring_now();
+            if (ring->stallTail != tail) {
+                ring->stallTail = tail;
+                ring->stallSince = now;
+                break;
+            }
+            if (now - ring->stallSince < stallTimeoutNanos) {
+                break;
+            }
+            if (length == 0 || size > head - tail) {
+                // Nothing tells how far to skip, discard everything pending
+                size = head - tail;
+            }
+        } else if (size > head - tail || (tail & ring->mask) + size > ring->capacity) {
+            // Corrupted, start over
+            size = head - tail;
+        } else if (type == SL_SHARED_RECORD_DATA) {
+            sink(record->bytes, (size_t)length, context);
+            count++;
+        }
+
+        sl_ring_release(ring, tail, size);
+        tail += size;
+    }
+    return count;
+}
+
+uint64_t SLSharedLogRingDropped(const SLSharedLogRing *ring) {
+    return __atomic_load_n(&ring->header->dropped, __ATOMIC_RELAXED);
+}
+
+size_t SLSharedLogRingPending(const SLSharedLogRing *ring) {
+    uint64_t head = __atomic_load_n(&ring->header->head, __ATOMIC_ACQUIRE);
+    uint64_t tail = __atomic_load_n(&ring->header->tail, __ATOMIC_ACQUIRE);
+    return (size_t)(head - tail);
+}
@@ -0,0 +1,77 @@
+//
+//  SLSharedLogRing.h
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/9.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#ifndef SLSharedLogRing_h
+#define SLSharedLogRing_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if __cplusplus
+extern "C" {
+#endif
+
+// Multi-process log ring in a shared memory mapped file.
+//
+// Any number of processes (app, extensions, helpers) open the same ring file and append
+// records. Space is reserved with a CAS on the shared head, so records from all processes are
+// totally ordered. A record is published by storing its header last; the reader stops at the
+// first record that is reserved but not yet published.
+//
+// Exactly one process drains the ring: the one holding an exclusive flock() on "<path>.writer".
+// The lock is released by the kernel when the writer exits or crashes, the next process that
+// calls SLSharedLogRingTryBecomeWriter() takes over.
+//
+// File layout:
+//   [header, one page][data, capacity bytes]
+// Records are 8 byte aligned: [uint32 header][uint32 length][bytes], header is 0 until
+// published. A padding record fills the end of the data area when a record would wrap.
+//
+// Plain C, no Foundation dependency.
+#define SL_SHARED_RING_DEFAULT_CAPACITY (1 << 20)
+
+typedef struct SLSharedLogRing_ SLSharedLogRing;
+
+// Creates or maps the ring file. `capacity` (rounded up to a power of 2) is only used when the
+// file is created, an existing ring keeps its capacity. A file that is not a ring of this version
+// is replaced by a new file, never rewritten in place: processes that still map it keep writing
+// to the old one. Returns NULL with errno set on failure.
+SLSharedLogRing *SLSharedLogRingOpen(const char *path, size_t capacity);
+
+// Unmaps the ring, releases the writer lock if held.
+void SLSharedLogRingClose(SLSharedLogRing *ring);
+
+// Appends one record, safe from any thread of any process. Records longer than a quarter of
+// the capacity are truncated. Returns 0, or -1 if the ring is full (record dropped and counted).
+int SLSharedLogRingWrite(SLSharedLogRing *ring, const void *data, size_t length);
+
+// Non blocking election. Returns 1 if this process is (or just became) the writer.
+int SLSharedLogRingTryBecomeWriter(SLSharedLogRing *ring);
+
+// Gives up the writer role, another process may take over.
+void SLSharedLogRingResignWriter(SLSharedLogRing *ring);
+
+typedef void (*SLSharedLogRingSink)(const char *data, size_t length, void *context);
+
+// Writer only: delivers published records in order and frees their space.
+// A record reserved by a process that died before publishing it blocks the ring, after
+// `stallTimeoutNanos` it is skipped (or, if even its length is unknown, everything pending
+// is discarded). Returns number of records delivered, -1 if not the writer.
+long SLSharedLogRingDrain(SLSharedLogRing *ring, SLSharedLogRingSink sink, void *context, uint64_t stallTimeoutNanos);
+
+// Records dropped because the ring was full, by all processes.
+uint64_t SLSharedLogRingDropped(const SLSharedLogRing *ring);
+
+// Bytes reserved but not yet drained.
+size_t SLSharedLogRingPending(const SLSharedLogRing *ring);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SLSharedLogRing_h */
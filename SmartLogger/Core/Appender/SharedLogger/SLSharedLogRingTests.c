@@ -0,0 +1,279 @@
+//
+//  SLSharedLogRingTests.c
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/9.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+// Linux test, see Makefile. Producers are forked processes sharing one ring file, drained
+// records go to a file opened with O_APPEND by whichever process is the writer at the time.
+
+#include "SLSharedLogRing.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define SL_TEST_PRODUCERS 8
+#define SL_TEST_MESSAGES 50000
+#define SL_TEST_KILLED 3            // Killed with SIGKILL while it is the writer
+#define SL_TEST_KILL_AFTER 20000
+#define SL_TEST_STALL_NS 100000000ull
+
+static int s_failures = 0;
+
+#define SL_EXPECT(condition, ...) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+        fprintf(stderr, __VA_ARGS__); \
+        fprintf(stderr, "\n"); \
+        s_failures++; \
+    } \
+} while (0)
+
+static void sl_test_sink(const char *data, size_t length, void *context) {
+    int fd = *(int *)context;
+    char line[128];
+    if (length >= sizeof(line)) {
+        length = sizeof(line) - 1;
+    }
+    memcpy(line, data, length);
+    line[length] = '\n';
+    // Single write, lines of writers that take over one another never interleave
+    if (write(fd, line, length + 1) != (ssize_t)(length + 1)) {
+        _exit(97);
+    }
+}
+
+static void sl_test_count(const char *data, size_t length, void *context) {
+    (void)data;
+    (void)length;
+    (*(long *)context)++;
+}
+
+// Drains as the writer if nobody else is, then gives the role up so it moves between processes
+static void sl_test_drain(SLSharedLogRing *ring, int outFd) {
+    if (SLSharedLogRingTryBecomeWriter(ring)) {
+        SLSharedLogRingDrain(ring, sl_test_sink, &outFd, SL_TEST_STALL_NS);
+        SLSharedLogRingResignWriter(ring);
+    }
+}
+
+static void sl_test_producer(const char *path, int outFd, int producer) {
+    SLSharedLogRing *ring = SLSharedLogRingOpen(path, 1 << 16);
+    if (ring == NULL) {
+        _exit(99);
+    }
+    for (int i = 0; i < SL_TEST_MESSAGES; i++) {
+        char message[64];
+        int length = snprintf(message, sizeof(message), "%d %d", producer, i);
+        // Retried when full, so every message arrives and order per producer can be checked
+        while (SLSharedLogRingWrite(ring, message, (size_t)length) != 0) {
+            sl_test_drain(ring, outFd);
+            usleep(50);
+        }
+        if (producer == SL_TEST_KILLED && i == SL_TEST_KILL_AFTER) {
+            // Dies holding the role, the flock goes with the process and another producer takes over
+            while (!SLSharedLogRingTryBecomeWriter(ring)) {
+                usleep(50);
+            }
+            SLSharedLogRingDrain(ring, sl_test_sink, &outFd, SL_TEST_STALL_NS);
+            raise(SIGKILL);
+        }
+        if ((i & 63) == 0) {
+            sl_test_drain(ring, outFd);
+        }
+    }
+    SLSharedLogRingClose(ring);
+    _exit(0);
+}
+
+// Every message of every producer arrives once, in order per producer, while the writer role
+// moves between processes and one writer is killed.
+static void sl_test_processes(const char *directory) {
+    char path[512], outPath[512];
+    snprintf(path, sizeof(path), "%s/stress.ring", directory);
+    snprintf(outPath, sizeof(outPath), "%s/stress.out", directory);
+    int outFd = open(outPath, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+
+    pid_t children[SL_TEST_PRODUCERS];
+    for (int p = 0; p < SL_TEST_PRODUCERS; p++) {
+        children[p] = fork();
+        if (children[p] == 0) {
+            sl_test_producer(path, outFd, p);
+        }
+    }
+    for (int p = 0; p < SL_TEST_PRODUCERS; p++) {
+        int status = 0;
+        waitpid(children[p], &status, 0);
+        if (p == SL_TEST_KILLED) {
+            SL_EXPECT(WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL, "producer %d status %#x", p, status);
+        } else {
+            SL_EXPECT(WIFEXITED(status) && WEXITSTATUS(status) == 0, "producer %d status %#x", p, status);
+        }
+    }
+
+    SLSharedLogRing *ring = SLSharedLogRingOpen(path, 0);
+    SL_EXPECT(ring != NULL && SLSharedLogRingTryBecomeWriter(ring), "final writer");
+    if (ring != NULL) {
+        SLSharedLogRingDrain(ring, sl_test_sink, &outFd, 0);
+        SL_EXPECT(SLSharedLogRingPending(ring) == 0, "pending %zu", SLSharedLogRingPending(ring));
+        SLSharedLogRingClose(ring);
+    }
+    close(outFd);
+
+    int last[SL_TEST_PRODUCERS];
+    for (int p = 0; p < SL_TEST_PRODUCERS; p++) {
+        last[p] = -1;
+    }
+    long total = 0, outOfOrder = 0;
+    int producer, index;
+    FILE *file = fopen(outPath, "r");
+    while (file != NULL && fscanf(file, "%d %d", &producer, &index) == 2) {
+        if (producer < 0 || producer >= SL_TEST_PRODUCERS || index != last[producer] + 1) {
+            outOfOrder++;
+            continue;
+        }
+        last[producer] = index;
+        total++;
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
+    SL_EXPECT(outOfOrder == 0, "%ld records out of order", outOfOrder);
+    for (int p = 0; p < SL_TEST_PRODUCERS; p++) {
+        if (p == SL_TEST_KILLED) {
+            SL_EXPECT(last[p] == SL_TEST_KILL_AFTER, "killed producer wrote up to %d", last[p]);
+        } else {
+            SL_EXPECT(last[p] == SL_TEST_MESSAGES - 1, "producer %d wrote up to %d", p, last[p]);
+        }
+    }
+
+    unlink(outPath);
+    unlink(path);
+    char writerPath[520];
+    snprintf(writerPath, sizeof(writerPath), "%s.writer", path);
+    unlink(writerPath);
+}
+
+// A writer killed while holding the role is replaced, the records it left are drained.
+static void sl_test_takeover(const char *directory) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/takeover.ring", directory);
+    int ready[2];
+    if (pipe(ready) != 0) {
+        SL_EXPECT(0, "pipe");
+        return;
+    }
+
+    pid_t writer = fork();
+    if (writer == 0) {
+        SLSharedLogRing *ring = SLSharedLogRingOpen(path, 0);
+        char result = ring != NULL && SLSharedLogRingTryBecomeWriter(ring) ? 'w' : '-';
+        for (int i = 0; ring != NULL && i < 5; i++) {
+            SLSharedLogRingWrite(ring, "pending", 7);
+        }
+        if (write(ready[1], &result, 1) != 1) {
+            _exit(97);
+        }
+        pause();
+        _exit(0);
+    }
+
+    char result = 0;
+    SL_EXPECT(read(ready[0], &result, 1) == 1 && result == 'w', "first process is not the writer");
+    SLSharedLogRing *ring = SLSharedLogRingOpen(path, 0);
+    SL_EXPECT(ring != NULL, "open");
+    if (ring == NULL) {
+        kill(writer, SIGKILL);
+        waitpid(writer, NULL, 0);
+        return;
+    }
+    SL_EXPECT(!SLSharedLogRingTryBecomeWriter(ring), "became writer while the writer is alive");
+    SL_EXPECT(SLSharedLogRingDrain(ring, sl_test_count, NULL, 0) == -1, "drained without the role");
+
+    kill(writer, SIGKILL);
+    waitpid(writer, NULL, 0);
+    SL_EXPECT(SLSharedLogRingTryBecomeWriter(ring), "no takeover after the writer was killed");
+    long count = 0;
+    SL_EXPECT(SLSharedLogRingDrain(ring, sl_test_count, &count, 0) == 5 && count == 5, "drained %ld", count);
+    SLSharedLogRingClose(ring);
+
+    close(ready[0]);
+    close(ready[1]);
+    unlink(path);
+    char writerPath[520];
+    snprintf(writerPath, sizeof(writerPath), "%s.writer", path);
+    unlink(writerPath);
+}
+
+// A ring of another version is replaced, a process still mapping the old file keeps working.
+static void sl_test_replace(const char *directory) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/replace.ring", directory);
+    size_t oldSize = 4096 + 4 * 4096;
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    SL_EXPECT(fd >= 0 && ftruncate(fd, (off_t)oldSize) == 0, "old ring");
+    // Magic "SLRG" with version 0
+    uint32_t oldHeader[2] = { 0x534C5247u, 0 };
+    SL_EXPECT(pwrite(fd, oldHeader, sizeof(oldHeader), 0) == (ssize_t)sizeof(oldHeader), "old header");
+    volatile char *old = (volatile char *)mmap(NULL, oldSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    SL_EXPECT(old != MAP_FAILED, "map old ring");
+    if (old == MAP_FAILED) {
+        close(fd);
+        return;
+    }
+
+    SLSharedLogRing *ring = SLSharedLogRingOpen(path, 0);
+    SL_EXPECT(ring != NULL, "open replaced ring");
+
+    // Faults with SIGBUS if the old file was truncated under the mapping
+    old[oldSize - 1] = 1;
+    SL_EXPECT(old[oldSize - 1] == 1, "old mapping");
+
+    if (ring != NULL) {
+        long count = 0;
+        SL_EXPECT(SLSharedLogRingWrite(ring, "new", 3) == 0, "write to new ring");
+        SL_EXPECT(SLSharedLogRingTryBecomeWriter(ring), "writer of new ring");
+        SL_EXPECT(SLSharedLogRingDrain(ring, sl_test_count, &count, 0) == 1, "drain new ring");
+        SLSharedLogRingClose(ring);
+    }
+    SLSharedLogRing *again = SLSharedLogRingOpen(path, 0);
+    struct stat st;
+    SL_EXPECT(again != NULL && stat(path, &st) == 0 && (size_t)st.st_size == 4096 + 4096,
+              "replaced ring is reused");
+    SLSharedLogRingClose(again);
+
+    munmap((void *)old, oldSize);
+    close(fd);
+    unlink(path);
+    char writerPath[520];
+    snprintf(writerPath, sizeof(writerPath), "%s.writer", path);
+    unlink(writerPath);
+}
+
+int main(void) {
+    char directory[] = "/tmp/sl-shared-ring-XXXXXX";
+    if (mkdtemp(directory) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    sl_test_takeover(directory);
+    sl_test_replace(directory);
+    sl_test_processes(directory);
+    rmdir(directory);
+
+    if (s_failures > 0) {
+        fprintf(stderr, "SLSharedLogRingTests: %d failures\n", s_failures);
+        return 1;
+    }
+    printf("SLSharedLogRingTests: ok\n");
+    return 0;
+}
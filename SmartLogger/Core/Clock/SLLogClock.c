@@ -0,0 +1,106 @@
+//
+//  SLLogClock.c
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/12.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#include "SLLogClock.h"
+
+#include <pthread.h>
+
+#define SL_CLOCK_SAMPLES 5      // Reads per calibration, the narrowest is kept
+
+static pthread_once_t s_once = PTHREAD_ONCE_INIT;
+static uint32_t s_numer = 1;
+static uint32_t s_denom = 1;
+
+static int64_t s_offset;
+static uint64_t s_calibrated;   // Ticks of the last calibration, 0 - never
+static uint64_t s_periodTicks;
+static int s_calibrating;
+
+static void SLLogClockInit(void) {
+#ifdef __APPLE__
+    mach_timebase_info_data_t timebase;
+    if (mach_timebase_info(&timebase) == KERN_SUCCESS && timebase.numer && timebase.denom) {
+        s_numer = timebase.numer;
+        s_denom = timebase.denom;
+    }
+#endif
+    s_periodTicks = SL_CLOCK_RECALIBRATE_NS / s_numer * s_denom + SL_CLOCK_RECALIBRATE_NS % s_numer * s_denom / s_numer;
+}
+
+uint64_t SLLogClockNanos(uint64_t ticks) {
+    pthread_once(&s_once, SLLogClockInit);
+    if (s_numer == s_denom) {
+        return ticks;
+    }
+    // Split so ticks * numer can't overflow (125/3 on arm64)
+    return ticks / s_denom * s_numer + ticks % s_denom * s_numer / s_denom;
+}
+
+static uint64_t SLLogClockTicks(uint64_t nanos) {
+    pthread_once(&s_once, SLLogClockInit);
+    if (s_numer == s_denom) {
+        return nanos;
+    }
+    return nanos / s_numer * s_denom + nanos % s_numer * s_denom / s_numer;
+}
+
+void SLLogClockRecalibrate(void) {
+    // Threads converting at the same time use the old offset meanwhile
+    if (__atomic_exchange_n(&s_calibrating, 1, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    // A read preempted between the two counter reads would be off by the preemption
+    uint64_t bestWindow = UINT64_MAX;
+    uint64_t bestTicks = 0;
+    uint64_t bestWall = 0;
+    for (int i = 0; i < SL_CLOCK_SAMPLES; i++) {
+        struct timespec ts;
+        uint64_t before = SLLogClockNow();
+        clock_gettime(CLOCK_REALTIME, &ts);
+        uint64_t after = SLLogClockNow();
+        if (after - before < bestWindow) {
+            bestWindow = after - before;
+            bestTicks = before + (after - before) / 2;
+            bestWall = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+        }
+    }
+    __atomic_store_n(&s_offset, (int64_t)(bestWall - SLLogClockNanos(bestTicks)), __ATOMIC_RELAXED);
+    __atomic_store_n(&s_calibrated, bestTicks ? bestTicks : 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&s_calibrating, 0, __ATOMIC_RELEASE);
+}
+
+int64_t SLLogClockOffset(void) {
+    uint64_t calibrated = __atomic_load_n(&s_calibrated, __ATOMIC_ACQUIRE);
+    if (calibrated == 0) {
+        SLLogClockRecalibrate();
+        // Another thread calibrating, wait for its offset
+        while (__atomic_load_n(&s_calibrated, __ATOMIC_ACQUIRE) == 0) {
+        }
+    }
+    return __atomic_load_n(&s_offset, __ATOMIC_RELAXED);
+}
+
+uint64_t SLLogClockWallNanos(uint64_t ticks) {
+    pthread_once(&s_once, SLLogClockInit);
+    uint64_t calibrated = __atomic_load_n(&s_calibrated, __ATOMIC_ACQUIRE);
+    if (calibrated != 0 && ticks > calibrated && ticks - calibrated > s_periodTicks) {
+        SLLogClockRecalibrate();
+    }
+    return (uint64_t)((int64_t)SLLogClockNanos(ticks) + SLLogClockOffset());
+}
+
+double SLLogClockWallSeconds(uint64_t ticks) {
+    uint64_t wall = SLLogClockWallNanos(ticks);
+    return (double)(wall / 1000000000ull) + (double)(wall % 1000000000ull) / 1e9;
+}
+
+uint64_t SLLogClockTicksFromWallNanos(uint64_t wallNanos) {
+    int64_t nanos = (int64_t)wallNanos - SLLogClockOffset();
+    // Before the counter started, clamp to its start
+    return nanos > 0 ? SLLogClockTicks((uint64_t)nanos) : 1;
+}
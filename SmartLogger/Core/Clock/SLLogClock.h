@@ -0,0 +1,82 @@
+//
+//  SLLogClock.h
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/12.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#ifndef SLLogClock_h
+#define SLLogClock_h
+
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __APPLE__
+#include <mach/mach_time.h>
+#endif
+
+#if __cplusplus
+extern "C" {
+#endif
+
+// Timestamps of log records: a 64-bit monotonic tick count taken on the producer thread, mapped
+// to wall clock time only when a record is formatted. Taking a timestamp is one read of the
+// system counter, no allocation, no system call.
+//
+// Ticks keep counting while the device sleeps: mach_continuous_time (cntvct based on arm64) on
+// Darwin, CLOCK_BOOTTIME on Linux, both read without entering the kernel. Before iOS 10
+// mach_absolute_time is used, which stops during sleep; recalibration catches up after wake.
+//
+// Wall clock time is ticks plus an offset sampled against CLOCK_REALTIME. The offset is
+// recalibrated lazily when a record more than SL_CLOCK_RECALIBRATE_NS after the last
+// calibration is converted, so clock changes (NTP, the user setting the time) show up within
+// that period, and right away with SLLogClockRecalibrate. Between calibrations the error is the
+// drift of the counter against the wall clock, a few µs per second at most.
+//
+// Plain C, builds on Linux as well.
+#define SL_CLOCK_RECALIBRATE_NS 1000000000ull
+
+// Current ticks. Only differences and SLLogClock conversions are meaningful.
+static inline uint64_t SLLogClockNow(void)
+{
+#ifdef __APPLE__
+    if (__builtin_available(iOS 10.0, macOS 10.12, tvOS 10.0, watchOS 3.0, *)) {
+        return mach_continuous_time();
+    }
+    return mach_absolute_time();
+#else
+    struct timespec ts;
+#ifdef CLOCK_BOOTTIME
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+// Tick count to nanoseconds, for durations.
+uint64_t SLLogClockNanos(uint64_t ticks);
+
+// Wall clock time of a timestamp, ns since 1970. Recalibrates if the offset is due.
+uint64_t SLLogClockWallNanos(uint64_t ticks);
+
+// Same as above in seconds, as NSDate's timeIntervalSince1970.
+double SLLogClockWallSeconds(uint64_t ticks);
+
+// Timestamp of a wall clock time, for records that come with their own time (spilled records,
+// imported logs). Converts back to the same time within a tick while the offset is unchanged.
+uint64_t SLLogClockTicksFromWallNanos(uint64_t wallNanos);
+
+// Samples the offset now. Called on system clock changes, cheap enough to call any time.
+void SLLogClockRecalibrate(void);
+
+// Offset in use, wall clock ns minus tick ns.
+int64_t SLLogClockOffset(void);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SLLogClock_h */
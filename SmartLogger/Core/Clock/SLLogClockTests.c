@@ -0,0 +1,123 @@
+//
+//  SLLogClockTests.c
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/12.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+// Linux test, see Makefile. Ticks are CLOCK_BOOTTIME there, wall time is checked against
+// CLOCK_REALTIME.
+
+#include "SLLogClock.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SL_TEST_DRIFT_SAMPLES 30            // 100 ms apart, several recalibration periods
+#define SL_TEST_MAX_DRIFT_NS 1000000        // 1 ms
+#define SL_TEST_MAX_AHEAD_NS 100000         // 100 µs
+#define SL_TEST_THREADS 4
+
+static int s_failures = 0;
+
+#define SL_EXPECT(condition, ...) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+        fprintf(stderr, __VA_ARGS__); \
+        fprintf(stderr, "\n"); \
+        s_failures++; \
+    } \
+} while (0)
+
+static uint64_t sl_test_realtime(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Wall time of a fresh timestamp stays within SL_TEST_MAX_DRIFT_NS of CLOCK_REALTIME over a
+// few seconds, including the conversions that recalibrate.
+static void sl_test_drift(void) {
+    int64_t worst = 0;
+    for (int i = 0; i < SL_TEST_DRIFT_SAMPLES; i++) {
+        struct timespec pause = { 0, 100000000 };
+        nanosleep(&pause, NULL);
+        uint64_t ticks = SLLogClockNow();
+        uint64_t realtime = sl_test_realtime();
+        int64_t drift = (int64_t)(SLLogClockWallNanos(ticks) - realtime);
+        drift = drift < 0 ? -drift : drift;
+        worst = drift > worst ? drift : worst;
+    }
+    SL_EXPECT(worst < SL_TEST_MAX_DRIFT_NS, "drift %lld ns", (long long)worst);
+}
+
+static void sl_test_round_trip(void) {
+    SLLogClockRecalibrate();
+    uint64_t wall = sl_test_realtime();
+    uint64_t back = SLLogClockWallNanos(SLLogClockTicksFromWallNanos(wall));
+    SL_EXPECT(back == wall, "round trip %llu -> %llu", (unsigned long long)wall, (unsigned long long)back);
+    SL_EXPECT(SLLogClockTicksFromWallNanos(0) == 1, "wall time before the counter started");
+
+    uint64_t start = SLLogClockNow();
+    struct timespec pause = { 0, 10000000 };
+    nanosleep(&pause, NULL);
+    uint64_t elapsed = SLLogClockNanos(SLLogClockNow() - start);
+    SL_EXPECT(elapsed >= 10000000 && elapsed < 1000000000, "10 ms measured as %llu ns", (unsigned long long)elapsed);
+
+    double seconds = SLLogClockWallSeconds(SLLogClockNow());
+    double expected = (double)sl_test_realtime() / 1e9;
+    SL_EXPECT(seconds <= expected && expected - seconds < 0.01, "wall seconds %.6f vs %.6f", seconds, expected);
+}
+
+static void *sl_test_convert(void *context) {
+    int64_t *ahead = (int64_t *)context;
+    for (int i = 0; i < 200000; i++) {
+        uint64_t wall = SLLogClockWallNanos(SLLogClockNow());
+        // Read after the timestamp, the conversion is only wrong if it comes out ahead
+        int64_t difference = (int64_t)(wall - sl_test_realtime());
+        *ahead = difference > *ahead ? difference : *ahead;
+    }
+    return NULL;
+}
+
+// Conversions on several threads while the offset is recalibrated, meant for SANITIZE=thread too.
+static void sl_test_concurrent(void) {
+    pthread_t threads[SL_TEST_THREADS];
+    int64_t ahead[SL_TEST_THREADS] = { 0 };
+    for (int i = 0; i < SL_TEST_THREADS; i++) {
+        pthread_create(&threads[i], NULL, sl_test_convert, &ahead[i]);
+    }
+    for (int i = 0; i < 1000; i++) {
+        SLLogClockRecalibrate();
+    }
+    for (int i = 0; i < SL_TEST_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        SL_EXPECT(ahead[i] < SL_TEST_MAX_AHEAD_NS, "thread %d ahead by %lld ns", i, (long long)ahead[i]);
+    }
+}
+
+static void sl_test_cost(void) {
+    const int count = 10000000;
+    volatile uint64_t sink = 0;
+    uint64_t start = sl_test_realtime();
+    for (int i = 0; i < count; i++) {
+        sink += SLLogClockNow();
+    }
+    printf("SLLogClockNow: %.1f ns\n", (double)(sl_test_realtime() - start) / count);
+}
+
+int main(void) {
+    sl_test_cost();
+    sl_test_drift();
+    sl_test_round_trip();
+    sl_test_concurrent();
+
+    if (s_failures > 0) {
+        fprintf(stderr, "SLLogClockTests: %d failures\n", s_failures);
+        return 1;
+    }
+    printf("SLLogClockTests: ok\n");
+    return 0;
+}
@@ -0,0 +1,279 @@
+//
+//  SLCrashFlush.c
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/8.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#include "SLCrashFlush.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SL_CRASH_ALT_STACK_SIZE (64 * 1024)
+
+typedef struct SLCrashRecord_ {
+    // sequence << 1 | pending, 0 while being written
+    uint64_t state;
+    uint32_t length;
+    char data[SL_CRASH_RECORD_SIZE];
+} SLCrashRecord;
+
+// Never freed: a producer that checked s_installed right before uninstall may still write into
+// it. Reinstalling with the same capacity reuses it, a different capacity leaks the old one.
+typedef struct SLCrashRing_ {
+    uint32_t mask;
+    SLCrashRecord records[];
+} SLCrashRing;
+
+static const int s_signals[] = { SIGSEGV, SIGBUS, SIGABRT, SIGILL, SIGFPE, SIGTRAP, SIGSYS };
+static const char *const s_signalNames[] = { "SIGSEGV", "SIGBUS", "SIGABRT", "SIGILL", "SIGFPE", "SIGTRAP", "SIGSYS" };
+#define SL_CRASH_SIGNAL_COUNT (sizeof(s_signals) / sizeof(s_signals[0]))
+
+static struct sigaction s_previous[SL_CRASH_SIGNAL_COUNT];
+static SLCrashRing *s_ring = NULL;
+static uint64_t s_next = 0;
+static int s_fd = -1;
+static int s_installed = 0;
+static int s_flushed = 0;
+static void *s_altStack = NULL;
+
+// Async-signal-safe helpers
+
+static int sl_crash_signal_index(int signal) {
+    for (size_t i = 0; i < SL_CRASH_SIGNAL_COUNT; i++) {
+        if (s_signals[i] == signal) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static void sl_crash_write_all(int fd, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+}
+
+static void sl_crash_write_string(int fd, const char *string) {
+    sl_crash_write_all(fd, string, strlen(string));
+}
+
+static void sl_crash_write_uint(int fd, uint64_t value) {
+    char buffer[24];
+    size_t i = sizeof(buffer);
+    do {
+        buffer[--i] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    sl_crash_write_all(fd, buffer + i, sizeof(buffer) - i);
+}
+
+// Handler
+
+static void sl_crash_restore(int index) {
+    sigaction(s_signals[index], &s_previous[index], NULL);
+}
+
+static void sl_crash_signal_handler(int signal, siginfo_t *info, void *context) {
+    (void)context;
+    int savedErrno = errno;
+
+    SLCrashFlushWrite(signal);
+
+    int index = sl_crash_signal_index(signal);
+    if (index >= 0) {
+        sl_crash_restore(index);
+    }
+    errno = savedErrno;
+
+    // Hardware faults re-fault on return and reach the previous handler with the original
+    // siginfo. Signals sent by abort()/kill() have to be raised again.
+    if (info == NULL || info->si_code <= 0 || signal == SIGABRT) {
+        raise(signal);
+    }
+}
+
+int SLCrashFlushWrite(int signal) {
+    if (!__atomic_load_n(&s_installed, __ATOMIC_ACQUIRE) ||
+        __atomic_exchange_n(&s_flushed, 1, __ATOMIC_ACQ_REL)) {
+        return -1;
+    }
+
+    int fd = s_fd;
+    int index = sl_crash_signal_index(signal);
+    sl_crash_write_string(fd, "\n=== SmartLogger crash flush: signal ");
+    sl_crash_write_uint(fd, (uint64_t)signal);
+    if (index >= 0) {
+        sl_crash_write_string(fd, " (");
+        sl_crash_write_string(fd, s_signalNames[index]);
+        sl_crash_write_string(fd, ")");
+    }
+    sl_crash_write_string(fd, " ===\n");
+
+    // Slots follow sequence order, start right after the newest one to write oldest first.
+    // Other threads may still be logging, a record rewritten meanwhile can come out torn.
+    SLCrashRing *ring = __atomic_load_n(&s_ring, __ATOMIC_ACQUIRE);
+    uint64_t next = __atomic_load_n(&s_next, __ATOMIC_ACQUIRE);
+    int count = 0;
+    for (uint32_t i = 1; i <= ring->mask + 1; i++) {
+        SLCrashRecord *record = &ring->records[(next + i) & ring->mask];
+        uint64_t state = __atomic_load_n(&record->state, __ATOMIC_ACQUIRE);
+        if ((state & 1) == 0) {
+            continue;
+        }
+        uint32_t length = record->length;
+        if (length > SL_CRASH_RECORD_SIZE) {
+            length = SL_CRASH_RECORD_SIZE;
+        }
+        sl_crash_write_all(fd, record->data, length);
+        if (length == 0 || record->data[length - 1] != '\n') {
+            sl_crash_write_all(fd, "\n", 1);
+        }
+        count++;
+    }
+
+    sl_crash_write_string(fd, "=== SmartLogger crash flush end: ");
+    sl_crash_write_uint(fd, (uint64_t)count);
+    sl_crash_write_string(fd, " records ===\n");
+    fsync(fd);
+    return count;
+}
+
+// Producer / consumer
+
+int SLCrashFlushEnabled(void) {
+    return __atomic_load_n(&s_installed, __ATOMIC_RELAXED);
+}
+
+char *SLCrashRecordBegin(uint64_t *sequence) {
+    if (!__atomic_load_n(&s_installed, __ATOMIC_ACQUIRE)) {
+        *sequence = 0;
+        return NULL;
+    }
+    SLCrashRing *ring = __atomic_load_n(&s_ring, __ATOMIC_ACQUIRE);
+    uint64_t current = __atomic_add_fetch(&s_next, 1, __ATOMIC_ACQ_REL);
+    SLCrashRecord *record = &ring->records[current & ring->mask];
+    __atomic_store_n(&record->state, 0, __ATOMIC_RELEASE);
+    *sequence = current;
+    return record->data;
+}
+
+void SLCrashRecordCommit(uint64_t sequence, size_t length) {
+    if (sequence == 0) {
+        return;
+    }
+    SLCrashRing *ring = __atomic_load_n(&s_ring, __ATOMIC_ACQUIRE);
+    SLCrashRecord *record = &ring->records[sequence & ring->mask];
+    record->length = (uint32_t)(length < SL_CRASH_RECORD_SIZE ? length : SL_CRASH_RECORD_SIZE);
+    __atomic_store_n(&record->state, (sequence << 1) | 1, __ATOMIC_RELEASE);
+}
+
+void SLCrashRecordComplete(uint64_t sequence) {
+    SLCrashRing *ring = __atomic_load_n(&s_ring, __ATOMIC_ACQUIRE);
+    if (sequence == 0 || ring == NULL) {
+        return;
+    }
+    // Slot may already be reused by a newer record, leave it alone then
+    uint64_t expected = (sequence << 1) | 1;
+    __atomic_compare_exchange_n(&ring->records[sequence & ring->mask].state, &expected, sequence << 1,
+                                0, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+// Install
+
+int SLCrashFlushInstall(const char *path, uint32_t capacity) {
+    if (s_installed) {
+        errno = EBUSY;
+        return -1;
+    }
+    if (path == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    uint32_t size = 1;
+    capacity = capacity ? capacity : SL_CRASH_RECORD_CAPACITY;
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    SLCrashRing *ring = s_ring;
+    if (ring != NULL && ring->mask == size - 1) {
+        // Records of the previous install are not flushed
+        for (uint32_t i = 0; i < size; i++) {
+            __atomic_store_n(&ring->records[i].state, 0, __ATOMIC_RELAXED);
+        }
+    } else {
+        ring = (SLCrashRing *)calloc(1, sizeof(SLCrashRing) + (size_t)size * sizeof(SLCrashRecord));
+        if (ring == NULL) {
+            close(fd);
+            errno = ENOMEM;
+            return -1;
+        }
+        ring->mask = size - 1;
+    }
+
+    __atomic_store_n(&s_ring, ring, __ATOMIC_RELEASE);
+    s_fd = fd;
+    s_flushed = 0;
+
+    // Stack overflow needs an alternate stack, only for this thread
+    stack_t current;
+    if (sigaltstack(NULL, &current) == 0 && (current.ss_flags & SS_DISABLE)) {
+        s_altStack = malloc(SL_CRASH_ALT_STACK_SIZE);
+        if (s_altStack) {
+            stack_t stack;
+            memset(&stack, 0, sizeof(stack));
+            stack.ss_sp = s_altStack;
+            stack.ss_size = SL_CRASH_ALT_STACK_SIZE;
+            if (sigaltstack(&stack, NULL) != 0) {
+                free(s_altStack);
+                s_altStack = NULL;
+            }
+        }
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = sl_crash_signal_handler;
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigemptyset(&action.sa_mask);
+    for (size_t i = 0; i < SL_CRASH_SIGNAL_COUNT; i++) {
+        sigaction(s_signals[i], &action, &s_previous[i]);
+    }
+
+    __atomic_store_n(&s_installed, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void SLCrashFlushUninstall(void) {
+    if (!s_installed) {
+        return;
+    }
+    __atomic_store_n(&s_installed, 0, __ATOMIC_RELEASE);
+    for (size_t i = 0; i < SL_CRASH_SIGNAL_COUNT; i++) {
+        sl_crash_restore((int)i);
+    }
+    close(s_fd);
+    s_fd = -1;
+    // The ring is kept, see SLCrashRing. The alternate stack stays installed for this thread, it is tiny and may be in use by
+    // another handler registered later.
+}
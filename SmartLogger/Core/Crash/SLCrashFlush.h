@@ -0,0 +1,70 @@
+//
+//  SLCrashFlush.h
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/8.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#ifndef SLCrashFlush_h
+#define SLCrashFlush_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if __cplusplus
+extern "C" {
+#endif
+
+// Crash flush of in-flight log records.
+//
+// Producers copy each record into a preallocated ring before it is queued, the logging queue
+// marks it complete once every appender has written it. On a fatal signal the handler writes
+// the records that are still pending, oldest first, straight to a file descriptor opened at
+// install time, followed by an end marker:
+//
+//   === SmartLogger crash flush: signal 11 (SIGSEGV) ===
+//   <pending records, one per line>
+//   === SmartLogger crash flush end: 3 records ===
+//
+// The handler only uses async-signal-safe calls (write, sigaction, raise), no allocation,
+// no locks, no Objective-C. Previous handlers are restored and the signal is re-raised, so
+// other crash reporters still run.
+//
+// Plain C, no Foundation dependency.
+#define SL_CRASH_RECORD_SIZE 512            // Bytes per record, longer records are truncated
+#define SL_CRASH_RECORD_CAPACITY 1024       // Default number of records, power of 2
+
+// Installs signal handlers (SIGSEGV, SIGBUS, SIGABRT, SIGILL, SIGFPE, SIGTRAP, SIGSYS) and
+// opens `path` for appending. `capacity` is rounded up to a power of 2, 0 uses the default.
+// An alternate signal stack is installed for the calling thread so stack overflows there
+// can still be flushed. Returns 0 on success, -1 with errno set otherwise.
+int SLCrashFlushInstall(const char *path, uint32_t capacity);
+
+// Restores previous handlers and closes the file. Producers racing with it write into the
+// ring, which stays allocated, and their records are not flushed.
+void SLCrashFlushUninstall(void);
+
+// Non zero once installed. Cheap, producers check it before formatting.
+int SLCrashFlushEnabled(void);
+
+// Reserves a record, returns its buffer (SL_CRASH_RECORD_SIZE bytes) and stores the sequence
+// in `sequence`. Returns NULL, sequence 0, if not installed.
+char *SLCrashRecordBegin(uint64_t *sequence);
+
+// Publishes `length` bytes written into the reserved buffer as pending.
+void SLCrashRecordCommit(uint64_t sequence, size_t length);
+
+// Record was written by appenders, it is no longer flushed on crash. 0 is ignored.
+void SLCrashRecordComplete(uint64_t sequence);
+
+// Writes pending records and markers to the crash fd, as the signal handler does.
+// Async-signal-safe, runs at most once per install. Returns number of records written,
+// -1 if not installed or already flushed.
+int SLCrashFlushWrite(int signal);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SLCrashFlush_h */
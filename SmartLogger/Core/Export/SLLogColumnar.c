@@ -0,0 +1,852 @@
+//
+//  SLLogColumnar.c
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/12.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#include "SLLogColumnar.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#define SL_COLUMNAR_MAGIC "SLCF"
+#define SL_COLUMNAR_VERSION 1
+#define SL_COLUMNAR_CHUNK_HEADER 9
+#define SL_COLUMNAR_GROUP_ENTRY (4 + 8 + 8 + SLLogColumnCount * 12)
+#define SL_COLUMNAR_MAX_GROUP_BYTES (8 * 1024 * 1024)  // Message bytes per row group
+#define SL_COLUMNAR_READ_CHUNK (64 * 1024)
+#define SL_COLUMNAR_TIMESTAMP_LENGTH 30                 // "2019-09-12 10:00:00:123(+0800)"
+
+static int sl_column_is_string(int column) {
+    return column == SLLogColumnProcess || column == SLLogColumnThread || column == SLLogColumnFile ||
+           column == SLLogColumnTag || column == SLLogColumnMessage;
+}
+
+// Buffers
+
+typedef struct SLColBuffer_ {
+    uint8_t *data;
+    size_t length;
+    size_t capacity;
+} SLColBuffer;
+
+static int sl_buffer_reserve(SLColBuffer *buffer, size_t extra) {
+    if (buffer->length + extra <= buffer->capacity) {
+        return 0;
+    }
+    size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+    while (capacity < buffer->length + extra) {
+        capacity *= 2;
+    }
+    uint8_t *data = (uint8_t *)realloc(buffer->data, capacity);
+    if (data == NULL) {
+        return -1;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return 0;
+}
+
+static int sl_buffer_append(SLColBuffer *buffer, const void *data, size_t length) {
+    if (sl_buffer_reserve(buffer, length) != 0) {
+        return -1;
+    }
+    if (length > 0) {
+        memcpy(buffer->data + buffer->length, data, length);
+    }
+    buffer->length += length;
+    return 0;
+}
+
+static int sl_buffer_varint(SLColBuffer *buffer, uint64_t value) {
+    if (sl_buffer_reserve(buffer, 10) != 0) {
+        return -1;
+    }
+    while (value >= 0x80) {
+        buffer->data[buffer->length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    buffer->data[buffer->length++] = (uint8_t)value;
+    return 0;
+}
+
+static int sl_buffer_le(SLColBuffer *buffer, uint64_t value, int bytes) {
+    if (sl_buffer_reserve(buffer, (size_t)bytes) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < bytes; i++) {
+        buffer->data[buffer->length++] = (uint8_t)(value >> (i * 8));
+    }
+    return 0;
+}
+
+static uint64_t sl_load_le(const uint8_t *data, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= (uint64_t)data[i] << (i * 8);
+    }
+    return value;
+}
+
+static int sl_read_varint(const uint8_t **position, const uint8_t *end, uint64_t *value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (*position >= end) {
+            return -1;
+        }
+        uint8_t byte = *(*position)++;
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Dictionary, reset per row group
+
+typedef struct SLColEntry_ {
+    uint32_t offset;
+    uint32_t length;
+    uint32_t hash;
+} SLColEntry;
+
+typedef struct SLColDict_ {
+    SLColBuffer bytes;
+    SLColEntry *entries;
+    uint32_t count;
+    uint32_t entryCapacity;
+    uint32_t *slots;            // id + 1, 0 if empty
+    uint32_t slotCapacity;
+} SLColDict;
+
+static uint32_t sl_dict_hash(const char *string, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (uint8_t)string[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static int sl_dict_grow(SLColDict *dict) {
+    uint32_t capacity = dict->slotCapacity ? dict->slotCapacity * 2 : 256;
+    uint32_t *slots = (uint32_t *)calloc(capacity, sizeof(uint32_t));
+    if (slots == NULL) {
+        return -1;
+    }
+    for (uint32_t id = 0; id < dict->count; id++) {
+        uint32_t index = dict->entries[id].hash & (capacity - 1);
+        while (slots[index]) {
+            index = (index + 1) & (capacity - 1);
+        }
+        slots[index] = id + 1;
+    }
+    free(dict->slots);
+    dict->slots = slots;
+    dict->slotCapacity = capacity;
+    return 0;
+}
+
+static int64_t sl_dict_intern(SLColDict *dict, const char *string, size_t length) {
+    if ((dict->count + 1) * 2 > dict->slotCapacity && sl_dict_grow(dict) != 0) {
+        return -1;
+    }
+    uint32_t hash = sl_dict_hash(string, length);
+    uint32_t index = hash & (dict->slotCapacity - 1);
+    while (dict->slots[index]) {
+        const SLColEntry *entry = &dict->entries[dict->slots[index] - 1];
+        if (entry->hash == hash && entry->length == length &&
+            memcmp(dict->bytes.data + entry->offset, string, length) == 0) {
+            return dict->slots[index] - 1;
+        }
+        index = (index + 1) & (dict->slotCapacity - 1);
+    }
+
+    if (dict->count == dict->entryCapacity) {
+        uint32_t capacity = dict->entryCapacity ? dict->entryCapacity * 2 : 128;
+        SLColEntry *entries = (SLColEntry *)realloc(dict->entries, capacity * sizeof(SLColEntry));
+        if (entries == NULL) {
+            return -1;
+        }
+        dict->entries = entries;
+        dict->entryCapacity = capacity;
+    }
+    SLColEntry *entry = &dict->entries[dict->count];
+    entry->offset = (uint32_t)dict->bytes.length;
+    entry->length = (uint32_t)length;
+    entry->hash = hash;
+    if (sl_buffer_append(&dict->bytes, string, length) != 0) {
+        return -1;
+    }
+    dict->slots[index] = ++dict->count;
+    return dict->count - 1;
+}
+
+static void sl_dict_reset(SLColDict *dict) {
+    dict->bytes.length = 0;
+    dict->count = 0;
+    if (dict->slots) {
+        memset(dict->slots, 0, dict->slotCapacity * sizeof(uint32_t));
+    }
+}
+
+static void sl_dict_free(SLColDict *dict) {
+    free(dict->bytes.data);
+    free(dict->entries);
+    free(dict->slots);
+}
+
+// Line parsing
+
+static int sl_digits(const char *p, int count, int *value) {
+    *value = 0;
+    for (int i = 0; i < count; i++) {
+        if (p[i] < '0' || p[i] > '9') {
+            return -1;
+        }
+        *value = *value * 10 + (p[i] - '0');
+    }
+    return 0;
+}
+
+static int64_t sl_days_from_civil(int year, int month, int day) {
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    int64_t yearOfEra = year - era * 400;
+    int64_t dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int64_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
+}
+
+// "yyyy-MM-dd HH:mm:ss:SSS(Z)" of SLLogQueueFormatter
+static int sl_parse_timestamp(const char *p, size_t length, int64_t *milliseconds) {
+    if (length < SL_COLUMNAR_TIMESTAMP_LENGTH || p[4] != '-' || p[7] != '-' || p[10] != ' ' ||
+        p[13] != ':' || p[16] != ':' || p[19] != ':' || p[23] != '(' || p[29] != ')' ||
+        (p[24] != '+' && p[24] != '-')) {
+        return -1;
+    }
+    int year, month, day, hour, minute, second, millisecond, zoneHours, zoneMinutes;
+    if (sl_digits(p, 4, &year) || sl_digits(p + 5, 2, &month) || sl_digits(p + 8, 2, &day) ||
+        sl_digits(p + 11, 2, &hour) || sl_digits(p + 14, 2, &minute) || sl_digits(p + 17, 2, &second) ||
+        sl_digits(p + 20, 3, &millisecond) || sl_digits(p + 25, 2, &zoneHours) || sl_digits(p + 27, 2, &zoneMinutes)) {
+        return -1;
+    }
+    int64_t zone = (zoneHours * 60 + zoneMinutes) * (p[24] == '-' ? -1 : 1);
+    int64_t seconds = sl_days_from_civil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second - zone * 60;
+    *milliseconds = seconds * 1000 + millisecond;
+    return 0;
+}
+
+// "[...] " or "[...]" at the end of the line
+static int sl_parse_token(const char *p, const char *end, const char **token, size_t *length, const char **next) {
+    if (p >= end || *p != '[') {
+        return -1;
+    }
+    for (const char *q = p + 1; q < end; q++) {
+        if (*q == ']' && (q + 1 == end || q[1] == ' ')) {
+            *token = p + 1;
+            *length = (size_t)(q - p - 1);
+            *next = q + 1 < end ? q + 2 : end;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// "file(line:N)"
+static int sl_parse_file_token(const char *token, size_t length, size_t *fileLength, uint64_t *line) {
+    if (length < 8 || token[length - 1] != ')') {
+        return -1;
+    }
+    size_t open = length - 1;
+    while (open > 0 && token[open] != '(') {
+        open--;
+    }
+    if (token[open] != '(' || length - open < 8 || memcmp(token + open, "(line:", 6) != 0) {
+        return -1;
+    }
+    *line = 0;
+    for (size_t i = open + 6; i < length - 1; i++) {
+        if (token[i] < '0' || token[i] > '9') {
+            return -1;
+        }
+        *line = *line * 10 + (uint64_t)(token[i] - '0');
+    }
+    *fileLength = open;
+    return 0;
+}
+
+// Writer
+
+typedef struct SLColRecord_ {
+    int64_t timestamp;
+    uint8_t level;
+    int64_t ids[SLLogColumnCount];  // String columns except the message
+    uint64_t line;
+    uint64_t sampleRate;
+} SLColRecord;
+
+struct SLLogColumnarWriter_ {
+    FILE *file;
+    uint64_t offset;
+    uint32_t rowsPerGroup;
+    int failed;
+
+    uint32_t rows;
+    int64_t lastTimestamp;
+    int64_t minTimestamp;
+    int64_t maxTimestamp;
+    SLColBuffer columns[SLLogColumnCount];
+    SLColDict dicts[SLLogColumnCount];
+
+    int hasPending;
+    SLColRecord pending;
+    SLColBuffer pendingMessage;
+
+    SLColBuffer footer;
+    uint32_t groups;
+    SLColBuffer chunk;
+};
+
+SLLogColumnarWriter *SLLogColumnarWriterOpen(const char *path, uint32_t rowsPerGroup) {
+    SLLogColumnarWriter *writer = (SLLogColumnarWriter *)calloc(1, sizeof(SLLogColumnarWriter));
+    if (writer == NULL || (writer->file = fopen(path, "wb")) == NULL) {
+        free(writer);
+        return NULL;
+    }
+    writer->rowsPerGroup = rowsPerGroup ? rowsPerGroup : SL_LOG_COLUMNAR_DEFAULT_ROWS;
+    uint8_t header[8] = { 'S', 'L', 'C', 'F', SL_COLUMNAR_VERSION, 0, 0, 0 };
+    writer->failed = fwrite(header, 1, sizeof(header), writer->file) != sizeof(header);
+    writer->offset = sizeof(header);
+    return writer;
+}
+
+static int sl_writer_write_chunk(SLLogColumnarWriter *writer, const uint8_t *data, size_t length) {
+    // Deflate if it pays, messages and dictionaries usually shrink a lot
+    SLColBuffer *chunk = &writer->chunk;
+    chunk->length = 0;
+    uLongf bound = compressBound((uLong)length);
+    if (sl_buffer_reserve(chunk, SL_COLUMNAR_CHUNK_HEADER + bound) != 0) {
+        return -1;
+    }
+    uint8_t codec = 0;
+    size_t stored = length;
+    if (length > 64 && compress2(chunk->data + SL_COLUMNAR_CHUNK_HEADER, &bound, data, (uLong)length, Z_DEFAULT_COMPRESSION) == Z_OK &&
+        bound < length) {
+        codec = 1;
+        stored = bound;
+    } else if (length > 0) {
+        memcpy(chunk->data + SL_COLUMNAR_CHUNK_HEADER, data, length);
+    }
+    chunk->data[0] = codec;
+    for (int i = 0; i < 4; i++) {
+        chunk->data[1 + i] = (uint8_t)(length >> (i * 8));
+        chunk->data[5 + i] = (uint8_t)(stored >> (i * 8));
+    }
+    size_t total = SL_COLUMNAR_CHUNK_HEADER + stored;
+    if (fwrite(chunk->data, 1, total, writer->file) != total) {
+        return -1;
+    }
+    sl_buffer_le(&writer->footer, writer->offset, 8);
+    sl_buffer_le(&writer->footer, total, 4);
+    writer->offset += total;
+    return 0;
+}
+
+static int sl_writer_flush_group(SLLogColumnarWriter *writer) {
+    if (writer->rows == 0) {
+        return 0;
+    }
+    sl_buffer_le(&writer->footer, writer->rows, 4);
+    sl_buffer_le(&writer->footer, (uint64_t)writer->minTimestamp, 8);
+    sl_buffer_le(&writer->footer, (uint64_t)writer->maxTimestamp, 8);
+
+    SLColBuffer encoded = { NULL, 0, 0 };
+    int result = 0;
+    for (int column = 0; result == 0 && column < SLLogColumnCount; column++) {
+        SLColBuffer *values = &writer->columns[column];
+        if (sl_column_is_string(column) && column != SLLogColumnMessage) {
+            SLColDict *dict = &writer->dicts[column];
+            encoded.length = 0;
+            result |= sl_buffer_varint(&encoded, dict->count);
+            for (uint32_t id = 0; id < dict->count; id++) {
+                result |= sl_buffer_varint(&encoded, dict->entries[id].length);
+                result |= sl_buffer_append(&encoded, dict->bytes.data + dict->entries[id].offset, dict->entries[id].length);
+            }
+            result |= sl_buffer_append(&encoded, values->data, values->length);
+            result |= sl_writer_write_chunk(writer, encoded.data, encoded.length);
+            sl_dict_reset(dict);
+        } else {
+            result |= sl_writer_write_chunk(writer, values->data, values->length);
+        }
+        values->length = 0;
+    }
+    free(encoded.data);
+
+    writer->groups++;
+    writer->rows = 0;
+    writer->lastTimestamp = 0;
+    return result;
+}
+
+static int sl_writer_commit(SLLogColumnarWriter *writer) {
+    if (!writer->hasPending) {
+        return 0;
+    }
+    SLColRecord *record = &writer->pending;
+    SLColBuffer *columns = writer->columns;
+    int64_t delta = record->timestamp - writer->lastTimestamp;
+    int result = sl_buffer_varint(&columns[SLLogColumnTimestamp], ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+    result |= sl_buffer_append(&columns[SLLogColumnLevel], &record->level, 1);
+    result |= sl_buffer_varint(&columns[SLLogColumnProcess], (uint64_t)record->ids[SLLogColumnProcess]);
+    result |= sl_buffer_varint(&columns[SLLogColumnThread], (uint64_t)record->ids[SLLogColumnThread]);
+    result |= sl_buffer_varint(&columns[SLLogColumnFile], (uint64_t)record->ids[SLLogColumnFile]);
+    result |= sl_buffer_varint(&columns[SLLogColumnLine], record->line);
+    result |= sl_buffer_varint(&columns[SLLogColumnTag], (uint64_t)record->ids[SLLogColumnTag]);
+    result |= sl_buffer_varint(&columns[SLLogColumnSampleRate], record->sampleRate);
+    result |= sl_buffer_varint(&columns[SLLogColumnMessage], writer->pendingMessage.length);
+    result |= sl_buffer_append(&columns[SLLogColumnMessage], writer->pendingMessage.data, writer->pendingMessage.length);
+
+    if (writer->rows == 0 || record->timestamp < writer->minTimestamp) {
+        writer->minTimestamp = record->timestamp;
+    }
+    if (writer->rows == 0 || record->timestamp > writer->maxTimestamp) {
+        writer->maxTimestamp = record->timestamp;
+    }
+    writer->lastTimestamp = record->timestamp;
+    writer->rows++;
+    writer->hasPending = 0;
+    writer->pendingMessage.length = 0;
+
+    if (writer->rows >= writer->rowsPerGroup || columns[SLLogColumnMessage].length >= SL_COLUMNAR_MAX_GROUP_BYTES) {
+        result |= sl_writer_flush_group(writer);
+    }
+    return result;
+}
+
+int SLLogColumnarWriterAddLine(SLLogColumnarWriter *writer, const char *line, size_t length) {
+    const char *end = line + length;
+    const char *p = line;
+    const char *process = "";
+    size_t processLength = 0;
+    int64_t timestamp = 0;
+
+    // Shared logging prefix "[name:pid] "
+    const char *token, *next;
+    size_t tokenLength;
+    if (sl_parse_token(p, end, &token, &tokenLength, &next) == 0 &&
+        sl_parse_timestamp(next, (size_t)(end - next), &timestamp) == 0) {
+        process = token;
+        processLength = tokenLength;
+        p = next;
+    } else if (sl_parse_timestamp(p, length, &timestamp) != 0) {
+        // Continuation of a multi-line message
+        if (!writer->hasPending) {
+            memset(&writer->pending, 0, sizeof(SLColRecord));
+            writer->pending.sampleRate = 1;
+            for (int column = 0; column < SLLogColumnCount; column++) {
+                if (sl_column_is_string(column) && column != SLLogColumnMessage &&
+                    (writer->pending.ids[column] = sl_dict_intern(&writer->dicts[column], "", 0)) < 0) {
+                    return -1;
+                }
+            }
+            writer->hasPending = 1;
+            return sl_buffer_append(&writer->pendingMessage, line, length);
+        }
+        return sl_buffer_append(&writer->pendingMessage, "\n", 1) | sl_buffer_append(&writer->pendingMessage, line, length);
+    }
+
+    if (sl_writer_commit(writer) != 0) {
+        return -1;
+    }
+    p += SL_COLUMNAR_TIMESTAMP_LENGTH;
+    if (p < end && *p == ' ') {
+        p++;
+    }
+
+    // [level] [queue] [file(line:N)] [tag], level is optional
+    const char *tokens[4];
+    size_t lengths[4];
+    const char *after[4];
+    int count = 0;
+    const char *q = p;
+    while (count < 4 && sl_parse_token(q, end, &tokens[count], &lengths[count], &after[count]) == 0) {
+        q = after[count++];
+    }
+    int fileToken = -1;
+    size_t fileLength = 0;
+    uint64_t lineNumber = 0;
+    for (int i = 1; i < count && i <= 2; i++) {
+        if (sl_parse_file_token(tokens[i], lengths[i], &fileLength, &lineNumber) == 0) {
+            fileToken = i;
+            break;
+        }
+    }
+    if (fileToken == 2 && lengths[0] != 1) {
+        fileToken = -1;
+    }
+
+    SLColRecord *record = &writer->pending;
+    memset(record, 0, sizeof(SLColRecord));
+    record->timestamp = timestamp;
+    record->sampleRate = 1;
+    const char *thread = "", *file = "", *tag = "";
+    size_t threadLength = 0, tagLength = 0;
+    const char *message = p;
+    if (fileToken > 0) {
+        if (fileToken == 2) {
+            record->level = (uint8_t)tokens[0][0];
+        }
+        thread = tokens[fileToken - 1];
+        threadLength = lengths[fileToken - 1];
+        file = tokens[fileToken];
+        record->line = lineNumber;
+        message = after[fileToken];
+        if (fileToken + 1 < count) {
+            tag = tokens[fileToken + 1];
+            tagLength = lengths[fileToken + 1];
+            message = after[fileToken + 1];
+        }
+        // "[sampled 1/N] "
+        if ((size_t)(end - message) > 11 && memcmp(message, "[sampled 1/", 11) == 0) {
+            const char *digit = message + 11;
+            uint64_t rate = 0;
+            while (digit < end && *digit >= '0' && *digit <= '9') {
+                rate = rate * 10 + (uint64_t)(*digit++ - '0');
+            }
+            if (digit < end && *digit == ']' && rate > 0) {
+                record->sampleRate = rate;
+                message = digit + 1 < end ? digit + 2 : end;
+            }
+        }
+    } else {
+        fileLength = 0;
+    }
+
+    record->ids[SLLogColumnProcess] = sl_dict_intern(&writer->dicts[SLLogColumnProcess], process, processLength);
+    record->ids[SLLogColumnThread] = sl_dict_intern(&writer->dicts[SLLogColumnThread], thread, threadLength);
+    record->ids[SLLogColumnFile] = sl_dict_intern(&writer->dicts[SLLogColumnFile], file, fileLength);
+    record->ids[SLLogColumnTag] = sl_dict_intern(&writer->dicts[SLLogColumnTag], tag, tagLength);
+    if (record->ids[SLLogColumnProcess] < 0 || record->ids[SLLogColumnThread] < 0 ||
+        record->ids[SLLogColumnFile] < 0 || record->ids[SLLogColumnTag] < 0) {
+        return -1;
+    }
+    writer->hasPending = 1;
+    writer->pendingMessage.length = 0;
+    return sl_buffer_append(&writer->pendingMessage, message, (size_t)(end - message));
+}
+
+int SLLogColumnarWriterAddFile(SLLogColumnarWriter *writer, const char *path,
+                               SLLogDictionaryLookup lookup, void *context) {
+    SLLogArchiveReader *reader = SLLogArchiveReaderOpen(path, lookup, context);
+    size_t capacity = SL_COLUMNAR_READ_CHUNK * 2;
+    char *buffer = (char *)malloc(capacity);
+    size_t filled = 0;
+    int result = reader && buffer ? 0 : -1;
+    int finished = 0;
+
+    while (result == 0 && !finished) {
+        long length = SLLogArchiveReaderRead(reader, buffer + filled, capacity - filled);
+        if (length < 0) {
+            result = (int)length;
+            break;
+        }
+        finished = length == 0;
+        filled += (size_t)length;
+
+        size_t start = 0;
+        for (;;) {
+            char *lineEnd = (char *)memchr(buffer + start, '\n', filled - start);
+            if (lineEnd == NULL) {
+                break;
+            }
+            result |= SLLogColumnarWriterAddLine(writer, buffer + start, (size_t)(lineEnd - buffer - start));
+            start = (size_t)(lineEnd - buffer) + 1;
+        }
+        if (start == 0 && filled == capacity) {
+            // Longer than the buffer, grow: a line must stay one record
+            char *grown = (char *)realloc(buffer, capacity * 2);
+            if (grown == NULL) {
+                result = -1;
+                break;
+            }
+            buffer = grown;
+            capacity *= 2;
+        }
+        memmove(buffer, buffer + start, filled - start);
+        filled -= start;
+        if (finished && filled > 0) {
+            result |= SLLogColumnarWriterAddLine(writer, buffer, filled);
+        }
+    }
+
+    SLLogArchiveReaderClose(reader);
+    free(buffer);
+    return result;
+}
+
+int SLLogColumnarWriterClose(SLLogColumnarWriter *writer) {
+    int result = writer->failed;
+    result |= sl_writer_commit(writer);
+    result |= sl_writer_flush_group(writer);
+
+    SLColBuffer tail = { NULL, 0, 0 };
+    result |= sl_buffer_le(&tail, writer->groups, 4);
+    result |= sl_buffer_append(&tail, writer->footer.data, writer->footer.length);
+    uint64_t footerLength = tail.length;
+    result |= sl_buffer_le(&tail, footerLength, 4);
+    result |= sl_buffer_append(&tail, SL_COLUMNAR_MAGIC, 4);
+    if (result == 0 && fwrite(tail.data, 1, tail.length, writer->file) != tail.length) {
+        result = -1;
+    }
+    if (fclose(writer->file) != 0) {
+        result = -1;
+    }
+
+    free(tail.data);
+    for (int column = 0; column < SLLogColumnCount; column++) {
+        free(writer->columns[column].data);
+        sl_dict_free(&writer->dicts[column]);
+    }
+    free(writer->pendingMessage.data);
+    free(writer->footer.data);
+    free(writer->chunk.data);
+    free(writer);
+    return result ? -1 : 0;
+}
+
+// Reader
+
+struct SLLogColumnarReader_ {
+    FILE *file;
+    uint64_t size;
+    uint64_t bytesRead;
+    uint32_t groups;
+    uint8_t *footer;            // Group entries
+};
+
+SLLogColumnarReader *SLLogColumnarReaderOpen(const char *path) {
+    SLLogColumnarReader *reader = (SLLogColumnarReader *)calloc(1, sizeof(SLLogColumnarReader));
+    if (reader == NULL || (reader->file = fopen(path, "rb")) == NULL) {
+        free(reader);
+        return NULL;
+    }
+
+    uint8_t header[8], tail[8];
+    long size = -1;
+    if (fread(header, 1, 8, reader->file) != 8 || memcmp(header, SL_COLUMNAR_MAGIC, 4) != 0 ||
+        header[4] != SL_COLUMNAR_VERSION || fseek(reader->file, -8, SEEK_END) != 0 ||
+        (size = ftell(reader->file)) < 0 || fread(tail, 1, 8, reader->file) != 8 ||
+        memcmp(tail + 4, SL_COLUMNAR_MAGIC, 4) != 0) {
+        SLLogColumnarReaderClose(reader);
+        return NULL;
+    }
+    uint64_t footerLength = sl_load_le(tail, 4);
+    reader->size = (uint64_t)size + 8;
+    reader->bytesRead = 16;
+    if (footerLength < 4 || footerLength > (uint64_t)size - 8 ||
+        (reader->footer = (uint8_t *)malloc((size_t)footerLength)) == NULL ||
+        fseek(reader->file, (long)((uint64_t)size - footerLength), SEEK_SET) != 0 ||
+        fread(reader->footer, 1, (size_t)footerLength, reader->file) != footerLength) {
+        SLLogColumnarReaderClose(reader);
+        return NULL;
+    }
+    reader->bytesRead += footerLength;
+    reader->groups = (uint32_t)sl_load_le(reader->footer, 4);
+    if ((uint64_t)reader->groups * SL_COLUMNAR_GROUP_ENTRY + 4 != footerLength) {
+        SLLogColumnarReaderClose(reader);
+        return NULL;
+    }
+    return reader;
+}
+
+void SLLogColumnarReaderClose(SLLogColumnarReader *reader) {
+    if (reader) {
+        if (reader->file) {
+            fclose(reader->file);
+        }
+        free(reader->footer);
+        free(reader);
+    }
+}
+
+uint32_t SLLogColumnarRowGroups(const SLLogColumnarReader *reader) {
+    return reader->groups;
+}
+
+uint64_t SLLogColumnarBytesRead(const SLLogColumnarReader *reader) {
+    return reader->bytesRead;
+}
+
+static const uint8_t *sl_reader_group(const SLLogColumnarReader *reader, uint32_t group) {
+    return reader->footer + 4 + (size_t)group * SL_COLUMNAR_GROUP_ENTRY;
+}
+
+void SLLogColumnarRowGroupInfo(const SLLogColumnarReader *reader, uint32_t group,
+                               uint32_t *rows, int64_t *minTimestamp, int64_t *maxTimestamp) {
+    const uint8_t *entry = sl_reader_group(reader, group);
+    if (rows) {
+        *rows = (uint32_t)sl_load_le(entry, 4);
+    }
+    if (minTimestamp) {
+        *minTimestamp = (int64_t)sl_load_le(entry + 4, 8);
+    }
+    if (maxTimestamp) {
+        *maxTimestamp = (int64_t)sl_load_le(entry + 12, 8);
+    }
+}
+
+typedef struct SLColStorage_ {
+    void *blocks[SLLogColumnCount * 5];  // Chunk, inflated chunk, values, strings, lengths
+    int count;
+} SLColStorage;
+
+static void *sl_storage_alloc(SLColStorage *storage, size_t size) {
+    void *block = malloc(size ? size : 1);
+    if (block) {
+        storage->blocks[storage->count++] = block;
+    }
+    return block;
+}
+
+static int sl_decode_strings(SLColStorage *storage, SLLogColumnarColumn *output, uint32_t count,
+                             const uint8_t **position, const uint8_t *end) {
+    output->stringCount = count;
+    output->strings = (const char **)sl_storage_alloc(storage, count * sizeof(char *));
+    output->lengths = (uint32_t *)sl_storage_alloc(storage, count * sizeof(uint32_t));
+    if (output->strings == NULL || output->lengths == NULL) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t length;
+        if (sl_read_varint(position, end, &length) != 0 || length > (uint64_t)(end - *position)) {
+            return -1;
+        }
+        output->strings[i] = (const char *)*position;
+        output->lengths[i] = (uint32_t)length;
+        *position += length;
+    }
+    return 0;
+}
+
+static int sl_decode_column(SLColStorage *storage, int column, const uint8_t *data, size_t length,
+                            uint32_t rows, SLLogColumnarColumn *output) {
+    const uint8_t *position = data;
+    const uint8_t *end = data + length;
+    output->values = (int64_t *)sl_storage_alloc(storage, rows * sizeof(int64_t));
+    if (output->values == NULL) {
+        return -1;
+    }
+
+    uint64_t dictionarySize = 0;
+    if (sl_column_is_string(column) && column != SLLogColumnMessage) {
+        if (sl_read_varint(&position, end, &dictionarySize) != 0 || dictionarySize > length ||
+            sl_decode_strings(storage, output, (uint32_t)dictionarySize, &position, end) != 0) {
+            return -1;
+        }
+    } else if (column == SLLogColumnMessage) {
+        for (uint32_t row = 0; row < rows; row++) {
+            output->values[row] = row;
+        }
+        return sl_decode_strings(storage, output, rows, &position, end);
+    }
+
+    int64_t previous = 0;
+    for (uint32_t row = 0; row < rows; row++) {
+        uint64_t value;
+        if (column == SLLogColumnLevel) {
+            if (position >= end) {
+                return -1;
+            }
+            output->values[row] = *position++;
+            continue;
+        }
+        if (sl_read_varint(&position, end, &value) != 0) {
+            return -1;
+        }
+        if (column == SLLogColumnTimestamp) {
+            previous += (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+            output->values[row] = previous;
+        } else {
+            if (sl_column_is_string(column) && value >= dictionarySize) {
+                return -1;
+            }
+            output->values[row] = (int64_t)value;
+        }
+    }
+    return 0;
+}
+
+int SLLogColumnarReadRowGroup(SLLogColumnarReader *reader, uint32_t group, uint32_t columnMask,
+                              SLLogColumnarBatch *batch) {
+    memset(batch, 0, sizeof(SLLogColumnarBatch));
+    if (group >= reader->groups) {
+        return -1;
+    }
+    SLColStorage *storage = (SLColStorage *)calloc(1, sizeof(SLColStorage));
+    if (storage == NULL) {
+        return -1;
+    }
+    batch->storage = storage;
+    SLLogColumnarRowGroupInfo(reader, group, &batch->rows, &batch->minTimestamp, &batch->maxTimestamp);
+
+    const uint8_t *entry = sl_reader_group(reader, group) + 20;
+    for (int column = 0; column < SLLogColumnCount; column++) {
+        if (!(columnMask & SL_LOG_COLUMN_MASK(column))) {
+            continue;
+        }
+        uint64_t offset = sl_load_le(entry + column * 12, 8);
+        uint64_t size = sl_load_le(entry + column * 12 + 8, 4);
+        uint8_t *stored = (uint8_t *)sl_storage_alloc(storage, (size_t)size);
+        if (stored == NULL || size < SL_COLUMNAR_CHUNK_HEADER || offset + size > reader->size ||
+            fseek(reader->file, (long)offset, SEEK_SET) != 0 ||
+            fread(stored, 1, (size_t)size, reader->file) != size) {
+            SLLogColumnarBatchFree(batch);
+            return -1;
+        }
+        reader->bytesRead += size;
+
+        uint8_t codec = stored[0];
+        uLongf rawLength = (uLongf)sl_load_le(stored + 1, 4);
+        uint64_t storedLength = sl_load_le(stored + 5, 4);
+        const uint8_t *raw = stored + SL_COLUMNAR_CHUNK_HEADER;
+        if (storedLength != size - SL_COLUMNAR_CHUNK_HEADER) {
+            SLLogColumnarBatchFree(batch);
+            return -1;
+        }
+        if (codec == 1) {
+            uint8_t *inflated = (uint8_t *)sl_storage_alloc(storage, rawLength);
+            uLongf inflatedLength = rawLength;
+            if (inflated == NULL || uncompress(inflated, &inflatedLength, raw, (uLong)storedLength) != Z_OK ||
+                inflatedLength != rawLength) {
+                SLLogColumnarBatchFree(batch);
+                return -1;
+            }
+            raw = inflated;
+        } else if (codec != 0 || rawLength != storedLength) {
+            SLLogColumnarBatchFree(batch);
+            return -1;
+        }
+        if (sl_decode_column(storage, column, raw, rawLength, batch->rows, &batch->columns[column]) != 0) {
+            SLLogColumnarBatchFree(batch);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void SLLogColumnarBatchFree(SLLogColumnarBatch *batch) {
+    SLColStorage *storage = (SLColStorage *)batch->storage;
+    if (storage) {
+        for (int i = 0; i < storage->count; i++) {
+            free(storage->blocks[i]);
+        }
+        free(storage);
+    }
+    memset(batch, 0, sizeof(SLLogColumnarBatch));
+}
@@ -0,0 +1,105 @@
+//
+//  SLLogColumnar.h
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/12.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#ifndef SLLogColumnar_h
+#define SLLogColumnar_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "SLLogDictionary.h"
+
+#if __cplusplus
+extern "C" {
+#endif
+
+// Columnar export of log files and archives, for analysis without parsing text lines.
+//
+// Lines written by SLLogQueueFormatter:
+//   [process:pid] 2019-09-12 10:00:00:123(+0800) [E] [queue] [file(line:N)] [tag] [sampled 1/N] message
+// where the process prefix (shared logging), the level (includesLevel) and the sample rate are
+// optional. Lines that don't start with a timestamp continue the message of the previous record.
+//
+// The file is a sequence of row groups, each holding one chunk per column, and a footer with the
+// position of every chunk, so a reader only reads the columns it needs:
+//   "SLCF" u32 version
+//   row groups: per column u8 codec (0 raw, 1 zlib) u32 rawLength u32 storedLength data
+//   footer: u32 groups, per group u32 rows i64 minTimestamp i64 maxTimestamp
+//           and per column u64 offset u32 size
+//   u32 footerLength "SLCF"
+// Integers little endian, varints LEB128. String columns are dictionary encoded per row group
+// (varint count, varint length + bytes per entry, varint id per row); timestamps are zigzag
+// varint deltas. The writer keeps one row group in memory.
+//
+// Plain C, zlib only.
+#define SL_LOG_COLUMNAR_DEFAULT_ROWS 65536
+
+typedef enum {
+    SLLogColumnTimestamp = 0,   // Milliseconds since 1970
+    SLLogColumnLevel,           // 'E' 'W' 'I' 'D', 0 if the line has no level
+    SLLogColumnProcess,         // String, "name:pid" of shared logging
+    SLLogColumnThread,          // String, queue or thread label
+    SLLogColumnFile,            // String
+    SLLogColumnLine,
+    SLLogColumnTag,             // String
+    SLLogColumnSampleRate,      // 1 unless sampled
+    SLLogColumnMessage,         // String, one per row
+    SLLogColumnCount
+} SLLogColumn;
+
+#define SL_LOG_COLUMN_MASK(column) (1u << (column))
+#define SL_LOG_COLUMN_ALL ((1u << SLLogColumnCount) - 1)
+
+typedef struct SLLogColumnarWriter_ SLLogColumnarWriter;
+
+// `rowsPerGroup` 0 for SL_LOG_COLUMNAR_DEFAULT_ROWS. Returns NULL if the file can't be created.
+SLLogColumnarWriter *SLLogColumnarWriterOpen(const char *path, uint32_t rowsPerGroup);
+// One line, without line feed.
+int SLLogColumnarWriterAddLine(SLLogColumnarWriter *writer, const char *line, size_t length);
+// All lines of a log file or archive, see SLLogArchiveReaderOpen.
+// Returns 0 on success, -1 on error, -2 if the dictionary was not found.
+int SLLogColumnarWriterAddFile(SLLogColumnarWriter *writer, const char *path,
+                               SLLogDictionaryLookup lookup, void *context);
+// Writes the last row group and the footer. Returns 0 on success.
+int SLLogColumnarWriterClose(SLLogColumnarWriter *writer);
+
+typedef struct SLLogColumnarReader_ SLLogColumnarReader;
+
+typedef struct SLLogColumnarColumn_ {
+    int64_t *values;            // Per row; dictionary id for string columns
+    uint32_t stringCount;       // String columns: dictionary size (messages: one per row)
+    const char **strings;
+    uint32_t *lengths;
+} SLLogColumnarColumn;
+
+typedef struct SLLogColumnarBatch_ {
+    uint32_t rows;
+    int64_t minTimestamp;
+    int64_t maxTimestamp;
+    SLLogColumnarColumn columns[SLLogColumnCount];  // Only the requested columns are set
+    void *storage;
+} SLLogColumnarBatch;
+
+SLLogColumnarReader *SLLogColumnarReaderOpen(const char *path);
+void SLLogColumnarReaderClose(SLLogColumnarReader *reader);
+uint32_t SLLogColumnarRowGroups(const SLLogColumnarReader *reader);
+// Row count and time range from the footer, without reading the group.
+void SLLogColumnarRowGroupInfo(const SLLogColumnarReader *reader, uint32_t group,
+                               uint32_t *rows, int64_t *minTimestamp, int64_t *maxTimestamp);
+// Reads and decodes the columns in `columnMask` (SL_LOG_COLUMN_MASK). Returns 0 on success.
+int SLLogColumnarReadRowGroup(SLLogColumnarReader *reader, uint32_t group, uint32_t columnMask,
+                              SLLogColumnarBatch *batch);
+void SLLogColumnarBatchFree(SLLogColumnarBatch *batch);
+// Bytes read from the file so far, footer included.
+uint64_t SLLogColumnarBytesRead(const SLLogColumnarReader *reader);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SLLogColumnar_h */
@@ -0,0 +1,41 @@
+//
+//  SLLogFilter.h
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/2.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#ifndef SLLogFilter_h
+#define SLLogFilter_h
+
+#import "SLInterfaces.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * 运行时日志过滤表.
+ *
+ * 读路径无锁: 过滤表是不可变快照，通过原子指针发布; 调用点缓存自己的 mask.
+ * 写路径（更新规则）加锁，发布新快照之后重新计算所有已注册调用点的 mask.
+ *
+ * 规则匹配优先级: call site 规则 > tag 规则; 完全匹配 > 前缀匹配; 前缀越长越优先.
+ */
+@interface SLLogFilter : NSObject
+
++ (void)setLevel:(SLLogLevel)level forTag:(NSString *)tagPattern;
++ (void)setLevel:(SLLogLevel)level forCallSite:(NSString *)sitePattern;
++ (void)removeFilter:(NSString *)pattern;
++ (void)removeAllFilters;
+
+/**
+ * Allowed flags for tag, without call site rules.
+ * Used for messages not coming through SL_LOG_MAYBE.
+ */
++ (unsigned int)maskForTag:(nullable id)tag;
+
+@end
+
+NS_ASSUME_NONNULL_END
+
+#endif /* SLLogFilter_h */
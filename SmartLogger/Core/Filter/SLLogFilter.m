@@ -0,0 +1,303 @@
+//
+//  SLLogFilter.m
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/2.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#import "SLLogFilter.h"
+
+#import <pthread.h>
+#import <stdatomic.h>
+
+#define SL_FILTER_MASK_ALL 0x3FFFFFFFu
+
+typedef struct SLLogFilterRule {
+    char *pattern;
+    size_t length;      // without trailing '*'
+    BOOL isPrefix;
+    BOOL isCallSite;
+    unsigned int mask;
+} SLLogFilterRule;
+
+/// Immutable snapshot, never modified after published.
+typedef struct SLLogFilterTable {
+    SLLogFilterRule *rules;
+    NSUInteger count;
+    struct SLLogFilterTable *retired;
+} SLLogFilterTable;
+
+static _Atomic(SLLogFilterTable *) s_table = NULL;
+/// Write path only: rule updates, site registration
+static pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
+static SLLogSite *s_sites = NULL;
+
+#pragma mark - Matching
+
+static inline const char *SLLogFilterTagCString(const void *tag)
+{
+    if (tag == NULL) {
+        return NULL;
+    }
+    id obj = (__bridge id)tag;
+    if ([obj isKindOfClass:NSString.class]) {
+        return [(NSString *)obj UTF8String];
+    }
+    return [[obj description] UTF8String];
+}
+
+/// Returns the matched pattern length, or -1 if not matched
+static inline long SLLogFilterRuleMatch(const SLLogFilterRule *rule, const char *str, size_t len)
+{
+    if (str == NULL) {
+        return -1;
+    }
+    if (rule->isPrefix) {
+        return (len >= rule->length && strncmp(str, rule->pattern, rule->length) == 0) ? (long)rule->length : -1;
+    }
+    // Exact match ranks above any prefix match
+    return (len == rule->length && memcmp(str, rule->pattern, len) == 0) ? LONG_MAX : -1;
+}
+
+/// `siteMatched` tells a call site rule from no rule, both may allow everything
+static unsigned int SLLogFilterResolve(SLLogFilterTable *table, const char *tag, const char *site, BOOL *siteMatched)
+{
+    if (siteMatched) {
+        *siteMatched = NO;
+    }
+    if (table == NULL || table->count == 0) {
+        return SL_FILTER_MASK_ALL;
+    }
+
+    size_t tagLen = tag ? strlen(tag) : 0;
+    size_t siteLen = site ? strlen(site) : 0;
+
+    long bestSite = -1, bestTag = -1;
+    unsigned int siteMask = SL_FILTER_MASK_ALL, tagMask = SL_FILTER_MASK_ALL;
+
+    for (NSUInteger i = 0; i < table->count; i++) {
+        SLLogFilterRule *rule = &table->rules[i];
+        if (rule->isCallSite) {
+            long score = SLLogFilterRuleMatch(rule, site, siteLen);
+            if (score > bestSite) {
+                bestSite = score;
+                siteMask = rule->mask;
+            }
+        } else {
+            long score = SLLogFilterRuleMatch(rule, tag, tagLen);
+            if (score > bestTag) {
+                bestTag = score;
+                tagMask = rule->mask;
+            }
+        }
+    }
+
+    if (siteMatched) {
+        *siteMatched = bestSite >= 0;
+    }
+    return bestSite >= 0 ? siteMask : tagMask;
+}
+
+/// "<file name>:<line>"
+static void SLLogSiteIdentifier(const SLLogSite *site, char *buffer, size_t size)
+{
+    const char *fileName = site->file ? strrchr(site->file, '/') : NULL;
+    fileName = fileName ? fileName + 1 : (site->file ?: "");
+    snprintf(buffer, size, "%s:%u", fileName, site->line);
+}
+
+/// Must hold s_mutex. Resolves against the tag copied at registration, the tag object may be gone.
+static unsigned int SLLogSiteComputeMask(SLLogSite *site, SLLogFilterTable *table)
+{
+    char siteId[PATH_MAX + 16];
+    SLLogSiteIdentifier(site, siteId, sizeof(siteId));
+    if (site->tag == (const void *)site) {
+        // Tag differs between calls, only call site rules can be cached
+        BOOL siteMatched;
+        unsigned int mask = SLLogFilterResolve(table, NULL, siteId, &siteMatched);
+        return siteMatched ? mask : SL_LOG_SITE_DYNAMIC;
+    }
+    return SLLogFilterResolve(table, site->tagName, siteId, NULL);
+}
+
+/// Must hold s_mutex
+static void SLLogSiteSetDynamic(SLLogSite *site)
+{
+    __atomic_store_n(&site->tag, (const void *)site, __ATOMIC_RELAXED);
+    free(site->tagName);
+    site->tagName = NULL;
+}
+
+#pragma mark - Call Site
+
+int SLLogSiteShouldLog(SLLogSite *site, unsigned int flag, const void *tag)
+{
+    unsigned int mask = __atomic_load_n(&site->mask, __ATOMIC_RELAXED);
+
+    if (mask == SL_LOG_SITE_UNRESOLVED) {
+        pthread_mutex_lock(&s_mutex);
+        const void *siteTag = __atomic_load_n(&site->tag, __ATOMIC_RELAXED);
+        if (site->mask == SL_LOG_SITE_UNRESOLVED) {
+            const char *tagName = SLLogFilterTagCString(tag);
+            site->tagName = tagName ? strdup(tagName) : NULL;
+            __atomic_store_n(&site->tag, tag, __ATOMIC_RELAXED);
+            site->next = s_sites;
+            s_sites = site;
+        } else if (siteTag != tag && siteTag != (const void *)site) {
+            // Resolved by another thread with a different tag
+            SLLogSiteSetDynamic(site);
+        }
+        mask = SLLogSiteComputeMask(site, atomic_load_explicit(&s_table, memory_order_acquire));
+        __atomic_store_n(&site->mask, mask, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&s_mutex);
+    } else {
+        const void *siteTag = __atomic_load_n(&site->tag, __ATOMIC_RELAXED);
+        if (siteTag != tag && siteTag != (const void *)site) {
+            // Same call site, different tag: stop caching tag verdict
+            pthread_mutex_lock(&s_mutex);
+            siteTag = __atomic_load_n(&site->tag, __ATOMIC_RELAXED);
+            if (siteTag != (const void *)site) {
+                SLLogSiteSetDynamic(site);
+                mask = SLLogSiteComputeMask(site, atomic_load_explicit(&s_table, memory_order_acquire));
+                __atomic_store_n(&site->mask, mask, __ATOMIC_RELAXED);
+            } else {
+                mask = __atomic_load_n(&site->mask, __ATOMIC_RELAXED);
+            }
+            pthread_mutex_unlock(&s_mutex);
+        }
+    }
+
+    if (mask == SL_LOG_SITE_DYNAMIC) {
+        SLLogFilterTable *table = atomic_load_explicit(&s_table, memory_order_acquire);
+        if (table == NULL || table->count == 0) {
+            return 1;
+        }
+        return (SLLogFilterResolve(table, SLLogFilterTagCString(tag), NULL, NULL) & flag) != 0;
+    }
+
+    return (mask & flag) != 0;
+}
+
+#pragma mark - Rules
+
+@implementation SLLogFilter
+
+/// Must hold s_mutex
++ (void)publishRules:(NSArray<NSValue *> *)rules
+{
+    SLLogFilterTable *old = atomic_load_explicit(&s_table, memory_order_relaxed);
+
+    SLLogFilterTable *table = (SLLogFilterTable *)calloc(1, sizeof(SLLogFilterTable));
+    table->count = rules.count;
+    table->rules = (SLLogFilterRule *)calloc(MAX(rules.count, (NSUInteger)1), sizeof(SLLogFilterRule));
+    for (NSUInteger i = 0; i < rules.count; i++) {
+        [rules[i] getValue:&table->rules[i]];
+    }
+    // Readers may still hold the old snapshot, so it is retired but never freed.
+    // Rules are changed rarely, the cost is a few bytes per update.
+    table->retired = old;
+
+    atomic_store_explicit(&s_table, table, memory_order_release);
+
+    for (SLLogSite *site = s_sites; site != NULL; site = site->next) {
+        __atomic_store_n(&site->mask, SLLogSiteComputeMask(site, table), __ATOMIC_RELAXED);
+    }
+}
+
+/// Must hold s_mutex
++ (NSMutableArray<NSValue *> *)currentRules
+{
+    SLLogFilterTable *table = atomic_load_explicit(&s_table, memory_order_relaxed);
+    NSMutableArray *rules = [NSMutableArray array];
+    for (NSUInteger i = 0; table && i < table->count; i++) {
+        [rules addObject:[NSValue valueWithBytes:&table->rules[i] objCType:@encode(SLLogFilterRule)]];
+    }
+    return rules;
+}
+
++ (void)setLevel:(SLLogLevel)level pattern:(NSString *)pattern isCallSite:(BOOL)isCallSite
+{
+    if (pattern.length == 0) {
+        return;
+    }
+
+    SLLogFilterRule rule;
+    rule.isPrefix = [pattern hasSuffix:@"*"];
+    rule.isCallSite = isCallSite;
+    rule.mask = (unsigned int)(level & SL_FILTER_MASK_ALL);
+    rule.pattern = strdup(pattern.UTF8String);
+    rule.length = strlen(rule.pattern) - (rule.isPrefix ? 1 : 0);
+
+    pthread_mutex_lock(&s_mutex);
+    {
+        NSMutableArray<NSValue *> *rules = [self currentRules];
+        for (NSUInteger i = 0; i < rules.count; i++) {
+            SLLogFilterRule existing;
+            [rules[i] getValue:&existing];
+            if (existing.isCallSite == isCallSite && strcmp(existing.pattern, rule.pattern) == 0) {
+                [rules removeObjectAtIndex:i];
+                break;
+            }
+        }
+        [rules addObject:[NSValue valueWithBytes:&rule objCType:@encode(SLLogFilterRule)]];
+        [self publishRules:rules];
+    }
+    pthread_mutex_unlock(&s_mutex);
+}
+
++ (void)setLevel:(SLLogLevel)level forTag:(NSString *)tagPattern
+{
+    [self setLevel:level pattern:tagPattern isCallSite:NO];
+}
+
++ (void)setLevel:(SLLogLevel)level forCallSite:(NSString *)sitePattern
+{
+    [self setLevel:level pattern:sitePattern isCallSite:YES];
+}
+
++ (void)removeFilter:(NSString *)pattern
+{
+    const char *cPattern = pattern.UTF8String;
+    if (cPattern == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&s_mutex);
+    {
+        NSMutableArray<NSValue *> *rules = [self currentRules];
+        NSMutableIndexSet *indexes = [NSMutableIndexSet indexSet];
+        for (NSUInteger i = 0; i < rules.count; i++) {
+            SLLogFilterRule existing;
+            [rules[i] getValue:&existing];
+            if (strcmp(existing.pattern, cPattern) == 0) {
+                [indexes addIndex:i];
+            }
+        }
+        if (indexes.count > 0) {
+            [rules removeObjectsAtIndexes:indexes];
+            [self publishRules:rules];
+        }
+    }
+    pthread_mutex_unlock(&s_mutex);
+}
+
++ (void)removeAllFilters
+{
+    pthread_mutex_lock(&s_mutex);
+    {
+        [self publishRules:@[]];
+    }
+    pthread_mutex_unlock(&s_mutex);
+}
+
++ (unsigned int)maskForTag:(id)tag
+{
+    SLLogFilterTable *table = atomic_load_explicit(&s_table, memory_order_acquire);
+    if (table == NULL || table->count == 0) {
+        return SL_FILTER_MASK_ALL;
+    }
+    return SLLogFilterResolve(table, SLLogFilterTagCString((__bridge const void *)tag), NULL, NULL);
+}
+
+@end
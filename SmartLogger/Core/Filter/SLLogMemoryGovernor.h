@@ -0,0 +1,110 @@
+//
+//  SLLogMemoryGovernor.h
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/12.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#ifndef SLLogMemoryGovernor_h
+#define SLLogMemoryGovernor_h
+
+#import "SLInterfaces.h"
+#import "SLLogMetrics.h"
+
+@class SLLogMessage;
+
+NS_ASSUME_NONNULL_BEGIN
+
+typedef NS_OPTIONS(NSUInteger, SLLogMemoryReaction) {
+    SLLogMemoryReactionNone     = 0,
+    /// Messages longer than maxMessageLength are cut, with a marker
+    SLLogMemoryReactionTruncate = (1 << 0),
+    /// Debug, then Info, then Warning are dropped as usage gets close to the budget
+    SLLogMemoryReactionShed     = (1 << 1),
+    /// Messages that would be shed, or any but Error over budget, go to a temp file and are logged later
+    SLLogMemoryReactionSpill    = (1 << 2),
+};
+
+typedef NS_ENUM(NSInteger, SLLogMemoryAdmission) {
+    SLLogMemoryAdmitted = 0,
+    /// Shed, or spill file is full
+    SLLogMemoryDropped,
+    /// Written to spill file, logged once usage is low again
+    SLLogMemorySpilled,
+};
+
+/**
+ * 日志内存预算.
+ *
+ * `_MAX_QUEUE_SIZE` 只限制消息条数, 100 KB 的消息排满队列就是 100 MB. 这里按字节统计日志管线持有的内存:
+ *  - 排队中的消息 (包括启动期间保留的消息): 入队时按文本 / 二进制参数大小计入, 所有 appender 写完后释放
+ *  - 格式化缓冲区: SLLogLine 的缓冲区按容量计入
+ * appender 在 `-[SLLogger mf_write:signal:]` 里同步处理完消息才释放, 所以消息的占用也覆盖了 appender 处理期间.
+ *
+ * 生产者线程入队前按配置处理:
+ *  - Truncate: 超过 maxMessageLength 的消息被截断
+ *  - Shed:     占用超过预算 50% 丢弃 Debug, 75% 丢弃 Info, 90% 丢弃 Warning, Error 永远不丢弃
+ *  - Spill:    本来要丢弃的消息 (没有 Shed 时为超过预算的消息, Error 除外) 写入临时文件, 占用降到预算 25% 以下后
+ *              在日志队列里读回并写入 appender. 保留原来的时间戳, 但会排在之后的消息后面. 临时文件在创建后
+ *              立即 unlink, 进程退出即释放, 崩溃时其中的消息会丢失 (不经过 crash flush).
+ *
+ * 系统内存压力 (DISPATCH_SOURCE_TYPE_MEMORYPRESSURE) 为 warning 时预算减半, critical 时为 1/4.
+ * 占用和峰值也在 `+[SLLogger metrics]` 的 gauges 里: memory_bytes / memory_bytes_max / memory_spilled.
+ */
+@interface SLLogMemoryGovernor : NSObject
+
+/// Bytes, 0 - not limited. Default 8 MB
+@property (class, nonatomic, assign) NSUInteger budget;
+/// Characters (UTF-16), 0 - not limited. Default 64K
+@property (class, nonatomic, assign) NSUInteger maxMessageLength;
+/// Default Truncate | Shed
+@property (class, nonatomic, assign) SLLogMemoryReaction reactions;
+/// Bytes the spill file may hold, messages are dropped after that. Default 32 MB
+@property (class, nonatomic, assign) NSUInteger spillLimit;
+
+/// Bytes currently held
+@property (class, nonatomic, readonly) NSUInteger usage;
+@property (class, nonatomic, readonly) NSUInteger peakUsage;
+/// Budget after system memory pressure
+@property (class, nonatomic, readonly) NSUInteger effectiveBudget;
+/// Messages waiting in spill file
+@property (class, nonatomic, readonly) NSUInteger spilledMessages;
+
+/**
+ * Called on producer thread before message is queued, truncates it in place and charges it
+ * if it is admitted. Dropped and spilled messages are recycled by the caller.
+ */
++ (SLLogMemoryAdmission)admitMessage:(SLLogMessage *)message;
+
+/**
+ * Binary messages are charged by their payload until decoded on global logging queue,
+ * then they are truncated and charged by their text.
+ */
++ (void)didDecodeMessage:(SLLogMessage *)message;
+
+/**
+ * Give back what message was charged, called on global logging queue once all appenders are done.
+ */
++ (void)releaseMessage:(SLLogMessage *)message;
+
+/**
+ * Called on global logging queue, spilled messages to log now if usage is low again, charged.
+ *  @return nil if nothing is due
+ */
++ (nullable NSArray<SLLogMessage *> *)drainSpilledMessages:(NSUInteger)maxCount;
+
+@end
+
+/// Formatter buffers and other long lived memory, `bytes` negative when freed. Lock free.
+static inline void SLLogMemoryCharge(int64_t bytes)
+{
+    int64_t used = __atomic_add_fetch(&SLLogMetricsGauges[SLLogGaugeMemoryBytes], bytes, __ATOMIC_RELAXED);
+    if (bytes > 0) {
+        SLLogMetricsRaiseGauge(SLLogGaugeMemoryBytesMax, used);
+    }
+}
+
+NS_ASSUME_NONNULL_END
+
+#endif /* SLLogMemoryGovernor_h */
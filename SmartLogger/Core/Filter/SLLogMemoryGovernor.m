@@ -0,0 +1,418 @@
+//
+//  SLLogMemoryGovernor.m
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/12.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#import "SLLogMemoryGovernor.h"
+#import "SLLogMessage.h"
+#import "SLLogClock.h"
+
+#import <pthread.h>
+#import <stdatomic.h>
+#import <unistd.h>
+
+#define SL_MEMORY_RECORD_OVERHEAD   256     // Message object, its strings and the queue entry
+#define SL_MEMORY_DRAIN_RATIO       4       // Spilled messages come back below budget / 4
+
+static _Atomic(NSUInteger) s_budget = 8 * 1024 * 1024;
+static _Atomic(NSUInteger) s_maxMessageLength = 64 * 1024;
+static _Atomic(NSUInteger) s_reactions = SLLogMemoryReactionTruncate | SLLogMemoryReactionShed;
+static _Atomic(NSUInteger) s_spillLimit = 32 * 1024 * 1024;
+
+/// 0 - normal, 1 - warning, 2 - critical, budget is shifted right by it
+static atomic_uint s_pressureShift = 0;
+static dispatch_source_t s_pressureSource;
+
+/// Spill file, unlinked once created
+typedef struct SLLogSpillRecord {
+    uint32_t size;          // Header and strings
+    uint32_t flag;
+    uint32_t level;
+    uint32_t line;
+    double timestamp;       // Since 1970
+    uint32_t lengths[7];    // UTF-8 file, function, tag, message, thread ID, thread name, queue label
+} SLLogSpillRecord;
+
+static pthread_mutex_t s_spillMutex = PTHREAD_MUTEX_INITIALIZER;
+static int s_spillFile = -1;
+static off_t s_spillReadOffset = 0;
+static off_t s_spillWriteOffset = 0;
+static _Atomic(NSUInteger) s_spillCount = 0;
+
+#pragma mark - Utilities
+
+static inline NSUInteger SLLogMemoryUsage(void)
+{
+    int64_t used = __atomic_load_n(&SLLogMetricsGauges[SLLogGaugeMemoryBytes], __ATOMIC_RELAXED);
+    return used > 0 ? (NSUInteger)used : 0;
+}
+
+static inline NSUInteger SLLogMemoryEffectiveBudget(void)
+{
+    return atomic_load_explicit(&s_budget, memory_order_relaxed) >> atomic_load_explicit(&s_pressureShift, memory_order_relaxed);
+}
+
+static inline NSUInteger SLLogMemoryCost(SLLogMessage *message)
+{
+    NSUInteger cost = SL_MEMORY_RECORD_OVERHEAD + message->_message.length * sizeof(unichar);
+    if (message->_binaryFormat) {
+        cost += message->_payload.length;
+    }
+    return cost;
+}
+
+/// Levels to shed once `used` bytes are held, lowest first, never Error
+static inline SLLogFlag SLLogMemoryShedFlags(uint64_t used, uint64_t budget)
+{
+    if (used * 10 > budget * 9) {
+        return SLLogFlagDebug | SLLogFlagInfo | SLLogFlagWarning;
+    }
+    if (used * 4 > budget * 3) {
+        return SLLogFlagDebug | SLLogFlagInfo;
+    }
+    if (used * 2 > budget) {
+        return SLLogFlagDebug;
+    }
+    return 0;
+}
+
+static void SLLogMemoryTruncate(SLLogMessage *message)
+{
+    NSUInteger limit = atomic_load_explicit(&s_maxMessageLength, memory_order_relaxed);
+    NSString *text = message->_message;
+    NSUInteger length = text.length;
+    if (limit == 0 || length <= limit) {
+        return;
+    }
+
+    // Don't split a surrogate pair or a composed character
+    NSUInteger keep = [text rangeOfComposedCharacterSequenceAtIndex:limit].location;
+    NSString *marker = [NSString stringWithFormat:@" ...[truncated %lu characters]", (unsigned long)(length - keep)];
+    if (text == message->_buffer) {
+        CFMutableStringRef buffer = (__bridge CFMutableStringRef)message->_buffer;
+        CFStringDelete(buffer, CFRangeMake((CFIndex)keep, (CFIndex)(length - keep)));
+        CFStringAppend(buffer, (__bridge CFStringRef)marker);
+    } else {
+        message->_message = [[text substringToIndex:keep] stringByAppendingString:marker];
+    }
+    SLLogMetricsIncrement(SLLogCounterTruncated, 1);
+}
+
+static NSString *SLLogMemorySpillString(id value)
+{
+    if (value == nil) {
+        return @"";
+    }
+    // Tags may be anything
+    return [value isKindOfClass:[NSString class]] ? value : [value description];
+}
+
+#pragma mark - Spill File
+
+/// Locked
+static BOOL SLLogSpillOpen(void)
+{
+    if (s_spillFile >= 0) {
+        return YES;
+    }
+
+    NSString *template = [NSTemporaryDirectory() stringByAppendingPathComponent:@"smartlogger-spill.XXXXXX"];
+    char path[PATH_MAX];
+    if (strlcpy(path, template.fileSystemRepresentation, sizeof(path)) >= sizeof(path)) {
+        return NO;
+    }
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        return NO;
+    }
+    // Nothing left behind, whatever way the process ends
+    unlink(path);
+    s_spillFile = fd;
+    return YES;
+}
+
+/// Locked
+static void SLLogSpillReset(void)
+{
+    if (s_spillFile >= 0) {
+        ftruncate(s_spillFile, 0);
+    }
+    s_spillReadOffset = 0;
+    s_spillWriteOffset = 0;
+    atomic_store_explicit(&s_spillCount, 0, memory_order_relaxed);
+}
+
+static BOOL SLLogSpillWrite(SLLogMessage *message)
+{
+    // Binary arguments have to be rendered here, spilling is rare
+    [message decodeBinaryPayload];
+
+    NSData *strings[7];
+    @autoreleasepool {
+        // Thread and queue of the producer, read back by the logging queue
+        NSString *values[7] = {
+            SLLogMemorySpillString(message->_file),
+            SLLogMemorySpillString(message->_function),
+            SLLogMemorySpillString(message->_tag),
+            SLLogMemorySpillString(message->_message),
+            SLLogMemorySpillString(message->_threadID),
+            SLLogMemorySpillString(message->_threadName),
+            SLLogMemorySpillString(message->_queueLabel),
+        };
+        for (int i = 0; i < 7; i++) {
+            strings[i] = [values[i] dataUsingEncoding:NSUTF8StringEncoding allowLossyConversion:YES] ?: [NSData data];
+        }
+    }
+
+    SLLogSpillRecord record = {
+        .size = sizeof(SLLogSpillRecord),
+        .flag = (uint32_t)message->_flag,
+        .level = (uint32_t)message->_level,
+        .line = (uint32_t)message->_line,
+        .timestamp = SLLogClockWallSeconds(message->_ticks ?: SLLogClockNow()),
+    };
+    NSMutableData *data = [NSMutableData dataWithCapacity:sizeof(record) + strings[3].length + 256];
+    [data setLength:sizeof(record)];
+    for (int i = 0; i < 7; i++) {
+        record.lengths[i] = (uint32_t)strings[i].length;
+        [data appendData:strings[i]];
+    }
+    record.size = (uint32_t)data.length;
+    memcpy(data.mutableBytes, &record, sizeof(record));
+
+    NSUInteger limit = atomic_load_explicit(&s_spillLimit, memory_order_relaxed);
+    BOOL written = NO;
+    pthread_mutex_lock(&s_spillMutex);
+    if (SLLogSpillOpen() && (NSUInteger)(s_spillWriteOffset - s_spillReadOffset) + data.length <= limit &&
+        pwrite(s_spillFile, data.bytes, data.length, s_spillWriteOffset) == (ssize_t)data.length) {
+        s_spillWriteOffset += (off_t)data.length;
+        NSUInteger count = atomic_fetch_add_explicit(&s_spillCount, 1, memory_order_relaxed) + 1;
+        SLLogMetricsSetGauge(SLLogGaugeMemorySpilled, (int64_t)count);
+        written = YES;
+    }
+    pthread_mutex_unlock(&s_spillMutex);
+
+    return written;
+}
+
+/// Locked
+static SLLogMessage *SLLogSpillRead(void)
+{
+    SLLogSpillRecord record;
+    if (pread(s_spillFile, &record, sizeof(record), s_spillReadOffset) != sizeof(record) || record.size < sizeof(record)) {
+        return nil;
+    }
+    NSMutableData *body = [NSMutableData dataWithLength:record.size - sizeof(record)];
+    if (pread(s_spillFile, body.mutableBytes, body.length, s_spillReadOffset + (off_t)sizeof(record)) != (ssize_t)body.length) {
+        return nil;
+    }
+
+    NSString *strings[7];
+    NSUInteger offset = 0;
+    for (int i = 0; i < 7; i++) {
+        if (offset + record.lengths[i] > body.length) {
+            return nil;
+        }
+        strings[i] = [[NSString alloc] initWithBytes:(const char *)body.bytes + offset
+                                              length:record.lengths[i]
+                                            encoding:NSUTF8StringEncoding] ?: @"";
+        offset += record.lengths[i];
+    }
+    s_spillReadOffset += record.size;
+
+    SLLogMessage *message = [[SLLogMessage alloc] initWithMessage:strings[3]
+                                                            level:(SLLogLevel)record.level
+                                                             flag:(SLLogFlag)record.flag
+                                                             file:strings[0]
+                                                         function:strings[1]
+                                                             line:record.line
+                                                              tag:strings[2]
+                                                        timestamp:[NSDate dateWithTimeIntervalSince1970:record.timestamp]];
+    // Not the replaying logging queue
+    message->_threadID = strings[4];
+    message->_threadName = strings[5].length > 0 ? strings[5] : nil;
+    message->_internedThreadName = message->_threadName ? SLLogLabelIntern(message->_threadName.UTF8String) : NULL;
+    message->_queueLabel = strings[6].length > 0 ? strings[6] : nil;
+    message->_internedQueueLabel = message->_queueLabel ? SLLogLabelIntern(message->_queueLabel.UTF8String) : NULL;
+    return message;
+}
+
+@implementation SLLogMemoryGovernor
+
++ (void)initialize
+{
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        s_pressureSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE, 0,
+                                                  DISPATCH_MEMORYPRESSURE_NORMAL | DISPATCH_MEMORYPRESSURE_WARN | DISPATCH_MEMORYPRESSURE_CRITICAL,
+                                                  dispatch_get_global_queue(QOS_CLASS_UTILITY, 0));
+        dispatch_source_set_event_handler(s_pressureSource, ^{
+            unsigned long status = dispatch_source_get_data(s_pressureSource);
+            unsigned int shift = 0;
+            if (status & DISPATCH_MEMORYPRESSURE_CRITICAL) {
+                shift = 2;
+            } else if (status & DISPATCH_MEMORYPRESSURE_WARN) {
+                shift = 1;
+            }
+            atomic_store_explicit(&s_pressureShift, shift, memory_order_relaxed);
+        });
+        dispatch_resume(s_pressureSource);
+    });
+}
+
+#pragma mark - Configuration
+
++ (NSUInteger)budget
+{
+    return atomic_load_explicit(&s_budget, memory_order_relaxed);
+}
+
++ (void)setBudget:(NSUInteger)budget
+{
+    atomic_store_explicit(&s_budget, budget, memory_order_relaxed);
+}
+
++ (NSUInteger)maxMessageLength
+{
+    return atomic_load_explicit(&s_maxMessageLength, memory_order_relaxed);
+}
+
++ (void)setMaxMessageLength:(NSUInteger)maxMessageLength
+{
+    atomic_store_explicit(&s_maxMessageLength, maxMessageLength, memory_order_relaxed);
+}
+
++ (SLLogMemoryReaction)reactions
+{
+    return atomic_load_explicit(&s_reactions, memory_order_relaxed);
+}
+
++ (void)setReactions:(SLLogMemoryReaction)reactions
+{
+    atomic_store_explicit(&s_reactions, reactions, memory_order_relaxed);
+}
+
++ (NSUInteger)spillLimit
+{
+    return atomic_load_explicit(&s_spillLimit, memory_order_relaxed);
+}
+
++ (void)setSpillLimit:(NSUInteger)spillLimit
+{
+    atomic_store_explicit(&s_spillLimit, spillLimit, memory_order_relaxed);
+}
+
++ (NSUInteger)usage
+{
+    return SLLogMemoryUsage();
+}
+
++ (NSUInteger)peakUsage
+{
+    int64_t peak = __atomic_load_n(&SLLogMetricsGauges[SLLogGaugeMemoryBytesMax], __ATOMIC_RELAXED);
+    return peak > 0 ? (NSUInteger)peak : 0;
+}
+
++ (NSUInteger)effectiveBudget
+{
+    return SLLogMemoryEffectiveBudget();
+}
+
++ (NSUInteger)spilledMessages
+{
+    return atomic_load_explicit(&s_spillCount, memory_order_relaxed);
+}
+
+#pragma mark - Producer
+
++ (SLLogMemoryAdmission)admitMessage:(SLLogMessage *)message
+{
+    SLLogMemoryReaction reactions = atomic_load_explicit(&s_reactions, memory_order_relaxed);
+    if (reactions & SLLogMemoryReactionTruncate) {
+        SLLogMemoryTruncate(message);
+    }
+
+    NSUInteger cost = SLLogMemoryCost(message);
+    NSUInteger budget = SLLogMemoryEffectiveBudget();
+    if (budget > 0) {
+        uint64_t used = (uint64_t)SLLogMemoryUsage() + cost;
+        BOOL shed = (reactions & SLLogMemoryReactionShed) && (SLLogMemoryShedFlags(used, budget) & message->_flag);
+        BOOL spill = (reactions & SLLogMemoryReactionSpill) &&
+                     (shed || (used > budget && !(message->_flag & SLLogFlagError)));
+
+        if (spill && SLLogSpillWrite(message)) {
+            SLLogMetricsIncrement(SLLogCounterSpilled, 1);
+            return SLLogMemorySpilled;
+        }
+        if (shed) {
+            SLLogMetricsIncrement(SLLogCounterMemoryShed, 1);
+            return SLLogMemoryDropped;
+        }
+        // Error, or nothing configured to react: the queue size is the only bound left
+    }
+
+    message->_memoryCost = cost;
+    SLLogMemoryCharge((int64_t)cost);
+    return SLLogMemoryAdmitted;
+}
+
+#pragma mark - Logging Queue
+
++ (void)didDecodeMessage:(SLLogMessage *)message
+{
+    if (atomic_load_explicit(&s_reactions, memory_order_relaxed) & SLLogMemoryReactionTruncate) {
+        SLLogMemoryTruncate(message);
+    }
+
+    NSUInteger cost = SLLogMemoryCost(message);
+    SLLogMemoryCharge((int64_t)cost - (int64_t)message->_memoryCost);
+    message->_memoryCost = cost;
+}
+
++ (void)releaseMessage:(SLLogMessage *)message
+{
+    if (message->_memoryCost > 0) {
+        SLLogMemoryCharge(-(int64_t)message->_memoryCost);
+        message->_memoryCost = 0;
+    }
+}
+
++ (NSArray<SLLogMessage *> *)drainSpilledMessages:(NSUInteger)maxCount
+{
+    if (atomic_load_explicit(&s_spillCount, memory_order_relaxed) == 0) {
+        return nil;
+    }
+    NSUInteger budget = SLLogMemoryEffectiveBudget();
+    if (budget > 0 && SLLogMemoryUsage() * SL_MEMORY_DRAIN_RATIO >= budget) {
+        return nil;
+    }
+
+    NSMutableArray<SLLogMessage *> *messages = [NSMutableArray arrayWithCapacity:maxCount];
+    pthread_mutex_lock(&s_spillMutex);
+    while (messages.count < maxCount && s_spillReadOffset < s_spillWriteOffset) {
+        SLLogMessage *message = SLLogSpillRead();
+        if (message == nil) {
+            // Short read or corrupted, what is left is lost
+            NSLog(@"SLLogMemoryGovernor: spill file unreadable, dropping %lu messages",
+                  (unsigned long)atomic_load_explicit(&s_spillCount, memory_order_relaxed));
+            SLLogSpillReset();
+            break;
+        }
+        atomic_fetch_sub_explicit(&s_spillCount, 1, memory_order_relaxed);
+        message->_memoryCost = SLLogMemoryCost(message);
+        SLLogMemoryCharge((int64_t)message->_memoryCost);
+        [messages addObject:message];
+    }
+    if (s_spillReadOffset >= s_spillWriteOffset) {
+        SLLogSpillReset();
+    }
+    SLLogMetricsSetGauge(SLLogGaugeMemorySpilled, (int64_t)atomic_load_explicit(&s_spillCount, memory_order_relaxed));
+    pthread_mutex_unlock(&s_spillMutex);
+
+    return messages;
+}
+
+@end
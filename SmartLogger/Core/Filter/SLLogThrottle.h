@@ -0,0 +1,69 @@
+//
+//  SLLogThrottle.h
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/3.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#ifndef SLLogThrottle_h
+#define SLLogThrottle_h
+
+#import "SLInterfaces.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+typedef NS_ENUM(NSInteger, SLLogPressure) {
+    /// Nothing is dropped
+    SLLogPressureNormal = 0,
+    /// Debug/Info are sampled, call sites are rate limited
+    SLLogPressureElevated,
+    /// Heavier sampling, Warning is rate limited too
+    SLLogPressureHigh,
+};
+
+/**
+ * 背压下的自适应采样/限流.
+ *
+ * 根据日志队列深度和 appender 延迟计算压力等级:
+ *  - Normal   : 不丢弃
+ *  - Elevated : Debug 1/4 采样, Info 1/2 采样, 每个调用点 token bucket 限流
+ *  - High     : Debug 1/16 采样, Info 1/4 采样, Warning 也参与限流
+ * Error 永远不会被丢弃.
+ *
+ * 被丢弃的数量按调用点统计，定期输出 "dropped N messages from site X" 汇总日志.
+ */
+@interface SLLogThrottle : NSObject
+
+/// Default YES
+@property (class, nonatomic, assign) BOOL enabled;
+/// Token bucket refill rate per call site under pressure, default 50 per second
+@property (class, nonatomic, assign) NSUInteger messagesPerSecond;
+/// Summary interval, default 10 seconds
+@property (class, nonatomic, assign) NSTimeInterval summaryInterval;
+/// Current pressure
+@property (class, nonatomic, readonly) SLLogPressure pressure;
+
+/**
+ * Called on producer thread before message is formatted.
+ *  @param sampleRate   1 if not sampled, N if only 1-in-N messages are kept
+ *  @return NO if message should be dropped
+ */
++ (BOOL)shouldLogFlag:(SLLogFlag)flag
+                 file:(const char *)file
+                 line:(NSUInteger)line
+           sampleRate:(NSUInteger *)sampleRate;
+
+/**
+ * Called on global logging queue after each message is dispatched to appenders.
+ *  @param depth    messages waiting in queue
+ *  @param capacity queue capacity
+ *  @param lag      seconds from message creation to appenders done
+ */
++ (void)reportQueueDepth:(NSUInteger)depth capacity:(NSUInteger)capacity lag:(NSTimeInterval)lag;
+
+@end
+
+NS_ASSUME_NONNULL_END
+
+#endif /* SLLogThrottle_h */
@@ -0,0 +1,315 @@
+//
+//  SLLogThrottle.m
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/3.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#import "SLLogThrottle.h"
+#import "SLLogger.h"
+#import "SLLogMetrics.h"
+
+#import <mach/mach_time.h>
+#import <stdatomic.h>
+
+#define SL_THROTTLE_SLOTS       512     // Should be power of 2
+#define SL_THROTTLE_MAX_PROBE   8
+#define SL_THROTTLE_BURST       2       // Bucket capacity in seconds of refill
+
+typedef struct SLThrottleSlot {
+    _Atomic(uintptr_t) key;
+    atomic_flag lock;
+    const char *file;
+    NSUInteger line;
+    double tokens;
+    uint64_t lastRefill;
+    _Atomic(uint32_t) dropped;
+} SLThrottleSlot;
+
+static SLThrottleSlot s_slots[SL_THROTTLE_SLOTS];
+
+static atomic_bool s_enabled = true;
+static _Atomic(NSUInteger) s_messagesPerSecond = 50;
+static _Atomic(NSInteger) s_pressure = SLLogPressureNormal;
+static _Atomic(uint64_t) s_droppedTotal = 0;
+
+/// Only accessed on global logging queue
+static NSTimeInterval s_lagAverage = 0;
+
+static dispatch_source_t s_summaryTimer;
+static NSTimeInterval s_summaryInterval = 10;
+
+static __thread uint32_t t_random = 0;
+
+#pragma mark - Utilities
+
+static inline uint64_t SLThrottleNow(void)
+{
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0) {
+        mach_timebase_info(&timebase);
+    }
+    return mach_absolute_time() * timebase.numer / timebase.denom;
+}
+
+/// xorshift32, per thread, no locking
+static inline uint32_t SLThrottleRandom(void)
+{
+    uint32_t x = t_random;
+    if (x == 0) {
+        x = (uint32_t)(uintptr_t)&x ^ (uint32_t)mach_absolute_time();
+        x = x ?: 0x9E3779B9u;
+    }
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    t_random = x;
+    return x;
+}
+
+static inline uintptr_t SLThrottleSiteKey(const char *file, NSUInteger line)
+{
+    // __FILE__ is a string literal, its address identifies the file
+    uintptr_t key = (uintptr_t)file ^ ((uintptr_t)line * 0x9E3779B97F4A7C15ull);
+    return key ?: 1;
+}
+
+static SLThrottleSlot *SLThrottleSlotForSite(const char *file, NSUInteger line)
+{
+    uintptr_t key = SLThrottleSiteKey(file, line);
+    NSUInteger index = (NSUInteger)((key >> 4) ^ (key >> 17)) & (SL_THROTTLE_SLOTS - 1);
+
+    for (int probe = 0; probe < SL_THROTTLE_MAX_PROBE; probe++) {
+        SLThrottleSlot *slot = &s_slots[(index + probe) & (SL_THROTTLE_SLOTS - 1)];
+        uintptr_t current = atomic_load_explicit(&slot->key, memory_order_acquire);
+        if (current == key) {
+            return slot;
+        }
+        if (current == 0) {
+            uintptr_t expected = 0;
+            if (atomic_compare_exchange_strong(&slot->key, &expected, key)) {
+                while (atomic_flag_test_and_set_explicit(&slot->lock, memory_order_acquire)) {}
+                slot->file = file;
+                slot->line = line;
+                slot->tokens = (double)atomic_load_explicit(&s_messagesPerSecond, memory_order_relaxed) * SL_THROTTLE_BURST;
+                slot->lastRefill = SLThrottleNow();
+                atomic_flag_clear_explicit(&slot->lock, memory_order_release);
+                return slot;
+            }
+            if (expected == key) {
+                return slot;
+            }
+        }
+    }
+    // Table is crowded, no rate limit for this site
+    return NULL;
+}
+
+static BOOL SLThrottleTakeToken(SLThrottleSlot *slot)
+{
+    double rate = (double)atomic_load_explicit(&s_messagesPerSecond, memory_order_relaxed);
+    BOOL allowed;
+
+    while (atomic_flag_test_and_set_explicit(&slot->lock, memory_order_acquire)) {}
+    {
+        uint64_t now = SLThrottleNow();
+        double elapsed = (double)(now - slot->lastRefill) / NSEC_PER_SEC;
+        slot->lastRefill = now;
+        slot->tokens = MIN(slot->tokens + elapsed * rate, rate * SL_THROTTLE_BURST);
+        allowed = slot->tokens >= 1.0;
+        if (allowed) {
+            slot->tokens -= 1.0;
+        }
+    }
+    atomic_flag_clear_explicit(&slot->lock, memory_order_release);
+
+    return allowed;
+}
+
+static inline NSUInteger SLThrottleSampleRate(SLLogFlag flag, SLLogPressure pressure)
+{
+    if (flag & SLLogFlagDebug) {
+        return pressure == SLLogPressureHigh ? 16 : 4;
+    }
+    if (flag & SLLogFlagInfo) {
+        return pressure == SLLogPressureHigh ? 4 : 2;
+    }
+    return 1;
+}
+
+@implementation SLLogThrottle
+
+#pragma mark - Configuration
+
++ (BOOL)enabled
+{
+    return atomic_load_explicit(&s_enabled, memory_order_relaxed);
+}
+
++ (void)setEnabled:(BOOL)enabled
+{
+    atomic_store_explicit(&s_enabled, enabled, memory_order_relaxed);
+    if (!enabled) {
+        atomic_store_explicit(&s_pressure, SLLogPressureNormal, memory_order_relaxed);
+    }
+}
+
++ (NSUInteger)messagesPerSecond
+{
+    return atomic_load_explicit(&s_messagesPerSecond, memory_order_relaxed);
+}
+
++ (void)setMessagesPerSecond:(NSUInteger)messagesPerSecond
+{
+    atomic_store_explicit(&s_messagesPerSecond, MAX(messagesPerSecond, (NSUInteger)1), memory_order_relaxed);
+}
+
++ (NSTimeInterval)summaryInterval
+{
+    return s_summaryInterval;
+}
+
++ (void)setSummaryInterval:(NSTimeInterval)summaryInterval
+{
+    dispatch_async([SLLogger globalLoggingQueue], ^{
+        s_summaryInterval = MAX(summaryInterval, 1.0);
+        if (s_summaryTimer) {
+            dispatch_source_set_timer(s_summaryTimer,
+                                      dispatch_time(DISPATCH_TIME_NOW, (int64_t)(s_summaryInterval * NSEC_PER_SEC)),
+                                      (uint64_t)(s_summaryInterval * NSEC_PER_SEC),
+                                      NSEC_PER_SEC);
+        }
+    });
+}
+
++ (SLLogPressure)pressure
+{
+    return (SLLogPressure)atomic_load_explicit(&s_pressure, memory_order_relaxed);
+}
+
+#pragma mark - Producer
+
++ (BOOL)shouldLogFlag:(SLLogFlag)flag
+                 file:(const char *)file
+                 line:(NSUInteger)line
+           sampleRate:(NSUInteger *)sampleRate
+{
+    *sampleRate = 1;
+
+    SLLogPressure pressure = (SLLogPressure)atomic_load_explicit(&s_pressure, memory_order_relaxed);
+    if (pressure == SLLogPressureNormal || (flag & SLLogFlagError)) {
+        return YES;
+    }
+
+    BOOL keep = YES;
+    NSUInteger rate = SLThrottleSampleRate(flag, pressure);
+    if (rate > 1 && (SLThrottleRandom() % rate) != 0) {
+        keep = NO;
+    }
+
+    SLThrottleSlot *slot = SLThrottleSlotForSite(file, line);
+    if (keep && slot && ((flag & (SLLogFlagDebug | SLLogFlagInfo)) || pressure == SLLogPressureHigh)) {
+        keep = SLThrottleTakeToken(slot);
+    }
+
+    if (!keep) {
+        if (slot) {
+            atomic_fetch_add_explicit(&slot->dropped, 1, memory_order_relaxed);
+        }
+        atomic_fetch_add_explicit(&s_droppedTotal, 1, memory_order_relaxed);
+        SLLogMetricsIncrement(SLLogCounterDropped, 1);
+        [self scheduleSummaryIfNeeded];
+        return NO;
+    }
+
+    *sampleRate = rate;
+    return YES;
+}
+
+#pragma mark - Controller
+
++ (void)reportQueueDepth:(NSUInteger)depth capacity:(NSUInteger)capacity lag:(NSTimeInterval)lag
+{
+    if (!atomic_load_explicit(&s_enabled, memory_order_relaxed)) {
+        return;
+    }
+
+    // EWMA, alpha = 1/8
+    s_lagAverage += (lag - s_lagAverage) / 8.0;
+
+    double fill = capacity > 0 ? (double)depth / (double)capacity : 0;
+    SLLogPressure current = (SLLogPressure)atomic_load_explicit(&s_pressure, memory_order_relaxed);
+    SLLogPressure next = current;
+
+    if (fill >= 0.8 || s_lagAverage >= 0.5) {
+        next = SLLogPressureHigh;
+    } else if (fill >= 0.5 || s_lagAverage >= 0.1) {
+        next = MAX(current, SLLogPressureElevated);
+        if (current == SLLogPressureHigh && fill < 0.6 && s_lagAverage < 0.3) {
+            next = SLLogPressureElevated;
+        }
+    } else if (fill < 0.25 && s_lagAverage < 0.05) {
+        // Hysteresis, only relax when well below the threshold
+        next = SLLogPressureNormal;
+    }
+
+    if (next != current) {
+        atomic_store_explicit(&s_pressure, next, memory_order_relaxed);
+    }
+}
+
+#pragma mark - Summary
+
++ (void)scheduleSummaryIfNeeded
+{
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        dispatch_async([SLLogger globalLoggingQueue], ^{
+            dispatch_queue_t queue = dispatch_queue_create("smartlogger.throttle", NULL);
+            s_summaryTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, queue);
+            dispatch_source_set_event_handler(s_summaryTimer, ^{ @autoreleasepool {
+                [SLLogThrottle writeSummary];
+            } });
+            dispatch_source_set_timer(s_summaryTimer,
+                                      dispatch_time(DISPATCH_TIME_NOW, (int64_t)(s_summaryInterval * NSEC_PER_SEC)),
+                                      (uint64_t)(s_summaryInterval * NSEC_PER_SEC),
+                                      NSEC_PER_SEC);
+            dispatch_resume(s_summaryTimer);
+        });
+    });
+}
+
++ (void)writeSummary
+{
+    uint64_t total = atomic_exchange_explicit(&s_droppedTotal, 0, memory_order_relaxed);
+    if (total == 0) {
+        return;
+    }
+
+    NSMutableString *summary = [NSMutableString stringWithFormat:@"dropped %llu messages under pressure %ld",
+                                total, (long)[self pressure]];
+    uint64_t attributed = 0;
+    for (NSUInteger i = 0; i < SL_THROTTLE_SLOTS; i++) {
+        SLThrottleSlot *slot = &s_slots[i];
+        if (atomic_load_explicit(&slot->key, memory_order_acquire) == 0) {
+            continue;
+        }
+        uint32_t dropped = atomic_exchange_explicit(&slot->dropped, 0, memory_order_relaxed);
+        if (dropped == 0 || slot->file == NULL) {
+            continue;
+        }
+        const char *fileName = strrchr(slot->file, '/');
+        fileName = fileName ? fileName + 1 : slot->file;
+        [summary appendFormat:@"\n  dropped %u messages from site %s:%lu", dropped, fileName, (unsigned long)slot->line];
+        attributed += dropped;
+    }
+    if (attributed < total) {
+        [summary appendFormat:@"\n  dropped %llu messages from untracked sites", total - attributed];
+    }
+
+    // Bypass throttle, directlog is never sampled
+    [SLLogger directlog:YES tag:@"SmartLogger" message:summary];
+}
+
+@end
@@ -0,0 +1,253 @@
+//
+//  SLBinaryFormat.cpp
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/6.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#include "SLBinaryFormat.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+struct SLBinaryReader {
+    const uint8_t *cursor;
+    const uint8_t *end;
+    unsigned remaining;
+
+    bool read(void *value, size_t size) {
+        if ((size_t)(end - cursor) < size) {
+            return false;
+        }
+        memcpy(value, cursor, size);
+        cursor += size;
+        return true;
+    }
+};
+
+struct SLBinaryArg {
+    uint8_t type;
+    uint8_t size;       // Of integers as passed to printf
+    union {
+        int64_t i;
+        uint64_t u;
+        double d;
+    } value;
+    const char *string;
+    uint32_t length;
+};
+
+bool SLBinaryReadArg(SLBinaryReader &reader, SLBinaryArg &arg) {
+    if (reader.remaining == 0 || !reader.read(&arg.type, 1)) {
+        return false;
+    }
+    reader.remaining--;
+    arg.size = arg.type >> SL_BINARY_SIZE_SHIFT;
+    arg.type &= SL_BINARY_TYPE_MASK;
+    if (arg.size == 0 || arg.size > sizeof(uint64_t)) {
+        arg.size = sizeof(uint64_t);
+    }
+    switch (arg.type) {
+        case SLBinaryArgInt64:
+        case SLBinaryArgUInt64:
+        case SLBinaryArgDouble:
+        case SLBinaryArgPointer:
+            return reader.read(&arg.value, sizeof(arg.value));
+        case SLBinaryArgString:
+            if (!reader.read(&arg.length, sizeof(arg.length)) || (size_t)(reader.end - reader.cursor) < arg.length) {
+                return false;
+            }
+            arg.string = (const char *)reader.cursor;
+            reader.cursor += arg.length;
+            return true;
+        default:
+            return false;
+    }
+}
+
+const char kSLBinaryUnknown[] = "<?>";
+
+// Size the length modifier converts the argument to, 0 without modifier
+size_t SLBinaryModifierSize(const char *modifier, size_t length) {
+    if (length == 0) {
+        return 0;
+    }
+    switch (modifier[0]) {
+        case 'h': return length > 1 ? sizeof(char) : sizeof(short);
+        case 'l': return length > 1 ? sizeof(long long) : sizeof(long);
+        case 'q': return sizeof(long long);
+        case 'j': return sizeof(intmax_t);
+        case 'z': return sizeof(size_t);
+        case 't': return sizeof(ptrdiff_t);
+        default: return 0;
+    }
+}
+
+// Integer as printf would see it after conversion to `size` bytes, signed or not
+uint64_t SLBinaryConvertInteger(uint64_t value, size_t size, bool isSigned) {
+    if (size >= sizeof(uint64_t)) {
+        return value;
+    }
+    uint64_t mask = (1ull << (size * 8)) - 1;
+    value &= mask;
+    if (isSigned && (value >> (size * 8 - 1)) != 0) {
+        value |= ~mask;
+    }
+    return value;
+}
+
+} // namespace
+
+int SLBinaryDecode(const char *format, const void *buffer, size_t length, SLBinaryDecodeSink sink, void *context) {
+    if (format == NULL || sink == NULL) {
+        return -1;
+    }
+
+    SLBinaryReader reader = { (const uint8_t *)buffer, (const uint8_t *)buffer + length, 0 };
+    uint8_t header[SL_BINARY_HEADER_SIZE] = { 0, 0 };
+    if (buffer == NULL || !reader.read(header, sizeof(header))) {
+        reader.end = reader.cursor;
+    }
+    reader.remaining = header[1];
+
+    int status = 0;
+    const char *literal = format;
+    const char *p = format;
+    char rendered[128];
+
+    while (*p != '\0') {
+        if (*p != '%') {
+            p++;
+            continue;
+        }
+        if (p > literal) {
+            sink(context, literal, (size_t)(p - literal));
+        }
+        if (p[1] == '%') {
+            sink(context, "%", 1);
+            p += 2;
+            literal = p;
+            continue;
+        }
+
+        // Parse "%[flags][width][.precision][length]conversion"
+        const char *start = p++;
+        while (*p && strchr("-+ #0", *p)) p++;
+        while (*p >= '0' && *p <= '9') p++;
+        const char *precision = NULL;
+        if (*p == '.') {
+            precision = ++p;
+            while (*p >= '0' && *p <= '9') p++;
+        }
+        const char *lengthModifier = p;
+        while (*p && strchr("hlqzjtL", *p)) p++;
+        char conversion = *p;
+        if (conversion == '\0') {
+            sink(context, start, (size_t)(p - start));
+            literal = p;
+            break;
+        }
+        p++;
+        literal = p;
+
+        // Spec without length modifier and conversion, e.g. "%-08.3"
+        char spec[32];
+        size_t specLength = (size_t)(lengthModifier - start);
+        if (specLength > sizeof(spec) - 4) {
+            specLength = sizeof(spec) - 4;
+        }
+        memcpy(spec, start, specLength);
+
+        SLBinaryArg arg;
+        if (!SLBinaryReadArg(reader, arg)) {
+            sink(context, kSLBinaryUnknown, sizeof(kSLBinaryUnknown) - 1);
+            status = -1;
+            continue;
+        }
+
+        int written = -1;
+        switch (conversion) {
+            case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+                if (arg.type == SLBinaryArgInt64 || arg.type == SLBinaryArgUInt64) {
+                    if (conversion == 'c') {
+                        spec[specLength] = 'c';
+                        spec[specLength + 1] = '\0';
+                        written = snprintf(rendered, sizeof(rendered), spec, (int)arg.value.i);
+                    } else {
+                        // The format's modifier if any, else the argument's own size
+                        size_t size = SLBinaryModifierSize(lengthModifier, (size_t)(p - 1 - lengthModifier));
+                        bool isSigned = conversion == 'd' || conversion == 'i';
+                        uint64_t value = SLBinaryConvertInteger(arg.value.u, size ? size : arg.size, isSigned);
+                        spec[specLength] = 'l';
+                        spec[specLength + 1] = 'l';
+                        spec[specLength + 2] = conversion;
+                        spec[specLength + 3] = '\0';
+                        written = isSigned
+                            ? snprintf(rendered, sizeof(rendered), spec, (long long)value)
+                            : snprintf(rendered, sizeof(rendered), spec, (unsigned long long)value);
+                    }
+                }
+                break;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                if (arg.type == SLBinaryArgDouble) {
+                    spec[specLength] = conversion;
+                    spec[specLength + 1] = '\0';
+                    written = snprintf(rendered, sizeof(rendered), spec, arg.value.d);
+                }
+                break;
+            case 'p':
+                if (arg.type == SLBinaryArgPointer) {
+                    spec[specLength] = 'p';
+                    spec[specLength + 1] = '\0';
+                    written = snprintf(rendered, sizeof(rendered), spec, (void *)(uintptr_t)arg.value.u);
+                }
+                break;
+            case 's': case '@':
+                if (arg.type == SLBinaryArgString) {
+                    // Strings are not zero terminated, honour precision by hand
+                    uint32_t shown = arg.length;
+                    if (precision) {
+                        unsigned long limit = strtoul(precision, NULL, 10);
+                        if (limit < shown) {
+                            shown = (uint32_t)limit;
+                        }
+                    }
+                    const char *width = start + 1;
+                    while (*width && strchr("-+ #0", *width)) width++;
+                    unsigned long padding = strtoul(width, NULL, 10);
+                    bool leftAlign = memchr(start, '-', (size_t)(width - start)) != NULL;
+                    if (!leftAlign) {
+                        for (unsigned long i = shown; i < padding; i++) sink(context, " ", 1);
+                    }
+                    sink(context, arg.string, shown);
+                    if (leftAlign) {
+                        for (unsigned long i = shown; i < padding; i++) sink(context, " ", 1);
+                    }
+                    written = 0;
+                }
+                break;
+            default:
+                break;
+        }
+
+        if (written < 0) {
+            sink(context, kSLBinaryUnknown, sizeof(kSLBinaryUnknown) - 1);
+            status = -1;
+        } else if (written > 0) {
+            sink(context, rendered, (size_t)written < sizeof(rendered) ? (size_t)written : sizeof(rendered) - 1);
+        }
+    }
+
+    if (*literal != '\0') {
+        sink(context, literal, strlen(literal));
+    }
+    if (header[0] & SL_BINARY_FLAG_TRUNCATED) {
+        sink(context, " <truncated>", 12);
+    }
+    return status;
+}
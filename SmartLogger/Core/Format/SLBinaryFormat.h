@@ -0,0 +1,54 @@
+//
+//  SLBinaryFormat.h
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/6.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#ifndef SLBinaryFormat_h
+#define SLBinaryFormat_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if __cplusplus
+extern "C" {
+#endif
+
+// Binary argument buffer written by SLBinaryCapture (SLBinaryFormat.hpp):
+//
+//   [uint8 flags][uint8 count] { [uint8 type][value] } * count
+//
+// Values are stored in native byte order, strings as [uint32 length][bytes] without
+// trailing zero. Integers are widened to 64 bits, the high 4 bits of their type byte keep
+// the argument's size after integer promotion so %x / %u / %o render as printf would. The format string
+// itself is not stored, it must be a string literal and is passed to the decoder separately.
+typedef enum SLBinaryArgType {
+    SLBinaryArgInt64 = 1,
+    SLBinaryArgUInt64,
+    SLBinaryArgDouble,
+    SLBinaryArgString,
+    SLBinaryArgPointer,
+} SLBinaryArgType;
+
+#define SL_BINARY_TYPE_MASK         0x0F
+#define SL_BINARY_SIZE_SHIFT        4
+
+#define SL_BINARY_FLAG_TRUNCATED    0x01
+#define SL_BINARY_HEADER_SIZE       2
+// Default capture buffer used by the LogXxxT macros
+#define SL_BINARY_LOG_CAPACITY      512
+
+typedef void (*SLBinaryDecodeSink)(void *context, const char *bytes, size_t length);
+
+// Renders format with the captured arguments, output is passed to sink in chunks.
+// Missing or mismatched arguments are rendered as "<?>".
+// Returns 0 on success, -1 if buffer is malformed.
+int SLBinaryDecode(const char *format, const void *buffer, size_t length, SLBinaryDecodeSink sink, void *context);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SLBinaryFormat_h */
@@ -0,0 +1,349 @@
+//
+//  SLBinaryFormat.hpp
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/6.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#ifndef SLBinaryFormat_hpp
+#define SLBinaryFormat_hpp
+
+#include "SLBinaryFormat.h"
+
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+// C++ front end for binary logging.
+//
+// SL_BINARY_FORMAT_CHECK parses a printf style format literal at compile time and checks every
+// conversion against the argument type, so a mismatch is a compile error instead of garbage at
+// runtime. SLBinaryCapture copies the arguments into a flat buffer by type, no formatting happens
+// on the caller's thread; SLBinaryDecode renders the buffer later.
+//
+// Supported conversions: d i u x X o c (integers and enums), f F e E g G a A (floating point),
+// s (char pointers and std::string), p (non-char pointers), @ (ObjC objects, ObjC++ only).
+// Flags, width, precision and length modifiers are accepted, '*' width/precision is not.
+//
+// Plain C++14, only the @ conversion depends on the ObjC runtime.
+
+// Compile time format parsing
+
+// Index of the conversion character of the specifier starting at format[i] == '%'
+constexpr size_t SLFormatConversionIndex(const char *format, size_t i) {
+    i++;
+    while (format[i] == '-' || format[i] == '+' || format[i] == ' ' || format[i] == '#' || format[i] == '0') {
+        i++;
+    }
+    while (format[i] >= '0' && format[i] <= '9') {
+        i++;
+    }
+    if (format[i] == '.') {
+        i++;
+        while (format[i] >= '0' && format[i] <= '9') {
+            i++;
+        }
+    }
+    while (format[i] == 'h' || format[i] == 'l' || format[i] == 'q' || format[i] == 'z' ||
+           format[i] == 'j' || format[i] == 't' || format[i] == 'L') {
+        i++;
+    }
+    return i;
+}
+
+// Conversion character of the specifier starting at format[i] == '%', 0 if invalid
+constexpr char SLFormatConversion(const char *format, size_t i) {
+    char c = format[SLFormatConversionIndex(format, i)];
+    switch (c) {
+        case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        case 's': case 'p': case '@':
+            return c;
+        default:
+            return 0;
+    }
+}
+
+// Index just after the specifier starting at format[i] == '%'
+constexpr size_t SLFormatSkipSpecifier(const char *format, size_t i) {
+    if (format[i + 1] == '%') {
+        return i + 2;
+    }
+    size_t end = SLFormatConversionIndex(format, i);
+    return format[end] != '\0' ? end + 1 : end;
+}
+
+// Number of conversions, -1 if any specifier is invalid
+constexpr int SLFormatCount(const char *format) {
+    int count = 0;
+    size_t i = 0;
+    while (format[i] != '\0') {
+        if (format[i] != '%') {
+            i++;
+            continue;
+        }
+        if (format[i + 1] == '%') {
+            i += 2;
+            continue;
+        }
+        if (SLFormatConversion(format, i) == 0) {
+            return -1;
+        }
+        count++;
+        i = SLFormatSkipSpecifier(format, i);
+    }
+    return count;
+}
+
+// Conversion character of the n-th specifier
+constexpr char SLFormatConversionAt(const char *format, int n) {
+    size_t i = 0;
+    while (format[i] != '\0') {
+        if (format[i] != '%') {
+            i++;
+            continue;
+        }
+        if (format[i + 1] == '%') {
+            i += 2;
+            continue;
+        }
+        if (n == 0) {
+            return SLFormatConversion(format, i);
+        }
+        n--;
+        i = SLFormatSkipSpecifier(format, i);
+    }
+    return 0;
+}
+
+// Type checking
+
+template <typename T>
+struct SLFormatIsString : std::integral_constant<bool,
+    std::is_same<T, char *>::value || std::is_same<T, const char *>::value ||
+    std::is_same<T, std::string>::value> {};
+
+#ifdef __OBJC__
+template <typename T>
+struct SLFormatIsObject : std::integral_constant<bool,
+    std::is_pointer<T>::value && std::is_convertible<T, id>::value> {};
+#else
+template <typename T>
+struct SLFormatIsObject : std::false_type {};
+#endif
+
+template <typename T>
+constexpr bool SLFormatAccepts(char conversion) {
+    using U = typename std::decay<T>::type;
+    switch (conversion) {
+        case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+            return std::is_integral<U>::value || std::is_enum<U>::value;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            return std::is_floating_point<U>::value;
+        case 's':
+            return SLFormatIsString<U>::value;
+        case 'p':
+            // char pointers are captured as strings, cast to void * for %p
+            return (std::is_pointer<U>::value || std::is_same<U, std::nullptr_t>::value) &&
+                   !SLFormatIsString<U>::value && !SLFormatIsObject<U>::value;
+        case '@':
+            return SLFormatIsObject<U>::value;
+        default:
+            return false;
+    }
+}
+
+template <typename... Args>
+struct SLFormatTypeList {
+    template <int I>
+    static constexpr bool matches(const char *) {
+        return true;
+    }
+};
+
+template <typename T, typename... Rest>
+struct SLFormatTypeList<T, Rest...> {
+    template <int I>
+    static constexpr bool matches(const char *format) {
+        return SLFormatAccepts<T>(SLFormatConversionAt(format, I)) &&
+               SLFormatTypeList<Rest...>::template matches<I + 1>(format);
+    }
+};
+
+template <typename... Args>
+constexpr bool SLFormatMatches(const char *format) {
+    return SLFormatCount(format) == (int)sizeof...(Args) &&
+           SLFormatTypeList<Args...>::template matches<0>(format);
+}
+
+// Only used in unevaluated context to collect argument types
+template <typename... Args>
+SLFormatTypeList<Args...> SLFormatTypesOf(const Args &...);
+
+template <typename... Args>
+constexpr bool SLFormatMatchesList(const char *format, SLFormatTypeList<Args...> *) {
+    return SLFormatMatches<Args...>(format);
+}
+
+// Compile error if format literal does not match the arguments
+#define SL_BINARY_FORMAT_CHECK(frmt, ...) \
+    static_assert(SLFormatCount(frmt) >= 0, "SmartLogger: invalid format specifier"); \
+    static_assert(SLFormatMatchesList(frmt, (decltype(SLFormatTypesOf(__VA_ARGS__)) *)nullptr), \
+                  "SmartLogger: format specifiers do not match arguments")
+
+// Capture
+
+class SLBinaryWriter {
+public:
+    SLBinaryWriter(void *buffer, size_t capacity)
+        : _begin(static_cast<uint8_t *>(buffer)), _cursor(_begin), _end(_begin + capacity) {
+        if (capacity >= SL_BINARY_HEADER_SIZE) {
+            _begin[0] = 0;
+            _begin[1] = 0;
+            _cursor += SL_BINARY_HEADER_SIZE;
+        } else {
+            _end = _begin;
+        }
+    }
+
+    size_t size() const { return (size_t)(_cursor - _begin); }
+
+    // `size` of the argument as passed to printf
+    void putInt(int64_t value, size_t size) {
+        putScalar(SLBinaryArgInt64 | (size << SL_BINARY_SIZE_SHIFT), &value, sizeof(value));
+    }
+    void putUInt(uint64_t value, size_t size) {
+        putScalar(SLBinaryArgUInt64 | (size << SL_BINARY_SIZE_SHIFT), &value, sizeof(value));
+    }
+    void putDouble(double value) { putScalar(SLBinaryArgDouble, &value, sizeof(value)); }
+    void putPointer(const void *value) {
+        uint64_t address = (uint64_t)(uintptr_t)value;
+        putScalar(SLBinaryArgPointer, &address, sizeof(address));
+    }
+
+    void putString(const char *string, size_t length) {
+        if (!reserve(1 + sizeof(uint32_t))) {
+            return;
+        }
+        size_t room = (size_t)(_end - _cursor) - 1 - sizeof(uint32_t);
+        if (length > room) {
+            length = room;
+            _begin[0] |= SL_BINARY_FLAG_TRUNCATED;
+        }
+        uint32_t stored = (uint32_t)length;
+        *_cursor++ = SLBinaryArgString;
+        memcpy(_cursor, &stored, sizeof(stored));
+        _cursor += sizeof(stored);
+        memcpy(_cursor, string, length);
+        _cursor += length;
+        _begin[1]++;
+    }
+
+private:
+    bool reserve(size_t bytes) {
+        if (_end == _begin || (size_t)(_end - _cursor) < bytes || _begin[1] == UINT8_MAX) {
+            if (_end != _begin) {
+                _begin[0] |= SL_BINARY_FLAG_TRUNCATED;
+            }
+            return false;
+        }
+        return true;
+    }
+
+    void putScalar(size_t type, const void *value, size_t size) {
+        if (!reserve(1 + size)) {
+            return;
+        }
+        *_cursor++ = (uint8_t)type;
+        memcpy(_cursor, value, size);
+        _cursor += size;
+        _begin[1]++;
+    }
+
+    uint8_t *_begin;
+    uint8_t *_cursor;
+    uint8_t *_end;
+};
+
+// Size printf sees, char and short are promoted to int
+template <typename T>
+constexpr size_t SLBinaryPromotedSize() {
+    return sizeof(T) < sizeof(int) ? sizeof(int) : sizeof(T);
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+SLBinaryPut(SLBinaryWriter &writer, T value) { writer.putInt((int64_t)value, SLBinaryPromotedSize<T>()); }
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type
+SLBinaryPut(SLBinaryWriter &writer, T value) { writer.putUInt((uint64_t)value, SLBinaryPromotedSize<T>()); }
+
+template <typename T>
+inline typename std::enable_if<std::is_enum<T>::value>::type
+SLBinaryPut(SLBinaryWriter &writer, T value) {
+    SLBinaryPut(writer, static_cast<typename std::underlying_type<T>::type>(value));
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_floating_point<T>::value>::type
+SLBinaryPut(SLBinaryWriter &writer, T value) { writer.putDouble((double)value); }
+
+inline void SLBinaryPut(SLBinaryWriter &writer, const char *value) {
+    if (value == nullptr) {
+        writer.putString("(null)", 6);
+    } else {
+        writer.putString(value, strlen(value));
+    }
+}
+
+inline void SLBinaryPut(SLBinaryWriter &writer, char *value) { SLBinaryPut(writer, (const char *)value); }
+
+inline void SLBinaryPut(SLBinaryWriter &writer, const std::string &value) {
+    writer.putString(value.data(), value.size());
+}
+
+inline void SLBinaryPut(SLBinaryWriter &writer, std::nullptr_t) { writer.putPointer(nullptr); }
+
+#ifdef __OBJC__
+// Objects may change after the call, their description is taken right away
+inline void SLBinaryPut(SLBinaryWriter &writer, id value) {
+    const char *description = value ? [[value description] UTF8String] : "(null)";
+    SLBinaryPut(writer, description);
+}
+#endif
+
+template <typename T>
+inline typename std::enable_if<std::is_pointer<T>::value && !SLFormatIsString<T>::value && !SLFormatIsObject<T>::value>::type
+SLBinaryPut(SLBinaryWriter &writer, T value) { writer.putPointer((const void *)value); }
+
+inline void SLBinaryPutAll(SLBinaryWriter &) {}
+
+template <typename T, typename... Rest>
+inline void SLBinaryPutAll(SLBinaryWriter &writer, const T &value, const Rest &... rest) {
+    SLBinaryPut(writer, value);
+    SLBinaryPutAll(writer, rest...);
+}
+
+// Copies arguments into buffer, returns bytes used. Oversized strings are truncated.
+template <typename... Args>
+inline size_t SLBinaryCapture(void *buffer, size_t capacity, const Args &... args) {
+    SLBinaryWriter writer(buffer, capacity);
+    SLBinaryPutAll(writer, args...);
+    return writer.size();
+}
+
+// Decode
+
+inline void SLBinaryDecodeAppend(void *context, const char *bytes, size_t length) {
+    static_cast<std::string *>(context)->append(bytes, length);
+}
+
+inline std::string SLBinaryDecodeString(const char *format, const void *buffer, size_t length) {
+    std::string result;
+    SLBinaryDecode(format, buffer, length, SLBinaryDecodeAppend, &result);
+    return result;
+}
+
+#endif /* SLBinaryFormat_hpp */
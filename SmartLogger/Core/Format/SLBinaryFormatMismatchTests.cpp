@@ -0,0 +1,46 @@
+//
+//  SLBinaryFormatMismatchTests.cpp
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/6.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+// Linux compile test, see Makefile. Built once per SL_TEST_MISMATCH case: case 0 must compile,
+// every other case is a format that does not match its arguments and must not.
+
+#include "SLBinaryFormat.hpp"
+
+#include <string>
+
+#ifndef SL_TEST_MISMATCH
+#define SL_TEST_MISMATCH 0
+#endif
+
+struct SLTestRecord { int value; };
+
+void sl_test_mismatch(int number, double real, const char *string, void *pointer, SLTestRecord record) {
+    (void)number; (void)real; (void)string; (void)pointer; (void)record;
+#if SL_TEST_MISMATCH == 0
+    SL_BINARY_FORMAT_CHECK("%d %.1f %s %p %%", number, real, string, pointer);
+    SL_BINARY_FORMAT_CHECK("%s %lu", std::string(), 1ul);
+#elif SL_TEST_MISMATCH == 1
+    SL_BINARY_FORMAT_CHECK("%d", real);                 // Floating point for an integer
+#elif SL_TEST_MISMATCH == 2
+    SL_BINARY_FORMAT_CHECK("%f", number);               // Integer for floating point
+#elif SL_TEST_MISMATCH == 3
+    SL_BINARY_FORMAT_CHECK("%s", number);               // Integer for a string
+#elif SL_TEST_MISMATCH == 4
+    SL_BINARY_FORMAT_CHECK("%p", string);               // char * is captured as a string
+#elif SL_TEST_MISMATCH == 5
+    SL_BINARY_FORMAT_CHECK("%d %d", number);            // Missing argument
+#elif SL_TEST_MISMATCH == 6
+    SL_BINARY_FORMAT_CHECK("%d", number, number);       // Extra argument
+#elif SL_TEST_MISMATCH == 7
+    SL_BINARY_FORMAT_CHECK("%k", number);               // Unknown conversion
+#elif SL_TEST_MISMATCH == 8
+    SL_BINARY_FORMAT_CHECK("%*d", number, number);      // '*' width
+#elif SL_TEST_MISMATCH == 9
+    SL_BINARY_FORMAT_CHECK("%d", record);               // Struct
+#endif
+}
@@ -0,0 +1,147 @@
+//
+//  SLBinaryFormatTests.cpp
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/6.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+// Linux test, see Makefile. Arguments are captured the way the LogXxxT macros do and decoded
+// again, numbers must come out as snprintf renders the same format with the same arguments.
+// SLBinaryFormatMismatchTests.cpp checks that mismatched formats do not compile.
+
+#include "SLBinaryFormat.hpp"
+
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+static int s_failures = 0;
+
+#define SL_EXPECT(condition, ...) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+        fprintf(stderr, __VA_ARGS__); \
+        fprintf(stderr, "\n"); \
+        s_failures++; \
+    } \
+} while (0)
+
+// Captured and decoded, compared with `expected`
+#define SL_EXPECT_RENDER(expected, format, ...) do { \
+    SL_BINARY_FORMAT_CHECK(format, __VA_ARGS__); \
+    uint8_t buffer[SL_BINARY_LOG_CAPACITY]; \
+    size_t size = SLBinaryCapture(buffer, sizeof(buffer), __VA_ARGS__); \
+    std::string rendered = SLBinaryDecodeString(format, buffer, size); \
+    SL_EXPECT(rendered == (expected), "\"%s\" rendered \"%s\", expected \"%s\"", \
+              format, rendered.c_str(), std::string(expected).c_str()); \
+} while (0)
+
+// Captured and decoded, compared with snprintf
+#define SL_EXPECT_PRINTF(format, ...) do { \
+    char reference[256]; \
+    snprintf(reference, sizeof(reference), format, __VA_ARGS__); \
+    SL_EXPECT_RENDER(reference, format, __VA_ARGS__); \
+} while (0)
+
+enum SLTestSmallEnum : uint8_t { SLTestSmallEnumLast = 200 };
+enum class SLTestSignedEnum : int16_t { Negative = -2 };
+
+static void sl_test_integers(void) {
+    // Signed arguments with unsigned conversions are not sign extended past their size
+    SL_EXPECT_RENDER("ffffffff", "%x", (int)-1);
+    SL_EXPECT_RENDER("4294967295", "%u", -1);
+    SL_EXPECT_RENDER("ffff", "%hx", (short)-1);
+    SL_EXPECT_PRINTF("%x", (int)-1);
+    SL_EXPECT_PRINTF("%X %o", INT_MIN, -8);
+    SL_EXPECT_PRINTF("%hx %hu %hd", (short)-1, 70000, 40000);
+    SL_EXPECT_PRINTF("%hhx %hhu %hhd", -1, 300, 200);
+    SL_EXPECT_PRINTF("%x %d", (signed char)-1, (unsigned char)255);
+    SL_EXPECT_PRINTF("%d %u", 3000000000u, -5);
+    SL_EXPECT_PRINTF("%lld %llu %llx", LLONG_MIN, ULLONG_MAX, -1ll);
+    SL_EXPECT_PRINTF("%ld %lx %zu %zx", LONG_MIN, -1l, SIZE_MAX, (size_t)48879);
+    SL_EXPECT_PRINTF("%jd %td", (intmax_t)-7, (ptrdiff_t)-9);
+
+    // Flags, width and precision
+    SL_EXPECT_PRINTF("[%5d] [%-5d] [%05d] [%+d] [% d] [%.3d]", 42, 42, 42, 42, 42, 7);
+    SL_EXPECT_PRINTF("[%#x] [%#o] [%8.4x] [%-8X]", 255, 8, (unsigned)-1, 3054);
+    SL_EXPECT_PRINTF("%c%c", 'o', 'k');
+
+    // Bool and enums, no printf reference for them
+    SL_EXPECT_RENDER("1 0", "%d %d", true, false);
+    SL_EXPECT_RENDER("200 c8", "%u %x", SLTestSmallEnumLast, SLTestSmallEnumLast);
+    SL_EXPECT_RENDER("-2 fffffffe", "%d %x", SLTestSignedEnum::Negative, SLTestSignedEnum::Negative);
+}
+
+static void sl_test_floats_pointers(void) {
+    SL_EXPECT_PRINTF("%.2f %e %g", 3.14159, 1e-10, 0.5);
+    SL_EXPECT_PRINTF("%8.3f|%-8.1f|%+.0f", 2.5, -1.25, 9.5);
+    SL_EXPECT_PRINTF("%f %G", 1.5f, 1e20f);
+    SL_EXPECT_PRINTF("%a", 1.0);
+    int local = 0;
+    SL_EXPECT_PRINTF("%p", (void *)&local);
+    SL_EXPECT_PRINTF("%p", (void *)nullptr);
+}
+
+static void sl_test_strings(void) {
+    const char *null = nullptr;
+    char mutableString[] = "mutable";
+    SL_EXPECT_RENDER("a b mutable", "%s %s %s", "a", std::string("b"), mutableString);
+    SL_EXPECT_RENDER("(null)", "%s", null);
+    SL_EXPECT_RENDER("[  abc] [abc  ] [ab]", "[%5s] [%-5s] [%.2s]", "abc", "abc", "abc");
+    SL_EXPECT_RENDER(std::string("in\0side", 7), "%s", std::string("in\0side", 7));
+    SL_EXPECT_RENDER("100% done 1", "100%% done %d", 1);
+    SL_EXPECT_RENDER("no arguments", "no arguments%s", "");
+}
+
+static void sl_test_truncated(void) {
+    // Header, one int and a string cut to what fits
+    uint8_t buffer[SL_BINARY_HEADER_SIZE + 9 + 5 + 3];
+    size_t size = SLBinaryCapture(buffer, sizeof(buffer), 7, "abcdefgh");
+    std::string rendered = SLBinaryDecodeString("%d %s", buffer, size);
+    SL_EXPECT(size == sizeof(buffer) && rendered == "7 abc <truncated>", "truncated to \"%s\"", rendered.c_str());
+
+    // No room for the second argument
+    uint8_t small[SL_BINARY_HEADER_SIZE + 9];
+    size = SLBinaryCapture(small, sizeof(small), 7, 8);
+    std::string out;
+    int status = SLBinaryDecode("%d %d", small, size, SLBinaryDecodeAppend, &out);
+    SL_EXPECT(status == -1 && out == "7 <?> <truncated>", "missing argument rendered \"%s\"", out.c_str());
+
+    // Malformed buffers
+    out.clear();
+    const uint8_t garbage[] = { 0, 1, 0x7F, 1, 2, 3 };
+    status = SLBinaryDecode("x=%d.", garbage, sizeof(garbage), SLBinaryDecodeAppend, &out);
+    SL_EXPECT(status == -1 && out == "x=<?>.", "garbage rendered \"%s\"", out.c_str());
+    out.clear();
+    status = SLBinaryDecode("%s", nullptr, 0, SLBinaryDecodeAppend, &out);
+    SL_EXPECT(status == -1 && out == "<?>", "empty buffer rendered \"%s\"", out.c_str());
+    SL_EXPECT(SLBinaryDecode(nullptr, garbage, sizeof(garbage), SLBinaryDecodeAppend, &out) == -1, "NULL format");
+}
+
+// Payloads written before integer sizes were recorded decode as 64 bit values
+static void sl_test_unsized(void) {
+    uint8_t buffer[SL_BINARY_HEADER_SIZE + 9] = { 0, 1, SLBinaryArgInt64 };
+    int64_t value = -1;
+    memcpy(buffer + SL_BINARY_HEADER_SIZE + 1, &value, sizeof(value));
+    std::string rendered = SLBinaryDecodeString("%d %x", buffer, sizeof(buffer));
+    SL_EXPECT(rendered == "-1 <?>", "unsized rendered \"%s\"", rendered.c_str());
+    rendered = SLBinaryDecodeString("%x", buffer, sizeof(buffer));
+    SL_EXPECT(rendered == "ffffffffffffffff", "unsized rendered \"%s\"", rendered.c_str());
+}
+
+int main(void) {
+    sl_test_integers();
+    sl_test_floats_pointers();
+    sl_test_strings();
+    sl_test_truncated();
+    sl_test_unsized();
+
+    if (s_failures > 0) {
+        fprintf(stderr, "SLBinaryFormatTests: %d failures\n", s_failures);
+        return 1;
+    }
+    printf("SLBinaryFormatTests: ok\n");
+    return 0;
+}
@@ -0,0 +1,47 @@
+//
+//  SLLogLabel.h
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/7.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#ifndef SLLogLabel_h
+#define SLLogLabel_h
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+#define SL_LOG_LABEL_CAPACITY 1024
+
+/**
+ * Interned queue label or thread name, created once per distinct name and never freed.
+ * `identifier` is dense (0 ..< SL_LOG_LABEL_CAPACITY), formatters use it to index their
+ * own caches of padded / replaced labels.
+ */
+typedef struct SLLogLabel {
+    uint32_t identifier;
+    /// Global root queues ("com.apple.root.*"), thread name or ID is more useful
+    BOOL isRootQueue;
+    const char *name;
+    __unsafe_unretained NSString *string;
+} SLLogLabel;
+
+#if __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Lock free lookup, takes a lock only the first time a name is seen.
+ * Returns NULL when capacity is exhausted, callers fall back to plain strings.
+ */
+SLLogLabel * _Nullable SLLogLabelIntern(const char *name);
+
+#if __cplusplus
+}
+#endif
+
+NS_ASSUME_NONNULL_END
+
+#endif /* SLLogLabel_h */
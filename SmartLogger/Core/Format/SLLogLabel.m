@@ -0,0 +1,75 @@
+//
+//  SLLogLabel.m
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/7.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#import "SLLogLabel.h"
+#import "SLLogMetrics.h"
+
+#import <pthread.h>
+#import <stdatomic.h>
+
+#define SL_LOG_LABEL_SLOTS (SL_LOG_LABEL_CAPACITY * 2)  // Should be power of 2
+
+static _Atomic(SLLogLabel *) s_slots[SL_LOG_LABEL_SLOTS];
+static uint32_t s_count = 0;
+static pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static inline uint32_t SLLogLabelHash(const char *name)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+        hash = (hash ^ *p) * 16777619u;
+    }
+    return hash;
+}
+
+static SLLogLabel * _Nullable SLLogLabelFind(const char *name, uint32_t hash, uint32_t *emptySlot)
+{
+    for (uint32_t probe = 0; probe < SL_LOG_LABEL_SLOTS; probe++) {
+        uint32_t index = (hash + probe) & (SL_LOG_LABEL_SLOTS - 1);
+        SLLogLabel *label = atomic_load_explicit(&s_slots[index], memory_order_acquire);
+        if (label == NULL) {
+            if (emptySlot) {
+                *emptySlot = index;
+            }
+            return NULL;
+        }
+        if (strcmp(label->name, name) == 0) {
+            return label;
+        }
+    }
+    return NULL;
+}
+
+SLLogLabel *SLLogLabelIntern(const char *name)
+{
+    uint32_t hash = SLLogLabelHash(name);
+    SLLogLabel *label = SLLogLabelFind(name, hash, NULL);
+    if (label || __atomic_load_n(&s_count, __ATOMIC_RELAXED) >= SL_LOG_LABEL_CAPACITY) {
+        return label;
+    }
+
+    pthread_mutex_lock(&s_mutex);
+    {
+        uint32_t slot = UINT32_MAX;
+        label = SLLogLabelFind(name, hash, &slot);
+        if (label == NULL && slot != UINT32_MAX && s_count < SL_LOG_LABEL_CAPACITY) {
+            label = (SLLogLabel *)calloc(1, sizeof(SLLogLabel));
+            label->identifier = s_count;
+            __atomic_store_n(&s_count, s_count + 1, __ATOMIC_RELAXED);
+            label->name = strdup(name);
+            label->isRootQueue = strncmp(name, "com.apple.root.", 15) == 0;
+            label->string = (__bridge NSString *)CFBridgingRetain([[NSString alloc] initWithUTF8String:name] ?: @"");
+            SLLogMetricsIncrement(SLLogCounterStringAllocations, 1);
+            atomic_store_explicit(&s_slots[slot], label, memory_order_release);
+        }
+    }
+    pthread_mutex_unlock(&s_mutex);
+
+    return label;
+}
@@ -0,0 +1,76 @@
+//
+//  SLLogLine.h
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/12.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "SLLogFormatter.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Lines shared per message, more layouts than this are formatted by each appender
+#define SL_LOG_LINE_SLOTS 4
+
+/**
+ * 一条消息按某个 formatter 格式化并编码后的 UTF-8 字节, 以 '\n' 结尾.
+ *
+ * 同一个 formatter 被多个 appender 使用时, -[SLLogger mf_log:] 在分发前只格式化、编码一次,
+ * 各 appender 直接读取同一块字节 (writev / NSFileHandle / 共享环形缓冲区), 不再各自生成 NSString / NSData.
+ * 只有一个 appender 使用的 formatter 由 appender 在自己的队列里格式化到自己的 line 里.
+ *
+ * line 跟随消息复用: 在消息回收前只读, appender 如果需要在 `logMessage:` 之后继续持有字节, 必须拷贝.
+ */
+@interface SLLogLine : NSObject
+{
+@public
+    /// Layout key, not retained
+    __unsafe_unretained id <SLLogFormatter> _formatter;
+    char *_bytes;
+    NSUInteger _length;
+    NSUInteger _capacity;
+    /// Formatter returned nil, nothing to write
+    BOOL _dropped;
+    /// Formatter returned something else than the raw message
+    BOOL _formatted;
+    /// Trailing '\n' was not part of the formatted text
+    BOOL _newlineAdded;
+}
+
+/// Includes trailing '\n'
+@property (nonatomic, readonly) const char *bytes;
+@property (nonatomic, readonly) NSUInteger length;
+@property (nonatomic, readonly, getter=isFormatted) BOOL formatted;
+
+/**
+ * Length to write, without the '\n' that was added if `newline` is NO.
+ * Text that ends with a newline of its own keeps it.
+ */
+- (NSUInteger)lengthWithNewline:(BOOL)newline;
+
+/**
+ * Bytes wrapped without copy, valid as long as the line is not rendered again.
+ */
+- (NSData *)dataWithNewline:(BOOL)newline;
+
+@end
+
+@class SLLogMessage;
+
+#if __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Format message with formatter (nil - raw message) and encode it into line, buffer is reused.
+ *  @return NO if formatter dropped the message
+ */
+BOOL SLLogLineRender(SLLogLine *line, SLLogMessage *message, id <SLLogFormatter> __nullable formatter);
+
+#if __cplusplus
+}
+#endif
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,104 @@
+//
+//  SLLogLine.m
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/12.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#import "SLLogLine.h"
+#import "SLLogMemoryGovernor.h"
+#import "SLLogMessage.h"
+#import "SLLogMetrics.h"
+
+#define SL_LOG_LINE_KEEP_CAPACITY 4096  // Bigger buffers are shrunk by the next short line
+
+@implementation SLLogLine
+
+- (void)dealloc
+{
+    SLLogMemoryCharge(-(int64_t)_capacity);
+    free(_bytes);
+}
+
+- (const char *)bytes
+{
+    return _bytes;
+}
+
+- (NSUInteger)length
+{
+    return _length;
+}
+
+- (BOOL)isFormatted
+{
+    return _formatted;
+}
+
+- (NSUInteger)lengthWithNewline:(BOOL)newline
+{
+    return (!newline && _newlineAdded) ? _length - 1 : _length;
+}
+
+- (NSData *)dataWithNewline:(BOOL)newline
+{
+    return [NSData dataWithBytesNoCopy:_bytes length:[self lengthWithNewline:newline] freeWhenDone:NO];
+}
+
+@end
+
+static BOOL SLLogLineReserve(SLLogLine *line, NSUInteger capacity)
+{
+    if (capacity <= line->_capacity &&
+        !(line->_capacity > SL_LOG_LINE_KEEP_CAPACITY && capacity <= SL_LOG_LINE_KEEP_CAPACITY)) {
+        return YES;
+    }
+
+    NSUInteger size = MAX(capacity, (NSUInteger)256);
+    char *bytes = realloc(line->_bytes, size);
+    if (bytes == NULL) {
+        return NO;
+    }
+    line->_bytes = bytes;
+    SLLogMemoryCharge((int64_t)size - (int64_t)line->_capacity);
+    line->_capacity = size;
+    SLLogMetricsIncrement(SLLogCounterStringAllocations, 1);
+    return YES;
+}
+
+BOOL SLLogLineRender(SLLogLine *line, SLLogMessage *message, id <SLLogFormatter> formatter)
+{
+    NSString *text = formatter ? [formatter formatLogMessage:message] : message->_message;
+
+    line->_formatter = formatter;
+    line->_length = 0;
+    line->_formatted = text != message->_message;
+    line->_newlineAdded = NO;
+    line->_dropped = (text == nil);
+    if (line->_dropped) {
+        return NO;
+    }
+
+    // One pass, worst case size instead of measuring first
+    NSUInteger characters = text.length;
+    if (!SLLogLineReserve(line, [text maximumLengthOfBytesUsingEncoding:NSUTF8StringEncoding] + 1)) {
+        line->_dropped = YES;
+        return NO;
+    }
+    NSUInteger used = 0;
+    [text getBytes:line->_bytes
+         maxLength:line->_capacity - 1
+        usedLength:&used
+          encoding:NSUTF8StringEncoding
+           options:0
+             range:NSMakeRange(0, characters)
+    remainingRange:NULL];
+
+    if (used == 0 || line->_bytes[used - 1] != '\n') {
+        line->_bytes[used++] = '\n';
+        line->_newlineAdded = YES;
+    }
+    line->_length = used;
+    return YES;
+}
@@ -25,6 +25,11 @@ typedef NS_ENUM(NSUInteger, SLLogQueueFormatterMode){
 @interface SLLogQueueFormatter : NSObject<SLLogFormatter>
 @property (assign, atomic) NSUInteger minQueueLength;
 @property (assign, atomic) NSUInteger maxQueueLength;
+/**
+ * Level letter after the timestamp, eg. "... [E] [main] [...]". Default NO, the line format is
+ * parsed by upload services; `SLLogColumnar.h` accepts both.
+ */
+@property (assign, atomic) BOOL includesLevel;
 
 - (instancetype)init NS_DESIGNATED_INITIALIZER;
 - (instancetype)initWithMode:(SLLogQueueFormatterMode)mode;
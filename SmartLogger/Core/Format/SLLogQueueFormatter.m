@@ -15,6 +15,17 @@
 #import <libkern/OSAtomic.h>
 #import <stdatomic.h>
 
+/// Immutable snapshot of the configuration, never modified after published,
+/// only `labels` is filled lazily (once per label, by CAS).
+typedef struct SLLogQueueLabelTable {
+    CFDictionaryRef replacements;
+    NSUInteger minLength;
+    NSUInteger maxLength;
+    /// Replaced + truncated/padded label, indexed by SLLogLabel identifier, retained
+    _Atomic(void *) labels[SL_LOG_LABEL_CAPACITY];
+    struct SLLogQueueLabelTable *retired;
+} SLLogQueueLabelTable;
+
 @interface SLLogQueueFormatter () {
     SLLogQueueFormatterMode _mode;
     NSString *_dateFormatterKey;
@@ -23,15 +34,26 @@
     atomic_int_fast32_t _atomicLoggerCount;
     NSDateFormatter *_threadUnsafeDateFormatter; // Use [self stringFromDate]
     
-    pthread_mutex_t _mutex;
-    
-    NSUInteger _minQueueLength;           // _prefix == Only access via atomic property
-    NSUInteger _maxQueueLength;           // _prefix == Only access via atomic property
-    NSMutableDictionary *_replacements;   // _prefix == Only access from within spinlock
+    pthread_mutex_t _mutex;               // Write path only
+    _Atomic(SLLogQueueLabelTable *) _table;
 }
 
 @end
 
+static NSString *SLLogQueueFormatterLevel(SLLogFlag flag)
+{
+    if (flag & SLLogFlagError) {
+        return @" [E]";
+    }
+    if (flag & SLLogFlagWarning) {
+        return @" [W]";
+    }
+    if (flag & SLLogFlagInfo) {
+        return @" [I]";
+    }
+    return @" [D]";
+}
+
 @implementation SLLogQueueFormatter
 
 - (instancetype)init
@@ -55,12 +77,8 @@
         _osAtomicLoggerCount = 0;
         _threadUnsafeDateFormatter = nil;
         
-        _minQueueLength = 0;
-        _maxQueueLength = 0;
         pthread_mutex_init(&_mutex, NULL);
-        _replacements = [[NSMutableDictionary alloc] init];
-        
-        _replacements[@"com.apple.main-thread"] = @"main";
+        [self publishReplacements:@{@"com.apple.main-thread": @"main"} minLength:0 maxLength:0];
     }
     
     return self;
@@ -76,36 +94,86 @@
 
 - (void)dealloc
 {
+    // No reader is left, retired snapshots can be freed now
+    SLLogQueueLabelTable *table = atomic_load_explicit(&_table, memory_order_relaxed);
+    while (table) {
+        SLLogQueueLabelTable *retired = table->retired;
+        for (NSUInteger i = 0; i < SL_LOG_LABEL_CAPACITY; i++) {
+            void *label = atomic_load_explicit(&table->labels[i], memory_order_relaxed);
+            if (label) {
+                CFRelease(label);
+            }
+        }
+        CFRelease(table->replacements);
+        free(table);
+        table = retired;
+    }
     pthread_mutex_destroy(&_mutex);
 }
 
 #pragma mark Configuration
 
-@synthesize minQueueLength = _minQueueLength;
-@synthesize maxQueueLength = _maxQueueLength;
+/// Must hold _mutex, or be called from init
+- (void)publishReplacements:(NSDictionary *)replacements minLength:(NSUInteger)minLength maxLength:(NSUInteger)maxLength
+{
+    SLLogQueueLabelTable *table = (SLLogQueueLabelTable *)calloc(1, sizeof(SLLogQueueLabelTable));
+    table->replacements = CFBridgingRetain([replacements copy]);
+    table->minLength = minLength;
+    table->maxLength = maxLength;
+    // Readers may still hold the old snapshot, so it is retired but never freed
+    // until the formatter itself goes away. Configuration is changed rarely.
+    table->retired = atomic_load_explicit(&_table, memory_order_relaxed);
+    atomic_store_explicit(&_table, table, memory_order_release);
+}
 
-- (NSString *)replacementStringForQueueLabel:(NSString *)longLabel
+- (NSUInteger)minQueueLength
+{
+    return atomic_load_explicit(&_table, memory_order_acquire)->minLength;
+}
+
+- (void)setMinQueueLength:(NSUInteger)minQueueLength
 {
-    NSString *result = nil;
-    
     pthread_mutex_lock(&_mutex);
     {
-        result = _replacements[longLabel];
+        SLLogQueueLabelTable *table = atomic_load_explicit(&_table, memory_order_relaxed);
+        [self publishReplacements:(__bridge NSDictionary *)table->replacements minLength:minQueueLength maxLength:table->maxLength];
     }
     pthread_mutex_unlock(&_mutex);
-    
-    return result;
+}
+
+- (NSUInteger)maxQueueLength
+{
+    return atomic_load_explicit(&_table, memory_order_acquire)->maxLength;
+}
+
+- (void)setMaxQueueLength:(NSUInteger)maxQueueLength
+{
+    pthread_mutex_lock(&_mutex);
+    {
+        SLLogQueueLabelTable *table = atomic_load_explicit(&_table, memory_order_relaxed);
+        [self publishReplacements:(__bridge NSDictionary *)table->replacements minLength:table->minLength maxLength:maxQueueLength];
+    }
+    pthread_mutex_unlock(&_mutex);
+}
+
+- (NSString *)replacementStringForQueueLabel:(NSString *)longLabel
+{
+    SLLogQueueLabelTable *table = atomic_load_explicit(&_table, memory_order_acquire);
+    return (__bridge NSString *)CFDictionaryGetValue(table->replacements, (__bridge const void *)longLabel);
 }
 
 - (void)setReplacementString:(NSString *)shortLabel forQueueLabel:(NSString *)longLabel
 {
     pthread_mutex_lock(&_mutex);
     {
+        SLLogQueueLabelTable *table = atomic_load_explicit(&_table, memory_order_relaxed);
+        NSMutableDictionary *replacements = [(__bridge NSDictionary *)table->replacements mutableCopy];
         if (shortLabel) {
-            _replacements[longLabel] = shortLabel;
+            replacements[longLabel] = shortLabel;
         } else {
-            [_replacements removeObjectForKey:longLabel];
+            [replacements removeObjectForKey:longLabel];
         }
+        [self publishReplacements:replacements minLength:table->minLength maxLength:table->maxLength];
     }
     pthread_mutex_unlock(&_mutex);
 }
@@ -162,81 +230,67 @@
     return [dateFormatter stringFromDate:date];
 }
 
-- (NSString *)queueThreadLabelForLogMessage:(SLLogMessage *)logMessage
+static NSString *SLLogQueueLabelResolve(SLLogQueueLabelTable *table, NSString *label, BOOL replace)
 {
+    NSString *result = label;
+    if (replace) {
+        result = (__bridge NSString *)CFDictionaryGetValue(table->replacements, (__bridge const void *)label) ?: label;
+    }
     
-    NSUInteger minQueueLength = self.minQueueLength;
-    NSUInteger maxQueueLength = self.maxQueueLength;
-    
-    NSString *queueThreadLabel = nil;
-    BOOL useQueueLabel = YES;
-    BOOL useThreadName = NO;
-    
-    if (logMessage->_queueLabel) {
-        // 如果是下面这些线程，我们更希望使用呢 threadName 或者 machThreadID.
-        NSArray *names = @[
-                           @"com.apple.root.low-priority",
-                           @"com.apple.root.default-priority",
-                           @"com.apple.root.high-priority",
-                           @"com.apple.root.low-overcommit-priority",
-                           @"com.apple.root.default-overcommit-priority",
-                           @"com.apple.root.high-overcommit-priority",
-                           @"com.apple.root.default-qos.overcommit"
-                           ];
-        
-        for (NSString * name in names) {
-            if ([logMessage->_queueLabel isEqualToString:name]) {
-                useQueueLabel = NO;
-                useThreadName = [logMessage->_threadName length] > 0;
-                break;
-            }
-        }
-    } else {
-        useQueueLabel = NO;
-        useThreadName = [logMessage->_threadName length] > 0;
+    NSUInteger labelLength = [result length];
+    if ((table->maxLength > 0) && (labelLength > table->maxLength)) {
+        // Truncate
+        return [result substringToIndex:table->maxLength];
+    } else if (labelLength < table->minLength) {
+        // Padding
+        return [result stringByPaddingToLength:table->minLength withString:@" " startingAtIndex:0];
     }
+    // Exact
+    return result;
+}
+
+- (NSString *)queueThreadLabelForLogMessage:(SLLogMessage *)logMessage
+{
+    SLLogQueueLabelTable *table = atomic_load_explicit(&_table, memory_order_acquire);
     
-    if (useQueueLabel || useThreadName) {
-        NSString *fullLabel;
-        NSString *abrvLabel;
-        
-        if (useQueueLabel) {
+    // 如果是 root queue，我们更希望使用 threadName 或者 machThreadID.
+    SLLogLabel *label = NULL;
+    NSString *fullLabel = nil;
+    if (logMessage->_queueLabel) {
+        BOOL isRootQueue = logMessage->_internedQueueLabel ? logMessage->_internedQueueLabel->isRootQueue
+                                                           : [logMessage->_queueLabel hasPrefix:@"com.apple.root."];
+        if (!isRootQueue) {
+            label = logMessage->_internedQueueLabel;
             fullLabel = logMessage->_queueLabel;
-        } else {
-            fullLabel = logMessage->_threadName;
         }
-        
-        pthread_mutex_lock(&_mutex);
-        {
-            abrvLabel = _replacements[fullLabel];
-        }
-        pthread_mutex_unlock(&_mutex);
-        
-        if (abrvLabel) {
-            queueThreadLabel = abrvLabel;
-        } else {
-            queueThreadLabel = fullLabel;
-        }
-    } else {
-        queueThreadLabel = logMessage->_threadID;
+    }
+    if (fullLabel == nil && [logMessage->_threadName length] > 0) {
+        label = logMessage->_internedThreadName;
+        fullLabel = logMessage->_threadName;
+    }
+    if (fullLabel == nil) {
+        return SLLogQueueLabelResolve(table, logMessage->_threadID, NO);
+    }
+    if (label == NULL) {
+        // Not interned, nothing to cache by
+        return SLLogQueueLabelResolve(table, fullLabel, YES);
     }
     
-    NSUInteger labelLength = [queueThreadLabel length];
+    // Fast path: one load per message once the label has been seen
+    _Atomic(void *) *slot = &table->labels[label->identifier];
+    void *cached = atomic_load_explicit(slot, memory_order_acquire);
+    if (cached) {
+        return (__bridge NSString *)cached;
+    }
     
-    if ((maxQueueLength > 0) && (labelLength > maxQueueLength)) {
-        // Truncate
-        return [queueThreadLabel substringToIndex:maxQueueLength];
-    } else if (labelLength < minQueueLength) {
-        // Padding
-        NSUInteger numSpaces = minQueueLength - labelLength;
-        char spaces[numSpaces + 1];
-        memset(spaces, ' ', numSpaces);
-        spaces[numSpaces] = '\0';
-        return [NSString stringWithFormat:@"%@%s", queueThreadLabel, spaces];
-    } else {
-        // Exact
-        return queueThreadLabel;
+    void *resolved = (void *)CFBridgingRetain(SLLogQueueLabelResolve(table, fullLabel, YES));
+    void *expected = NULL;
+    if (!atomic_compare_exchange_strong_explicit(slot, &expected, resolved, memory_order_acq_rel, memory_order_acquire)) {
+        // Another appender thread resolved it first
+        CFRelease(resolved);
+        resolved = expected;
     }
+    return (__bridge NSString *)resolved;
 }
 
 - (NSString *)formatLogMessage:(SLLogMessage *)logMessage
@@ -244,9 +298,15 @@
     if (logMessage.noFormatter) {
         return [NSString stringWithFormat:@"[%@] %@", logMessage->_tag, logMessage->_message];
     }
-    NSString *timestamp = [self stringFromDate:(logMessage->_timestamp)];
+    NSString *timestamp = [self stringFromDate:logMessage.timestamp];
     NSString *queueThreadLabel = [self queueThreadLabelForLogMessage:logMessage];
+    if (self.includesLevel) {
+        timestamp = [timestamp stringByAppendingString:SLLogQueueFormatterLevel(logMessage->_flag)];
+    }
     
+    if (logMessage->_sampleRate > 1) {
+        return [NSString stringWithFormat:@"%@ [%@] [%@(line:%lu)] [%@] [sampled 1/%lu] %@", timestamp, queueThreadLabel, logMessage->_file, (unsigned long)logMessage->_line, logMessage->_tag, (unsigned long)logMessage->_sampleRate, logMessage->_message];
+    }
     return [NSString stringWithFormat:@"%@ [%@] [%@(line:%lu)] [%@] %@", timestamp, queueThreadLabel, logMessage->_file, (unsigned long)logMessage->_line, logMessage->_tag, logMessage->_message];
 }
 
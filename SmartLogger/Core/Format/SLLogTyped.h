@@ -0,0 +1,57 @@
+//
+//  SLLogTyped.h
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/6.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#ifndef SLLogTyped_h
+#define SLLogTyped_h
+
+#if defined(__cplusplus) && defined(__OBJC__)
+
+#import "SLInterfaces.h"
+#include "SLBinaryFormat.hpp"
+
+/**
+ * Objective-C++ 专用的类型安全日志宏.
+ *
+ * 与 LogInfo 等宏的区别:
+ *  - format 必须是 C 字符串字面量 ("..." 而不是 @"..."), 编译期检查格式与参数类型是否匹配;
+ *  - 参数按类型拷贝到二进制缓冲区，格式化推迟到日志队列进行，调用线程不做格式化;
+ *  - `%@` 对象在调用时取 description.
+ *
+ *  LogInfoT(@"Network", "request %s took %.1f ms, status %d", url.c_str(), cost, status);
+ */
+#define SL_LOG_TYPED_MAYBE(async, lvl, flg, atag, frmt, ...)            \
+do {                                                                    \
+if(lvl & flg) {                                                     \
+SL_BINARY_FORMAT_CHECK(frmt, ##__VA_ARGS__);                            \
+static SLLogSite __sl_log_site = { SL_LOG_SITE_UNRESOLVED, __FILE__, __LINE__, NULL, NULL }; \
+if ((__atomic_load_n(&__sl_log_site.mask, __ATOMIC_RELAXED) & (flg))  \
+    && SLLogSiteShouldLog(&__sl_log_site, (flg), (__bridge const void *)(atag))) { \
+uint8_t __sl_payload[SL_BINARY_LOG_CAPACITY];                           \
+size_t __sl_length = SLBinaryCapture(__sl_payload, sizeof(__sl_payload), ##__VA_ARGS__); \
+[SLLogger log:async                     \
+level:lvl                                  \
+flag:flg                                  \
+file:__FILE__                             \
+function:__PRETTY_FUNCTION__                  \
+line:__LINE__                             \
+tag:atag                                 \
+binaryFormat:(frmt)                         \
+payload:__sl_payload                        \
+length:__sl_length];                        \
+}                                                                   \
+}                                                                   \
+} while(0)
+
+#define LogErrorT(tag, frmt, ...)   SL_LOG_TYPED_MAYBE(NO, SL_GLOBAL_LOG_LEVEL, SLLogFlagError, tag, frmt, ##__VA_ARGS__)
+#define LogWarnT(tag, frmt, ...)    SL_LOG_TYPED_MAYBE(YES, SL_GLOBAL_LOG_LEVEL, SLLogFlagWarning, tag, frmt, ##__VA_ARGS__)
+#define LogInfoT(tag, frmt, ...)    SL_LOG_TYPED_MAYBE(YES, SL_GLOBAL_LOG_LEVEL, SLLogFlagInfo, tag, frmt, ##__VA_ARGS__)
+#define LogDebugT(tag, frmt, ...)   SL_LOG_TYPED_MAYBE(YES, SL_GLOBAL_LOG_LEVEL, SLLogFlagDebug, tag, frmt, ##__VA_ARGS__)
+
+#endif /* __cplusplus && __OBJC__ */
+
+#endif /* SLLogTyped_h */
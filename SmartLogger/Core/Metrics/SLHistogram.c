@@ -0,0 +1,108 @@
+//
+//  SLHistogram.c
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/4.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#include "SLHistogram.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+void SLHistogramInit(SLHistogram *histogram) {
+    memset(histogram, 0, sizeof(SLHistogram));
+    histogram->min = UINT64_MAX;
+}
+
+uint64_t SLHistogramBucketLowerBound(size_t index) {
+    if (index < SL_HISTOGRAM_SUB_BUCKETS) {
+        return (uint64_t)index;
+    }
+    size_t shift = index / SL_HISTOGRAM_SUB_BUCKETS - 1;
+    uint64_t sub = index % SL_HISTOGRAM_SUB_BUCKETS;
+    return (SL_HISTOGRAM_SUB_BUCKETS + sub) << shift;
+}
+
+uint64_t SLHistogramBucketUpperBound(size_t index) {
+    if (index < SL_HISTOGRAM_SUB_BUCKETS) {
+        return (uint64_t)index;
+    }
+    size_t shift = index / SL_HISTOGRAM_SUB_BUCKETS - 1;
+    return SLHistogramBucketLowerBound(index) + ((uint64_t)1 << shift) - 1;
+}
+
+void SLHistogramMerge(SLHistogram *destination, const SLHistogram *source) {
+    for (size_t i = 0; i < SL_HISTOGRAM_BUCKETS; i++) {
+        uint64_t count = __atomic_load_n(&source->counts[i], __ATOMIC_RELAXED);
+        if (count) {
+            __atomic_fetch_add(&destination->counts[i], count, __ATOMIC_RELAXED);
+        }
+    }
+    __atomic_fetch_add(&destination->total, __atomic_load_n(&source->total, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+    __atomic_fetch_add(&destination->sum, __atomic_load_n(&source->sum, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+
+    uint64_t min = __atomic_load_n(&source->min, __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&source->max, __ATOMIC_RELAXED);
+    if (min < destination->min) {
+        destination->min = min;
+    }
+    if (max > destination->max) {
+        destination->max = max;
+    }
+}
+
+void SLHistogramSnapshot(const SLHistogram *histogram, SLHistogram *snapshot) {
+    SLHistogramInit(snapshot);
+    SLHistogramMerge(snapshot, histogram);
+}
+
+uint64_t SLHistogramPercentile(const SLHistogram *histogram, double percentile) {
+    uint64_t total = 0;
+    for (size_t i = 0; i < SL_HISTOGRAM_BUCKETS; i++) {
+        total += histogram->counts[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    if (percentile < 0) {
+        percentile = 0;
+    } else if (percentile > 100) {
+        percentile = 100;
+    }
+    uint64_t rank = (uint64_t)((percentile / 100.0) * (double)total + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < SL_HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen >= rank) {
+            uint64_t upper = SLHistogramBucketUpperBound(i);
+            return upper < histogram->max ? upper : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+double SLHistogramMean(const SLHistogram *histogram) {
+    return histogram->total ? (double)histogram->sum / (double)histogram->total : 0;
+}
+
+int SLHistogramPrintJSON(const SLHistogram *histogram, char *buffer, size_t size) {
+    return snprintf(buffer, size,
+                    "{\"count\":%" PRIu64 ",\"min\":%" PRIu64 ",\"mean\":%.1f,\"p50\":%" PRIu64
+                    ",\"p90\":%" PRIu64 ",\"p99\":%" PRIu64 ",\"p999\":%" PRIu64 ",\"max\":%" PRIu64 "}",
+                    histogram->total,
+                    histogram->total ? histogram->min : 0,
+                    SLHistogramMean(histogram),
+                    SLHistogramPercentile(histogram, 50),
+                    SLHistogramPercentile(histogram, 90),
+                    SLHistogramPercentile(histogram, 99),
+                    SLHistogramPercentile(histogram, 99.9),
+                    histogram->max);
+}
@@ -0,0 +1,91 @@
+//
+//  SLHistogram.h
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/4.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#ifndef SLHistogram_h
+#define SLHistogram_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if __cplusplus
+extern "C" {
+#endif
+
+// Log-linear (HDR style) histogram for latencies in nanoseconds.
+//
+// Values below 2^SL_HISTOGRAM_SUB_BUCKET_BITS are counted exactly, above that every power of two
+// is split into 2^SL_HISTOGRAM_SUB_BUCKET_BITS linear sub buckets, so the relative error is
+// bounded by ~3% over the whole uint64_t range.
+//
+// Recording is lock free (relaxed atomic add), histograms can be shared by threads or kept per
+// thread and merged later. Plain C, no Foundation dependency.
+#define SL_HISTOGRAM_SUB_BUCKET_BITS 5
+#define SL_HISTOGRAM_SUB_BUCKETS (1 << SL_HISTOGRAM_SUB_BUCKET_BITS)
+#define SL_HISTOGRAM_BUCKETS ((64 - SL_HISTOGRAM_SUB_BUCKET_BITS + 1) * SL_HISTOGRAM_SUB_BUCKETS)
+
+typedef struct SLHistogram_ {
+    uint64_t counts[SL_HISTOGRAM_BUCKETS];
+    uint64_t total;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+} SLHistogram;
+
+// Resets all counters.
+void SLHistogramInit(SLHistogram *histogram);
+
+// Bucket index for value, exposed for tests and external encoders.
+static inline size_t SLHistogramIndex(uint64_t value) {
+    if (value < SL_HISTOGRAM_SUB_BUCKETS) {
+        return (size_t)value;
+    }
+    unsigned exponent = 63 - (unsigned)__builtin_clzll(value);
+    unsigned shift = exponent - SL_HISTOGRAM_SUB_BUCKET_BITS;
+    size_t sub = (size_t)((value >> shift) & (SL_HISTOGRAM_SUB_BUCKETS - 1));
+    return (size_t)(shift + 1) * SL_HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+// Records one value. Lock free, safe from any thread.
+static inline void SLHistogramRecord(SLHistogram *histogram, uint64_t value) {
+    __atomic_fetch_add(&histogram->counts[SLHistogramIndex(value)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->total, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->sum, value, __ATOMIC_RELAXED);
+
+    uint64_t current = __atomic_load_n(&histogram->min, __ATOMIC_RELAXED);
+    while (value < current &&
+           !__atomic_compare_exchange_n(&histogram->min, &current, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+    current = __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+    while (value > current &&
+           !__atomic_compare_exchange_n(&histogram->max, &current, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+}
+
+// Lowest and highest value that fall into the bucket at index.
+uint64_t SLHistogramBucketLowerBound(size_t index);
+uint64_t SLHistogramBucketUpperBound(size_t index);
+
+// Adds all counts of source into destination.
+void SLHistogramMerge(SLHistogram *destination, const SLHistogram *source);
+
+// Copies a consistent-enough snapshot, counts recorded concurrently may be partially included.
+void SLHistogramSnapshot(const SLHistogram *histogram, SLHistogram *snapshot);
+
+// Value at percentile (0 - 100), reported as the upper bound of the matching bucket.
+uint64_t SLHistogramPercentile(const SLHistogram *histogram, double percentile);
+
+// Mean of all recorded values, 0 if empty.
+double SLHistogramMean(const SLHistogram *histogram);
+
+// Writes `{"count":..,"min":..,"mean":..,"p50":..,"p90":..,"p99":..,"p999":..,"max":..}` into buffer.
+// Returns the number of characters that would have been written, like snprintf.
+int SLHistogramPrintJSON(const SLHistogram *histogram, char *buffer, size_t size);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SLHistogram_h */
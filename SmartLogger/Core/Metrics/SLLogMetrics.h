@@ -0,0 +1,189 @@
+//
+//  SLLogMetrics.h
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/5.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#ifndef SLLogMetrics_h
+#define SLLogMetrics_h
+
+#import <Foundation/Foundation.h>
+#import "SLHistogram.h"
+#import "SLLogSketch.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+typedef NS_ENUM(NSUInteger, SLLogCounter) {
+    /// Messages queued by producers
+    SLLogCounterEnqueued = 0,
+    /// Messages dispatched to appenders
+    SLLogCounterLogged,
+    /// Producer found the queue full and had to wait
+    SLLogCounterSemaphoreWaits,
+    /// Dropped by SLLogThrottle
+    SLLogCounterDropped,
+    /// Exceptions swallowed by appenders
+    SLLogCounterExceptions,
+    /// SLLogMessage created because pool was empty
+    SLLogCounterMessageAllocations,
+    /// Strings built on logging path (thread/queue labels, file names, message buffers)
+    SLLogCounterStringAllocations,
+    /// Cut by SLLogMemoryGovernor
+    SLLogCounterTruncated,
+    /// Dropped by SLLogMemoryGovernor
+    SLLogCounterMemoryShed,
+    /// Written to spill file by SLLogMemoryGovernor
+    SLLogCounterSpilled,
+    SLLogCounterCount
+};
+
+typedef NS_ENUM(NSUInteger, SLLogGauge) {
+    /// Messages waiting in queue
+    SLLogGaugeQueueDepth = 0,
+    /// High water mark of queue depth
+    SLLogGaugeQueueDepthMax,
+    /// Archived log files waiting for compression
+    SLLogGaugeCompressionBacklog,
+    /// Bytes held by queued messages and formatter buffers
+    SLLogGaugeMemoryBytes,
+    /// High water mark of memory bytes
+    SLLogGaugeMemoryBytesMax,
+    /// Messages waiting in spill file
+    SLLogGaugeMemorySpilled,
+    SLLogGaugeCount
+};
+
+typedef NS_ENUM(NSUInteger, SLLogLatency) {
+    /// Time blocked on full queue
+    SLLogLatencySemaphoreWait = 0,
+    /// dispatch_group_wait in -mf_log:
+    SLLogLatencyGroupWait,
+    /// Message creation to all appenders done
+    SLLogLatencyEndToEnd,
+    /// Default appenders created and ready, off the first caller's thread
+    SLLogLatencyStartup,
+    SLLogLatencyCount
+};
+
+#define SL_METRICS_SHARDS 16    // Should be power of 2
+
+/// Counters are sharded per thread, each shard on its own cache line.
+typedef struct SLLogMetricsShard {
+    uint64_t counters[SLLogCounterCount];
+} __attribute__((aligned(64))) SLLogMetricsShard;
+
+/// Per appender, created once per appender name and never freed.
+typedef struct SLLogAppenderMetrics {
+    const char *name;
+    uint64_t messages;
+    uint64_t bytes;
+    SLHistogram latency;
+    struct SLLogAppenderMetrics *next;
+} SLLogAppenderMetrics;
+
+#if __cplusplus
+extern "C" {
+#endif
+
+extern SLLogMetricsShard SLLogMetricsShards[SL_METRICS_SHARDS];
+extern int64_t SLLogMetricsGauges[SLLogGaugeCount];
+extern SLHistogram SLLogMetricsLatencies[SLLogLatencyCount];
+extern __thread unsigned int SLLogMetricsThreadShard;
+
+unsigned int SLLogMetricsAssignShard(void);
+
+/// Monotonic nanoseconds
+uint64_t SLLogMetricsNow(void);
+
+/// Metrics of appender, created on first use. Thread safe.
+SLLogAppenderMetrics *SLLogMetricsForAppender(NSString *appenderName);
+
+/// Counts one message for its call site and tag, see SLLogSketch.h. Called on producer thread
+/// after throttling, `bytes` is the UTF-8 length of the message without formatter prefix (or of
+/// the binary payload). Tags are counted by content. Lock free.
+void SLLogMetricsRecordSite(const char *file, NSUInteger line, NSString * _Nullable tag, NSUInteger bytes);
+
+#if __cplusplus
+}
+#endif
+
+/// One uncontended relaxed add on the calling thread's shard.
+static inline void SLLogMetricsIncrement(SLLogCounter counter, uint64_t value)
+{
+    unsigned int shard = SLLogMetricsThreadShard;
+    if (__builtin_expect(shard == 0, 0)) {
+        shard = SLLogMetricsAssignShard();
+    }
+    __atomic_fetch_add(&SLLogMetricsShards[shard - 1].counters[counter], value, __ATOMIC_RELAXED);
+}
+
+static inline void SLLogMetricsSetGauge(SLLogGauge gauge, int64_t value)
+{
+    __atomic_store_n(&SLLogMetricsGauges[gauge], value, __ATOMIC_RELAXED);
+}
+
+static inline void SLLogMetricsAddGauge(SLLogGauge gauge, int64_t value)
+{
+    __atomic_fetch_add(&SLLogMetricsGauges[gauge], value, __ATOMIC_RELAXED);
+}
+
+/// Only grows, used for high water marks
+static inline void SLLogMetricsRaiseGauge(SLLogGauge gauge, int64_t value)
+{
+    int64_t current = __atomic_load_n(&SLLogMetricsGauges[gauge], __ATOMIC_RELAXED);
+    while (value > current &&
+           !__atomic_compare_exchange_n(&SLLogMetricsGauges[gauge], &current, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+}
+
+static inline void SLLogMetricsRecordLatency(SLLogLatency latency, uint64_t nanos)
+{
+    SLHistogramRecord(&SLLogMetricsLatencies[latency], nanos);
+}
+
+/**
+ * 日志系统自身的运行指标.
+ *
+ * 记录路径全部是无锁的: 计数器按线程分片, gauge 为单个原子变量,
+ * 延迟使用对数分桶直方图 (SLHistogram). 单次记录开销在几纳秒量级.
+ * 每个调用点和 tag 的消息数/字节数用 count-min sketch + top-K 统计 (SLLogSketch), 内存固定,
+ * 用来定位刷日志导致 logFilesDiskQuota 提前删除文件的调用点.
+ * 快照按需生成，也可以定期以日志形式输出.
+ */
+@interface SLLogMetrics : NSObject
+
+/// Periodic report interval, 0 disables it. Default 0
+@property (class, nonatomic, assign) NSTimeInterval reportInterval;
+
+/**
+ * Snapshot of all metrics:
+ *  {
+ *    "counters":  {"enqueued": N, ...},
+ *    "gauges":    {"queue_depth": N, ...},
+ *    "latency_ns": {"group_wait": {"count":..,"p50":..,...}, ...},
+ *    "appenders": {"<name>": {"messages": N, "bytes": N, "latency_ns": {...}}},
+ *    "sites":     [{"name": "File.m:42", "messages": N, "bytes": N}, ...],
+ *    "tags":      [{"name": "<tag>", "messages": N, "bytes": N}, ...]
+ *  }
+ * sites / tags are the busiest call sites and tags of the last `siteWindow`, most messages first.
+ */
++ (NSDictionary<NSString *, id> *)snapshot;
+
+/// Sliding window of site and tag accounting, 50 - 60 seconds
+@property (class, nonatomic, readonly) NSTimeInterval siteWindow;
+
+/**
+ * Logs the busiest call sites and tags, e.g. when log files are deleted early by disk quota.
+ * Asynchronous, safe on any queue.
+ */
++ (void)writeSiteReport:(NSString *)reason;
+
+/// Reset counters and histograms, gauges are kept
++ (void)reset;
+
+@end
+
+NS_ASSUME_NONNULL_END
+
+#endif /* SLLogMetrics_h */
@@ -0,0 +1,362 @@
+//
+//  SLLogMetrics.m
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/5.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#import "SLLogMetrics.h"
+#import "SLLogger.h"
+
+#import <mach/mach_time.h>
+#import <pthread.h>
+
+SLLogMetricsShard SLLogMetricsShards[SL_METRICS_SHARDS];
+int64_t SLLogMetricsGauges[SLLogGaugeCount];
+SLHistogram SLLogMetricsLatencies[SLLogLatencyCount];
+__thread unsigned int SLLogMetricsThreadShard = 0;
+
+static unsigned int s_nextShard = 0;
+static mach_timebase_info_data_t s_timebase;
+
+static pthread_mutex_t s_appendersMutex = PTHREAD_MUTEX_INITIALIZER;
+static SLLogAppenderMetrics *s_appenders = NULL;
+
+static dispatch_queue_t s_reportQueue;
+static dispatch_source_t s_reportTimer;
+static NSTimeInterval s_reportInterval = 0;
+
+#define SL_SITE_PERIOD 10      // Seconds per sketch window
+
+static SLLogSketch *s_siteSketch;
+static SLLogSketch *s_tagSketch;
+static dispatch_source_t s_rotateTimer;
+static __thread SLLogSketchCache t_siteCache;
+static __thread SLLogSketchCache t_tagCache;
+
+static NSString * const SLLogCounterNames[SLLogCounterCount] = {
+    @"enqueued", @"logged", @"semaphore_waits", @"dropped", @"exceptions",
+    @"message_allocations", @"string_allocations", @"truncated", @"memory_shed", @"spilled",
+};
+
+static NSString * const SLLogGaugeNames[SLLogGaugeCount] = {
+    @"queue_depth", @"queue_depth_max", @"compression_backlog",
+    @"memory_bytes", @"memory_bytes_max", @"memory_spilled",
+};
+
+static NSString * const SLLogLatencyNames[SLLogLatencyCount] = {
+    @"semaphore_wait", @"group_wait", @"end_to_end", @"startup",
+};
+
+__attribute__((constructor))
+static void SLLogMetricsInitialize(void)
+{
+    mach_timebase_info(&s_timebase);
+    for (NSUInteger i = 0; i < SLLogLatencyCount; i++) {
+        SLHistogramInit(&SLLogMetricsLatencies[i]);
+    }
+}
+
+unsigned int SLLogMetricsAssignShard(void)
+{
+    // Round robin, threads created together land on different cache lines
+    unsigned int shard = (__atomic_fetch_add(&s_nextShard, 1, __ATOMIC_RELAXED) & (SL_METRICS_SHARDS - 1)) + 1;
+    SLLogMetricsThreadShard = shard;
+    return shard;
+}
+
+uint64_t SLLogMetricsNow(void)
+{
+    return mach_absolute_time() * s_timebase.numer / s_timebase.denom;
+}
+
+SLLogAppenderMetrics *SLLogMetricsForAppender(NSString *appenderName)
+{
+    const char *name = appenderName.UTF8String ?: "";
+    SLLogAppenderMetrics *metrics;
+
+    pthread_mutex_lock(&s_appendersMutex);
+    for (metrics = s_appenders; metrics != NULL; metrics = metrics->next) {
+        if (strcmp(metrics->name, name) == 0) {
+            break;
+        }
+    }
+    if (metrics == NULL) {
+        // Appenders come and go, but names are few, never freed
+        metrics = (SLLogAppenderMetrics *)calloc(1, sizeof(SLLogAppenderMetrics));
+        metrics->name = strdup(name);
+        SLHistogramInit(&metrics->latency);
+        metrics->next = s_appenders;
+        s_appenders = metrics;
+    }
+    pthread_mutex_unlock(&s_appendersMutex);
+
+    return metrics;
+}
+
+@interface SLLogMetrics ()
++ (dispatch_queue_t)reportQueue;
+@end
+
+#pragma mark - Sites
+
+static void SLLogMetricsSiteName(const void *object, uintptr_t extra, char *buffer, size_t size)
+{
+    const char *file = object ? (const char *)object : "";
+    const char *fileName = strrchr(file, '/');
+    snprintf(buffer, size, "%s:%lu", fileName ? fileName + 1 : file, (unsigned long)extra);
+}
+
+static void SLLogMetricsTagName(const void *object, uintptr_t extra, char *buffer, size_t size)
+{
+    const char *tag = [(__bridge NSString *)object UTF8String];
+    strlcpy(buffer, tag ?: "", size);
+}
+
+static void SLLogMetricsStartSites(void)
+{
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        // __FILE__ is a literal, tags may be dynamic strings
+        SLLogSketch *tags = SLLogSketchCreate(SLLogMetricsTagName, 0);
+        SLLogSketch *sites = SLLogSketchCreate(SLLogMetricsSiteName, 1);
+        if (tags == NULL || sites == NULL) {
+            return;
+        }
+        s_rotateTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, [SLLogMetrics reportQueue]);
+        dispatch_source_set_event_handler(s_rotateTimer, ^{
+            SLLogSketchRotate(s_siteSketch);
+            SLLogSketchRotate(s_tagSketch);
+        });
+        dispatch_source_set_timer(s_rotateTimer,
+                                  dispatch_time(DISPATCH_TIME_NOW, SL_SITE_PERIOD * NSEC_PER_SEC),
+                                  SL_SITE_PERIOD * NSEC_PER_SEC,
+                                  NSEC_PER_SEC);
+        s_tagSketch = tags;
+        __atomic_store_n(&s_siteSketch, sites, __ATOMIC_RELEASE);
+        dispatch_resume(s_rotateTimer);
+    });
+}
+
+/// FNV-1a of the UTF-8 bytes, tags longer than the buffer are told apart by prefix and length
+static uint64_t SLLogMetricsTagKey(NSString *tag)
+{
+    CFStringRef string = (__bridge CFStringRef)tag;
+    CFIndex length = CFStringGetLength(string);
+    const char *bytes = CFStringGetCStringPtr(string, kCFStringEncodingUTF8);
+    char buffer[256];
+    CFIndex used;
+    if (bytes) {
+        used = (CFIndex)strlen(bytes);
+    } else {
+        used = 0;
+        CFStringGetBytes(string, CFRangeMake(0, length), kCFStringEncodingUTF8, '?', false,
+                         (UInt8 *)buffer, sizeof(buffer), &used);
+        bytes = buffer;
+    }
+    uint64_t hash = 14695981039346656037ull;
+    for (CFIndex i = 0; i < used; i++) {
+        hash = (hash ^ (uint8_t)bytes[i]) * 1099511628211ull;
+    }
+    return hash ^ (uint64_t)length;
+}
+
+void SLLogMetricsRecordSite(const char *file, NSUInteger line, NSString *tag, NSUInteger bytes)
+{
+    SLLogSketch *sites = __atomic_load_n(&s_siteSketch, __ATOMIC_ACQUIRE);
+    if (__builtin_expect(sites == NULL, 0)) {
+        SLLogMetricsStartSites();
+        if ((sites = __atomic_load_n(&s_siteSketch, __ATOMIC_ACQUIRE)) == NULL) {
+            return;
+        }
+    }
+    uint32_t length = (uint32_t)MIN(bytes, (NSUInteger)UINT32_MAX >> 2);
+    // Same site key as SLLogThrottle
+    uint64_t siteKey = (uintptr_t)file ^ ((uint64_t)line * 0x9E3779B97F4A7C15ull);
+    SLLogSketchAdd(sites, &t_siteCache, siteKey, length, file, line);
+    if (tag) {
+        // By content, dynamic tags are usually new objects for every message
+        SLLogSketchAdd(s_tagSketch, &t_tagCache, SLLogMetricsTagKey(tag), length, (__bridge void *)tag, 0);
+    }
+}
+
+static NSArray *SLLogMetricsSketchArray(SLLogSketch *sketch)
+{
+    if (sketch == NULL) {
+        return @[];
+    }
+    SLLogSketchEntry entries[SL_SKETCH_TOP];
+    size_t count = SLLogSketchTop(sketch, entries, SL_SKETCH_TOP);
+    NSMutableArray *array = [NSMutableArray arrayWithCapacity:count];
+    for (size_t i = 0; i < count; i++) {
+        [array addObject:@{
+                           @"name": @(entries[i].name) ?: @"",
+                           @"messages": @(entries[i].messages),
+                           @"bytes": @(entries[i].bytes),
+                           }];
+    }
+    return array;
+}
+
+static NSDictionary *SLLogMetricsHistogramDictionary(const SLHistogram *histogram)
+{
+    SLHistogram snapshot;
+    SLHistogramSnapshot(histogram, &snapshot);
+    return @{
+             @"count": @(snapshot.total),
+             @"min": @(snapshot.total ? snapshot.min : 0),
+             @"mean": @((uint64_t)SLHistogramMean(&snapshot)),
+             @"p50": @(SLHistogramPercentile(&snapshot, 50)),
+             @"p90": @(SLHistogramPercentile(&snapshot, 90)),
+             @"p99": @(SLHistogramPercentile(&snapshot, 99)),
+             @"p999": @(SLHistogramPercentile(&snapshot, 99.9)),
+             @"max": @(snapshot.max),
+             };
+}
+
+@implementation SLLogMetrics
+
++ (NSDictionary<NSString *,id> *)snapshot
+{
+    NSMutableDictionary *counters = [NSMutableDictionary dictionaryWithCapacity:SLLogCounterCount];
+    for (NSUInteger c = 0; c < SLLogCounterCount; c++) {
+        uint64_t total = 0;
+        for (NSUInteger s = 0; s < SL_METRICS_SHARDS; s++) {
+            total += __atomic_load_n(&SLLogMetricsShards[s].counters[c], __ATOMIC_RELAXED);
+        }
+        counters[SLLogCounterNames[c]] = @(total);
+    }
+
+    NSMutableDictionary *gauges = [NSMutableDictionary dictionaryWithCapacity:SLLogGaugeCount];
+    for (NSUInteger g = 0; g < SLLogGaugeCount; g++) {
+        gauges[SLLogGaugeNames[g]] = @(__atomic_load_n(&SLLogMetricsGauges[g], __ATOMIC_RELAXED));
+    }
+
+    NSMutableDictionary *latencies = [NSMutableDictionary dictionaryWithCapacity:SLLogLatencyCount];
+    for (NSUInteger l = 0; l < SLLogLatencyCount; l++) {
+        latencies[SLLogLatencyNames[l]] = SLLogMetricsHistogramDictionary(&SLLogMetricsLatencies[l]);
+    }
+
+    NSMutableDictionary *appenders = [NSMutableDictionary dictionary];
+    pthread_mutex_lock(&s_appendersMutex);
+    for (SLLogAppenderMetrics *metrics = s_appenders; metrics != NULL; metrics = metrics->next) {
+        appenders[@(metrics->name)] = @{
+                                        @"messages": @(__atomic_load_n(&metrics->messages, __ATOMIC_RELAXED)),
+                                        @"bytes": @(__atomic_load_n(&metrics->bytes, __ATOMIC_RELAXED)),
+                                        @"latency_ns": SLLogMetricsHistogramDictionary(&metrics->latency),
+                                        };
+    }
+    pthread_mutex_unlock(&s_appendersMutex);
+
+    SLLogSketch *sites = __atomic_load_n(&s_siteSketch, __ATOMIC_ACQUIRE);
+    return @{
+             @"counters": counters,
+             @"gauges": gauges,
+             @"latency_ns": latencies,
+             @"appenders": appenders,
+             @"sites": SLLogMetricsSketchArray(sites),
+             @"tags": SLLogMetricsSketchArray(sites ? s_tagSketch : NULL),
+             };
+}
+
++ (void)reset
+{
+    // Values recorded concurrently may be lost, acceptable for metrics
+    for (NSUInteger s = 0; s < SL_METRICS_SHARDS; s++) {
+        for (NSUInteger c = 0; c < SLLogCounterCount; c++) {
+            __atomic_store_n(&SLLogMetricsShards[s].counters[c], 0, __ATOMIC_RELAXED);
+        }
+    }
+    for (NSUInteger l = 0; l < SLLogLatencyCount; l++) {
+        SLHistogramInit(&SLLogMetricsLatencies[l]);
+    }
+    pthread_mutex_lock(&s_appendersMutex);
+    for (SLLogAppenderMetrics *metrics = s_appenders; metrics != NULL; metrics = metrics->next) {
+        __atomic_store_n(&metrics->messages, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&metrics->bytes, 0, __ATOMIC_RELAXED);
+        SLHistogramInit(&metrics->latency);
+    }
+    pthread_mutex_unlock(&s_appendersMutex);
+    SLLogSketch *sites = __atomic_load_n(&s_siteSketch, __ATOMIC_ACQUIRE);
+    if (sites) {
+        SLLogSketchReset(sites);
+        SLLogSketchReset(s_tagSketch);
+    }
+    SLLogMetricsSetGauge(SLLogGaugeQueueDepthMax, __atomic_load_n(&SLLogMetricsGauges[SLLogGaugeQueueDepth], __ATOMIC_RELAXED));
+}
+
+#pragma mark - Report
+
++ (NSTimeInterval)reportInterval
+{
+    __block NSTimeInterval interval;
+    dispatch_sync([self reportQueue], ^{
+        interval = s_reportInterval;
+    });
+    return interval;
+}
+
++ (void)setReportInterval:(NSTimeInterval)reportInterval
+{
+    dispatch_async([self reportQueue], ^{
+        s_reportInterval = MAX(reportInterval, 0);
+        if (s_reportTimer) {
+            dispatch_source_cancel(s_reportTimer);
+            s_reportTimer = nil;
+        }
+        if (s_reportInterval <= 0) {
+            return;
+        }
+        s_reportTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, s_reportQueue);
+        dispatch_source_set_event_handler(s_reportTimer, ^{ @autoreleasepool {
+            [SLLogMetrics writeReport];
+        } });
+        dispatch_source_set_timer(s_reportTimer,
+                                  dispatch_time(DISPATCH_TIME_NOW, (int64_t)(s_reportInterval * NSEC_PER_SEC)),
+                                  (uint64_t)(s_reportInterval * NSEC_PER_SEC),
+                                  NSEC_PER_SEC);
+        dispatch_resume(s_reportTimer);
+    });
+}
+
++ (NSTimeInterval)siteWindow
+{
+    return SL_SITE_PERIOD * SL_SKETCH_WINDOWS;
+}
+
++ (void)writeSiteReport:(NSString *)reason
+{
+    dispatch_async([self reportQueue], ^{ @autoreleasepool {
+        NSMutableString *report = [NSMutableString stringWithFormat:@"busiest log sites (%@), last %d seconds", reason,
+                                   SL_SITE_PERIOD * (SL_SKETCH_WINDOWS - 1)];
+        NSDictionary *snapshot = [self snapshot];
+        for (NSString *kind in @[@"sites", @"tags"]) {
+            for (NSDictionary *entry in snapshot[kind]) {
+                [report appendFormat:@"\n  %@ %@: %@ messages, %@ bytes", kind, entry[@"name"], entry[@"messages"], entry[@"bytes"]];
+            }
+        }
+        [SLLogger directlog:YES tag:@"SmartLogger" message:report];
+    } });
+}
+
++ (dispatch_queue_t)reportQueue
+{
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        s_reportQueue = dispatch_queue_create("smartlogger.metrics", NULL);
+    });
+    return s_reportQueue;
+}
+
++ (void)writeReport
+{
+    NSData *data = [NSJSONSerialization dataWithJSONObject:[self snapshot] options:0 error:NULL];
+    if (data == nil) {
+        return;
+    }
+    NSString *json = [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
+    [SLLogger directlog:YES tag:@"SmartLogger" message:[@"metrics " stringByAppendingString:json]];
+}
+
+@end
@@ -0,0 +1,197 @@
+//
+//  SLLogSketch.c
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/12.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#include "SLLogSketch.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SL_SKETCH_OFFER_RATE 8
+
+static void sl_sketch_lock(SLLogSketch *sketch) {
+    while (__atomic_test_and_set(&sketch->lock, __ATOMIC_ACQUIRE)) {}
+}
+
+static void sl_sketch_unlock(SLLogSketch *sketch) {
+    __atomic_clear(&sketch->lock, __ATOMIC_RELEASE);
+}
+
+static void sl_sketch_update_threshold(SLLogSketch *sketch) {
+    uint64_t threshold = 0;
+    if (sketch->heavyCount == SL_SKETCH_TOP) {
+        threshold = UINT64_MAX;
+        for (uint32_t i = 0; i < sketch->heavyCount; i++) {
+            threshold = sketch->heavy[i].estimate < threshold ? sketch->heavy[i].estimate : threshold;
+        }
+    }
+    if (threshold != __atomic_load_n(&sketch->threshold, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&sketch->threshold, threshold, __ATOMIC_RELAXED);
+    }
+}
+
+SLLogSketch *SLLogSketchCreate(SLLogSketchNamer namer, int stableObjects) {
+    // Large enough for calloc to map fresh zero pages
+    SLLogSketch *sketch = (SLLogSketch *)calloc(1, sizeof(SLLogSketch));
+    if (sketch) {
+        sketch->namer = namer;
+        sketch->stableObjects = stableObjects;
+    }
+    return sketch;
+}
+
+void SLLogSketchReset(SLLogSketch *sketch) {
+    for (int window = 0; window < SL_SKETCH_WINDOWS; window++) {
+        for (int row = 0; row < SL_SKETCH_DEPTH; row++) {
+            for (int column = 0; column < SL_SKETCH_WIDTH; column++) {
+                __atomic_store_n(&sketch->cells[window][row][column], 0, __ATOMIC_RELAXED);
+            }
+        }
+    }
+    sl_sketch_lock(sketch);
+    sketch->heavyCount = 0;
+    sl_sketch_update_threshold(sketch);
+    sl_sketch_unlock(sketch);
+}
+
+static void sl_sketch_offer(SLLogSketch *sketch, const SLLogSketchCacheEntry *entry, uint64_t estimate, int named) {
+    // Never wait on the logging path
+    if (__atomic_test_and_set(&sketch->lock, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    SLLogSketchHeavy *target = NULL;
+    for (uint32_t i = 0; i < sketch->heavyCount; i++) {
+        if (sketch->heavy[i].key == entry->key) {
+            target = &sketch->heavy[i];
+            break;
+        }
+    }
+    if (target == NULL) {
+        if (sketch->heavyCount < SL_SKETCH_TOP) {
+            target = &sketch->heavy[sketch->heavyCount++];
+        } else {
+            // Replace the smallest, it is below `estimate` unless the threshold moved meanwhile
+            target = &sketch->heavy[0];
+            for (uint32_t i = 1; i < sketch->heavyCount; i++) {
+                if (sketch->heavy[i].estimate < target->estimate) {
+                    target = &sketch->heavy[i];
+                }
+            }
+            if (target->estimate >= estimate) {
+                target = NULL;
+            }
+        }
+        if (target) {
+            target->key = entry->key;
+            target->name[0] = '\0';
+        }
+    }
+    if (target && target->name[0] == '\0' && named && sketch->namer) {
+        sketch->namer(entry->object, entry->extra, target->name, sizeof(target->name));
+    }
+    if (target && target->estimate < estimate) {
+        target->estimate = estimate;
+    }
+    sl_sketch_update_threshold(sketch);
+
+    sl_sketch_unlock(sketch);
+}
+
+void SLLogSketchFlush(SLLogSketch *sketch, SLLogSketchCacheEntry *entry, int named) {
+    const uint64_t byteMask = (1ull << SL_SKETCH_BYTES_BITS) - 1;
+    uint64_t increment = ((uint64_t)entry->messages << SL_SKETCH_BYTES_BITS) | (entry->bytes & byteMask);
+    uint64_t hash = SLLogSketchHash(entry->key);
+    uint32_t window = __atomic_load_n(&sketch->current, __ATOMIC_RELAXED);
+    uint64_t estimate = UINT64_MAX;
+    for (int row = 0; row < SL_SKETCH_DEPTH; row++) {
+        uint64_t *cell = &sketch->cells[window][row][(hash >> (row * 16)) & (SL_SKETCH_WIDTH - 1)];
+        uint64_t messages = (__atomic_fetch_add(cell, increment, __ATOMIC_RELAXED) + increment) >> SL_SKETCH_BYTES_BITS;
+        estimate = messages < estimate ? messages : estimate;
+    }
+    entry->messages = 0;
+    entry->bytes = 0;
+    // Once the list is full, about one flush in SL_SKETCH_OFFER_RATE offers, the list lock is shared
+    uint64_t threshold = __atomic_load_n(&sketch->threshold, __ATOMIC_RELAXED);
+    if (estimate > threshold && (threshold == 0 || ((estimate / SL_SKETCH_CACHE_FLUSH) % SL_SKETCH_OFFER_RATE) == 0)) {
+        sl_sketch_offer(sketch, entry, estimate, named);
+    }
+}
+
+void SLLogSketchEstimate(SLLogSketch *sketch, uint64_t key, uint64_t *messages, uint64_t *bytes) {
+    const uint64_t byteMask = (1ull << SL_SKETCH_BYTES_BITS) - 1;
+    uint64_t hash = SLLogSketchHash(key);
+    uint64_t totalMessages = 0, totalBytes = 0;
+    for (int window = 0; window < SL_SKETCH_WINDOWS; window++) {
+        // Rows are minimized separately, the smallest message and byte counts may be in different rows
+        uint64_t windowMessages = UINT64_MAX, windowBytes = UINT64_MAX;
+        for (int row = 0; row < SL_SKETCH_DEPTH; row++) {
+            uint64_t cell = __atomic_load_n(&sketch->cells[window][row][(hash >> (row * 16)) & (SL_SKETCH_WIDTH - 1)],
+                                            __ATOMIC_RELAXED);
+            uint64_t cellMessages = cell >> SL_SKETCH_BYTES_BITS;
+            uint64_t cellBytes = cell & byteMask;
+            windowMessages = cellMessages < windowMessages ? cellMessages : windowMessages;
+            windowBytes = cellBytes < windowBytes ? cellBytes : windowBytes;
+        }
+        totalMessages += windowMessages;
+        totalBytes += windowBytes;
+    }
+    *messages = totalMessages;
+    *bytes = totalBytes;
+}
+
+void SLLogSketchRotate(SLLogSketch *sketch) {
+    uint32_t next = (__atomic_load_n(&sketch->current, __ATOMIC_RELAXED) + 1) % SL_SKETCH_WINDOWS;
+    // Not written since it was current, (windows - 1) periods ago
+    for (int row = 0; row < SL_SKETCH_DEPTH; row++) {
+        for (int column = 0; column < SL_SKETCH_WIDTH; column++) {
+            __atomic_store_n(&sketch->cells[next][row][column], 0, __ATOMIC_RELAXED);
+        }
+    }
+    __atomic_store_n(&sketch->current, next, __ATOMIC_RELEASE);
+
+    // Entries compete again from zero, quiet ones are replaced first
+    sl_sketch_lock(sketch);
+    for (uint32_t i = 0; i < sketch->heavyCount; i++) {
+        sketch->heavy[i].estimate = 0;
+    }
+    sl_sketch_update_threshold(sketch);
+    sl_sketch_unlock(sketch);
+}
+
+static int sl_sketch_compare(const void *a, const void *b) {
+    const SLLogSketchEntry *left = (const SLLogSketchEntry *)a;
+    const SLLogSketchEntry *right = (const SLLogSketchEntry *)b;
+    if (left->messages != right->messages) {
+        return left->messages > right->messages ? -1 : 1;
+    }
+    return left->bytes > right->bytes ? -1 : left->bytes < right->bytes;
+}
+
+size_t SLLogSketchTop(SLLogSketch *sketch, SLLogSketchEntry *entries, size_t capacity) {
+    SLLogSketchHeavy heavy[SL_SKETCH_TOP];
+    sl_sketch_lock(sketch);
+    uint32_t count = sketch->heavyCount;
+    memcpy(heavy, sketch->heavy, count * sizeof(SLLogSketchHeavy));
+    sl_sketch_unlock(sketch);
+
+    SLLogSketchEntry all[SL_SKETCH_TOP];
+    size_t found = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        SLLogSketchEntry *entry = &all[found];
+        SLLogSketchEstimate(sketch, heavy[i].key, &entry->messages, &entry->bytes);
+        if (entry->messages == 0) {
+            continue;
+        }
+        memcpy(entry->name, heavy[i].name, sizeof(entry->name));
+        found++;
+    }
+    qsort(all, found, sizeof(SLLogSketchEntry), sl_sketch_compare);
+    found = found < capacity ? found : capacity;
+    memcpy(entries, all, found * sizeof(SLLogSketchEntry));
+    return found;
+}
@@ -0,0 +1,150 @@
+//
+//  SLLogSketch.h
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/12.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#ifndef SLLogSketch_h
+#define SLLogSketch_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if __cplusplus
+extern "C" {
+#endif
+
+// Heavy hitters (call sites, tags) by messages and bytes over a sliding window, in fixed memory.
+//
+// A count-min sketch per window: SL_SKETCH_DEPTH rows of SL_SKETCH_WIDTH cells, each cell packs
+// messages (high bits) and bytes (low SL_SKETCH_BYTES_BITS bits) so one relaxed atomic add per row
+// counts both. The estimate of a key is the smallest cell of its rows, never below the real count.
+// SL_SKETCH_WINDOWS windows form a ring, SLLogSketchRotate clears the oldest and makes it current,
+// so the sketch covers the last (windows - 1) to windows rotation periods.
+//
+// Adds go through a small per thread cache (SLLogSketchCache, declared __thread by the caller),
+// plain increments without atomics. A cached key is written to the sketch after
+// SL_SKETCH_CACHE_FLUSH messages or when another key takes its slot, so hot keys cost a few
+// nanoseconds and shared cache lines are only touched once per flush. Counts still in a cache are
+// not visible yet, at most SL_SKETCH_CACHE_FLUSH - 1 messages per key and thread.
+//
+// A flushed key whose estimate exceeds the smallest tracked one is offered to a top list of
+// SL_SKETCH_TOP entries (once the list is full, on about one flush in eight). The list is guarded by a try-lock, a busy list skips the offer and the
+// key is offered again on its next flush. The list holds names, counts are read from the sketch.
+// Without stable objects, keys that only reach the list by cache eviction stay unnamed (empty
+// name) until a flush on the adding thread.
+//
+// Plain C, no Foundation dependency.
+#define SL_SKETCH_DEPTH 4
+#define SL_SKETCH_WIDTH 512         // Should be power of 2
+#define SL_SKETCH_WINDOWS 6
+#define SL_SKETCH_TOP 16
+#define SL_SKETCH_NAME_SIZE 64
+#define SL_SKETCH_BYTES_BITS 40
+#define SL_SKETCH_CACHE_SIZE 32     // Should be power of 2
+#define SL_SKETCH_CACHE_FLUSH 32
+
+typedef struct SLLogSketchHeavy_ {
+    uint64_t key;
+    uint64_t estimate;          // Messages in the current window when last offered
+    char name[SL_SKETCH_NAME_SIZE];
+} SLLogSketchHeavy;
+
+// Writes the name of a key in the top list, once, on a thread adding the key.
+typedef void (*SLLogSketchNamer)(const void *object, uintptr_t extra, char *buffer, size_t size);
+
+typedef struct SLLogSketch_ {
+    uint64_t cells[SL_SKETCH_WINDOWS][SL_SKETCH_DEPTH][SL_SKETCH_WIDTH];
+    // Read on every flush, written once per rotation or when the list changes
+    uint32_t current;
+    uint64_t threshold;         // Smallest tracked estimate, 0 until the list is full
+    SLLogSketchNamer namer;
+    int stableObjects;
+    char lock __attribute__((aligned(64)));
+    uint32_t heavyCount;
+    SLLogSketchHeavy heavy[SL_SKETCH_TOP];
+} SLLogSketch;
+
+typedef struct SLLogSketchCacheEntry_ {
+    uint64_t key;
+    uint32_t messages;
+    uint32_t bytes;
+    const void *object;
+    uintptr_t extra;
+} SLLogSketchCacheEntry;
+
+// Per thread and sketch, zero initialized.
+typedef struct SLLogSketchCache_ {
+    SLLogSketchCacheEntry entries[SL_SKETCH_CACHE_SIZE];
+} SLLogSketchCache;
+
+typedef struct SLLogSketchEntry_ {
+    char name[SL_SKETCH_NAME_SIZE];
+    uint64_t messages;
+    uint64_t bytes;
+} SLLogSketchEntry;
+
+// Zeroed sketch, pages are only touched when counted. `stableObjects` if objects passed to
+// SLLogSketchAdd live forever (__FILE__ literals), they are then also used to name keys evicted
+// from a cache. Returns NULL if out of memory.
+SLLogSketch *SLLogSketchCreate(SLLogSketchNamer namer, int stableObjects);
+
+// Clears all windows and the top list. Counts added concurrently may be partially kept.
+void SLLogSketchReset(SLLogSketch *sketch);
+
+// Writes a cache entry to the current window and offers its key to the top list. `named` if the
+// entry's object is still valid.
+void SLLogSketchFlush(SLLogSketch *sketch, SLLogSketchCacheEntry *entry, int named);
+
+static inline uint64_t SLLogSketchHash(uint64_t key) {
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ull;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebull;
+    return key ^ (key >> 31);
+}
+
+// Counts one message of `bytes` for key, `object` and `extra` are passed to the namer.
+// Lock free, `cache` belongs to the calling thread.
+static inline void SLLogSketchAdd(SLLogSketch *sketch, SLLogSketchCache *cache, uint64_t key, uint32_t bytes,
+                                  const void *object, uintptr_t extra) {
+    // Two ways, a key lives in either slot of its pair
+    size_t index = (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & (SL_SKETCH_CACHE_SIZE - 2);
+    SLLogSketchCacheEntry *entry = &cache->entries[index];
+    if (__builtin_expect(entry->key != key, 0)) {
+        SLLogSketchCacheEntry *other = &cache->entries[index + 1];
+        if (other->key == key) {
+            entry = other;
+        } else {
+            // Evict the colder one
+            entry = other->messages < entry->messages ? other : entry;
+            if (entry->messages > 0) {
+                SLLogSketchFlush(sketch, entry, sketch->stableObjects);
+            }
+            entry->key = key;
+        }
+    }
+    entry->object = object;
+    entry->extra = extra;
+    entry->bytes += bytes;
+    if (++entry->messages >= SL_SKETCH_CACHE_FLUSH || entry->bytes >= (1u << 31)) {
+        SLLogSketchFlush(sketch, entry, 1);
+    }
+}
+
+// Messages and bytes of key over all windows.
+void SLLogSketchEstimate(SLLogSketch *sketch, uint64_t key, uint64_t *messages, uint64_t *bytes);
+
+// Clears the oldest window and makes it current, call once per period.
+void SLLogSketchRotate(SLLogSketch *sketch);
+
+// Tracked keys with their counts over all windows, most messages first. Returns the entry count.
+size_t SLLogSketchTop(SLLogSketch *sketch, SLLogSketchEntry *entries, size_t capacity);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SLLogSketch_h */
@@ -0,0 +1,416 @@
+//
+//  SLLogTrace.c
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/12.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#include "SLLogTrace.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#include <mach/mach_time.h>
+#endif
+
+#define SL_TRACE_MAGIC          "SLTRACE1"
+#define SL_TRACE_BUFFER_SIZE    (64 * 1024)
+#define SL_TRACE_RECORD_MAX     64      // Call record, names are flushed around
+#define SL_TRACE_TABLE_SIZE     (SL_TRACE_MAX_NAMES * 2)
+
+enum {
+    SLLogTraceKindSite = 0x01,
+    SLLogTraceKindTag = 0x02,
+    SLLogTraceKindCall = 0x03,
+};
+
+typedef struct SLLogTraceName_ {
+    const void *key;
+    uint32_t line;
+    uint32_t id;        // 0 - empty slot
+} SLLogTraceName;
+
+int SLLogTraceActive = 0;
+
+static pthread_mutex_t s_traceMutex = PTHREAD_MUTEX_INITIALIZER;
+static int s_traceFile = -1;
+static uint32_t s_traceGeneration = 0;
+static uint64_t s_traceLast = 0;
+static uint32_t s_traceThreads = 0;
+static uint32_t s_traceSiteCount = 0;
+static uint32_t s_traceTagCount = 0;
+static SLLogTraceName *s_traceSites;
+static SLLogTraceName *s_traceTags;
+static uint8_t *s_traceBuffer;
+static size_t s_traceLength = 0;
+
+// Thread numbers are per trace
+static __thread uint32_t t_traceGeneration = 0;
+static __thread uint32_t t_traceThread = 0;
+
+static uint64_t SLLogTraceNow(void)
+{
+#ifdef __APPLE__
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0) {
+        mach_timebase_info(&timebase);
+    }
+    return mach_absolute_time() * timebase.numer / timebase.denom;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static size_t SLLogTracePutVarint(uint8_t *bytes, uint64_t value)
+{
+    size_t length = 0;
+    while (value >= 0x80) {
+        bytes[length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    bytes[length++] = (uint8_t)value;
+    return length;
+}
+
+// Writer, all locked
+
+static void SLLogTraceFlush(void)
+{
+    size_t offset = 0;
+    while (offset < s_traceLength) {
+        ssize_t written = write(s_traceFile, s_traceBuffer + offset, s_traceLength - offset);
+        if (written <= 0) {
+            // Full disk, what is on file stays readable
+            __atomic_store_n(&SLLogTraceActive, 0, __ATOMIC_RELAXED);
+            break;
+        }
+        offset += (size_t)written;
+    }
+    s_traceLength = 0;
+}
+
+static void SLLogTraceAppend(const void *bytes, size_t length)
+{
+    if (s_traceLength + length > SL_TRACE_BUFFER_SIZE) {
+        SLLogTraceFlush();
+    }
+    if (length > SL_TRACE_BUFFER_SIZE) {
+        return;
+    }
+    memcpy(s_traceBuffer + s_traceLength, bytes, length);
+    s_traceLength += length;
+}
+
+static void SLLogTraceAppendName(uint8_t kind, uint32_t id, const char *name)
+{
+    uint8_t header[1 + 2 * 10];
+    size_t nameLength = name ? strlen(name) : 0;
+    if (nameLength > 1024) {
+        nameLength = 1024;
+    }
+    size_t length = 0;
+    header[length++] = kind;
+    length += SLLogTracePutVarint(header + length, id);
+    length += SLLogTracePutVarint(header + length, nameLength);
+    SLLogTraceAppend(header, length);
+    if (nameLength > 0) {
+        SLLogTraceAppend(name, nameLength);
+    }
+}
+
+// Open addressing by identity, returns the slot of key or the empty slot it would go to
+static SLLogTraceName *SLLogTraceFind(SLLogTraceName *table, const void *key, uint32_t line)
+{
+    uint64_t hash = (uintptr_t)key ^ ((uint64_t)line * 0x9E3779B97F4A7C15ull);
+    hash ^= hash >> 29;
+    size_t index = (size_t)(hash * 0xBF58476D1CE4E5B9ull >> 32) & (SL_TRACE_TABLE_SIZE - 1);
+    while (table[index].id != 0 && (table[index].key != key || table[index].line != line)) {
+        index = (index + 1) & (SL_TRACE_TABLE_SIZE - 1);
+    }
+    return &table[index];
+}
+
+static uint32_t SLLogTraceSiteID(const char *file, uint32_t line)
+{
+    SLLogTraceName *slot = SLLogTraceFind(s_traceSites, file, line);
+    if (slot->id != 0) {
+        return slot->id;
+    }
+    if (s_traceSiteCount >= SL_TRACE_MAX_NAMES) {
+        return 0;
+    }
+    const char *fileName = strrchr(file, '/');
+    char name[256];
+    snprintf(name, sizeof(name), "%s:%u", fileName ? fileName + 1 : file, line);
+    slot->key = file;
+    slot->line = line;
+    slot->id = ++s_traceSiteCount;
+    SLLogTraceAppendName(SLLogTraceKindSite, slot->id, name);
+    return slot->id;
+}
+
+static uint32_t SLLogTraceTagID(const void *tag, SLLogTraceTagName tagName)
+{
+    SLLogTraceName *slot = SLLogTraceFind(s_traceTags, tag, 0);
+    if (slot->id != 0) {
+        return slot->id;
+    }
+    if (s_traceTagCount >= SL_TRACE_MAX_NAMES) {
+        return 0;
+    }
+    slot->key = tag;
+    slot->id = ++s_traceTagCount;
+    SLLogTraceAppendName(SLLogTraceKindTag, slot->id, tagName ? tagName(tag) : NULL);
+    return slot->id;
+}
+
+static void SLLogTraceClose(void)
+{
+    if (s_traceFile >= 0) {
+        SLLogTraceFlush();
+        close(s_traceFile);
+        s_traceFile = -1;
+    }
+    free(s_traceBuffer);
+    free(s_traceSites);
+    free(s_traceTags);
+    s_traceBuffer = NULL;
+    s_traceSites = NULL;
+    s_traceTags = NULL;
+}
+
+int SLLogTraceStart(const char *path)
+{
+    pthread_mutex_lock(&s_traceMutex);
+    if (s_traceFile >= 0) {
+        pthread_mutex_unlock(&s_traceMutex);
+        return -1;
+    }
+
+    s_traceBuffer = malloc(SL_TRACE_BUFFER_SIZE);
+    s_traceSites = calloc(SL_TRACE_TABLE_SIZE, sizeof(SLLogTraceName));
+    s_traceTags = calloc(SL_TRACE_TABLE_SIZE, sizeof(SLLogTraceName));
+    s_traceFile = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (s_traceBuffer == NULL || s_traceSites == NULL || s_traceTags == NULL || s_traceFile < 0) {
+        SLLogTraceClose();
+        pthread_mutex_unlock(&s_traceMutex);
+        return -1;
+    }
+
+    struct timespec wall;
+    clock_gettime(CLOCK_REALTIME, &wall);
+    uint64_t wallStart = (uint64_t)wall.tv_sec * 1000000000ull + (uint64_t)wall.tv_nsec;
+    uint8_t header[16];
+    memcpy(header, SL_TRACE_MAGIC, 8);
+    for (int i = 0; i < 8; i++) {
+        header[8 + i] = (uint8_t)(wallStart >> (8 * i));
+    }
+    SLLogTraceAppend(header, sizeof(header));
+
+    s_traceGeneration++;
+    s_traceThreads = 0;
+    s_traceSiteCount = 0;
+    s_traceTagCount = 0;
+    s_traceLast = SLLogTraceNow();
+    __atomic_store_n(&SLLogTraceActive, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&s_traceMutex);
+    return 0;
+}
+
+void SLLogTraceStop(void)
+{
+    pthread_mutex_lock(&s_traceMutex);
+    __atomic_store_n(&SLLogTraceActive, 0, __ATOMIC_RELAXED);
+    SLLogTraceClose();
+    pthread_mutex_unlock(&s_traceMutex);
+}
+
+void SLLogTraceRecord(const char *file, uint32_t line, const void *tag, SLLogTraceTagName tagName,
+                      uint32_t flag, int synchronous, uint32_t length)
+{
+    pthread_mutex_lock(&s_traceMutex);
+    if (s_traceFile < 0 || !SLLogTraceEnabled()) {
+        pthread_mutex_unlock(&s_traceMutex);
+        return;
+    }
+
+    // Taken under the lock, deltas are never negative
+    uint64_t now = SLLogTraceNow();
+    uint64_t delta = now > s_traceLast ? now - s_traceLast : 0;
+    s_traceLast = now;
+    if (t_traceGeneration != s_traceGeneration) {
+        t_traceGeneration = s_traceGeneration;
+        t_traceThread = s_traceThreads++;
+    }
+    uint32_t site = file ? SLLogTraceSiteID(file, line) : 0;
+    uint32_t tagID = tag ? SLLogTraceTagID(tag, tagName) : 0;
+
+    uint8_t record[SL_TRACE_RECORD_MAX];
+    size_t size = 0;
+    record[size++] = SLLogTraceKindCall;
+    size += SLLogTracePutVarint(record + size, delta);
+    size += SLLogTracePutVarint(record + size, t_traceThread);
+    size += SLLogTracePutVarint(record + size, site);
+    size += SLLogTracePutVarint(record + size, tagID);
+    record[size++] = (uint8_t)((flag & 0x7f) | (synchronous ? SL_TRACE_SYNC : 0));
+    size += SLLogTracePutVarint(record + size, length);
+    SLLogTraceAppend(record, size);
+    pthread_mutex_unlock(&s_traceMutex);
+}
+
+// Reader
+
+typedef struct SLLogTraceCursor_ {
+    const uint8_t *bytes;
+    size_t length;
+    size_t offset;
+} SLLogTraceCursor;
+
+static int SLLogTraceGetVarint(SLLogTraceCursor *cursor, uint64_t *value)
+{
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64 && cursor->offset < cursor->length; shift += 7) {
+        uint8_t byte = cursor->bytes[cursor->offset++];
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int SLLogTraceGetName(SLLogTraceCursor *cursor, char ***names, uint32_t *count)
+{
+    uint64_t id, length;
+    if (SLLogTraceGetVarint(cursor, &id) != 0 || SLLogTraceGetVarint(cursor, &length) != 0 ||
+        length > cursor->length - cursor->offset || id != *count) {
+        return -1;
+    }
+    char **grown = realloc(*names, (*count + 1) * sizeof(char *));
+    char *name = malloc((size_t)length + 1);
+    if (grown == NULL || name == NULL) {
+        free(name);
+        if (grown) {
+            *names = grown;
+        }
+        return -1;
+    }
+    memcpy(name, cursor->bytes + cursor->offset, (size_t)length);
+    name[length] = '\0';
+    cursor->offset += (size_t)length;
+    grown[(*count)++] = name;
+    *names = grown;
+    return 0;
+}
+
+static int SLLogTraceGetCall(SLLogTraceCursor *cursor, SLLogTraceData *trace, uint64_t *time)
+{
+    uint64_t delta, thread, site, tag, length;
+    if (SLLogTraceGetVarint(cursor, &delta) != 0 || SLLogTraceGetVarint(cursor, &thread) != 0 ||
+        SLLogTraceGetVarint(cursor, &site) != 0 || SLLogTraceGetVarint(cursor, &tag) != 0 ||
+        cursor->offset >= cursor->length) {
+        return -1;
+    }
+    uint8_t flags = cursor->bytes[cursor->offset++];
+    if (SLLogTraceGetVarint(cursor, &length) != 0 || site >= trace->siteCount || tag >= trace->tagCount ||
+        thread > UINT32_MAX || length > UINT32_MAX) {
+        return -1;
+    }
+
+    *time += delta;
+    SLLogTraceEvent *event = &trace->events[trace->count++];
+    event->time = *time;
+    event->thread = (uint32_t)thread;
+    event->site = (uint32_t)site;
+    event->tag = (uint32_t)tag;
+    event->length = (uint32_t)length;
+    event->flag = flags & 0x7f;
+    event->synchronous = (flags & SL_TRACE_SYNC) != 0;
+    if (event->thread >= trace->threadCount) {
+        trace->threadCount = event->thread + 1;
+    }
+    if (event->length > trace->maxLength) {
+        trace->maxLength = event->length;
+    }
+    return 0;
+}
+
+int SLLogTraceLoad(const char *path, SLLogTraceData *trace)
+{
+    memset(trace, 0, sizeof(SLLogTraceData));
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *bytes = size >= 16 ? malloc((size_t)size) : NULL;
+    int ok = bytes && fread(bytes, 1, (size_t)size, file) == (size_t)size && memcmp(bytes, SL_TRACE_MAGIC, 8) == 0;
+    fclose(file);
+    if (!ok) {
+        free(bytes);
+        return -1;
+    }
+
+    for (int i = 0; i < 8; i++) {
+        trace->wallStart |= (uint64_t)bytes[8 + i] << (8 * i);
+    }
+    // Id 0 of both
+    trace->sites = calloc(1, sizeof(char *));
+    trace->tags = calloc(1, sizeof(char *));
+    // A call record takes 7 bytes at least
+    trace->events = malloc(((size_t)size / 7 + 1) * sizeof(SLLogTraceEvent));
+    if (trace->sites == NULL || trace->tags == NULL || trace->events == NULL ||
+        (trace->sites[0] = strdup("")) == NULL || (trace->tags[0] = strdup("")) == NULL) {
+        free(bytes);
+        SLLogTraceFree(trace);
+        return -1;
+    }
+    trace->siteCount = 1;
+    trace->tagCount = 1;
+
+    // Cut short traces are read up to their last complete record
+    SLLogTraceCursor cursor = { bytes, (size_t)size, 16 };
+    uint64_t time = 0;
+    while (cursor.offset < cursor.length) {
+        uint8_t kind = bytes[cursor.offset++];
+        int result = -1;
+        if (kind == SLLogTraceKindSite) {
+            result = SLLogTraceGetName(&cursor, &trace->sites, &trace->siteCount);
+        } else if (kind == SLLogTraceKindTag) {
+            result = SLLogTraceGetName(&cursor, &trace->tags, &trace->tagCount);
+        } else if (kind == SLLogTraceKindCall) {
+            result = SLLogTraceGetCall(&cursor, trace, &time);
+        }
+        if (result != 0) {
+            break;
+        }
+    }
+    free(bytes);
+    return 0;
+}
+
+void SLLogTraceFree(SLLogTraceData *trace)
+{
+    for (uint32_t i = 0; trace->sites && i < trace->siteCount; i++) {
+        free(trace->sites[i]);
+    }
+    for (uint32_t i = 0; trace->tags && i < trace->tagCount; i++) {
+        free(trace->tags[i]);
+    }
+    free(trace->sites);
+    free(trace->tags);
+    free(trace->events);
+    memset(trace, 0, sizeof(SLLogTraceData));
+}
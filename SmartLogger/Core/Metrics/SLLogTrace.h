@@ -0,0 +1,93 @@
+//
+//  SLLogTrace.h
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/12.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#ifndef SLLogTrace_h
+#define SLLogTrace_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if __cplusplus
+extern "C" {
+#endif
+
+// Workload trace of the logging calls, for replaying real traffic in benchmarks (SLLogTraceReplay.h).
+//
+// Every call that passes throttling is recorded with its call site, tag, flag, sync or async,
+// message length, thread and time since the previous call. Message contents are never recorded.
+// Sites ("File.m:42") and tags are written once, the first time they are seen, later calls refer
+// to them by number. Sites and tags are told apart by identity.
+//
+// File format, little endian, numbers as unsigned LEB128 varints unless noted:
+//   header  "SLTRACE1", wall clock of the start in ns since 1970 (8 bytes)
+//   site    0x01 id length bytes
+//   tag     0x02 id length bytes
+//   call    0x03 delta_ns thread site tag flags length
+//           tag 0 - no tag, site 0 - unknown, flags = SLLogFlag | 0x80 if synchronous
+// Written through a 64 KB buffer, a trace cut short (crash, full disk) is read up to its last
+// complete record. Plain C, builds on Linux as well.
+
+#define SL_TRACE_SYNC       0x80
+#define SL_TRACE_MAX_NAMES  4096    // Distinct sites and tags each, later ones are recorded as 0
+
+// Starts recording to path, replacing the file. Returns 0 on success, -1 if it can't be created
+// or a trace is already recording.
+int SLLogTraceStart(const char *path);
+
+// Flushes and closes the trace. Calls in flight are either recorded or dropped whole.
+void SLLogTraceStop(void);
+
+extern int SLLogTraceActive;
+
+static inline int SLLogTraceEnabled(void)
+{
+    return __atomic_load_n(&SLLogTraceActive, __ATOMIC_RELAXED);
+}
+
+// Only asked the first time `tag` is seen, the name is copied.
+typedef const char *(*SLLogTraceTagName)(const void *tag);
+
+// Called on producer thread. `length` as in SLLogMetricsRecordSite: UTF-8 bytes of the message,
+// or bytes of the binary payload. Takes a lock, only meant for capture runs.
+void SLLogTraceRecord(const char *file, uint32_t line, const void *tag, SLLogTraceTagName tagName,
+                      uint32_t flag, int synchronous, uint32_t length);
+
+// Reader
+
+typedef struct SLLogTraceEvent_ {
+    uint64_t time;          // ns since recording started
+    uint32_t thread;        // 0 ..< threadCount, in order of first call
+    uint32_t site;          // Index into sites, 0 - unknown
+    uint32_t tag;           // Index into tags, 0 - no tag
+    uint32_t length;
+    uint8_t flag;           // SLLogFlag
+    uint8_t synchronous;
+} SLLogTraceEvent;
+
+typedef struct SLLogTraceData_ {
+    uint64_t wallStart;     // ns since 1970
+    SLLogTraceEvent *events;
+    size_t count;
+    uint32_t threadCount;
+    uint32_t maxLength;
+    // Names by id, [0] is "" for both
+    char **sites;
+    uint32_t siteCount;
+    char **tags;
+    uint32_t tagCount;
+} SLLogTraceData;
+
+// Returns 0 on success, -1 if the file can't be read or isn't a trace.
+int SLLogTraceLoad(const char *path, SLLogTraceData *trace);
+void SLLogTraceFree(SLLogTraceData *trace);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SLLogTrace_h */
@@ -9,10 +9,19 @@
 #import "SLInterfaces.h"
 #import "SLLogAppender.h"
 
+@class SLLogUploadBundle;
+
 NS_ASSUME_NONNULL_BEGIN
 
 static void * const SLGlobalLoggingQueueIdentityKey = (void *)&SLGlobalLoggingQueueIdentityKey;
 
+/**
+ * 启动: 第一次日志调用只把消息放入队列, 默认 appender (TTY / 文件) 在后台创建,
+ * 期间的异步日志保留在内存中 (最多 2048 条, 超过后调用方等待启动完成), appender 就绪后按顺序写入.
+ * 同步日志会等待启动完成, 返回时已写入.
+ * 文件相关的接口 (logsDirectory, logFiles, setFileLoggerConfig: 等) 会等待启动完成.
+ * 编译时定义 SL_LAZY_STARTUP=0 则在第一次调用时同步创建.
+ */
 @interface SLLogger : NSObject<SLInterfaces>
 /**
  * Global logging queue
@@ -54,6 +63,76 @@ static void * const SLGlobalLoggingQueueIdentityKey = (void *)&SLGlobalLoggingQu
  */
 + (void)flush;
 
+/**
+ * 崩溃时把还没有被 appender 写入的日志直接写到文件 (async-signal-safe), 格式见 `SLCrashFlush.h`.
+ *  @param path     nil 则使用 logsDirectory/crash.log
+ *  @return NO if the file can't be opened or it is already enabled
+ */
++ (BOOL)enableCrashFlushAtPath:(nullable NSString *)path;
+
+/**
+ * Restore previous signal handlers
+ */
++ (void)disableCrashFlush;
+
+/**
+ * 多进程共享日志, 见 `SLSharedLogAppender.h`. 应该在启动时尽早调用, 所有进程使用同一个 ring 文件.
+ *  @param ringPath nil 则使用 logsDirectory/shared.ring
+ *  @return NO if there is no file appender or the ring can't be opened
+ */
++ (BOOL)enableSharedLoggingAtPath:(nullable NSString *)ringPath;
+
+/**
+ * 增量上传, 见 `SLLogUploadBundle.h`. manifest 保存在 logsDirectory/upload.manifest.
+ * 用法: createBundleAtPath:forFiles:[SLLogger logFiles] ..., 上传成功后 acknowledgeBundleAtPath:.
+ *  @return nil if there is no file appender
+ */
++ (nullable SLLogUploadBundle *)uploadBundle;
+
+/**
+ * 在所有日志文件和归档中搜索, 最新的文件优先. 归档的索引见 `SLCompressLogFileManager.searchIndex`.
+ * 会读取和解压文件, 不要在主线程调用.
+ *  @param maxResults 0 for no limit
+ */
++ (NSArray<NSString *> *)searchLogs:(NSString *)string maxResults:(NSUInteger)maxResults;
+
+/**
+ * 把所有日志文件和归档导出为一个列式文件, 按时间顺序, 见 `SLLogColumnar.h`.
+ * 用于离线分析 (例如每分钟每个 tag 的错误数), 只需要读取用到的列. 不要在主线程调用.
+ */
++ (BOOL)exportLogsToColumnarFileAtPath:(NSString *)path;
+
+/**
+ * 日志系统自身指标快照: 队列深度、丢弃数、各 appender 耗时与写入字节等.
+ * 格式见 `SLLogMetrics.h`.
+ */
++ (NSDictionary<NSString *, id> *)metrics;
+
+/**
+ * Emit metrics snapshot as a log line periodically, 0 disables. Default 0
+ */
++ (void)setMetricsReportInterval:(NSTimeInterval)interval;
+
+/**
+ * 录制日志调用的负载 trace (调用点、tag、级别、消息长度、线程、时间间隔, 不含消息内容),
+ * 用 `SLLogTraceReplay.h` 或 `SLLogBenchmark.tracePath` 回放. 格式见 `SLLogTrace.h`.
+ *  @return NO if the file can't be created or a trace is already recording
+ */
++ (BOOL)startRecordingTraceAtPath:(NSString *)path;
+
++ (void)stopRecordingTrace;
+
+/**
+ * 日志管线 (排队中的消息和格式化缓冲区) 的内存预算, 超过时截断、丢弃低级别日志或写入临时文件,
+ * 见 `SLLogMemoryGovernor.h`. 0 不限制, 默认 8 MB
+ */
++ (void)setMemoryBudget:(NSUInteger)bytes;
+
+/**
+ * Bytes currently held by queued messages and formatter buffers
+ */
++ (NSUInteger)memoryUsage;
+
 @end
 
 NS_ASSUME_NONNULL_END
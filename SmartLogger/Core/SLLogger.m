@@ -14,6 +14,27 @@
 #import "SLTTYLogAppender.h"
 #import "SLLogQueueFormatter.h"
 #import "SLLogMessage.h"
+#import "SLLogFilter.h"
+#import "SLLogThrottle.h"
+#import "SLLogMemoryGovernor.h"
+#import "SLLogMetrics.h"
+#import "SLLogTrace.h"
+#import "SLLogClock.h"
+#import "SLCrashFlush.h"
+#import "SLSharedLogAppender.h"
+#import "SLLogUploadBundle.h"
+
+#import <stdatomic.h>
+
+/// 1 - the first log call only queues the message, default appenders are created off the caller's
+/// thread and messages logged meanwhile are written once they are ready, see -startDefaultAppendersAsynchronously
+#ifndef SL_LAZY_STARTUP
+#define SL_LAZY_STARTUP 1
+#endif
+/// Messages held during startup, producers wait for startup after that, see -queueLogMessage:asynchronously:
+#define SL_STARTUP_BUFFER_CAPACITY 2048
+/// Spilled messages read back per batch, see SLLogMemoryGovernor.h
+#define SL_SPILL_REPLAY_BATCH 64
 
 // Component declare
 // char *loggerComponent __attribute((used, section("__DATA,STComponent "))) = "SLLogger#SLInterfaces#OnNeed#1";
@@ -28,8 +49,20 @@
 {
     /// Caching message, because all threads will suspended while crash,
     /// So we can't only using dispatch_queue for caching.
+    /// The signal handler itself can't touch it, see SLCrashFlush.h.
     NSMutableArray<SLLogMessage *> *messagesQueue;
     NSLock *queueLock;
+    
+    /// Logging queue only, messages logged and appender changes made before default appenders
+    /// are ready (SLLogMessage or dispatch_block_t)
+    BOOL startupPending;
+    NSMutableArray *startupMessages;
+    
+    /// Logging queue only, spilled messages are being written
+    BOOL replayingSpilled;
+    
+    /// Appenders added without a formatter share it, so their lines are formatted once
+    SLLogQueueFormatter *defaultFormatter;
 }
 @dynamic logsDirectory, logFiles, compressBlock, isRelease;
 
@@ -83,9 +116,16 @@
 {
     SLLogger *logger = [self shared];
     
+    // Messages held during startup are written before it completes
+    [logger waitForStartup];
+    
     // flush queue first
+    // Messages are recycled once logged, take copies while they are still queued
     [logger->queueLock lock];
-    NSArray *logs = [logger->messagesQueue copy];
+    NSMutableArray *logs = [NSMutableArray arrayWithCapacity:logger->messagesQueue.count];
+    for (SLLogMessage *logMessage in logger->messagesQueue) {
+        [logs addObject:[logMessage copy]];
+    }
     [logger->queueLock unlock];
     
     for (SLLogMessage *logMessage in logs) {
@@ -103,6 +143,88 @@
     [logger flushAppenders];
 }
 
++ (BOOL)enableCrashFlushAtPath:(NSString *)path
+{
+    if (path == nil) {
+        NSString *directory = [self logsDirectory];
+        if (directory == nil) {
+            return NO;
+        }
+        path = [directory stringByAppendingPathComponent:@"crash.log"];
+    }
+    return SLCrashFlushInstall(path.fileSystemRepresentation, SL_CRASH_RECORD_CAPACITY) == 0;
+}
+
++ (void)disableCrashFlush
+{
+    SLCrashFlushUninstall();
+}
+
++ (BOOL)enableSharedLoggingAtPath:(NSString *)ringPath
+{
+    SLLogger *logger = [self shared];
+    for (id<SLLogAppender> appender in [logger allAppenders]) {
+        if ([appender isKindOfClass:SLSharedLogAppender.class]) {
+            return YES;
+        }
+    }
+    
+    SLLogFileAppender *fileAppender = logger.fileAppender;
+    if (fileAppender == nil) {
+        return NO;
+    }
+    if (ringPath == nil) {
+        ringPath = [fileAppender.logFileManager.logsDirectory stringByAppendingPathComponent:@"shared.ring"];
+    }
+    SLSharedLogAppender *sharedAppender = [[SLSharedLogAppender alloc] initWithRingPath:ringPath fileAppender:fileAppender];
+    if (sharedAppender == nil) {
+        return NO;
+    }
+    
+    // Only the elected writer process touches log files from now on
+    [logger removeAppender:fileAppender];
+    [logger addAppender:sharedAppender];
+    return YES;
+}
+
++ (SLLogUploadBundle *)uploadBundle
+{
+    static SLLogUploadBundle *uploadBundle;
+    static dispatch_once_t onceToken;
+    NSString *logsDirectory = [self logsDirectory];
+    if (logsDirectory == nil) {
+        return nil;
+    }
+    dispatch_once(&onceToken, ^{
+        uploadBundle = [[SLLogUploadBundle alloc] initWithManifestPath:[logsDirectory stringByAppendingPathComponent:@"upload.manifest"]];
+    });
+    return uploadBundle;
+}
+
++ (NSArray<NSString *> *)searchLogs:(NSString *)string maxResults:(NSUInteger)maxResults
+{
+    id <SLLogFileManager> fileManager = SLLogger.shared.fileAppender.logFileManager;
+    NSArray<NSString *> *paths = fileManager.sortedLogFilePaths;
+    if (paths.count == 0 || string.length == 0) {
+        return @[];
+    }
+    return [SLCompressLogFileManager searchString:string inFiles:paths maxResults:maxResults stats:NULL];
+}
+
++ (BOOL)exportLogsToColumnarFileAtPath:(NSString *)path
+{
+    id <SLLogFileManager> fileManager = SLLogger.shared.fileAppender.logFileManager;
+    NSArray<NSString *> *paths = fileManager.sortedLogFilePaths;
+    // Newest first, timestamps are delta encoded
+    return [SLCompressLogFileManager exportFiles:paths.reverseObjectEnumerator.allObjects toColumnarFileAtPath:path];
+}
+
+/// Asked once per tag while a workload trace is recording
+static const char *SLLoggerTraceTagName(const void *tag)
+{
+    return [[(__bridge id)tag description] UTF8String];
+}
+
 + (void)log:(BOOL)asynchronous
       level:(SLLogLevel)level
        flag:(SLLogFlag)flag
@@ -114,33 +236,131 @@
 {
     va_list args;
     
+    // Drop before formatting, Error is never dropped
+    NSUInteger sampleRate = 1;
+    if (![SLLogThrottle shouldLogFlag:flag file:file line:line sampleRate:&sampleRate]) {
+        return;
+    }
+    
     if (format) {
         va_start(args, format);
         
-        NSString *message = [[NSString alloc] initWithFormat:format arguments:args];
+        // Recycled message, formatted in place
+        SLLogMessage *logMessage = [SLLogMessage messageWithLevel:level
+                                                             flag:flag
+                                                             file:file
+                                                         function:function
+                                                             line:line
+                                                              tag:tag
+                                                           format:format
+                                                        arguments:args];
         
         va_end(args);
         
-        va_start(args, format);
-        
-        [[self shared] log:asynchronous
-                           message:message
-                             level:level
-                              flag:flag
-                              file:file
-                          function:function
-                              line:line
-                               tag:tag];
-        
-        va_end(args);
+        NSUInteger bytes = [logMessage->_message lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+        SLLogMetricsRecordSite(file, line, tag, bytes);
+        if (SLLogTraceEnabled()) {
+            SLLogTraceRecord(file, (uint32_t)line, (__bridge void *)tag, SLLoggerTraceTagName,
+                             flag, !asynchronous, (uint32_t)bytes);
+        }
+        logMessage->_sampleRate = sampleRate;
+        [[self shared] queueLogMessage:logMessage asynchronously:asynchronous];
+    }
+}
+
++ (void)log:(BOOL)asynchronous
+      level:(SLLogLevel)level
+       flag:(SLLogFlag)flag
+       file:(const char *)file
+   function:(const char *)function
+       line:(NSUInteger)line
+        tag:(id)tag
+binaryFormat:(const char *)format
+    payload:(const void *)payload
+     length:(NSUInteger)length
+{
+    NSUInteger sampleRate = 1;
+    if (![SLLogThrottle shouldLogFlag:flag file:file line:line sampleRate:&sampleRate]) {
+        return;
+    }
+    
+    // Decoded on logging queue, see -mf_log:
+    SLLogMessage *logMessage = [SLLogMessage messageWithLevel:level
+                                                         flag:flag
+                                                         file:file
+                                                     function:function
+                                                         line:line
+                                                          tag:tag
+                                                 binaryFormat:format
+                                                      payload:payload
+                                                       length:length];
+    SLLogMetricsRecordSite(file, line, tag, length);
+    if (SLLogTraceEnabled()) {
+        SLLogTraceRecord(file, (uint32_t)line, (__bridge void *)tag, SLLoggerTraceTagName,
+                         flag, !asynchronous, (uint32_t)length);
     }
+    logMessage->_sampleRate = sampleRate;
+    [[self shared] queueLogMessage:logMessage asynchronously:asynchronous];
 }
 
 + (void)directlog:(BOOL)async tag:(id)tag message:(NSString *)message
 {
+    if (!([SLLogFilter maskForTag:tag] & SLLogFlagInfo)) {
+        return;
+    }
     [self.shared directlog:async tag:tag message:message];
 }
 
++ (void)setLevel:(SLLogLevel)level forTag:(NSString *)tagPattern
+{
+    [SLLogFilter setLevel:level forTag:tagPattern];
+}
+
++ (void)setLevel:(SLLogLevel)level forCallSite:(NSString *)sitePattern
+{
+    [SLLogFilter setLevel:level forCallSite:sitePattern];
+}
+
++ (void)removeLevelFilter:(NSString *)pattern
+{
+    [SLLogFilter removeFilter:pattern];
+}
+
++ (void)removeAllLevelFilters
+{
+    [SLLogFilter removeAllFilters];
+}
+
++ (NSDictionary<NSString *,id> *)metrics
+{
+    return [SLLogMetrics snapshot];
+}
+
++ (void)setMetricsReportInterval:(NSTimeInterval)interval
+{
+    SLLogMetrics.reportInterval = interval;
+}
+
++ (BOOL)startRecordingTraceAtPath:(NSString *)path
+{
+    return SLLogTraceStart(path.fileSystemRepresentation) == 0;
+}
+
++ (void)stopRecordingTrace
+{
+    SLLogTraceStop();
+}
+
++ (void)setMemoryBudget:(NSUInteger)bytes
+{
+    SLLogMemoryGovernor.budget = bytes;
+}
+
++ (NSUInteger)memoryUsage
+{
+    return SLLogMemoryGovernor.usage;
+}
+
 - (void)startDefaultAppenders
 {
     // Only in case of empty appenders.
@@ -148,7 +368,7 @@
     
     // Create a tty appender
     SLTTYLogAppender *ttyLogger = [[SLTTYLogAppender alloc] init];
-    ttyLogger.logFormatter = [[SLLogQueueFormatter alloc] initWithMode:SLLogQueueFormatterModeAlone];
+    ttyLogger.logFormatter = defaultFormatter;
     [self addAppender:ttyLogger];
     
     // Default file appender
@@ -163,8 +383,15 @@
 
 static dispatch_queue_t _loggingQueue;
 static dispatch_group_t _loggingGroup;
+static dispatch_group_t _startupGroup;
 #define _MAX_QUEUE_SIZE 1000 // Should not exceed INT32_MAX
 static dispatch_semaphore_t _queueSemaphore;
+// Messages queued but not yet written by appenders
+static atomic_long _pendingCount;
+// A replay of spilled messages is queued
+static atomic_flag _spillReplayScheduled = ATOMIC_FLAG_INIT;
+// Messages held until default appenders are ready, reset once they are written
+static atomic_long _startupHeldCount;
 
 // Minor optimization for uniprocessor machines
 static NSUInteger _numProcessors;
@@ -185,6 +412,7 @@ static NSUInteger _numProcessors;
     dispatch_once(&onceToken, ^{
         _loggingQueue = dispatch_queue_create("smartlogger.logger", NULL);
         _loggingGroup = dispatch_group_create();
+        _startupGroup = dispatch_group_create();
         
         void *nonNullValue = SLGlobalLoggingQueueIdentityKey; // Whatever, just not null
         dispatch_queue_set_specific(_loggingQueue, SLGlobalLoggingQueueIdentityKey, nonNullValue, NULL);
@@ -198,7 +426,11 @@ static NSUInteger _numProcessors;
 #else
     [self setIsRelease:YES];
 #endif
+#if SL_LAZY_STARTUP
+    [[self shared] startDefaultAppendersAsynchronously];
+#else
     [[self shared] startDefaultAppenders];
+#endif
 }
 
 
@@ -206,6 +438,7 @@ static NSUInteger _numProcessors;
 {
     if (self = [super init]) {
         messagesQueue = [NSMutableArray arrayWithCapacity:50];
+        defaultFormatter = [[SLLogQueueFormatter alloc] initWithMode:SLLogQueueFormatterModeShared];
         
         self.appenders = [[NSMutableArray alloc] initWithCapacity:4];
         
@@ -234,11 +467,74 @@ static NSUInteger _numProcessors;
                                                          name:notificationName
                                                        object:nil];
         }
+        
+        // Time set by the user or the network, timestamps map through a new offset right away
+        [[NSNotificationCenter defaultCenter] addObserver:self
+                                                 selector:@selector(systemClockDidChange:)
+                                                     name:NSSystemClockDidChangeNotification
+                                                   object:nil];
     }
     
     return self;
 }
 
+/**
+ * Same as -startDefaultAppenders without blocking the first caller: the file manager scans the logs
+ * directory and the first write looks up, stats and sorts the existing files. Messages logged
+ * meanwhile are held by -mf_log: and written in order once the appenders are added.
+ */
+- (void)startDefaultAppendersAsynchronously
+{
+    // Runs in +initialize, before any message can reach the logging queue
+    static atomic_flag started = ATOMIC_FLAG_INIT;
+    if (atomic_flag_test_and_set(&started)) {
+        return;
+    }
+    startupPending = YES;
+    dispatch_group_enter(_startupGroup);
+    uint64_t start = SLLogMetricsNow();
+    
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{ @autoreleasepool {
+        SLTTYLogAppender *ttyLogger = [[SLTTYLogAppender alloc] init];
+        ttyLogger.logFormatter = self->defaultFormatter;
+        
+        SLCompressLogFileManager *fm = [[SLCompressLogFileManager alloc] initWithLogsDirectory:nil];
+        fm.compressBlock = self.archiveCompressBlock;
+        SLLogFileAppender *fileAppender = [[SLLogFileAppender alloc] initWithLogFileManager:fm];
+        fileAppender.logFormatter = self->defaultFormatter;
+        
+        // Pick or create the current file now, not in the first -logMessage:
+        dispatch_sync(fileAppender.loggingQueue, ^{ @autoreleasepool {
+            (void)fileAppender.currentLogFileInfo;
+        } });
+        
+        // Formatters are set by blocks queued before this one
+        dispatch_async(_loggingQueue, ^{ @autoreleasepool {
+            [self mf_addAppender:ttyLogger level:SLLogLevelAll];
+            [self mf_addAppender:fileAppender level:SLLogLevelAll];
+            self.fileAppender = fileAppender;
+            [self mf_finishStartup];
+            SLLogMetricsRecordLatency(SLLogLatencyStartup, SLLogMetricsNow() - start);
+            dispatch_group_leave(_startupGroup);
+        } });
+    } });
+}
+
+/// Blocks until default appenders are added, no-op on the logging queue
+- (void)waitForStartup
+{
+    if (dispatch_get_specific(SLGlobalLoggingQueueIdentityKey)) {
+        return;
+    }
+    dispatch_group_wait(_startupGroup, DISPATCH_TIME_FOREVER);
+}
+
+- (SLLogFileAppender *)fileAppender
+{
+    [self waitForStartup];
+    return _fileAppender;
+}
+
 + (dispatch_queue_t)globalLoggingQueue
 {
     return _loggingQueue;
@@ -251,6 +547,11 @@ static NSUInteger _numProcessors;
     [self flushAppenders];
 }
 
+- (void)systemClockDidChange:(NSNotification * __attribute__((unused)))notification
+{
+    SLLogClockRecalibrate();
+}
+
 #pragma mark - Logger Management
 
 + (void)setIsRelease:(BOOL)isRelease
@@ -308,10 +609,12 @@ static NSUInteger _numProcessors;
         return;
     }
     if (appender.logFormatter == nil) {
-        appender.logFormatter = [[SLLogQueueFormatter alloc] initWithMode:SLLogQueueFormatterModeAlone];
+        appender.logFormatter = defaultFormatter;
     }
     dispatch_async(_loggingQueue, ^{ @autoreleasepool {
-        [self mf_addAppender:appender level:level];
+        [self mf_afterStartup:^{
+            [self mf_addAppender:appender level:level];
+        }];
     } });
 }
 
@@ -327,7 +630,9 @@ static NSUInteger _numProcessors;
     }
     
     dispatch_async(_loggingQueue, ^{ @autoreleasepool {
-        [self mf_removeAppender:appender];
+        [self mf_afterStartup:^{
+            [self mf_removeAppender:appender];
+        }];
     } });
 }
 
@@ -339,7 +644,9 @@ static NSUInteger _numProcessors;
 - (void)removeAllAppenders
 {
     dispatch_async(_loggingQueue, ^{ @autoreleasepool {
-        [self mf_removeAllAppenders];
+        [self mf_afterStartup:^{
+            [self mf_removeAllAppenders];
+        }];
     } });
 }
 
@@ -350,6 +657,7 @@ static NSUInteger _numProcessors;
 
 - (NSArray<id<SLLogAppender>> *)allAppenders
 {
+    [self waitForStartup];
     __block NSArray *theAppenders;
     
     dispatch_sync(_loggingQueue, ^{ @autoreleasepool {
@@ -361,10 +669,56 @@ static NSUInteger _numProcessors;
 
 #pragma mark - Master Logging
 
+static size_t SLLoggerCrashRecordAppend(char *buffer, size_t length, id string)
+{
+    if (![string isKindOfClass:NSString.class] || length >= SL_CRASH_RECORD_SIZE) {
+        return length;
+    }
+    CFIndex used = 0;
+    CFStringRef cfString = (__bridge CFStringRef)string;
+    CFStringGetBytes(cfString, CFRangeMake(0, CFStringGetLength(cfString)), kCFStringEncodingUTF8, '?', false,
+                     (UInt8 *)buffer + length, (CFIndex)(SL_CRASH_RECORD_SIZE - length), &used);
+    return length + (size_t)used;
+}
+
+/// Copy of the record for crash flush, written into preallocated memory, no allocation
+static void SLLoggerCrashRecord(SLLogMessage *logMessage)
+{
+    char *buffer = SLCrashRecordBegin(&logMessage->_crashSequence);
+    if (buffer == NULL) {
+        return;
+    }
+    
+    int header = snprintf(buffer, SL_CRASH_RECORD_SIZE, "%.3f [", SLLogClockWallSeconds(logMessage->_ticks));
+    size_t length = header > 0 ? MIN((size_t)header, SL_CRASH_RECORD_SIZE) : 0;
+    length = SLLoggerCrashRecordAppend(buffer, length, logMessage->_tag);
+    length = SLLoggerCrashRecordAppend(buffer, length, @"] [");
+    length = SLLoggerCrashRecordAppend(buffer, length, logMessage->_fileName);
+    if (length < SL_CRASH_RECORD_SIZE) {
+        header = snprintf(buffer + length, SL_CRASH_RECORD_SIZE - length, ":%lu] ", (unsigned long)logMessage->_line);
+        length = header > 0 ? MIN(length + (size_t)header, SL_CRASH_RECORD_SIZE) : length;
+    }
+    if (logMessage->_binaryFormat) {
+        // Arguments are decoded on logging queue, the format still tells where it came from
+        size_t formatLength = MIN(strlen(logMessage->_binaryFormat), SL_CRASH_RECORD_SIZE - length);
+        memcpy(buffer + length, logMessage->_binaryFormat, formatLength);
+        length += formatLength;
+    } else {
+        length = SLLoggerCrashRecordAppend(buffer, length, logMessage->_message);
+    }
+    SLCrashRecordCommit(logMessage->_crashSequence, length);
+}
+
 - (void)queueLogMessage:(SLLogMessage *)logMessage asynchronously:(BOOL)asyncFlag
 {
     dispatch_block_t logBlock = ^{
-        dispatch_semaphore_wait(_queueSemaphore, DISPATCH_TIME_FOREVER);
+        if (dispatch_semaphore_wait(_queueSemaphore, DISPATCH_TIME_NOW) != 0) {
+            // Queue is full
+            SLLogMetricsIncrement(SLLogCounterSemaphoreWaits, 1);
+            uint64_t waitStart = SLLogMetricsNow();
+            dispatch_semaphore_wait(_queueSemaphore, DISPATCH_TIME_FOREVER);
+            SLLogMetricsRecordLatency(SLLogLatencySemaphoreWait, SLLogMetricsNow() - waitStart);
+        }
         @autoreleasepool {
             [self->queueLock lock];
             SLLogMessage *mf_msg = asyncFlag ? [self->messagesQueue firstObject] : logMessage;
@@ -378,40 +732,47 @@ static NSUInteger _numProcessors;
         }
     };
     
+    switch ([SLLogMemoryGovernor admitMessage:logMessage]) {
+        case SLLogMemoryAdmitted:
+            break;
+        case SLLogMemorySpilled:
+            if (!atomic_flag_test_and_set(&_spillReplayScheduled)) {
+                // Usually written back by the next -mf_write:, this one covers nothing else being logged
+                dispatch_async(_loggingQueue, ^{
+                    [self mf_replaySpilled];
+                });
+            }
+            // fallthrough
+        case SLLogMemoryDropped:
+            [logMessage recycle];
+            return;
+    }
+    
+    if (SLCrashFlushEnabled()) {
+        SLLoggerCrashRecord(logMessage);
+    }
+    
+    long depth = atomic_fetch_add_explicit(&_pendingCount, 1, memory_order_relaxed) + 1;
+    SLLogMetricsIncrement(SLLogCounterEnqueued, 1);
+    SLLogMetricsSetGauge(SLLogGaugeQueueDepth, depth);
+    SLLogMetricsRaiseGauge(SLLogGaugeQueueDepthMax, depth);
+    
     if (asyncFlag) {
+        // The startup buffer is full, wait here rather than in logBlock, the logging queue must get to the startup block
+        if (__builtin_expect(atomic_load_explicit(&_startupHeldCount, memory_order_relaxed) >= SL_STARTUP_BUFFER_CAPACITY, 0)) {
+            [self waitForStartup];
+        }
         [self->queueLock lock];
         [self->messagesQueue addObject:logMessage];
         [self->queueLock unlock];
         dispatch_async(_loggingQueue, logBlock);
     } else {
+        // Written when this returns, held messages are not
+        [self waitForStartup];
         dispatch_sync(_loggingQueue, logBlock);
     }
 }
 
-#define __FILE_NAME__(file) (ATHExtractFileNameWithoutExtension(file, NO))
-
-- (void)log:(BOOL)asynchronous
-    message:(NSString *)message
-      level:(SLLogLevel)level
-       flag:(SLLogFlag)flag
-       file:(const char *)file
-   function:(const char *)function
-       line:(NSUInteger)line
-        tag:(NSString *)tag
-{
-    NSString *funcName = [NSString stringWithFormat:@"%s", function];
-    SLLogMessage *logMessage = [[SLLogMessage alloc] initWithMessage:message
-                                                                 level:level
-                                                                  flag:flag
-                                                                  file:__FILE_NAME__(file)
-                                                              function:funcName
-                                                                  line:line
-                                                                   tag:tag
-                                                             timestamp:nil];
-    
-    [self queueLogMessage:logMessage asynchronously:asynchronous];
-}
-
 - (void)directlog:(BOOL)asynchronous
               tag:(id)tag
           message:(NSString *)message
@@ -545,6 +906,69 @@ static NSUInteger _numProcessors;
     NSAssert(dispatch_get_specific(SLGlobalLoggingQueueIdentityKey),
              @"This method should only be run on the logging thread/queue");
     
+    if (__builtin_expect(startupPending, 0)) {
+        // No appenders yet, the first log call only costs the queueing
+        if (startupMessages == nil) {
+            startupMessages = [[NSMutableArray alloc] initWithCapacity:64];
+        }
+        // Gives the queue slot back, the startup block is queued behind other blocks waiting for one
+        [startupMessages addObject:logMessage];
+        atomic_store_explicit(&_startupHeldCount, (long)startupMessages.count, memory_order_relaxed);
+        dispatch_semaphore_signal(_queueSemaphore);
+        return;
+    }
+    
+    [self mf_write:logMessage signal:YES];
+}
+
+/// Appender changes made during startup are held with the messages and run after the default
+/// appenders are added, as if those had been added synchronously.
+- (void)mf_afterStartup:(dispatch_block_t)block
+{
+    NSAssert(dispatch_get_specific(SLGlobalLoggingQueueIdentityKey),
+             @"This method should only be run on the logging thread/queue");
+    
+    if (__builtin_expect(startupPending, 0)) {
+        if (startupMessages == nil) {
+            startupMessages = [[NSMutableArray alloc] initWithCapacity:64];
+        }
+        [startupMessages addObject:[block copy]];
+        return;
+    }
+    block();
+}
+
+/// Writes held messages and runs held appender changes in order, messages hold no queue slot
+- (void)mf_finishStartup
+{
+    NSAssert(dispatch_get_specific(SLGlobalLoggingQueueIdentityKey),
+             @"This method should only be run on the logging thread/queue");
+    
+    startupPending = NO;
+    NSArray *held = startupMessages;
+    startupMessages = nil;
+    atomic_store_explicit(&_startupHeldCount, 0, memory_order_relaxed);
+    
+    for (id item in held) {
+        @autoreleasepool {
+            if ([item isKindOfClass:[SLLogMessage class]]) {
+                [self mf_write:(SLLogMessage *)item signal:NO];
+            } else {
+                ((dispatch_block_t)item)();
+            }
+        }
+    }
+}
+
+- (void)mf_write:(SLLogMessage *)logMessage signal:(BOOL)signal
+{
+    // Binary captured arguments are formatted here, off the caller's thread
+    if (logMessage->_binaryFormat) {
+        [logMessage decodeBinaryPayload];
+        [SLLogMemoryGovernor didDecodeMessage:logMessage];
+    }
+    [self mf_renderSharedLines:logMessage];
+    
     if (_numProcessors > 1) {
         for (SLLogAppenderNode *appenderNode in self.appenders) {
             if (!(logMessage->_flag & appenderNode->_level)) {
@@ -552,11 +976,13 @@ static NSUInteger _numProcessors;
             }
             
             dispatch_group_async(_loggingGroup, appenderNode->_loggingQueue, ^{ @autoreleasepool {
-                [appenderNode->_appender logMessage:logMessage];
+                [self mf_appender:appenderNode logMessage:logMessage];
             } });
         }
         
+        uint64_t waitStart = SLLogMetricsNow();
         dispatch_group_wait(_loggingGroup, DISPATCH_TIME_FOREVER);
+        SLLogMetricsRecordLatency(SLLogLatencyGroupWait, SLLogMetricsNow() - waitStart);
     } else {
         for (SLLogAppenderNode *appenderNode in self.appenders) {
             if (!(logMessage->_flag & appenderNode->_level)) {
@@ -564,12 +990,100 @@ static NSUInteger _numProcessors;
             }
             
             dispatch_sync(appenderNode->_loggingQueue, ^{ @autoreleasepool {
-                [appenderNode->_appender logMessage:logMessage];
+                [self mf_appender:appenderNode logMessage:logMessage];
             } });
         }
     }
     
-    dispatch_semaphore_signal(_queueSemaphore);
+    if (signal) {
+        dispatch_semaphore_signal(_queueSemaphore);
+    }
+    
+    long pending = atomic_fetch_sub_explicit(&_pendingCount, 1, memory_order_relaxed) - 1;
+    uint64_t now = SLLogClockNow();
+    NSTimeInterval lag = now > logMessage->_ticks ? (double)SLLogClockNanos(now - logMessage->_ticks) / NSEC_PER_SEC : 0;
+    SLLogMetricsIncrement(SLLogCounterLogged, 1);
+    SLLogMetricsSetGauge(SLLogGaugeQueueDepth, MAX(pending, 0L));
+    SLLogMetricsRecordLatency(SLLogLatencyEndToEnd, (uint64_t)MAX(lag * NSEC_PER_SEC, 0.0));
+    [SLLogThrottle reportQueueDepth:(NSUInteger)MAX(pending, 0L) capacity:_MAX_QUEUE_SIZE lag:lag];
+    
+    // All appenders are done
+    SLCrashRecordComplete(logMessage->_crashSequence);
+    [SLLogMemoryGovernor releaseMessage:logMessage];
+    [logMessage recycle];
+    
+    if (!replayingSpilled && SLLogMemoryGovernor.spilledMessages > 0) {
+        [self mf_replaySpilled];
+    }
+}
+
+/// Spilled messages are written back once usage is low again, they hold no queue slot
+- (void)mf_replaySpilled
+{
+    NSAssert(dispatch_get_specific(SLGlobalLoggingQueueIdentityKey),
+             @"This method should only be run on the logging thread/queue");
+    
+    atomic_flag_clear(&_spillReplayScheduled);
+    if (startupPending || replayingSpilled) {
+        // Picked up by the next write
+        return;
+    }
+    
+    replayingSpilled = YES;
+    NSArray<SLLogMessage *> *messages;
+    while ((messages = [SLLogMemoryGovernor drainSpilledMessages:SL_SPILL_REPLAY_BATCH]).count > 0) {
+        for (SLLogMessage *logMessage in messages) {
+            @autoreleasepool {
+                atomic_fetch_add_explicit(&_pendingCount, 1, memory_order_relaxed);
+                [self mf_write:logMessage signal:NO];
+            }
+        }
+    }
+    replayingSpilled = NO;
+}
+
+/// Formatters used by more than one appender format and encode the message once, see SLLogLine.h
+- (void)mf_renderSharedLines:(SLLogMessage *)logMessage
+{
+    __unsafe_unretained id <SLLogFormatter> formatters[SL_LOG_LINE_SLOTS * 2];
+    NSUInteger users[SL_LOG_LINE_SLOTS * 2];
+    NSUInteger count = 0;
+    
+    for (SLLogAppenderNode *appenderNode in self.appenders) {
+        if (!appenderNode->_sharesLines || !(logMessage->_flag & appenderNode->_level)) {
+            continue;
+        }
+        
+        // Set on global queue, the appender picks up a new formatter later and renders its own line meanwhile
+        id <SLLogFormatter> formatter = ((SLAbstractLogAppender *)appenderNode->_appender)->_fanOutFormatter;
+        NSUInteger index = 0;
+        while (index < count && formatters[index] != formatter) {
+            index++;
+        }
+        if (index == count) {
+            if (count == SL_LOG_LINE_SLOTS * 2) {
+                continue;
+            }
+            formatters[count] = formatter;
+            users[count++] = 0;
+        }
+        users[index]++;
+    }
+    
+    for (NSUInteger i = 0; i < count; i++) {
+        if (users[i] > 1 && ![logMessage renderLineForFormatter:formatters[i]]) {
+            break;
+        }
+    }
+}
+
+- (void)mf_appender:(SLLogAppenderNode *)appenderNode logMessage:(SLLogMessage *)logMessage
+{
+    SLLogAppenderMetrics *metrics = appenderNode->_metrics;
+    uint64_t start = SLLogMetricsNow();
+    [appenderNode->_appender logMessage:logMessage];
+    SLHistogramRecord(&metrics->latency, SLLogMetricsNow() - start);
+    __atomic_fetch_add(&metrics->messages, 1, __ATOMIC_RELAXED);
 }
 
 - (void)mf_flushAppenders
@@ -0,0 +1,624 @@
+//
+//  SLLogSearch.c
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/12.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#include "SLLogSearch.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__) || defined(__arm64__)
+#include <arm_neon.h>
+#endif
+
+#define SL_INDEX_MAGIC "SLIX"
+#define SL_INDEX_VERSION 1
+#define SL_INDEX_HEADER_SIZE 32
+#define SL_INDEX_ENTRY_SIZE 25
+#define SL_INDEX_HASHES 2
+#define SL_INDEX_MAX_BITS_LOG2 19           // Filter is built at 64 KB, then folded
+#define SL_INDEX_MIN_BITS_LOG2 9
+#define SL_INDEX_MAX_FILL 0.75
+#define SL_SEARCH_STREAM_CHUNK (64 * 1024)
+
+// Substring kernels
+//
+// Candidates are positions where both the first and the last byte of the needle match, 16 or 32
+// at a time, the middle is only compared for those. All kernels need needleLength >= 2.
+
+typedef const char *(*SLSearchKernel)(const char *haystack, size_t length, const char *needle, size_t needleLength);
+
+static const char *sl_find_scalar_from(const char *haystack, size_t length, const char *needle, size_t needleLength, size_t i) {
+    const char first = needle[0];
+    const char last = needle[needleLength - 1];
+    while (i + needleLength <= length) {
+        const char *candidate = (const char *)memchr(haystack + i, first, length - needleLength + 1 - i);
+        if (candidate == NULL) {
+            return NULL;
+        }
+        i = (size_t)(candidate - haystack);
+        if (haystack[i + needleLength - 1] == last &&
+            memcmp(haystack + i + 1, needle + 1, needleLength - 2) == 0) {
+            return haystack + i;
+        }
+        i++;
+    }
+    return NULL;
+}
+
+static const char *sl_find_scalar(const char *haystack, size_t length, const char *needle, size_t needleLength) {
+    return sl_find_scalar_from(haystack, length, needle, needleLength, 0);
+}
+
+#if defined(__x86_64__)
+
+static const char *sl_find_sse2(const char *haystack, size_t length, const char *needle, size_t needleLength) {
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needleLength - 1]);
+    size_t i = 0;
+    for (; i + needleLength + 15 <= length; i += 16) {
+        __m128i blockFirst = _mm_loadu_si128((const __m128i *)(haystack + i));
+        __m128i blockLast = _mm_loadu_si128((const __m128i *)(haystack + i + needleLength - 1));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, blockFirst),
+                                                                  _mm_cmpeq_epi8(last, blockLast)));
+        while (mask) {
+            unsigned bit = (unsigned)__builtin_ctz(mask);
+            if (memcmp(haystack + i + bit + 1, needle + 1, needleLength - 2) == 0) {
+                return haystack + i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return sl_find_scalar_from(haystack, length, needle, needleLength, i);
+}
+
+__attribute__((target("avx2")))
+static const char *sl_find_avx2(const char *haystack, size_t length, const char *needle, size_t needleLength) {
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[needleLength - 1]);
+    size_t i = 0;
+    for (; i + needleLength + 31 <= length; i += 32) {
+        __m256i blockFirst = _mm256_loadu_si256((const __m256i *)(haystack + i));
+        __m256i blockLast = _mm256_loadu_si256((const __m256i *)(haystack + i + needleLength - 1));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, blockFirst),
+                                                                        _mm256_cmpeq_epi8(last, blockLast)));
+        while (mask) {
+            unsigned bit = (unsigned)__builtin_ctz(mask);
+            if (memcmp(haystack + i + bit + 1, needle + 1, needleLength - 2) == 0) {
+                return haystack + i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return sl_find_scalar_from(haystack, length, needle, needleLength, i);
+}
+
+#elif defined(__aarch64__) || defined(__arm64__)
+
+static const char *sl_find_neon(const char *haystack, size_t length, const char *needle, size_t needleLength) {
+    const uint8x16_t first = vdupq_n_u8((uint8_t)needle[0]);
+    const uint8x16_t last = vdupq_n_u8((uint8_t)needle[needleLength - 1]);
+    size_t i = 0;
+    for (; i + needleLength + 15 <= length; i += 16) {
+        uint8x16_t blockFirst = vld1q_u8((const uint8_t *)haystack + i);
+        uint8x16_t blockLast = vld1q_u8((const uint8_t *)haystack + i + needleLength - 1);
+        uint8x16_t equal = vandq_u8(vceqq_u8(first, blockFirst), vceqq_u8(last, blockLast));
+        // No movemask on NEON: narrowing shift leaves 4 bits per byte
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(equal), 4)), 0);
+        while (mask) {
+            unsigned bit = (unsigned)__builtin_ctzll(mask) >> 2;
+            if (memcmp(haystack + i + bit + 1, needle + 1, needleLength - 2) == 0) {
+                return haystack + i + bit;
+            }
+            mask &= ~(0xFull << (bit * 4));
+        }
+    }
+    return sl_find_scalar_from(haystack, length, needle, needleLength, i);
+}
+
+#endif
+
+static SLSearchKernel s_kernel = sl_find_scalar;
+static pthread_once_t s_kernelOnce = PTHREAD_ONCE_INIT;
+
+static void sl_search_kernel_init(void) {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    s_kernel = __builtin_cpu_supports("avx2") ? sl_find_avx2 : sl_find_sse2;
+#elif defined(__aarch64__) || defined(__arm64__)
+    s_kernel = sl_find_neon;
+#endif
+}
+
+const char *SLLogSearchFind(const char *haystack, size_t length, const char *needle, size_t needleLength) {
+    if (needleLength == 0) {
+        return haystack;
+    }
+    if (needleLength > length) {
+        return NULL;
+    }
+    if (needleLength == 1) {
+        return (const char *)memchr(haystack, needle[0], length);
+    }
+    pthread_once(&s_kernelOnce, sl_search_kernel_init);
+    return s_kernel(haystack, length, needle, needleLength);
+}
+
+// Little endian helpers
+
+static void sl_store_le(uint8_t *buffer, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        buffer[i] = (uint8_t)(value >> (i * 8));
+    }
+}
+
+static uint64_t sl_load_le(const uint8_t *buffer, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= (uint64_t)buffer[i] << (i * 8);
+    }
+    return value;
+}
+
+// Bloom filter
+//
+// Probe positions are computed for the largest filter and masked, so a filter of 2N bits folds
+// into N bits by OR-ing its halves. Each block is filtered at the largest size, then folded while
+// at most SL_INDEX_MAX_FILL of the bits would be set. That is a high false positive rate per gram,
+// but a pattern has to pass for all of its grams: a 16 digit hex id still rejects ~99.9% of the
+// blocks that do not contain it, at an index of ~1/5 of the archive.
+
+static inline uint64_t sl_gram_hash(const uint8_t *p, int gram) {
+    uint64_t value = 0;
+    for (int i = 0; i < gram; i++) {
+        value = (value << 8) | p[i];
+    }
+    // splitmix64 finalizer, probes take low bits
+    value = (value + 1) * 0x9E3779B97F4A7C15ull;
+    value = (value ^ (value >> 29)) * 0xBF58476D1CE4E5B9ull;
+    return value ^ (value >> 32);
+}
+
+static inline void sl_bloom_probes(uint64_t hash, uint32_t probes[SL_INDEX_HASHES], uint32_t mask) {
+    uint32_t h1 = (uint32_t)hash;
+    uint32_t h2 = (uint32_t)(hash >> 32) | 1;
+    for (int i = 0; i < SL_INDEX_HASHES; i++) {
+        probes[i] = (h1 + (uint32_t)i * h2) & mask;
+    }
+}
+
+static int sl_bloom_build(const uint8_t *data, size_t length, uint64_t *words) {
+    const uint32_t maxMask = (1u << SL_INDEX_MAX_BITS_LOG2) - 1;
+    size_t wordCount = ((size_t)1 << SL_INDEX_MAX_BITS_LOG2) / 64;
+    memset(words, 0, wordCount * sizeof(uint64_t));
+    for (size_t i = 0; i + SL_LOG_INDEX_GRAM <= length; i++) {
+        uint32_t probes[SL_INDEX_HASHES];
+        sl_bloom_probes(sl_gram_hash(data + i, SL_LOG_INDEX_GRAM), probes, maxMask);
+        for (int k = 0; k < SL_INDEX_HASHES; k++) {
+            words[probes[k] >> 6] |= 1ull << (probes[k] & 63);
+        }
+    }
+
+    int bitsLog2 = SL_INDEX_MAX_BITS_LOG2;
+    while (bitsLog2 > SL_INDEX_MIN_BITS_LOG2) {
+        size_t half = wordCount / 2;
+        uint64_t ones = 0;
+        for (size_t i = 0; i < half; i++) {
+            ones += (uint64_t)__builtin_popcountll(words[i] | words[i + half]);
+        }
+        if (ones > (uint64_t)(half * 64 * SL_INDEX_MAX_FILL)) {
+            break;
+        }
+        for (size_t i = 0; i < half; i++) {
+            words[i] |= words[i + half];
+        }
+        wordCount = half;
+        bitsLog2--;
+    }
+    return bitsLog2;
+}
+
+static int sl_bloom_may_contain(const uint8_t *filter, int bitsLog2, int gram, const char *pattern, size_t length) {
+    uint32_t mask = (1u << bitsLog2) - 1;
+    for (size_t i = 0; i + (size_t)gram <= length; i++) {
+        uint32_t probes[SL_INDEX_HASHES];
+        sl_bloom_probes(sl_gram_hash((const uint8_t *)pattern + i, gram), probes, mask);
+        for (int k = 0; k < SL_INDEX_HASHES; k++) {
+            if (!(filter[probes[k] >> 3] & (1u << (probes[k] & 7)))) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// Compression
+
+int SLLogIndexPathForArchive(const char *archivePath, char *buffer, size_t size) {
+    const char *slash = strrchr(archivePath, '/');
+    int directoryLength = slash ? (int)(slash - archivePath + 1) : 0;
+    const char *name = slash ? slash + 1 : archivePath;
+    int written = snprintf(buffer, size, "%.*sindex-%s.slidx", directoryLength, archivePath, name);
+    return (written > 0 && (size_t)written < size) ? 0 : -1;
+}
+
+static int sl_deflate_block(z_stream *strm, FILE *output, uint8_t *out, size_t outSize,
+                            const uint8_t *data, size_t length, int flush) {
+    strm->next_in = (Bytef *)data;
+    strm->avail_in = (uInt)length;
+    do {
+        strm->next_out = out;
+        strm->avail_out = (uInt)outSize;
+        int status = deflate(strm, flush);
+        if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) {
+            return -1;
+        }
+        size_t produced = outSize - strm->avail_out;
+        if (fwrite(out, 1, produced, output) != produced) {
+            return -1;
+        }
+    } while (strm->avail_out == 0);
+    return 0;
+}
+
+int SLLogArchiveCompressFile(const char *inputPath, const char *outputPath, const char *indexPath,
+                             SLLogArchiveFormat format, const void *dictionary, size_t length, int level) {
+    FILE *input = fopen(inputPath, "rb");
+    FILE *output = input ? fopen(outputPath, "wb") : NULL;
+    FILE *index = output ? fopen(indexPath, "wb") : NULL;
+    uint8_t *in = (uint8_t *)malloc(SL_LOG_INDEX_BLOCK_SIZE);
+    uint8_t *out = (uint8_t *)malloc(SL_LOG_INDEX_BLOCK_SIZE);
+    uint64_t *filter = (uint64_t *)malloc(((size_t)1 << SL_INDEX_MAX_BITS_LOG2) / 8);
+    int useDictionary = format == SLLogArchiveFormatZlib && dictionary && length > 0;
+    int result = -1;
+
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    if (index == NULL || in == NULL || out == NULL || filter == NULL ||
+        deflateInit2(&strm, level, Z_DEFLATED, format == SLLogArchiveFormatGzip ? 15 + 16 : 15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        goto done;
+    }
+    if (useDictionary && deflateSetDictionary(&strm, (const Bytef *)dictionary, (uInt)length) != Z_OK) {
+        deflateEnd(&strm);
+        goto done;
+    }
+
+    // Header is rewritten with the final counts
+    uint8_t header[SL_INDEX_HEADER_SIZE];
+    memset(header, 0, sizeof(header));
+    if (fwrite(header, 1, sizeof(header), index) != sizeof(header)) {
+        deflateEnd(&strm);
+        goto done;
+    }
+
+    // First block starts after the container header: gzip 10 bytes, zlib 2 (+ DICTID)
+    uint64_t compressedOffset = format == SLLogArchiveFormatGzip ? 10 : (useDictionary ? 6 : 2);
+    uint64_t rawOffset = 0;
+    uint32_t blocks = 0;
+    size_t filled = 0;
+    int failed = 0;
+    for (;;) {
+        size_t read = fread(in + filled, 1, SL_LOG_INDEX_BLOCK_SIZE - filled, input);
+        if (ferror(input)) {
+            failed = 1;
+            break;
+        }
+        filled += read;
+        if (filled == 0) {
+            break;
+        }
+
+        // Cut after the last line feed, lines stay in one block
+        size_t cut = filled;
+        if (filled == SL_LOG_INDEX_BLOCK_SIZE) {
+            for (size_t i = filled; i > 0; i--) {
+                if (in[i - 1] == '\n') {
+                    cut = i;
+                    break;
+                }
+            }
+        }
+
+        int bitsLog2 = sl_bloom_build(in, cut, filter);
+        if (sl_deflate_block(&strm, output, out, SL_LOG_INDEX_BLOCK_SIZE, in, cut, Z_FULL_FLUSH) != 0) {
+            failed = 1;
+            break;
+        }
+        uint64_t compressedEnd = strm.total_out;
+        uint8_t entry[SL_INDEX_ENTRY_SIZE];
+        sl_store_le(entry, rawOffset, 8);
+        sl_store_le(entry + 8, cut, 4);
+        sl_store_le(entry + 12, compressedOffset, 8);
+        sl_store_le(entry + 20, compressedEnd - compressedOffset, 4);
+        entry[24] = (uint8_t)bitsLog2;
+        size_t filterBytes = ((size_t)1 << bitsLog2) / 8;
+        uint8_t *filterData = (uint8_t *)filter;
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+        for (size_t i = 0; i < filterBytes / 8; i++) {
+            filter[i] = __builtin_bswap64(filter[i]);
+        }
+#endif
+        if (fwrite(entry, 1, sizeof(entry), index) != sizeof(entry) ||
+            fwrite(filterData, 1, filterBytes, index) != filterBytes) {
+            failed = 1;
+            break;
+        }
+        blocks++;
+        rawOffset += cut;
+        compressedOffset = compressedEnd;
+        memmove(in, in + cut, filled - cut);
+        filled -= cut;
+    }
+    if (!failed && sl_deflate_block(&strm, output, out, SL_LOG_INDEX_BLOCK_SIZE, NULL, 0, Z_FINISH) != 0) {
+        failed = 1;
+    }
+    uint64_t archiveSize = strm.total_out;
+    deflateEnd(&strm);
+    if (failed) {
+        goto done;
+    }
+
+    memcpy(header, SL_INDEX_MAGIC, 4);
+    sl_store_le(header + 4, SL_INDEX_VERSION, 4);
+    header[8] = (uint8_t)format;
+    header[9] = SL_LOG_INDEX_GRAM;
+    header[10] = SL_INDEX_HASHES;
+    sl_store_le(header + 12, useDictionary ? SLLogDictionaryID(dictionary, length) : 0, 4);
+    sl_store_le(header + 16, archiveSize, 8);
+    sl_store_le(header + 24, blocks, 4);
+    if (fseek(index, 0, SEEK_SET) == 0 && fwrite(header, 1, sizeof(header), index) == sizeof(header)) {
+        result = 0;
+    }
+
+done:
+    if (index && fclose(index) != 0) {
+        result = -1;
+    }
+    if (output && fclose(output) != 0) {
+        result = -1;
+    }
+    if (input) {
+        fclose(input);
+    }
+    free(in);
+    free(out);
+    free(filter);
+    return result;
+}
+
+// Search
+
+typedef struct SLSearchContext_ {
+    const char *pattern;
+    size_t patternLength;
+    SLLogSearchMatch match;
+    void *matchContext;
+    SLLogSearchStats *stats;
+    int stopped;
+} SLSearchContext;
+
+static void sl_search_lines(SLSearchContext *search, const char *buffer, size_t length) {
+    const char *end = buffer + length;
+    const char *position = buffer;
+    search->stats->bytesScanned += length;
+    while (!search->stopped && position < end) {
+        const char *hit = SLLogSearchFind(position, (size_t)(end - position), search->pattern, search->patternLength);
+        if (hit == NULL) {
+            break;
+        }
+        const char *lineStart = hit;
+        while (lineStart > buffer && lineStart[-1] != '\n') {
+            lineStart--;
+        }
+        const char *lineEnd = (const char *)memchr(hit, '\n', (size_t)(end - hit));
+        if (lineEnd == NULL) {
+            lineEnd = end;
+        }
+        search->stats->matches++;
+        if (search->match && search->match(lineStart, (size_t)(lineEnd - lineStart), search->matchContext)) {
+            search->stopped = 1;
+        }
+        position = lineEnd + 1;
+    }
+}
+
+typedef struct SLSearchIndex_ {
+    uint8_t *data;
+    size_t length;
+    int format;
+    int gram;
+    uint32_t dictionaryID;
+    uint64_t archiveSize;
+    uint32_t blocks;
+} SLSearchIndex;
+
+static int sl_index_load(const char *indexPath, uint64_t archiveSize, SLSearchIndex *index) {
+    FILE *file = indexPath ? fopen(indexPath, "rb") : NULL;
+    if (file == NULL) {
+        return -1;
+    }
+    struct stat st;
+    memset(index, 0, sizeof(SLSearchIndex));
+    if (fstat(fileno(file), &st) == 0 && st.st_size >= SL_INDEX_HEADER_SIZE &&
+        (index->data = (uint8_t *)malloc((size_t)st.st_size)) != NULL &&
+        fread(index->data, 1, (size_t)st.st_size, file) == (size_t)st.st_size) {
+        index->length = (size_t)st.st_size;
+    }
+    fclose(file);
+
+    const uint8_t *header = index->data;
+    if (index->length == 0 || memcmp(header, SL_INDEX_MAGIC, 4) != 0 ||
+        sl_load_le(header + 4, 4) != SL_INDEX_VERSION || header[10] != SL_INDEX_HASHES ||
+        header[9] == 0 || header[9] > 8 || sl_load_le(header + 16, 8) != archiveSize) {
+        // Not ours or stale: the archive was replaced
+        free(index->data);
+        index->data = NULL;
+        return -1;
+    }
+    index->format = header[8];
+    index->gram = header[9];
+    index->dictionaryID = (uint32_t)sl_load_le(header + 12, 4);
+    index->archiveSize = archiveSize;
+    index->blocks = (uint32_t)sl_load_le(header + 24, 4);
+    return 0;
+}
+
+static int sl_search_indexed(int fd, const SLSearchIndex *index, SLSearchContext *search,
+                             SLLogDictionaryLookup lookup, void *lookupContext) {
+    uint8_t *compressed = (uint8_t *)malloc(compressBound(SL_LOG_INDEX_BLOCK_SIZE) + 64);
+    char *raw = (char *)malloc(SL_LOG_INDEX_BLOCK_SIZE);
+    int canSkip = search->patternLength >= (size_t)index->gram;
+    size_t offset = SL_INDEX_HEADER_SIZE;
+    int result = compressed && raw ? 0 : -1;
+
+    for (uint32_t block = 0; result == 0 && !search->stopped && block < index->blocks; block++) {
+        if (offset + SL_INDEX_ENTRY_SIZE > index->length) {
+            result = -1;
+            break;
+        }
+        const uint8_t *entry = index->data + offset;
+        uint32_t rawLength = (uint32_t)sl_load_le(entry + 8, 4);
+        uint64_t compressedOffset = sl_load_le(entry + 12, 8);
+        uint32_t compressedLength = (uint32_t)sl_load_le(entry + 20, 4);
+        int bitsLog2 = entry[24];
+        size_t filterBytes = bitsLog2 >= 3 && bitsLog2 <= SL_INDEX_MAX_BITS_LOG2 ? ((size_t)1 << bitsLog2) / 8 : 0;
+        offset += SL_INDEX_ENTRY_SIZE + filterBytes;
+        if (filterBytes == 0 || offset > index->length || rawLength > SL_LOG_INDEX_BLOCK_SIZE ||
+            compressedLength > compressBound(SL_LOG_INDEX_BLOCK_SIZE) + 64 ||
+            compressedOffset + compressedLength > index->archiveSize) {
+            result = -1;
+            break;
+        }
+
+        if (canSkip && !sl_bloom_may_contain(entry + SL_INDEX_ENTRY_SIZE, bitsLog2, index->gram,
+                                             search->pattern, search->patternLength)) {
+            search->stats->blocksSkipped++;
+            search->stats->bytesSkipped += rawLength;
+            continue;
+        }
+
+        if (pread(fd, compressed, compressedLength, (off_t)compressedOffset) != (ssize_t)compressedLength) {
+            result = -1;
+            break;
+        }
+        z_stream strm;
+        memset(&strm, 0, sizeof(strm));
+        if (inflateInit2(&strm, -15) != Z_OK) {
+            result = -1;
+            break;
+        }
+        if (block == 0 && index->dictionaryID != 0) {
+            // Only the first block can reach back into the dictionary
+            size_t length = 0;
+            const void *dictionary = lookup ? lookup(index->dictionaryID, &length, lookupContext) : NULL;
+            if (dictionary == NULL) {
+                inflateEnd(&strm);
+                result = -2;
+                break;
+            }
+            inflateSetDictionary(&strm, (const Bytef *)dictionary, (uInt)length);
+        }
+        strm.next_in = compressed;
+        strm.avail_in = compressedLength;
+        strm.next_out = (Bytef *)raw;
+        strm.avail_out = rawLength;
+        int status = inflate(&strm, Z_SYNC_FLUSH);
+        size_t produced = rawLength - strm.avail_out;
+        inflateEnd(&strm);
+        if ((status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) || produced != rawLength) {
+            result = -1;
+            break;
+        }
+        search->stats->blocksScanned++;
+        sl_search_lines(search, raw, rawLength);
+    }
+    free(compressed);
+    free(raw);
+    return result;
+}
+
+static int sl_search_stream(const char *path, SLSearchContext *search,
+                            SLLogDictionaryLookup lookup, void *lookupContext) {
+    SLLogArchiveReader *reader = SLLogArchiveReaderOpen(path, lookup, lookupContext);
+    // Buffer holds the unfinished line of the previous chunk plus a new chunk
+    size_t capacity = SL_SEARCH_STREAM_CHUNK * 2;
+    char *buffer = (char *)malloc(capacity);
+    size_t carry = 0;
+    int result = reader && buffer ? 0 : -1;
+    int finished = 0;
+
+    while (result == 0 && !finished && !search->stopped) {
+        long length = SLLogArchiveReaderRead(reader, buffer + carry, capacity - carry);
+        if (length < 0) {
+            result = (int)length;
+            break;
+        }
+        finished = length == 0;
+
+        size_t filled = carry + (size_t)length;
+        size_t cut = filled;
+        if (!finished) {
+            while (cut > 0 && buffer[cut - 1] != '\n') {
+                cut--;
+            }
+            if (cut == 0 && filled == capacity) {
+                // Longer than the buffer, split
+                cut = filled;
+            }
+        }
+        sl_search_lines(search, buffer, cut);
+        memmove(buffer, buffer + cut, filled - cut);
+        carry = filled - cut;
+    }
+
+    SLLogArchiveReaderClose(reader);
+    free(buffer);
+    return result;
+}
+
+int SLLogSearchFile(const char *path, const char *indexPath,
+                    const char *pattern, size_t patternLength,
+                    SLLogDictionaryLookup lookup, void *lookupContext,
+                    SLLogSearchMatch match, void *matchContext,
+                    SLLogSearchStats *stats) {
+    SLLogSearchStats localStats;
+    memset(&localStats, 0, sizeof(localStats));
+    SLSearchContext search = { pattern, patternLength, match, matchContext, stats ? stats : &localStats, 0 };
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    uint8_t magic[2] = { 0, 0 };
+    if (fstat(fd, &st) != 0 || (st.st_size >= 2 && pread(fd, magic, 2, 0) != 2)) {
+        close(fd);
+        return -1;
+    }
+
+    int result;
+    SLSearchIndex index;
+    int gzip = magic[0] == 0x1f && magic[1] == 0x8b;
+    int zlib = (magic[0] & 0x0f) == Z_DEFLATED && ((magic[0] << 8) | magic[1]) % 31 == 0;
+    if ((gzip || zlib) && sl_index_load(indexPath, (uint64_t)st.st_size, &index) == 0) {
+        result = sl_search_indexed(fd, &index, &search, lookup, lookupContext);
+        free(index.data);
+        close(fd);
+    } else {
+        close(fd);
+        result = sl_search_stream(path, &search, lookup, lookupContext);
+    }
+    return result;
+}
@@ -0,0 +1,84 @@
+//
+//  SLLogSearch.h
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/12.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#ifndef SLLogSearch_h
+#define SLLogSearch_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "SLLogDictionary.h"
+
+#if __cplusplus
+extern "C" {
+#endif
+
+// Full-text search over log files and archives.
+//
+// Indexed archives are compressed in blocks of about SL_LOG_INDEX_BLOCK_SIZE raw bytes, cut at
+// line ends, with a deflate full flush between blocks, so every block can be inflated on its
+// own. They are still ordinary .gz / .zd files, but the flush also drops the preset dictionary
+// of .zd archives after the first block, which costs them most of its gain. A sidecar index (see SLLogIndexPathForArchive)
+// keeps, per block, the raw and compressed ranges and a Bloom filter of the block's n-grams.
+// A block is only inflated if the filter may contain every n-gram of the pattern.
+//
+// Candidate data is scanned with a first/last byte SIMD kernel: NEON on arm64, AVX2 or SSE2 on
+// x86_64 (chosen at runtime), scalar elsewhere. Archives without index and plain log files are
+// scanned as a stream.
+//
+// Matches are reported per line. Lines longer than a block are split.
+//
+// Plain C, zlib only.
+#define SL_LOG_INDEX_BLOCK_SIZE (64 * 1024)
+#define SL_LOG_INDEX_GRAM 4
+
+typedef enum {
+    SLLogArchiveFormatGzip = 0,
+    SLLogArchiveFormatZlib,         // Dictionary archives (.zd), see SLLogDictionary.h
+} SLLogArchiveFormat;
+
+// Compresses `inputPath` into a block-restartable archive and writes its index to `indexPath`.
+// `dictionary` is only used for SLLogArchiveFormatZlib and may be NULL.
+// Returns 0 on success, -1 otherwise (outputs may be partially written).
+int SLLogArchiveCompressFile(const char *inputPath, const char *outputPath, const char *indexPath,
+                             SLLogArchiveFormat format, const void *dictionary, size_t length, int level);
+
+// "<directory>/index-<archive name>.slidx", not matched as a log file by the file managers.
+// Returns 0 on success, -1 if `size` is too small.
+int SLLogIndexPathForArchive(const char *archivePath, char *buffer, size_t size);
+
+typedef struct SLLogSearchStats_ {
+    uint64_t bytesScanned;      // Raw bytes searched
+    uint64_t bytesSkipped;      // Raw bytes of blocks rejected by their filter, never inflated
+    uint64_t blocksScanned;
+    uint64_t blocksSkipped;
+    uint64_t matches;           // Lines
+} SLLogSearchStats;
+
+// Called with one matching line, without the line feed. Return non-zero to stop searching.
+typedef int (*SLLogSearchMatch)(const char *line, size_t length, void *context);
+
+// Searches a plain log file, a .gz or a .zd archive (detected from content) for `pattern`.
+// `indexPath` may be NULL; an index that does not belong to the archive is ignored.
+// `lookup` resolves dictionaries of .zd archives, may be NULL. `stats` accumulates, may be NULL.
+// Returns 0 on success (also when stopped by `match`), -1 on I/O or data error, -2 if the
+// dictionary was not found.
+int SLLogSearchFile(const char *path, const char *indexPath,
+                    const char *pattern, size_t patternLength,
+                    SLLogDictionaryLookup lookup, void *lookupContext,
+                    SLLogSearchMatch match, void *matchContext,
+                    SLLogSearchStats *stats);
+
+// First occurrence of `needle` in `haystack`, NULL if none. Same kernel as SLLogSearchFile.
+const char *SLLogSearchFind(const char *haystack, size_t length, const char *needle, size_t needleLength);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SLLogSearch_h */
@@ -0,0 +1,746 @@
+//
+//  SLLogBundle.c
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/11.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#include "SLLogBundle.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#define SL_BUNDLE_MAGIC "SLDB"
+#define SL_BUNDLE_VERSION 1
+#define SL_MANIFEST_MAGIC "SLDM"
+#define SL_MANIFEST_VERSION 1
+
+#define SL_BUNDLE_INFLIGHT 64               // Chunks between reader and writer
+#define SL_BUNDLE_READ_SIZE (256 * 1024)
+#define SL_BUNDLE_MAX_THREADS 16
+
+// Little endian helpers
+
+static int sl_put(FILE *file, const void *data, size_t length) {
+    return fwrite(data, 1, length, file) == length ? 0 : -1;
+}
+
+static int sl_put_u8(FILE *file, uint8_t value) {
+    return sl_put(file, &value, 1);
+}
+
+static int sl_put_le(FILE *file, uint64_t value, int bytes) {
+    uint8_t buffer[8];
+    for (int i = 0; i < bytes; i++) {
+        buffer[i] = (uint8_t)(value >> (i * 8));
+    }
+    return sl_put(file, buffer, (size_t)bytes);
+}
+
+static int sl_get(FILE *file, void *data, size_t length) {
+    return fread(data, 1, length, file) == length ? 0 : -1;
+}
+
+static int sl_get_le(FILE *file, uint64_t *value, int bytes) {
+    uint8_t buffer[8];
+    if (sl_get(file, buffer, (size_t)bytes) != 0) {
+        return -1;
+    }
+    *value = 0;
+    for (int i = 0; i < bytes; i++) {
+        *value |= (uint64_t)buffer[i] << (i * 8);
+    }
+    return 0;
+}
+
+static void sl_hex(const uint8_t hash[SL_CHUNK_HASH_SIZE], char hex[SL_CHUNK_HASH_SIZE * 2 + 1]) {
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < SL_CHUNK_HASH_SIZE; i++) {
+        hex[i * 2] = digits[hash[i] >> 4];
+        hex[i * 2 + 1] = digits[hash[i] & 15];
+    }
+    hex[SL_CHUNK_HASH_SIZE * 2] = '\0';
+}
+
+// Manifest
+
+struct SLLogManifest_ {
+    char *path;
+    uint8_t *hashes;    // Sorted
+    size_t count;
+};
+
+static int sl_hash_compare(const void *a, const void *b) {
+    return memcmp(a, b, SL_CHUNK_HASH_SIZE);
+}
+
+SLLogManifest *SLLogManifestOpen(const char *path) {
+    SLLogManifest *manifest = (SLLogManifest *)calloc(1, sizeof(SLLogManifest));
+    if (manifest == NULL || (manifest->path = strdup(path)) == NULL) {
+        free(manifest);
+        return NULL;
+    }
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return manifest;
+    }
+    char magic[4];
+    uint64_t version = 0, count = 0;
+    if (sl_get(file, magic, 4) == 0 && memcmp(magic, SL_MANIFEST_MAGIC, 4) == 0 &&
+        sl_get_le(file, &version, 4) == 0 && version == SL_MANIFEST_VERSION &&
+        sl_get_le(file, &count, 8) == 0 && count < SIZE_MAX / SL_CHUNK_HASH_SIZE) {
+        manifest->hashes = (uint8_t *)malloc((size_t)count * SL_CHUNK_HASH_SIZE + 1);
+        if (manifest->hashes && sl_get(file, manifest->hashes, (size_t)count * SL_CHUNK_HASH_SIZE) == 0) {
+            manifest->count = (size_t)count;
+        }
+    }
+    // A damaged manifest only costs a full upload
+    fclose(file);
+    return manifest;
+}
+
+void SLLogManifestClose(SLLogManifest *manifest) {
+    if (manifest) {
+        free(manifest->path);
+        free(manifest->hashes);
+        free(manifest);
+    }
+}
+
+int SLLogManifestContains(const SLLogManifest *manifest, const uint8_t hash[SL_CHUNK_HASH_SIZE]) {
+    if (manifest == NULL || manifest->count == 0) {
+        return 0;
+    }
+    return bsearch(hash, manifest->hashes, manifest->count, SL_CHUNK_HASH_SIZE, sl_hash_compare) != NULL;
+}
+
+size_t SLLogManifestCount(const SLLogManifest *manifest) {
+    return manifest ? manifest->count : 0;
+}
+
+int SLLogManifestAcknowledge(SLLogManifest *manifest, const uint8_t *hashes, size_t count) {
+    size_t total = manifest->count + count;
+    uint8_t *merged = (uint8_t *)malloc(total * SL_CHUNK_HASH_SIZE + 1);
+    if (merged == NULL) {
+        return -1;
+    }
+    if (manifest->count > 0) {
+        memcpy(merged, manifest->hashes, manifest->count * SL_CHUNK_HASH_SIZE);
+    }
+    memcpy(merged + manifest->count * SL_CHUNK_HASH_SIZE, hashes, count * SL_CHUNK_HASH_SIZE);
+    qsort(merged, total, SL_CHUNK_HASH_SIZE, sl_hash_compare);
+    size_t unique = 0;
+    for (size_t i = 0; i < total; i++) {
+        if (unique == 0 || memcmp(merged + (unique - 1) * SL_CHUNK_HASH_SIZE, merged + i * SL_CHUNK_HASH_SIZE, SL_CHUNK_HASH_SIZE) != 0) {
+            memmove(merged + unique * SL_CHUNK_HASH_SIZE, merged + i * SL_CHUNK_HASH_SIZE, SL_CHUNK_HASH_SIZE);
+            unique++;
+        }
+    }
+
+    char temp[4096];
+    snprintf(temp, sizeof(temp), "%s.tmp", manifest->path);
+    FILE *file = fopen(temp, "wb");
+    int result = -1;
+    if (file) {
+        result = sl_put(file, SL_MANIFEST_MAGIC, 4) | sl_put_le(file, SL_MANIFEST_VERSION, 4) |
+                 sl_put_le(file, unique, 8) | sl_put(file, merged, unique * SL_CHUNK_HASH_SIZE);
+        result |= fclose(file) == 0 ? 0 : -1;
+        result = (result == 0 && rename(temp, manifest->path) == 0) ? 0 : -1;
+    }
+    if (result != 0) {
+        remove(temp);
+        free(merged);
+        return -1;
+    }
+    free(manifest->hashes);
+    manifest->hashes = merged;
+    manifest->count = unique;
+    return 0;
+}
+
+// Pipeline
+
+typedef enum {
+    SLBundleJobChunk = 0,
+    SLBundleJobFileBegin,
+    SLBundleJobFileEnd,
+} SLBundleJobKind;
+
+typedef enum {
+    SLBundleJobEmpty = 0,
+    SLBundleJobReady,       // Waiting for a worker
+    SLBundleJobWorking,
+    SLBundleJobDone,        // Waiting for the writer
+} SLBundleJobState;
+
+typedef struct SLBundleJob_ {
+    SLBundleJobKind kind;
+    SLBundleJobState state;
+    size_t file;
+    uint64_t size;          // File end: bytes read
+    uint8_t *data;
+    size_t length;
+    uint8_t hash[SL_CHUNK_HASH_SIZE];
+    int known;              // In manifest
+    uint8_t *deflated;
+    size_t deflatedLength;
+} SLBundleJob;
+
+typedef struct SLBundlePipeline_ {
+    pthread_mutex_t mutex;
+    pthread_cond_t workAvailable;
+    pthread_cond_t jobDone;
+    pthread_cond_t slotFree;
+    SLBundleJob jobs[SL_BUNDLE_INFLIGHT];
+    uint64_t produced;      // Next sequence to fill
+    uint64_t nextWork;      // Next sequence for a worker
+    uint64_t written;       // Next sequence for the writer
+    int finished;           // No more jobs
+    int failed;
+
+    const SLLogManifest *manifest;
+    const char *const *names;
+    FILE *output;
+    SLLogBundleStats stats;
+
+    // Writer only: hashes already sent as data in this bundle
+    uint8_t *sent;
+    size_t sentCapacity;
+    size_t sentCount;
+} SLBundlePipeline;
+
+static SLBundleJob *sl_pipeline_job(SLBundlePipeline *pipeline, uint64_t sequence) {
+    return &pipeline->jobs[sequence % SL_BUNDLE_INFLIGHT];
+}
+
+// Reader side, blocks while SL_BUNDLE_INFLIGHT jobs are not written yet
+static void sl_pipeline_push(SLBundlePipeline *pipeline, SLBundleJob *job) {
+    pthread_mutex_lock(&pipeline->mutex);
+    while (pipeline->produced - pipeline->written >= SL_BUNDLE_INFLIGHT) {
+        pthread_cond_wait(&pipeline->slotFree, &pipeline->mutex);
+    }
+    job->state = job->kind == SLBundleJobChunk ? SLBundleJobReady : SLBundleJobDone;
+    *sl_pipeline_job(pipeline, pipeline->produced) = *job;
+    pipeline->produced++;
+    if (job->kind == SLBundleJobChunk) {
+        pthread_cond_signal(&pipeline->workAvailable);
+    } else {
+        pthread_cond_broadcast(&pipeline->jobDone);
+    }
+    pthread_mutex_unlock(&pipeline->mutex);
+}
+
+static void *sl_pipeline_worker(void *arg) {
+    SLBundlePipeline *pipeline = (SLBundlePipeline *)arg;
+    pthread_mutex_lock(&pipeline->mutex);
+    for (;;) {
+        if (pipeline->nextWork < pipeline->written) {
+            // The writer already passed trailing file markers
+            pipeline->nextWork = pipeline->written;
+        }
+        while (pipeline->nextWork < pipeline->produced &&
+               sl_pipeline_job(pipeline, pipeline->nextWork)->state != SLBundleJobReady) {
+            // File markers need no work
+            pipeline->nextWork++;
+        }
+        if (pipeline->nextWork == pipeline->produced) {
+            if (pipeline->finished) {
+                break;
+            }
+            pthread_cond_wait(&pipeline->workAvailable, &pipeline->mutex);
+            continue;
+        }
+        SLBundleJob *job = sl_pipeline_job(pipeline, pipeline->nextWork++);
+        job->state = SLBundleJobWorking;
+        pthread_mutex_unlock(&pipeline->mutex);
+
+        SLLogChunkHash(job->data, job->length, job->hash);
+        job->known = SLLogManifestContains(pipeline->manifest, job->hash);
+        if (!job->known) {
+            // Compressed speculatively, the writer drops it if the chunk repeats in this bundle
+            uLongf bound = compressBound((uLong)job->length);
+            job->deflated = (uint8_t *)malloc(bound);
+            if (job->deflated && compress2(job->deflated, &bound, job->data, (uLong)job->length, Z_DEFAULT_COMPRESSION) == Z_OK) {
+                job->deflatedLength = bound;
+            } else {
+                free(job->deflated);
+                job->deflated = NULL;
+            }
+        }
+
+        pthread_mutex_lock(&pipeline->mutex);
+        job->state = SLBundleJobDone;
+        pthread_cond_broadcast(&pipeline->jobDone);
+    }
+    pthread_mutex_unlock(&pipeline->mutex);
+    return NULL;
+}
+
+static int sl_pipeline_sent_insert(SLBundlePipeline *pipeline, const uint8_t hash[SL_CHUNK_HASH_SIZE]) {
+    // Open addressing on the first hash bytes, grows at half load
+    if ((pipeline->sentCount + 1) * 2 > pipeline->sentCapacity) {
+        size_t capacity = pipeline->sentCapacity ? pipeline->sentCapacity * 2 : 1024;
+        uint8_t *table = (uint8_t *)calloc(capacity, SL_CHUNK_HASH_SIZE + 1);
+        if (table == NULL) {
+            return -1;
+        }
+        for (size_t i = 0; i < pipeline->sentCapacity; i++) {
+            uint8_t *slot = pipeline->sent + i * (SL_CHUNK_HASH_SIZE + 1);
+            if (slot[0]) {
+                uint64_t index;
+                memcpy(&index, slot + 1, sizeof(index));
+                for (index &= capacity - 1;; index = (index + 1) & (capacity - 1)) {
+                    uint8_t *target = table + index * (SL_CHUNK_HASH_SIZE + 1);
+                    if (!target[0]) {
+                        memcpy(target, slot, SL_CHUNK_HASH_SIZE + 1);
+                        break;
+                    }
+                }
+            }
+        }
+        free(pipeline->sent);
+        pipeline->sent = table;
+        pipeline->sentCapacity = capacity;
+    }
+
+    uint64_t index;
+    memcpy(&index, hash, sizeof(index));
+    for (index &= pipeline->sentCapacity - 1;; index = (index + 1) & (pipeline->sentCapacity - 1)) {
+        uint8_t *slot = pipeline->sent + index * (SL_CHUNK_HASH_SIZE + 1);
+        if (!slot[0]) {
+            slot[0] = 1;
+            memcpy(slot + 1, hash, SL_CHUNK_HASH_SIZE);
+            pipeline->sentCount++;
+            return 1;
+        }
+        if (memcmp(slot + 1, hash, SL_CHUNK_HASH_SIZE) == 0) {
+            return 0;
+        }
+    }
+}
+
+static int sl_pipeline_write(SLBundlePipeline *pipeline, SLBundleJob *job) {
+    FILE *output = pipeline->output;
+    switch (job->kind) {
+        case SLBundleJobFileBegin: {
+            const char *name = pipeline->names[job->file];
+            size_t length = strlen(name);
+            return sl_put_u8(output, 'F') | sl_put_le(output, length, 2) | sl_put(output, name, length);
+        }
+        case SLBundleJobFileEnd:
+            pipeline->stats.inputBytes += job->size;
+            return sl_put_u8(output, 'E') | sl_put_le(output, job->size, 8);
+        case SLBundleJobChunk:
+            break;
+    }
+
+    pipeline->stats.chunks++;
+    int isNew = !job->known;
+    if (isNew) {
+        isNew = sl_pipeline_sent_insert(pipeline, job->hash);
+        if (isNew < 0 || (isNew && job->deflated == NULL)) {
+            return -1;
+        }
+    }
+    if (!isNew) {
+        return sl_put_u8(output, 'R') | sl_put(output, job->hash, SL_CHUNK_HASH_SIZE);
+    }
+    pipeline->stats.newChunks++;
+    pipeline->stats.newBytes += job->length;
+    return sl_put_u8(output, 'D') | sl_put(output, job->hash, SL_CHUNK_HASH_SIZE) |
+           sl_put_le(output, job->length, 4) | sl_put_le(output, job->deflatedLength, 4) |
+           sl_put(output, job->deflated, job->deflatedLength);
+}
+
+static void *sl_pipeline_writer(void *arg) {
+    SLBundlePipeline *pipeline = (SLBundlePipeline *)arg;
+    pthread_mutex_lock(&pipeline->mutex);
+    for (;;) {
+        if (pipeline->written == pipeline->produced && pipeline->finished) {
+            break;
+        }
+        SLBundleJob *job = sl_pipeline_job(pipeline, pipeline->written);
+        if (pipeline->written == pipeline->produced || job->state != SLBundleJobDone) {
+            pthread_cond_wait(&pipeline->jobDone, &pipeline->mutex);
+            continue;
+        }
+        SLBundleJob current = *job;
+        int failed = pipeline->failed;
+        pthread_mutex_unlock(&pipeline->mutex);
+
+        failed = failed || sl_pipeline_write(pipeline, &current) != 0;
+        free(current.data);
+        free(current.deflated);
+
+        pthread_mutex_lock(&pipeline->mutex);
+        memset(job, 0, sizeof(SLBundleJob));
+        pipeline->failed |= failed;
+        pipeline->written++;
+        pthread_cond_signal(&pipeline->slotFree);
+    }
+    pthread_mutex_unlock(&pipeline->mutex);
+    return NULL;
+}
+
+static int sl_pipeline_read_file(SLBundlePipeline *pipeline, size_t index, const char *path, uint8_t *buffer) {
+    FILE *input = fopen(path, "rb");
+    if (input == NULL) {
+        return -1;
+    }
+
+    SLBundleJob job;
+    memset(&job, 0, sizeof(job));
+    job.kind = SLBundleJobFileBegin;
+    job.file = index;
+    sl_pipeline_push(pipeline, &job);
+
+    SLLogChunker chunker;
+    SLLogChunkerInit(&chunker);
+    uint8_t *chunk = NULL;
+    size_t chunkLength = 0;
+    uint64_t size = 0;
+    int result = 0;
+
+    for (;;) {
+        size_t length = fread(buffer, 1, SL_BUNDLE_READ_SIZE, input);
+        if (length == 0) {
+            result = ferror(input) ? -1 : 0;
+            break;
+        }
+        size += length;
+        size_t offset = 0;
+        while (offset < length) {
+            int boundary = 0;
+            size_t consumed = SLLogChunkerNext(&chunker, buffer + offset, length - offset, &boundary);
+            if (chunk == NULL && (chunk = (uint8_t *)malloc(SL_CHUNK_MAX_SIZE)) == NULL) {
+                result = -1;
+                break;
+            }
+            memcpy(chunk + chunkLength, buffer + offset, consumed);
+            chunkLength += consumed;
+            offset += consumed;
+            if (boundary) {
+                memset(&job, 0, sizeof(job));
+                job.kind = SLBundleJobChunk;
+                job.file = index;
+                job.data = chunk;
+                job.length = chunkLength;
+                sl_pipeline_push(pipeline, &job);
+                chunk = NULL;
+                chunkLength = 0;
+            }
+        }
+        if (result != 0) {
+            break;
+        }
+    }
+    fclose(input);
+
+    if (chunkLength > 0) {
+        memset(&job, 0, sizeof(job));
+        job.kind = SLBundleJobChunk;
+        job.file = index;
+        job.data = chunk;
+        job.length = chunkLength;
+        sl_pipeline_push(pipeline, &job);
+    } else {
+        free(chunk);
+    }
+
+    memset(&job, 0, sizeof(job));
+    job.kind = SLBundleJobFileEnd;
+    job.file = index;
+    job.size = size;
+    sl_pipeline_push(pipeline, &job);
+    return result;
+}
+
+int SLLogBundleCreate(const char *bundlePath,
+                      const char *const *paths,
+                      const char *const *names,
+                      size_t count,
+                      const SLLogManifest *manifest,
+                      int threads,
+                      SLLogBundleStats *stats) {
+    if (threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int)cpus : 1;
+    }
+    if (threads > SL_BUNDLE_MAX_THREADS) {
+        threads = SL_BUNDLE_MAX_THREADS;
+    }
+
+    SLBundlePipeline *pipeline = (SLBundlePipeline *)calloc(1, sizeof(SLBundlePipeline));
+    uint8_t *buffer = (uint8_t *)malloc(SL_BUNDLE_READ_SIZE);
+    FILE *output = fopen(bundlePath, "wb");
+    if (pipeline == NULL || buffer == NULL || output == NULL) {
+        free(pipeline);
+        free(buffer);
+        if (output) {
+            fclose(output);
+        }
+        return -1;
+    }
+    pthread_mutex_init(&pipeline->mutex, NULL);
+    pthread_cond_init(&pipeline->workAvailable, NULL);
+    pthread_cond_init(&pipeline->jobDone, NULL);
+    pthread_cond_init(&pipeline->slotFree, NULL);
+    pipeline->manifest = manifest;
+    pipeline->names = names;
+    pipeline->output = output;
+    pipeline->failed = sl_put(output, SL_BUNDLE_MAGIC, 4) | sl_put_le(output, SL_BUNDLE_VERSION, 4);
+
+    pthread_t writer;
+    pthread_t workers[SL_BUNDLE_MAX_THREADS];
+    int started = 0;
+    int writerStarted = pthread_create(&writer, NULL, sl_pipeline_writer, pipeline) == 0;
+    for (int i = 0; writerStarted && i < threads; i++) {
+        if (pthread_create(&workers[started], NULL, sl_pipeline_worker, pipeline) == 0) {
+            started++;
+        }
+    }
+
+    int result = (writerStarted && started > 0) ? 0 : -1;
+    for (size_t i = 0; result == 0 && i < count; i++) {
+        result = sl_pipeline_read_file(pipeline, i, paths[i], buffer);
+    }
+
+    pthread_mutex_lock(&pipeline->mutex);
+    if (!writerStarted || started == 0) {
+        // Nobody would drain the jobs
+        pipeline->failed = 1;
+    }
+    pipeline->finished = 1;
+    pthread_cond_broadcast(&pipeline->workAvailable);
+    pthread_cond_broadcast(&pipeline->jobDone);
+    pthread_mutex_unlock(&pipeline->mutex);
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    if (writerStarted) {
+        pthread_join(writer, NULL);
+    }
+
+    long bundleBytes = ftell(output);
+    if (fclose(output) != 0 || pipeline->failed) {
+        result = -1;
+    }
+    pipeline->stats.bundleBytes = bundleBytes > 0 ? (uint64_t)bundleBytes : 0;
+    if (stats) {
+        *stats = pipeline->stats;
+    }
+
+    pthread_cond_destroy(&pipeline->slotFree);
+    pthread_cond_destroy(&pipeline->jobDone);
+    pthread_cond_destroy(&pipeline->workAvailable);
+    pthread_mutex_destroy(&pipeline->mutex);
+    free(pipeline->sent);
+    free(pipeline);
+    free(buffer);
+    if (result != 0) {
+        remove(bundlePath);
+    }
+    return result;
+}
+
+// Reading
+
+typedef int (*SLBundleVisitor)(void *context, int record, const char *name, uint64_t size,
+                               const uint8_t *hash, const uint8_t *deflated, uint32_t deflatedLength, uint32_t rawLength);
+
+static int sl_bundle_walk(const char *bundlePath, SLBundleVisitor visitor, void *context) {
+    FILE *input = fopen(bundlePath, "rb");
+    if (input == NULL) {
+        return -1;
+    }
+    char magic[4];
+    uint64_t version;
+    int result = -1;
+    if (sl_get(input, magic, 4) != 0 || memcmp(magic, SL_BUNDLE_MAGIC, 4) != 0 ||
+        sl_get_le(input, &version, 4) != 0 || version != SL_BUNDLE_VERSION) {
+        fclose(input);
+        return -1;
+    }
+
+    char name[65536];
+    uint8_t hash[SL_CHUNK_HASH_SIZE];
+    uint8_t *deflated = (uint8_t *)malloc(compressBound(SL_CHUNK_MAX_SIZE));
+    for (;;) {
+        int record = fgetc(input);
+        if (record == EOF) {
+            result = 0;
+            break;
+        }
+        uint64_t value = 0, rawLength = 0, deflatedLength = 0;
+        if (record == 'F') {
+            if (sl_get_le(input, &value, 2) != 0 || sl_get(input, name, (size_t)value) != 0) {
+                break;
+            }
+            name[value] = '\0';
+            result = visitor(context, record, name, 0, NULL, NULL, 0, 0);
+        } else if (record == 'E') {
+            if (sl_get_le(input, &value, 8) != 0) {
+                break;
+            }
+            result = visitor(context, record, name, value, NULL, NULL, 0, 0);
+        } else if (record == 'R') {
+            if (sl_get(input, hash, SL_CHUNK_HASH_SIZE) != 0) {
+                break;
+            }
+            result = visitor(context, record, name, 0, hash, NULL, 0, 0);
+        } else if (record == 'D') {
+            if (sl_get(input, hash, SL_CHUNK_HASH_SIZE) != 0 ||
+                sl_get_le(input, &rawLength, 4) != 0 || sl_get_le(input, &deflatedLength, 4) != 0 ||
+                rawLength > SL_CHUNK_MAX_SIZE || deflatedLength > compressBound(SL_CHUNK_MAX_SIZE) ||
+                deflated == NULL || sl_get(input, deflated, (size_t)deflatedLength) != 0) {
+                break;
+            }
+            result = visitor(context, record, name, 0, hash, deflated, (uint32_t)deflatedLength, (uint32_t)rawLength);
+        } else {
+            break;
+        }
+        if (result != 0) {
+            break;
+        }
+        result = -1;
+    }
+    free(deflated);
+    fclose(input);
+    return result;
+}
+
+typedef struct SLBundleHashes_ {
+    uint8_t *hashes;
+    size_t count;
+    size_t capacity;
+} SLBundleHashes;
+
+static int sl_bundle_collect(void *context, int record, const char *name, uint64_t size,
+                             const uint8_t *hash, const uint8_t *deflated, uint32_t deflatedLength, uint32_t rawLength) {
+    (void)name; (void)size; (void)deflated; (void)deflatedLength; (void)rawLength;
+    SLBundleHashes *collected = (SLBundleHashes *)context;
+    if (record != 'R' && record != 'D') {
+        return 0;
+    }
+    if (collected->count == collected->capacity) {
+        size_t capacity = collected->capacity ? collected->capacity * 2 : 256;
+        uint8_t *hashes = (uint8_t *)realloc(collected->hashes, capacity * SL_CHUNK_HASH_SIZE);
+        if (hashes == NULL) {
+            return -1;
+        }
+        collected->hashes = hashes;
+        collected->capacity = capacity;
+    }
+    memcpy(collected->hashes + collected->count * SL_CHUNK_HASH_SIZE, hash, SL_CHUNK_HASH_SIZE);
+    collected->count++;
+    return 0;
+}
+
+int SLLogBundleChunkHashes(const char *bundlePath, uint8_t **hashes, size_t *count) {
+    SLBundleHashes collected = { NULL, 0, 0 };
+    if (sl_bundle_walk(bundlePath, sl_bundle_collect, &collected) != 0) {
+        free(collected.hashes);
+        return -1;
+    }
+    *hashes = collected.hashes;
+    *count = collected.count;
+    return 0;
+}
+
+typedef struct SLBundleExtract_ {
+    const char *chunkStore;
+    const char *outputDirectory;
+    FILE *output;
+    uint64_t written;
+    uint8_t chunk[SL_CHUNK_MAX_SIZE];
+    int missing;
+} SLBundleExtract;
+
+static int sl_bundle_extract(void *context, int record, const char *name, uint64_t size,
+                             const uint8_t *hash, const uint8_t *deflated, uint32_t deflatedLength, uint32_t rawLength) {
+    SLBundleExtract *extract = (SLBundleExtract *)context;
+    char path[4096];
+    char hex[SL_CHUNK_HASH_SIZE * 2 + 1];
+
+    if (record == 'F') {
+        if (strchr(name, '/') || strcmp(name, "..") == 0 || name[0] == '\0') {
+            return -1;
+        }
+        snprintf(path, sizeof(path), "%s/%s", extract->outputDirectory, name);
+        extract->output = fopen(path, "wb");
+        extract->written = 0;
+        return extract->output ? 0 : -1;
+    }
+    if (extract->output == NULL) {
+        return -1;
+    }
+    if (record == 'E') {
+        int result = fclose(extract->output) == 0 && extract->written == size ? 0 : -1;
+        extract->output = NULL;
+        return result;
+    }
+
+    sl_hex(hash, hex);
+    snprintf(path, sizeof(path), "%s/%s", extract->chunkStore, hex);
+    size_t length = 0;
+    if (record == 'D') {
+        uLongf rawSize = sizeof(extract->chunk);
+        uint8_t check[SL_CHUNK_HASH_SIZE];
+        if (uncompress(extract->chunk, &rawSize, deflated, deflatedLength) != Z_OK || rawSize != rawLength) {
+            return -1;
+        }
+        SLLogChunkHash(extract->chunk, rawSize, check);
+        if (memcmp(check, hash, SL_CHUNK_HASH_SIZE) != 0) {
+            return -1;
+        }
+        length = rawSize;
+        if (access(path, F_OK) != 0) {
+            char temp[4200];
+            snprintf(temp, sizeof(temp), "%s.tmp", path);
+            FILE *file = fopen(temp, "wb");
+            int ok = file && fwrite(extract->chunk, 1, length, file) == length;
+            ok = file && fclose(file) == 0 && ok;
+            if (!ok || rename(temp, path) != 0) {
+                remove(temp);
+                return -1;
+            }
+        }
+    } else {
+        FILE *file = fopen(path, "rb");
+        if (file == NULL) {
+            extract->missing = 1;
+            return -1;
+        }
+        length = fread(extract->chunk, 1, sizeof(extract->chunk), file);
+        fclose(file);
+    }
+    extract->written += length;
+    return fwrite(extract->chunk, 1, length, extract->output) == length ? 0 : -1;
+}
+
+int SLLogBundleExtract(const char *bundlePath, const char *chunkStore, const char *outputDirectory) {
+    SLBundleExtract *extract = (SLBundleExtract *)calloc(1, sizeof(SLBundleExtract));
+    if (extract == NULL) {
+        return -1;
+    }
+    extract->chunkStore = chunkStore;
+    extract->outputDirectory = outputDirectory;
+    int result = sl_bundle_walk(bundlePath, sl_bundle_extract, extract);
+    if (extract->output) {
+        fclose(extract->output);
+        result = -1;
+    }
+    if (result != 0 && extract->missing) {
+        result = -2;
+    }
+    free(extract);
+    return result;
+}
@@ -0,0 +1,83 @@
+//
+//  SLLogBundle.h
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/11.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#ifndef SLLogBundle_h
+#define SLLogBundle_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "SLLogChunker.h"
+
+#if __cplusplus
+extern "C" {
+#endif
+
+// Incremental log upload: delta bundles against a manifest of acknowledged chunks.
+//
+// Log files are split with SLLogChunker, every chunk is identified by its SHA-256. Chunks the
+// receiver already acknowledged are sent as a reference only, new chunks are sent deflated.
+// After a successful upload the sender acknowledges the bundle's chunks in its manifest.
+//
+// Bundle format, integers little endian:
+//   "SLDB" u32 version
+//   per file:  'F' u16 nameLength name
+//              per chunk: 'R' hash[32]
+//                      or 'D' hash[32] u32 rawLength u32 deflatedLength zlib data
+//              'E' u64 size
+//
+// A chunk that repeats within one bundle is sent as data once and referenced afterwards.
+//
+// Creation is a streaming pipeline: the calling thread reads and chunks, worker threads hash,
+// look up and compress, a writer thread emits records in order. Memory is bounded by the number
+// of chunks in flight, not by file size.
+//
+// Plain C + zlib + pthreads, no Foundation dependency.
+
+typedef struct SLLogManifest_ SLLogManifest;
+
+// Loads the acknowledged chunk hashes from `path`, an empty manifest if it does not exist yet.
+SLLogManifest *SLLogManifestOpen(const char *path);
+void SLLogManifestClose(SLLogManifest *manifest);
+int SLLogManifestContains(const SLLogManifest *manifest, const uint8_t hash[SL_CHUNK_HASH_SIZE]);
+size_t SLLogManifestCount(const SLLogManifest *manifest);
+// Adds hashes and saves the manifest atomically. Returns 0 on success.
+int SLLogManifestAcknowledge(SLLogManifest *manifest, const uint8_t *hashes, size_t count);
+
+typedef struct SLLogBundleStats_ {
+    uint64_t inputBytes;
+    uint64_t chunks;
+    uint64_t newChunks;     // Sent as data
+    uint64_t newBytes;      // Raw bytes of new chunks
+    uint64_t bundleBytes;
+} SLLogBundleStats;
+
+// Writes a delta bundle of `paths` (stored under `names`) against `manifest`.
+// `threads` workers, 0 for the number of CPUs. `stats` may be NULL. Returns 0 on success.
+int SLLogBundleCreate(const char *bundlePath,
+                      const char *const *paths,
+                      const char *const *names,
+                      size_t count,
+                      const SLLogManifest *manifest,
+                      int threads,
+                      SLLogBundleStats *stats);
+
+// All chunk hashes in a bundle, to acknowledge once it was delivered. `*hashes` is malloc'd,
+// SL_CHUNK_HASH_SIZE bytes per chunk. Returns 0 on success.
+int SLLogBundleChunkHashes(const char *bundlePath, uint8_t **hashes, size_t *count);
+
+// Receiver side: stores new chunks in `chunkStore` (one file per chunk, named by hex hash) and
+// rebuilds every file of the bundle in `outputDirectory`. Data chunks are verified against their
+// hash. Returns 0 on success, -2 if a referenced chunk is not in the store, -1 otherwise.
+int SLLogBundleExtract(const char *bundlePath, const char *chunkStore, const char *outputDirectory);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SLLogBundle_h */
@@ -0,0 +1,191 @@
+//
+//  SLLogBundleTests.c
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/11.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+// Linux test, see Makefile. A local stand-in receiver: bundles are created against a manifest,
+// extracted into a chunk store and compared with the sent files, then acknowledged; a bundle of
+// the appended files must only carry the new chunks.
+
+#define _XOPEN_SOURCE 700
+
+#include "SLLogBundle.h"
+
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SL_TEST_FILES 2
+#define SL_TEST_APPENDED (16 * 1024)
+
+static int s_failures = 0;
+
+#define SL_EXPECT(condition, ...) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+        fprintf(stderr, __VA_ARGS__); \
+        fprintf(stderr, "\n"); \
+        s_failures++; \
+    } \
+} while (0)
+
+static char s_directory[] = "/tmp/sl-bundle-XXXXXX";
+
+static void sl_test_path(char *buffer, size_t size, const char *name) {
+    snprintf(buffer, size, "%s/%s", s_directory, name);
+}
+
+// Formatter-like lines, varying enough that chunks don't repeat
+static int sl_test_write_log(const char *path, const char *mode, size_t bytes, unsigned int seed) {
+    static const char *tags[] = { "Network", "Database", "UI", "Upload" };
+    FILE *file = fopen(path, mode);
+    if (file == NULL) {
+        return -1;
+    }
+    size_t written = 0;
+    while (written < bytes) {
+        int length = fprintf(file, "2019-09-11 10:%02u:%02u.%03u [%s] [SLLogBundleTests.c(line:%u)] request %u took %u ms\n",
+                             rand_r(&seed) % 60, rand_r(&seed) % 60, rand_r(&seed) % 1000, tags[rand_r(&seed) % 4],
+                             rand_r(&seed) % 500, rand_r(&seed), rand_r(&seed) % 2000);
+        written += length > 0 ? (size_t)length : 0;
+    }
+    return fclose(file);
+}
+
+static int sl_test_same_file(const char *first, const char *second) {
+    FILE *a = fopen(first, "rb"), *b = fopen(second, "rb");
+    int same = a != NULL && b != NULL;
+    while (same) {
+        int ca = fgetc(a), cb = fgetc(b);
+        same = ca == cb;
+        if (ca == EOF || cb == EOF) {
+            break;
+        }
+    }
+    if (a) fclose(a);
+    if (b) fclose(b);
+    return same;
+}
+
+static off_t sl_test_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? st.st_size : -1;
+}
+
+static int sl_test_remove(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    (void)st;
+    (void)flag;
+    (void)ftw;
+    return remove(path);
+}
+
+int main(void) {
+    if (mkdtemp(s_directory) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    char paths[SL_TEST_FILES][512], manifestPath[512], store[512], received[512], bundle[512];
+    const char *pathList[SL_TEST_FILES];
+    const char *names[SL_TEST_FILES] = { "app.log", "app-1.log" };
+    for (int i = 0; i < SL_TEST_FILES; i++) {
+        sl_test_path(paths[i], sizeof(paths[i]), names[i]);
+        pathList[i] = paths[i];
+        SL_EXPECT(sl_test_write_log(paths[i], "w", (size_t)(1 + i) << 20, (unsigned int)i + 1) == 0, "write %s", names[i]);
+    }
+    sl_test_path(manifestPath, sizeof(manifestPath), "upload.manifest");
+    sl_test_path(store, sizeof(store), "receiver-chunks");
+    sl_test_path(received, sizeof(received), "received");
+    mkdir(store, 0755);
+    mkdir(received, 0755);
+
+    // First upload, every chunk is new. The order of records does not depend on the workers.
+    SLLogManifest *manifest = SLLogManifestOpen(manifestPath);
+    SL_EXPECT(manifest != NULL && SLLogManifestCount(manifest) == 0, "empty manifest");
+    SLLogBundleStats first = { 0 };
+    char serialBundle[512];
+    sl_test_path(bundle, sizeof(bundle), "first.bundle");
+    sl_test_path(serialBundle, sizeof(serialBundle), "serial.bundle");
+    SL_EXPECT(SLLogBundleCreate(bundle, pathList, names, SL_TEST_FILES, manifest, 4, &first) == 0, "first bundle");
+    SL_EXPECT(SLLogBundleCreate(serialBundle, pathList, names, SL_TEST_FILES, manifest, 1, NULL) == 0, "serial bundle");
+    SL_EXPECT(sl_test_same_file(bundle, serialBundle), "bundles of 4 and 1 workers differ");
+    SL_EXPECT(first.chunks > 0 && first.newChunks == first.chunks && first.newBytes == first.inputBytes,
+              "first bundle sent %llu of %llu chunks", (unsigned long long)first.newChunks, (unsigned long long)first.chunks);
+
+    SL_EXPECT(SLLogBundleExtract(bundle, store, received) == 0, "extract first bundle");
+    for (int i = 0; i < SL_TEST_FILES; i++) {
+        char copy[600];
+        snprintf(copy, sizeof(copy), "%s/%s", received, names[i]);
+        SL_EXPECT(sl_test_same_file(paths[i], copy), "%s differs after the first bundle", names[i]);
+    }
+
+    // Delivered, the sender acknowledges and the manifest survives a reopen
+    uint8_t *hashes = NULL;
+    size_t hashCount = 0;
+    SL_EXPECT(SLLogBundleChunkHashes(bundle, &hashes, &hashCount) == 0 && hashCount == first.chunks, "hashes");
+    SL_EXPECT(SLLogManifestAcknowledge(manifest, hashes, hashCount) == 0, "acknowledge");
+    SL_EXPECT(hashes == NULL || SLLogManifestContains(manifest, hashes), "acknowledged hash");
+    free(hashes);
+    SLLogManifestClose(manifest);
+    manifest = SLLogManifestOpen(manifestPath);
+    SL_EXPECT(manifest != NULL && SLLogManifestCount(manifest) == first.chunks, "reopened manifest");
+
+    // Logs grow, only the changed tail and the appended bytes are sent again
+    SL_EXPECT(sl_test_write_log(paths[0], "a", SL_TEST_APPENDED, 99) == 0, "append");
+    SLLogBundleStats second = { 0 };
+    sl_test_path(bundle, sizeof(bundle), "second.bundle");
+    SL_EXPECT(SLLogBundleCreate(bundle, pathList, names, SL_TEST_FILES, manifest, 0, &second) == 0, "second bundle");
+    SL_EXPECT(second.newChunks > 0 && second.newChunks * 10 < second.chunks,
+              "second bundle sent %llu of %llu chunks", (unsigned long long)second.newChunks, (unsigned long long)second.chunks);
+    SL_EXPECT(second.newBytes <= SL_TEST_APPENDED + 2 * SL_CHUNK_MAX_SIZE, "second bundle sent %llu bytes",
+              (unsigned long long)second.newBytes);
+    SL_EXPECT(second.bundleBytes * 4 < first.bundleBytes, "second bundle is %llu bytes", (unsigned long long)second.bundleBytes);
+
+    SL_EXPECT(SLLogBundleExtract(bundle, store, received) == 0, "extract second bundle");
+    for (int i = 0; i < SL_TEST_FILES; i++) {
+        char copy[600];
+        snprintf(copy, sizeof(copy), "%s/%s", received, names[i]);
+        SL_EXPECT(sl_test_same_file(paths[i], copy), "%s differs after the second bundle", names[i]);
+    }
+
+    // A receiver without the acknowledged chunks can't rebuild the files
+    char emptyStore[512];
+    sl_test_path(emptyStore, sizeof(emptyStore), "empty-chunks");
+    mkdir(emptyStore, 0755);
+    SL_EXPECT(SLLogBundleExtract(bundle, emptyStore, received) == -2, "missing chunks not reported");
+
+    // Damaged data is rejected
+    sl_test_path(bundle, sizeof(bundle), "first.bundle");
+    FILE *file = fopen(bundle, "r+b");
+    off_t middle = sl_test_size(bundle) / 2;
+    if (file != NULL && fseeko(file, middle, SEEK_SET) == 0) {
+        int c = fgetc(file);
+        fseeko(file, middle, SEEK_SET);
+        fputc(c ^ 0x5A, file);
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
+    SL_EXPECT(SLLogBundleExtract(bundle, emptyStore, received) != 0, "damaged bundle extracted");
+
+    printf("first bundle: %llu chunks, %llu KB -> %llu KB; after appending %d KB: %llu of %llu chunks sent, %llu KB\n",
+           (unsigned long long)first.chunks, (unsigned long long)first.inputBytes / 1024,
+           (unsigned long long)first.bundleBytes / 1024, SL_TEST_APPENDED / 1024,
+           (unsigned long long)second.newChunks, (unsigned long long)second.chunks,
+           (unsigned long long)second.bundleBytes / 1024);
+
+    SLLogManifestClose(manifest);
+    nftw(s_directory, sl_test_remove, 16, FTW_DEPTH | FTW_PHYS);
+
+    if (s_failures > 0) {
+        fprintf(stderr, "SLLogBundleTests: %d failures\n", s_failures);
+        return 1;
+    }
+    printf("SLLogBundleTests: ok\n");
+    return 0;
+}
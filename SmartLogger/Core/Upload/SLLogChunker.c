@@ -0,0 +1,161 @@
+//
+//  SLLogChunker.c
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/11.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#include "SLLogChunker.h"
+
+#include <pthread.h>
+#include <string.h>
+
+// FastCDC masks for 8 KB average: harder (15 bits) before the average size, easier (11 bits) after
+#define SL_CHUNK_MASK_S 0x0000d9f003530000ull
+#define SL_CHUNK_MASK_L 0x0000d90003530000ull
+
+static uint64_t s_gear[256];
+static pthread_once_t s_gearOnce = PTHREAD_ONCE_INIT;
+
+static void sl_chunk_gear_init(void) {
+    // splitmix64, fixed seed: boundaries must be the same on every device and every release
+    uint64_t state = 0x534C4C6F67434443ull;
+    for (int i = 0; i < 256; i++) {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        s_gear[i] = z ^ (z >> 31);
+    }
+}
+
+void SLLogChunkerInit(SLLogChunker *chunker) {
+    pthread_once(&s_gearOnce, sl_chunk_gear_init);
+    chunker->fingerprint = 0;
+    chunker->length = 0;
+}
+
+size_t SLLogChunkerNext(SLLogChunker *chunker, const uint8_t *data, size_t length, int *boundary) {
+    uint64_t fingerprint = chunker->fingerprint;
+    size_t position = chunker->length;
+    size_t i = 0;
+
+    *boundary = 0;
+    // Nothing can cut before the minimum size, skip hashing it
+    if (position < SL_CHUNK_MIN_SIZE) {
+        size_t skip = SL_CHUNK_MIN_SIZE - position;
+        if (skip > length) {
+            skip = length;
+        }
+        i = skip;
+        position += skip;
+    }
+    for (; i < length; i++, position++) {
+        if (position >= SL_CHUNK_MAX_SIZE) {
+            *boundary = 1;
+            break;
+        }
+        fingerprint = (fingerprint << 1) + s_gear[data[i]];
+        uint64_t mask = position < SL_CHUNK_AVG_SIZE ? SL_CHUNK_MASK_S : SL_CHUNK_MASK_L;
+        if ((fingerprint & mask) == 0) {
+            *boundary = 1;
+            i++;
+            break;
+        }
+    }
+    if (!*boundary && position >= SL_CHUNK_MAX_SIZE) {
+        *boundary = 1;
+    }
+
+    if (*boundary) {
+        chunker->fingerprint = 0;
+        chunker->length = 0;
+    } else {
+        chunker->fingerprint = fingerprint;
+        chunker->length = position;
+    }
+    return i;
+}
+
+// SHA-256 (FIPS 180-4)
+
+static const uint32_t s_sha256K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define SL_ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sl_sha256_block(uint32_t state[8], const uint8_t block[64]) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) |
+               ((uint32_t)block[i * 4 + 2] << 8) | (uint32_t)block[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = SL_ROTR(w[i - 15], 7) ^ SL_ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = SL_ROTR(w[i - 2], 17) ^ SL_ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t s1 = SL_ROTR(e, 6) ^ SL_ROTR(e, 11) ^ SL_ROTR(e, 25);
+        uint32_t ch = (e & f) ^ (~e & g);
+        uint32_t t1 = h + s1 + ch + s_sha256K[i] + w[i];
+        uint32_t s0 = SL_ROTR(a, 2) ^ SL_ROTR(a, 13) ^ SL_ROTR(a, 22);
+        uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t t2 = s0 + maj;
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+void SLLogChunkHash(const void *data, size_t length, uint8_t hash[SL_CHUNK_HASH_SIZE]) {
+    uint32_t state[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    const uint8_t *bytes = (const uint8_t *)data;
+    size_t remaining = length;
+    while (remaining >= 64) {
+        sl_sha256_block(state, bytes);
+        bytes += 64;
+        remaining -= 64;
+    }
+
+    uint8_t tail[128];
+    memset(tail, 0, sizeof(tail));
+    memcpy(tail, bytes, remaining);
+    tail[remaining] = 0x80;
+    size_t tailLength = remaining < 56 ? 64 : 128;
+    uint64_t bits = (uint64_t)length * 8;
+    for (int i = 0; i < 8; i++) {
+        tail[tailLength - 1 - i] = (uint8_t)(bits >> (i * 8));
+    }
+    sl_sha256_block(state, tail);
+    if (tailLength == 128) {
+        sl_sha256_block(state, tail + 64);
+    }
+
+    for (int i = 0; i < 8; i++) {
+        hash[i * 4] = (uint8_t)(state[i] >> 24);
+        hash[i * 4 + 1] = (uint8_t)(state[i] >> 16);
+        hash[i * 4 + 2] = (uint8_t)(state[i] >> 8);
+        hash[i * 4 + 3] = (uint8_t)state[i];
+    }
+}
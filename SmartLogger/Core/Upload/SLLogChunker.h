@@ -0,0 +1,51 @@
+//
+//  SLLogChunker.h
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/11.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#ifndef SLLogChunker_h
+#define SLLogChunker_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if __cplusplus
+extern "C" {
+#endif
+
+// Content defined chunking (FastCDC, gear rolling hash with normalized chunking).
+//
+// Boundaries depend only on nearby content, so bytes appended to a log file or a file that is
+// rolled again produce the same chunks for the unchanged part, which makes them deduplicable
+// across uploads. Chunks are 2 KB .. 64 KB, 8 KB on average.
+//
+// Plain C, no Foundation dependency.
+#define SL_CHUNK_MIN_SIZE (2 * 1024)
+#define SL_CHUNK_AVG_SIZE (8 * 1024)
+#define SL_CHUNK_MAX_SIZE (64 * 1024)
+
+#define SL_CHUNK_HASH_SIZE 32
+
+typedef struct SLLogChunker_ {
+    uint64_t fingerprint;
+    size_t length;      // Bytes in the current chunk so far
+} SLLogChunker;
+
+void SLLogChunkerInit(SLLogChunker *chunker);
+
+// Scans `data` for the end of the current chunk. Returns the number of bytes that belong to the
+// current chunk; `*boundary` is 1 if the chunk ends there (the chunker is reset for the next
+// one), 0 if all of `data` was consumed and the chunk continues.
+size_t SLLogChunkerNext(SLLogChunker *chunker, const uint8_t *data, size_t length, int *boundary);
+
+// SHA-256, identifies chunks in manifests and bundles.
+void SLLogChunkHash(const void *data, size_t length, uint8_t hash[SL_CHUNK_HASH_SIZE]);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SLLogChunker_h */
@@ -0,0 +1,53 @@
+//
+//  SLLogUploadBundle.h
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/11.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "SLLogBundle.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * 增量上传.
+ *
+ * 每次上传 `+logFiles` 的完整 .gz 文件, 大部分内容其实上次已经传过了, 而且文件重新滚动/压缩之后
+ * 整个压缩包都会变化. 这里把原始日志按内容切块 (见 `SLLogChunker.h`), 本地 manifest 记录服务端
+ * 已经确认收到的块, 只把新块打进 delta bundle, 旧块只发 hash. 格式见 `SLLogBundle.h`.
+ *
+ * .gz / .zd 归档会先解压再切块, bundle 里的文件名去掉压缩扩展名.
+ * 服务端确认收到之后调用 `-acknowledgeBundleAtPath:`, 否则下次还会发送同样的块.
+ */
+@interface SLLogUploadBundle : NSObject
+
+- (instancetype)initWithManifestPath:(NSString *)manifestPath NS_DESIGNATED_INITIALIZER;
+- (instancetype)init NS_UNAVAILABLE;
+
+@property (nonatomic, copy, readonly) NSString *manifestPath;
+/// Hash / compress threads, 0 for the number of CPUs. Default 0
+@property (nonatomic, assign) NSUInteger threads;
+
+/**
+ *  @param bundlePath   Output file
+ *  @param paths        Log files or .gz / .zd archives
+ *  @param stats        Optional
+ *  @return NO if a file can't be read or the bundle can't be written
+ */
+- (BOOL)createBundleAtPath:(NSString *)bundlePath
+                  forFiles:(NSArray<NSString *> *)paths
+                     stats:(nullable SLLogBundleStats *)stats;
+
+/**
+ * Record all chunks of a delivered bundle in the manifest
+ */
+- (BOOL)acknowledgeBundleAtPath:(NSString *)bundlePath;
+
+/// Forget acknowledged chunks, eg. the server lost its chunk store
+- (void)reset;
+
+@end
+
+NS_ASSUME_NONNULL_END
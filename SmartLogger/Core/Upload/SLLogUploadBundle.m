@@ -0,0 +1,106 @@
+//
+//  SLLogUploadBundle.m
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/11.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#import "SLLogUploadBundle.h"
+#import "SLCompressLogFileManager.h"
+
+@implementation SLLogUploadBundle
+{
+    /// Manifest is read and written under this lock only
+    NSLock *_lock;
+}
+
+- (instancetype)initWithManifestPath:(NSString *)manifestPath
+{
+    if ((self = [super init])) {
+        _manifestPath = [manifestPath copy];
+        _lock = [[NSLock alloc] init];
+    }
+    return self;
+}
+
+#pragma mark - Bundle
+
+- (BOOL)createBundleAtPath:(NSString *)bundlePath forFiles:(NSArray<NSString *> *)paths stats:(SLLogBundleStats *)stats
+{
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    NSString *tempDirectory = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    NSMutableArray<NSString *> *inputPaths = [NSMutableArray arrayWithCapacity:paths.count];
+    NSMutableArray<NSString *> *names = [NSMutableArray arrayWithCapacity:paths.count];
+    BOOL success = YES;
+
+    // Chunk raw content, compressed archives change entirely when they are rolled again
+    for (NSString *path in paths) {
+        NSString *extension = path.pathExtension;
+        if ([extension isEqualToString:@"gz"] || [extension isEqualToString:@"zd"]) {
+            NSString *name = path.lastPathComponent.stringByDeletingPathExtension;
+            NSString *rawPath = [tempDirectory stringByAppendingPathComponent:name];
+            if (![fileManager createDirectoryAtPath:tempDirectory withIntermediateDirectories:YES attributes:nil error:nil] ||
+                ![SLCompressLogFileManager decompressArchiveAtPath:path toPath:rawPath]) {
+                NSLog(@"SLLogUploadBundle: can't decompress %@", path);
+                success = NO;
+                break;
+            }
+            [inputPaths addObject:rawPath];
+            [names addObject:name];
+        } else {
+            [inputPaths addObject:path];
+            [names addObject:path.lastPathComponent];
+        }
+    }
+
+    if (success) {
+        NSUInteger count = inputPaths.count;
+        const char **cPaths = calloc(count + 1, sizeof(char *));
+        const char **cNames = calloc(count + 1, sizeof(char *));
+        for (NSUInteger i = 0; i < count; i++) {
+            cPaths[i] = inputPaths[i].fileSystemRepresentation;
+            cNames[i] = names[i].UTF8String;
+        }
+
+        [_lock lock];
+        SLLogManifest *manifest = SLLogManifestOpen(_manifestPath.fileSystemRepresentation);
+        success = manifest != NULL &&
+                  SLLogBundleCreate(bundlePath.fileSystemRepresentation, cPaths, cNames, count, manifest, (int)_threads, stats) == 0;
+        SLLogManifestClose(manifest);
+        [_lock unlock];
+
+        free(cPaths);
+        free(cNames);
+    }
+
+    [fileManager removeItemAtPath:tempDirectory error:nil];
+    return success;
+}
+
+- (BOOL)acknowledgeBundleAtPath:(NSString *)bundlePath
+{
+    uint8_t *hashes = NULL;
+    size_t count = 0;
+    if (SLLogBundleChunkHashes(bundlePath.fileSystemRepresentation, &hashes, &count) != 0) {
+        return NO;
+    }
+
+    [_lock lock];
+    SLLogManifest *manifest = SLLogManifestOpen(_manifestPath.fileSystemRepresentation);
+    BOOL success = manifest != NULL && SLLogManifestAcknowledge(manifest, hashes, count) == 0;
+    SLLogManifestClose(manifest);
+    [_lock unlock];
+
+    free(hashes);
+    return success;
+}
+
+- (void)reset
+{
+    [_lock lock];
+    [[NSFileManager defaultManager] removeItemAtPath:_manifestPath error:nil];
+    [_lock unlock];
+}
+
+@end
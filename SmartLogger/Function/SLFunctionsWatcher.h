@@ -15,15 +15,65 @@ extern "C" {
     void WatcherSetup();
     void Watcher_enableLogging();
     void Watcher_disableLogging();
+    // Logs every call of the current thread, see sampling below.
+    void Watcher_enableCompleteLogging();
+    void Watcher_disableCompleteLogging();
+    // Mirrors the current thread's traced calls into a stack other threads can read, see
+    // shadowstack.h. Returns the same stack on later calls, NULL if out of memory.
+    struct ShadowStack_ * Watcher_publishCurrentThread();
 #if __cplusplus
 }
 #endif
 NS_ASSUME_NONNULL_BEGIN
 
+// A call is watched if its class passes every filter that is set and its selector matches.
+// Filters are compiled once per class into a cached verdict, classes no rule can match cost one
+// lookup per objc_msgSend.
+@interface SLFunctionsWatchRule : NSObject <NSCopying>
+
+@property (nonatomic, copy, nullable) NSString *classPrefix;
+@property (nonatomic, assign, nullable) Class kindOfClass;          // The class or a subclass
+@property (nonatomic, assign, nullable) Protocol *protocol;         // Adopted by the class or a superclass
+@property (nonatomic, copy, nullable) NSString *imagePattern;       // Glob on the image path, or on its last component if there is no '/'
+@property (nonatomic, copy, nullable) NSString *selectorPattern;    // Glob on the selector name, nil for all selectors
+@property (nonatomic, assign) BOOL classMethods;                    // Class methods instead of instance methods
+
+@end
+
+// Which nested calls (under a watch hit, or all calls with complete logging) are logged.
+typedef NS_ENUM(NSInteger, SLFunctionsSampling) {
+    SLFunctionsSamplingAll = 0,
+    SLFunctionsSamplingEveryNth,    // One call in N per thread
+    SLFunctionsSamplingWindows,     // On and off periods, the same on all threads
+    SLFunctionsSamplingBudget,      // Logging takes at most a fraction of each thread's time
+};
+
 @interface SLFunctionsWatcher : NSObject
 
 + (instancetype)shared;
 + (void)watchClass:(Class)cls selector:(SEL)selector;
++ (void)addRule:(SLFunctionsWatchRule *)rule;
++ (void)removeAllRules;
+// Verdicts are recomputed when rules change or an image loads. Call after changing classes at
+// runtime (class_addProtocol, objc_disposeClassPair).
++ (void)invalidateVerdicts;
+
+// Watch hits are always logged, sampling applies to nested calls.
++ (void)sampleAll;
++ (void)sampleOneIn:(NSUInteger)interval;
++ (void)sampleWindowsOn:(NSTimeInterval)on off:(NSTimeInterval)off;
+// 0.02 for at most 2%, measured per thread over the time since the previous sample. Hits are
+// charged too and may exceed it.
++ (void)sampleWithBudget:(double)fraction;
+
+// Logged calls are recorded raw (registers, stack arguments, type encoding id) into a ring of
+// `capacity` records per thread and decoded on a background queue, so objc_msgSend doesn't format
+// anything. Lines are printed as without snapshots, or with `path` written to a dump file for
+// offline decoding (argsnapshot.h). Objects print as pointers. A full ring drops calls. arm64 only,
+// returns NO elsewhere, if already enabled or if the dump can't be created.
++ (BOOL)enableArgumentSnapshots:(NSUInteger)capacity dumpPath:(nullable NSString *)path;
+// Decodes what was recorded and goes back to logging in place.
++ (void)disableArgumentSnapshots;
 
 @end
 
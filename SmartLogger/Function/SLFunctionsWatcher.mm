@@ -7,10 +7,13 @@
 //
 
 #import "SLFunctionsWatcher.h"
-#import "hashmap.h"
+#import "pointercache.h"
+#import "shadowstack.h"
+#import "argsnapshot.h"
 #import "blocks.h"
 #import "fishhook.h"
 
+#include <fnmatch.h>
 #include <stdarg.h>
 #include <stdio.h>
 
@@ -21,6 +24,8 @@
 
 #include <objc/runtime.h>
 #include <objc/message.h>
+#include <mach-o/dyld.h>
+#include <mach/mach_time.h>
 
 #import <CoreGraphics/CGAffineTransform.h>
 #import <UIKit/UIGeometry.h>
@@ -52,40 +57,6 @@ t varName = va_arg(args, t); \
 // The original objc_msgSend.
 static id (*orig_objc_msgSend)(id, SEL, ...) = NULL;
 
-// HashMap functions.
-static int pointerEquality(void *a, void *b) {
-    uintptr_t ia = reinterpret_cast<uintptr_t>(a);
-    uintptr_t ib = reinterpret_cast<uintptr_t>(b);
-    return ia == ib;
-}
-
-#ifdef __arm64__
-// 64 bit hash from https://gist.github.com/badboy/6267743.
-static inline NSUInteger pointerHash(void *v) {
-    uintptr_t key = reinterpret_cast<uintptr_t>(v);
-    key = (~key) + (key << 21); // key = (key << 21) - key - 1;
-    key = key ^ (key >> 24);
-    key = (key + (key << 3)) + (key << 8); // key * 265
-    key = key ^ (key >> 14);
-    key = (key + (key << 2)) + (key << 4); // key * 21
-    key = key ^ (key >> 28);
-    key = key + (key << 31);
-    return key;
-}
-#else
-// Robert Jenkin's 32 bit int hash.
-static inline NSUInteger pointerHash(void *v) {
-    uintptr_t a = reinterpret_cast<uintptr_t>(v);
-    a = (a + 0x7ed55d16) + (a << 12);
-    a = (a ^ 0xc761c23c) ^ (a >> 19);
-    a = (a + 0x165667b1) + (a << 5);
-    a = (a + 0xd3a2646c) ^ (a << 9);
-    a = (a + 0xfd7046c5) + (a << 3);
-    a = (a ^ 0xb55a4f09) ^ (a >> 16);
-    return (NSUInteger)a;
-}
-#endif
-
 // These classes support handling of void *s using callback functions, yet their methods
 // accept (fake) ids. =/ i.e. objectForKey: and setObject:forKey: are dangerous for us because what
 // looks like an id can be a regular old int and crash our program...
@@ -117,17 +88,6 @@ static inline void logNSStringForStruct(NSString *str) {
     printf("%s", [str UTF8String]);
 }
 
-static HashMapRef classMap;
-static HashMapRef selsSet;
-
-static inline BOOL selectorSetContainsSelector(HashMapRef selectorSet, SEL _cmd) {
-    if (selectorSet == NULL) {
-        return NO;
-    }
-    return HMGet(selectorSet, NULL) != NULL ||
-    HMGet(selectorSet, _cmd) != NULL;
-}
-
 // Shared structures.
 typedef struct CallRecord_ {
     id obj;
@@ -147,6 +107,11 @@ typedef struct ThreadCallStack_ {
     int lastHitIndex;
     char isLoggingEnabled;
     char isCompleteLoggingEnabled;
+    uint32_t sampleCounter;
+    int64_t budgetTicks; // Logging time left, SLFunctionsSamplingBudget.
+    uint64_t budgetUpdated;
+    ShadowStackRef shadow; // Readable copy for other threads, see Watcher_publishCurrentThread.
+    ASRingRef snapshots; // Created on the first call recorded, see snapshotCall.
 } ThreadCallStack;
 
 // Store ThreadCallStack
@@ -167,6 +132,11 @@ static inline ThreadCallStack * getThreadCallStack() {
         cs->numWatchHits = 0;
         cs->isLoggingEnabled = 1;
         cs->isCompleteLoggingEnabled = 0;
+        cs->sampleCounter = 0;
+        cs->budgetTicks = 0;
+        cs->budgetUpdated = 0;
+        cs->shadow = NULL;
+        cs->snapshots = NULL;
         pthread_setspecific(threadKey, cs);
     }
     return cs;
@@ -186,6 +156,9 @@ static inline void pushCallRecord(id obj, uintptr_t lr, SEL cmd, ThreadCallStack
     newRecord->cmd = cmd;
     newRecord->lr = lr;
     newRecord->isWatchHit = 0;
+    if (cs->shadow) {
+        SSPush(cs->shadow, nextIndex, (__bridge void *)object_getClass(obj), (void *)cmd, mach_absolute_time());
+    }
 }
 
 static inline CallRecord * popCallRecord(ThreadCallStack *cs) {
@@ -209,6 +182,156 @@ extern "C" int Watcher_isLoggingEnabled() {
     return (int)cs->isLoggingEnabled;
 }
 
+extern "C" struct ShadowStack_ * Watcher_publishCurrentThread() {
+    ThreadCallStack *cs = getThreadCallStack();
+    if (cs->shadow == NULL) {
+        cs->shadow = SSCreate(cs->allocatedLength);
+    }
+    return cs->shadow;
+}
+
+extern "C" void Watcher_enableCompleteLogging() {
+    ThreadCallStack *cs = getThreadCallStack();
+    cs->isCompleteLoggingEnabled = 1;
+}
+
+extern "C" void Watcher_disableCompleteLogging() {
+    ThreadCallStack *cs = getThreadCallStack();
+    cs->isCompleteLoggingEnabled = 0;
+}
+
+// Sampling of nested calls and complete logging. Only decides what is logged, every call is still
+// pushed and popped so return addresses and hit depths stay right whatever is sampled.
+static SLFunctionsSampling samplingMode = SLFunctionsSamplingAll;
+static uint32_t sampleInterval;
+static uint64_t windowOnTicks;
+static uint64_t windowPeriodTicks;
+static uint32_t budgetPerMillion; // Logging ticks allowed per million ticks of thread time.
+static uint64_t budgetBurstTicks; // Most a thread may save up.
+#define BUDGET_BURST_NS 100000000ull
+
+static uint64_t ticksFromNanoseconds(uint64_t ns) {
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0) {
+        mach_timebase_info(&timebase);
+    }
+    return ns * timebase.denom / timebase.numer;
+}
+
+static inline BOOL shouldSampleCall(ThreadCallStack *cs) {
+    switch (__atomic_load_n(&samplingMode, __ATOMIC_ACQUIRE)) {
+        case SLFunctionsSamplingEveryNth:
+            if (++cs->sampleCounter >= sampleInterval) {
+                cs->sampleCounter = 0;
+                return YES;
+            }
+            return NO;
+        case SLFunctionsSamplingWindows:
+            // Same phase on all threads
+            return (mach_absolute_time() % windowPeriodTicks) < windowOnTicks;
+        case SLFunctionsSamplingBudget: {
+            // Token bucket refilled at the budget rate, logging is charged what it really took
+            uint64_t now = mach_absolute_time();
+            uint64_t elapsed = cs->budgetUpdated ? now - cs->budgetUpdated : 0;
+            cs->budgetUpdated = now;
+            cs->budgetTicks += (int64_t)(elapsed / 1000000 * budgetPerMillion + elapsed % 1000000 * budgetPerMillion / 1000000);
+            if (cs->budgetTicks > (int64_t)budgetBurstTicks) {
+                cs->budgetTicks = (int64_t)budgetBurstTicks;
+            }
+            return cs->budgetTicks > 0;
+        }
+        default:
+            return YES;
+    }
+}
+
+static inline void chargeBudget(ThreadCallStack *cs, uint64_t start) {
+    if (start) {
+        cs->budgetTicks -= (int64_t)(mach_absolute_time() - start);
+    }
+}
+
+// Argument snapshots: logged calls are recorded raw into the thread's ring (argsnapshot.h) and
+// decoded on snapshotQueue, objc_msgSend only copies registers and stack. arm64 only.
+static char snapshotsEnabled;
+static uint32_t snapshotCapacity;
+static dispatch_source_t snapshotTimer;
+static ASDump *snapshotDump;
+#define SNAPSHOT_DRAIN_NS (100 * NSEC_PER_MSEC)
+
+// Records the call instead of logging it, flags are AS_FLAG_LOGGED or 0 for the calls leading to a
+// hit, which are recorded without arguments.
+//
+// Returns NO if snapshots are off and the call should be logged in place.
+static BOOL snapshotCall(ThreadCallStack *cs, int depth, id obj, SEL cmd, uint8_t flags, arg_list *args) {
+#ifdef __arm64__
+    if (!__atomic_load_n(&snapshotsEnabled, __ATOMIC_ACQUIRE)) {
+        return NO;
+    }
+    if (cs->snapshots == NULL && (cs->snapshots = ASRingCreate(snapshotCapacity)) == NULL) {
+        return YES;
+    }
+    ArgSnapshot *snapshot = ASRingReserve(cs->snapshots);
+    if (snapshot == NULL) { // Full, counted in the ring.
+        return YES;
+    }
+    Class kind = object_getClass(obj);
+    const char *typeEncoding = NULL;
+    if (flags & AS_FLAG_LOGGED) {
+        Method method = class_getInstanceMethod(kind, cmd);
+        if (method && !classSupportsArbitraryPointerTypes(kind)) {
+            typeEncoding = method_getTypeEncoding(method);
+        }
+    }
+    snapshot->timestamp = mach_absolute_time();
+    snapshot->obj = (uint64_t)(uintptr_t)(__bridge void *)obj;
+    snapshot->cls = (uint64_t)(uintptr_t)(__bridge void *)kind;
+    snapshot->sel = (uint64_t)(uintptr_t)(void *)cmd;
+    snapshot->encoding = ASEncodingId(typeEncoding);
+    snapshot->depth = (uint16_t)MIN(depth, UINT16_MAX);
+    snapshot->flags = flags | (class_isMetaClass(kind) ? AS_FLAG_META : 0);
+    snapshot->stackLength = 0;
+    if (args && snapshot->encoding) {
+        ASCapture(snapshot, args->regs, args->stack);
+    }
+    ASRingCommit(cs->snapshots);
+    return YES;
+#else
+    return NO;
+#endif
+}
+
+static const char * snapshotClassName(uint64_t pointer) {
+    return class_getName((__bridge Class)(void *)(uintptr_t)pointer);
+}
+
+static const char * snapshotSelectorName(uint64_t pointer) {
+    return sel_getName((SEL)(void *)(uintptr_t)pointer);
+}
+
+// Empties all rings, on snapshotQueue. Records of one thread stay in order.
+static void drainSnapshots() {
+    ThreadCallStack *cs = getThreadCallStack();
+    char isLoggingEnabled = cs->isLoggingEnabled;
+    cs->isLoggingEnabled = 0;
+    ArgSnapshot snapshot;
+    char line[1024];
+    for (ASRingRef ring = ASRingFirst(); ring; ring = ring->next) {
+        while (ASRingPop(ring, &snapshot)) {
+            const char *className = snapshot.cls ? snapshotClassName(snapshot.cls) : NULL;
+            const char *selectorName = snapshot.sel ? snapshotSelectorName(snapshot.sel) : NULL;
+            if (snapshotDump) {
+                ASDumpWrite(snapshotDump, &snapshot, className, selectorName);
+            } else {
+                ASFormatRecord(&snapshot, ASEncodingString(snapshot.encoding), className, selectorName,
+                               line, sizeof(line), snapshotClassName, snapshotSelectorName);
+                printf("%s\n", line);
+            }
+        }
+    }
+    cs->isLoggingEnabled = isLoggingEnabled;
+}
+
 @interface SLFunctionsWatcher()
 
 - (void)onWatchHit:(ThreadCallStack *)cs args:(arg_list)args;
@@ -216,26 +339,276 @@ extern "C" int Watcher_isLoggingEnabled() {
 
 @end
 
-static pthread_rwlock_t lock = PTHREAD_RWLOCK_INITIALIZER;
-#define RLOCK pthread_rwlock_rdlock(&lock)
-#define WLOCK pthread_rwlock_wrlock(&lock)
-#define UNLOCK pthread_rwlock_unlock(&lock)
-#define WATCH_ALL_SELECTORS_SELECTOR NULL
+// Watch rules, from +watchClass:selector: (exact class and selector) and SLFunctionsWatchRule.
+typedef struct WatchRule_ {
+    Class exactClass; // Compared with object_getClass only, other filters are unused.
+    SEL exactSelector;
+    const char *classPrefix;
+    Class kindOfClass;
+    Protocol *protocol;
+    const char *imagePattern;
+    const char *selectorPattern;
+    char classMethods;
+} WatchRule;
+
+// What the rules matching a class watch. Computed once per class and generation.
+typedef struct ClassVerdict_ {
+    char allSelectors;
+    PointerCacheRef selectors; // SEL -> SEL_MATCH.
+    const char **patterns;
+    int patternCount;
+    PointerCacheRef patternResults; // SEL -> SEL_MATCH or SEL_MISS, filled as selectors are seen.
+} ClassVerdict;
+
+#define SEL_MATCH ((void *)1)
+#define SEL_MISS ((void *)2)
+#define VERDICT_CACHE_CAPACITY 1024
+
+// Verdict of classes no rule matches.
+static ClassVerdict noVerdict;
+// Cached for root metaclasses. The root class object and every metaclass object share that isa
+// but not the verdict, theirs are cached under verdictKey().
+static ClassVerdict rootMetaVerdict;
+
+// Guards rules and all writes to the caches, lookups take no lock. Strings of removed rules and
+// stale caches and verdicts are never freed, a call in flight may still read them.
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK pthread_mutex_lock(&lock)
+#define UNLOCK pthread_mutex_unlock(&lock)
+static WatchRule *rules;
+static int ruleCount;
+static int ruleCapacity;
+static int protocolRuleCount;
+// Bumped when verdicts may have changed, the verdict cache of an older generation is dropped.
+static uintptr_t rulesGeneration = 1;
+static PointerCacheRef verdictCache; // Class -> ClassVerdict.
+
+static inline void invalidateVerdicts() {
+    __atomic_fetch_add(&rulesGeneration, 1, __ATOMIC_RELEASE);
+}
+
+// Inserts into *cacheRef, replacing it with a larger table when full. Called with lock held.
+static void cachePut(PointerCacheRef *cacheRef, void *key, void *value, uintptr_t generation) {
+    PointerCacheRef cache = *cacheRef;
+    if (cache && PCPut(cache, key, value)) {
+        return;
+    }
+    PointerCacheRef grown = cache ? PCGrow(cache) : PCCreate(16, generation);
+    if (grown && PCPut(grown, key, value)) {
+        __atomic_store_n(cacheRef, grown, __ATOMIC_RELEASE);
+    }
+}
+
+static inline BOOL conformsToProtocol(Class clazz, Protocol *protocol) {
+    for (Class candidate = clazz; candidate; candidate = class_getSuperclass(candidate)) {
+        if (class_conformsToProtocol(candidate, protocol)) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+static inline BOOL imageMatches(Class clazz, const char *pattern) {
+    const char *image = class_getImageName(clazz);
+    if (image == NULL) {
+        return NO;
+    }
+    if (strchr(pattern, '/') == NULL) {
+        const char *name = strrchr(image, '/');
+        image = name ? name + 1 : image;
+    }
+    return fnmatch(pattern, image, 0) == 0;
+}
+
+// `base` is the class itself, or for a metaclass the class it describes.
+static BOOL ruleMatchesClass(const WatchRule *rule, Class clazz, Class base) {
+    if (rule->exactClass) {
+        return rule->exactClass == clazz;
+    }
+    if (class_isMetaClass(clazz) != (BOOL)rule->classMethods || base == nil) {
+        return NO;
+    }
+    if (rule->classPrefix && strncmp(class_getName(base), rule->classPrefix, strlen(rule->classPrefix)) != 0) {
+        return NO;
+    }
+    if (rule->kindOfClass && !isKindOfClass(base, rule->kindOfClass)) {
+        return NO;
+    }
+    if (rule->protocol && !conformsToProtocol(base, rule->protocol)) {
+        return NO;
+    }
+    if (rule->imagePattern && !imageMatches(base, rule->imagePattern)) {
+        return NO;
+    }
+    return YES;
+}
+
+// Called with lock held.
+static ClassVerdict * compileVerdict(Class clazz, Class base, uintptr_t generation) {
+    ClassVerdict *verdict = NULL;
+    for (int i = 0; i < ruleCount; ++i) {
+        const WatchRule *rule = &rules[i];
+        if (!ruleMatchesClass(rule, clazz, base)) {
+            continue;
+        }
+        if (verdict == NULL) {
+            verdict = (ClassVerdict *)calloc(1, sizeof(ClassVerdict));
+            if (verdict == NULL) {
+                return &noVerdict;
+            }
+            verdict->patterns = (const char **)calloc(ruleCount, sizeof(const char *));
+            if (verdict->patterns == NULL) {
+                free(verdict);
+                return &noVerdict;
+            }
+        }
+        if (rule->exactSelector) {
+            cachePut(&verdict->selectors, (void *)rule->exactSelector, SEL_MATCH, generation);
+        } else if (rule->selectorPattern) {
+            verdict->patterns[verdict->patternCount++] = rule->selectorPattern;
+        } else {
+            verdict->allSelectors = 1;
+        }
+    }
+    return verdict ?: &noVerdict;
+}
+
+// Key of a root metaclass' verdict by receiver, classes are aligned so the low bits are free.
+static inline void * verdictKey(Class clazz, id mSelf) {
+    return (void *)((uintptr_t)(__bridge void *)clazz | (class_isMetaClass((Class)mSelf) ? 1 : 2));
+}
+
+static ClassVerdict * verdictForClass(Class clazz, id mSelf, ThreadCallStack *cs) {
+    uintptr_t generation = __atomic_load_n(&rulesGeneration, __ATOMIC_ACQUIRE);
+    PointerCacheRef cache = __atomic_load_n(&verdictCache, __ATOMIC_ACQUIRE);
+    if (cache && cache->generation == generation) {
+        ClassVerdict *verdict = (ClassVerdict *)PCGet(cache, (__bridge void *)clazz);
+        if (verdict == &rootMetaVerdict) {
+            verdict = (ClassVerdict *)PCGet(cache, verdictKey(clazz, mSelf));
+        }
+        if (verdict) {
+            return verdict;
+        }
+    }
+
+    // Once per class and generation. Don't trace what the runtime calls from here.
+    char isLoggingEnabled = cs->isLoggingEnabled;
+    cs->isLoggingEnabled = 0;
+    LOCK;
+    generation = __atomic_load_n(&rulesGeneration, __ATOMIC_ACQUIRE);
+    if (verdictCache == NULL || verdictCache->generation != generation) {
+        PointerCacheRef fresh = PCCreate(VERDICT_CACHE_CAPACITY, generation);
+        if (fresh) {
+            __atomic_store_n(&verdictCache, fresh, __ATOMIC_RELEASE);
+        }
+    }
+    // Only a root metaclass' superclass is not a metaclass.
+    void *key = (__bridge void *)clazz;
+    if (class_isMetaClass(clazz) && !class_isMetaClass(class_getSuperclass(clazz))) {
+        if (verdictCache && verdictCache->generation == generation) {
+            cachePut(&verdictCache, key, &rootMetaVerdict, generation);
+        }
+        key = verdictKey(clazz, mSelf);
+    }
+    ClassVerdict *verdict = NULL;
+    if (verdictCache && verdictCache->generation == generation) {
+        verdict = (ClassVerdict *)PCGet(verdictCache, key);
+    }
+    if (verdict == NULL) {
+        Class base = class_isMetaClass(clazz) ? (Class)mSelf : clazz;
+        if (class_isMetaClass(base)) { // A message to a metaclass object.
+            base = nil;
+        }
+        verdict = compileVerdict(clazz, base, generation);
+        if (verdictCache && verdictCache->generation == generation) {
+            cachePut(&verdictCache, key, verdict, generation);
+        }
+    }
+    UNLOCK;
+    cs->isLoggingEnabled = isLoggingEnabled;
+    return verdict;
+}
+
+static inline BOOL verdictMatchesSelector(ClassVerdict *verdict, SEL cmd, ThreadCallStack *cs) {
+    if (verdict->allSelectors) {
+        return YES;
+    }
+    PointerCacheRef selectors = __atomic_load_n(&verdict->selectors, __ATOMIC_ACQUIRE);
+    if (selectors && PCGet(selectors, (void *)cmd)) {
+        return YES;
+    }
+    if (verdict->patternCount == 0) {
+        return NO;
+    }
+    PointerCacheRef results = __atomic_load_n(&verdict->patternResults, __ATOMIC_ACQUIRE);
+    void *result = results ? PCGet(results, (void *)cmd) : NULL;
+    if (result == NULL) {
+        result = SEL_MISS;
+        const char *name = sel_getName(cmd);
+        for (int i = 0; i < verdict->patternCount; ++i) {
+            if (fnmatch(verdict->patterns[i], name, 0) == 0) {
+                result = SEL_MATCH;
+                break;
+            }
+        }
+        char isLoggingEnabled = cs->isLoggingEnabled;
+        cs->isLoggingEnabled = 0;
+        LOCK;
+        cachePut(&verdict->patternResults, (void *)cmd, result, 0);
+        UNLOCK;
+        cs->isLoggingEnabled = isLoggingEnabled;
+    }
+    return result == SEL_MATCH;
+}
+
+static void addWatchRule(const WatchRule *rule) {
+    // Rules are appended with logging disabled, a lookup on this thread would wait for the lock.
+    ThreadCallStack *cs = getThreadCallStack();
+    char isLoggingEnabled = cs->isLoggingEnabled;
+    cs->isLoggingEnabled = 0;
+    LOCK;
+    if (ruleCount == ruleCapacity) {
+        int capacity = ruleCapacity ? ruleCapacity * 2 : 16;
+        WatchRule *grown = (WatchRule *)realloc(rules, capacity * sizeof(WatchRule));
+        if (grown) {
+            rules = grown;
+            ruleCapacity = capacity;
+        }
+    }
+    if (ruleCount < ruleCapacity) {
+        rules[ruleCount++] = *rule;
+        if (rule->protocol) {
+            ++protocolRuleCount;
+        }
+        invalidateVerdicts();
+    }
+    UNLOCK;
+    cs->isLoggingEnabled = isLoggingEnabled;
+}
+
+// Categories of a new image may add protocols to loaded classes, new classes need no invalidation.
+static void onImageAdded(const struct mach_header *header, intptr_t slide) {
+    if (__atomic_load_n(&protocolRuleCount, __ATOMIC_RELAXED) > 0) {
+        invalidateVerdicts();
+    }
+}
 
 static inline void preObjc_msgSend_common(id mSelf, uintptr_t lr, SEL cmd, ThreadCallStack *cs, arg_list args) {
     if (mSelf == nil) {
         return;
     }
+    // Classes no rule matches stop after one lookup.
     Class clazz = object_getClass(mSelf);
-    RLOCK;
-    // Critical section - check for hits.
-    BOOL isWatchedClass = selectorSetContainsSelector((HashMapRef)HMGet(classMap, (__bridge void *)clazz), cmd);
-    BOOL isWatchedSel = (HMGet(selsSet, (void *)cmd) != NULL);
-    UNLOCK;
-    if (isWatchedClass || isWatchedSel) {
+    ClassVerdict *verdict = verdictForClass(clazz, mSelf, cs);
+    if (verdict != &noVerdict && verdictMatchesSelector(verdict, cmd, cs)) {
+        // Hits are always logged, within a budget their cost delays the next samples.
+        uint64_t start = samplingMode == SLFunctionsSamplingBudget ? mach_absolute_time() : 0;
         [SLFunctionsWatcher.shared onWatchHit:cs args:args];
-    } else if (cs->numWatchHits > 0 || cs->isCompleteLoggingEnabled) {
+        chargeBudget(cs, start);
+    } else if ((cs->numWatchHits > 0 || cs->isCompleteLoggingEnabled) && shouldSampleCall(cs)) {
+        uint64_t start = samplingMode == SLFunctionsSamplingBudget ? mach_absolute_time() : 0;
         [SLFunctionsWatcher.shared onNestCall:cs args:args];
+        chargeBudget(cs, start);
     }
 }
 
@@ -251,6 +624,9 @@ uintptr_t postObjc_msgSend() {
     if (cs->lastPrintedIndex > cs->index) {
         cs->lastPrintedIndex = cs->index;
     }
+    if (cs->shadow) {
+        SSSetDepth(cs->shadow, cs->index + 1);
+    }
     return record->lr;
 }
 
@@ -417,8 +793,7 @@ extern "C" void WatcherSetup() {
     
     NSMapTable_Class = [objc_getClass("NSMapTable") class];
     NSHashTable_Class = [objc_getClass("NSHashTable") class];
-    classMap = HMCreate(&pointerEquality, &pointerHash);
-    selsSet = HMCreate(&pointerEquality, &pointerHash);
+    _dyld_register_func_for_add_image(onImageAdded);
     
 #if TARGET_IPHONE_SIMULATOR
 #else
@@ -426,6 +801,32 @@ extern "C" void WatcherSetup() {
 #endif
 }
 
+@implementation SLFunctionsWatchRule
+
+- (id)copyWithZone:(NSZone *)zone
+{
+    SLFunctionsWatchRule *rule = [[[self class] allocWithZone:zone] init];
+    rule.classPrefix = self.classPrefix;
+    rule.kindOfClass = self.kindOfClass;
+    rule.protocol = self.protocol;
+    rule.imagePattern = self.imagePattern;
+    rule.selectorPattern = self.selectorPattern;
+    rule.classMethods = self.classMethods;
+    return rule;
+}
+
+#if !__has_feature(objc_arc)
+- (void)dealloc
+{
+    [_classPrefix release];
+    [_imagePattern release];
+    [_selectorPattern release];
+    [super dealloc];
+}
+#endif
+
+@end
+
 @implementation SLFunctionsWatcher
 
 + (instancetype)shared
@@ -444,15 +845,142 @@ extern "C" void WatcherSetup() {
         return;
     }
     
-    WLOCK;
-    HashMapRef selectorSet = (HashMapRef)HMGet(classMap, (__bridge void *)cls);
-    if (selectorSet == NULL) {
-        selectorSet = HMCreate(&pointerEquality, &pointerHash);
-        HMPut(classMap, (__bridge void *)cls, selectorSet);
+    WatchRule rule = {0};
+    rule.exactClass = cls;
+    rule.exactSelector = selector;
+    addWatchRule(&rule);
+}
+
+static const char * copyPattern(NSString *string) {
+    return string.length > 0 ? strdup(string.UTF8String) : NULL;
+}
+
++ (void)addRule:(SLFunctionsWatchRule *)watchRule
+{
+    if (watchRule == nil) {
+        return;
     }
     
-    HMPut(selectorSet, selector, (void *)YES);
+    WatchRule rule = {0};
+    rule.classPrefix = copyPattern(watchRule.classPrefix);
+    rule.kindOfClass = watchRule.kindOfClass;
+    rule.protocol = watchRule.protocol;
+    rule.imagePattern = copyPattern(watchRule.imagePattern);
+    rule.selectorPattern = copyPattern(watchRule.selectorPattern);
+    rule.classMethods = watchRule.classMethods;
+    addWatchRule(&rule);
+}
+
++ (void)removeAllRules
+{
+    ThreadCallStack *cs = getThreadCallStack();
+    char isLoggingEnabled = cs->isLoggingEnabled;
+    cs->isLoggingEnabled = 0;
+    LOCK;
+    ruleCount = 0;
+    protocolRuleCount = 0;
+    invalidateVerdicts();
     UNLOCK;
+    cs->isLoggingEnabled = isLoggingEnabled;
+}
+
++ (void)invalidateVerdicts
+{
+    invalidateVerdicts();
+}
+
++ (void)sampleAll
+{
+    __atomic_store_n(&samplingMode, SLFunctionsSamplingAll, __ATOMIC_RELAXED);
+}
+
++ (void)sampleOneIn:(NSUInteger)interval
+{
+    if (interval <= 1) {
+        [self sampleAll];
+        return;
+    }
+    sampleInterval = (uint32_t)MIN(interval, UINT32_MAX);
+    __atomic_store_n(&samplingMode, SLFunctionsSamplingEveryNth, __ATOMIC_RELEASE);
+}
+
++ (void)sampleWindowsOn:(NSTimeInterval)on off:(NSTimeInterval)off
+{
+    if (on <= 0) {
+        return;
+    }
+    // Parameters are written before the mode, a window change is only approximate for a moment
+    __atomic_store_n(&samplingMode, SLFunctionsSamplingAll, __ATOMIC_RELAXED);
+    windowOnTicks = ticksFromNanoseconds((uint64_t)(on * NSEC_PER_SEC));
+    windowPeriodTicks = windowOnTicks + ticksFromNanoseconds((uint64_t)(MAX(off, 0) * NSEC_PER_SEC));
+    __atomic_store_n(&samplingMode, SLFunctionsSamplingWindows, __ATOMIC_RELEASE);
+}
+
++ (void)sampleWithBudget:(double)fraction
+{
+    if (fraction >= 1) {
+        [self sampleAll];
+        return;
+    }
+    budgetPerMillion = (uint32_t)(MAX(fraction, 0) * 1000000);
+    budgetBurstTicks = ticksFromNanoseconds(BUDGET_BURST_NS) / 1000000 * budgetPerMillion;
+    __atomic_store_n(&samplingMode, SLFunctionsSamplingBudget, __ATOMIC_RELEASE);
+}
+
++ (dispatch_queue_t)snapshotQueue
+{
+    static dispatch_queue_t queue;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        queue = dispatch_queue_create("SmartLogger.argumentSnapshots", DISPATCH_QUEUE_SERIAL);
+        dispatch_set_target_queue(queue, dispatch_get_global_queue(QOS_CLASS_UTILITY, 0));
+    });
+    return queue;
+}
+
++ (BOOL)enableArgumentSnapshots:(NSUInteger)capacity dumpPath:(NSString *)path
+{
+#ifdef __arm64__
+    __block BOOL enabled = NO;
+    dispatch_sync([self snapshotQueue], ^{
+        if (snapshotTimer) {
+            return;
+        }
+        if (path.length > 0 && (snapshotDump = ASDumpOpen(path.fileSystemRepresentation)) == NULL) {
+            return;
+        }
+        // Rings already created keep their size
+        snapshotCapacity = (uint32_t)MIN(MAX(capacity, (NSUInteger)16), (NSUInteger)1 << 20);
+        dispatch_source_t timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, [self snapshotQueue]);
+        dispatch_source_set_timer(timer, dispatch_time(DISPATCH_TIME_NOW, SNAPSHOT_DRAIN_NS), SNAPSHOT_DRAIN_NS, SNAPSHOT_DRAIN_NS / 10);
+        dispatch_source_set_event_handler(timer, ^{
+            drainSnapshots();
+        });
+        dispatch_resume(timer);
+        snapshotTimer = timer;
+        __atomic_store_n(&snapshotsEnabled, 1, __ATOMIC_RELEASE);
+        enabled = YES;
+    });
+    return enabled;
+#else
+    return NO;
+#endif
+}
+
++ (void)disableArgumentSnapshots
+{
+    dispatch_sync([self snapshotQueue], ^{
+        if (snapshotTimer == nil) {
+            return;
+        }
+        __atomic_store_n(&snapshotsEnabled, 0, __ATOMIC_RELEASE);
+        dispatch_source_cancel(snapshotTimer);
+        snapshotTimer = nil;
+        // Calls in flight when disabled are picked up by the next enable
+        drainSnapshots();
+        ASDumpClose(snapshotDump);
+        snapshotDump = NULL;
+    });
 }
 
 - (void)onWatchHit:(ThreadCallStack *)cs args:(arg_list)args
@@ -467,6 +995,9 @@ extern "C" void WatcherSetup() {
     // Log previous calls if necessary.
     for (int i = cs->lastPrintedIndex + 1; i < hitIndex; ++i) {
         CallRecord record = cs->stack[i];
+        if (snapshotCall(cs, i, record.obj, record.cmd, 0, NULL)) {
+            continue;
+        }
         
         // Modify spacesStr.
         char *spaces = cs->spacesStr;
@@ -486,14 +1017,16 @@ extern "C" void WatcherSetup() {
     }
     
     // Log the hit call.
-    char *spaces = cs->spacesStr;
-    spaces[hitIndex] = '\0';
-    Class kind = object_getClass(hitRecord->obj);
-    BOOL isMetaClass = class_isMetaClass(kind);
-    [self logWithClass:kind isMetaClass:isMetaClass object:hitRecord->obj selector:hitRecord->cmd spaces:spaces args:args];
-    
-    // Clean up spacesStr.
-    spaces[hitIndex] = ' ';
+    if (!snapshotCall(cs, hitIndex, hitRecord->obj, hitRecord->cmd, AS_FLAG_LOGGED, &args)) {
+        char *spaces = cs->spacesStr;
+        spaces[hitIndex] = '\0';
+        Class kind = object_getClass(hitRecord->obj);
+        BOOL isMetaClass = class_isMetaClass(kind);
+        [self logWithClass:kind isMetaClass:isMetaClass object:hitRecord->obj selector:hitRecord->cmd spaces:spaces args:args];
+        
+        // Clean up spacesStr.
+        spaces[hitIndex] = ' ';
+    }
     
     // Lastly, set the lastPrintedIndex.
     cs->lastPrintedIndex = hitIndex;
@@ -505,15 +1038,17 @@ extern "C" void WatcherSetup() {
     if (cs->isCompleteLoggingEnabled || (curIndex - cs->lastHitIndex) <= CALLSTACK_DEPTH_INCREMENT) {
         
         // Log the current call.
-        char *spaces = cs->spacesStr;
-        spaces[curIndex] = '\0';
         CallRecord curRecord = cs->stack[curIndex];
-        Class kind = object_getClass(curRecord.obj);
-        BOOL isMetaClass = class_isMetaClass(kind);
-        [self logWithClass:kind isMetaClass:isMetaClass object:curRecord.obj selector:curRecord.cmd spaces:spaces args:args];
-        
-        // Reset
-        spaces[curIndex] = ' ';
+        if (!snapshotCall(cs, curIndex, curRecord.obj, curRecord.cmd, AS_FLAG_LOGGED, &args)) {
+            char *spaces = cs->spacesStr;
+            spaces[curIndex] = '\0';
+            Class kind = object_getClass(curRecord.obj);
+            BOOL isMetaClass = class_isMetaClass(kind);
+            [self logWithClass:kind isMetaClass:isMetaClass object:curRecord.obj selector:curRecord.cmd spaces:spaces args:args];
+            
+            // Reset
+            spaces[curIndex] = ' ';
+        }
         
         // Lastly, set the lastPrintedIndex.
         cs->lastPrintedIndex = curIndex;
@@ -522,7 +1057,8 @@ extern "C" void WatcherSetup() {
 
 - (void)logWithClass:(Class)clazz isMetaClass:(BOOL)isMetaClass object:(id)object selector:(SEL)selector spaces:(char *)spaces args:(arg_list)args
 {
-    Method method = (isMetaClass) ? class_getClassMethod(clazz, _cmd) : class_getInstanceMethod(clazz, _cmd);
+    // clazz is already the metaclass for class methods
+    Method method = class_getInstanceMethod(clazz, selector);
     if (method == nil) {
         return;
     }
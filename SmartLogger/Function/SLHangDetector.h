@@ -0,0 +1,27 @@
+//
+//  SLHangDetector.h
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/8/19.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+// Reports main thread hangs through the logger (error, tag "Hang"). A run loop observer marks
+// each main thread activity, a watchdog queue checks it every threshold / 2 and, when one has
+// run longer than threshold, logs the traced Objective-C calls of the main thread, innermost
+// last, with the time spent in each. Calls are only known while SLFunctionsWatcher traces
+// objc_msgSend, otherwise the report has the duration only. One report per stuck activity.
+@interface SLHangDetector : NSObject
+
++ (void)startWithThreshold:(NSTimeInterval)threshold;
++ (void)stop;
+
+@property (class, nonatomic, readonly) NSUInteger hangCount;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,154 @@
+//
+//  SLHangDetector.mm
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/8/19.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+
+#import "SLHangDetector.h"
+#import "SLFunctionsWatcher.h"
+#import "SLLogger.h"
+#import "hangmonitor.h"
+#import "shadowstack.h"
+
+#include <mach/mach_time.h>
+#include <objc/runtime.h>
+
+#define HANG_REPORT_FRAMES 64
+#define HANG_SNAPSHOT_ATTEMPTS 16
+
+static HangMonitor mainMonitor;
+static ShadowStackRef mainShadow;
+static uint64_t thresholdTicks;
+static NSUInteger hangCount;
+static CFRunLoopObserverRef observer;
+static dispatch_source_t watchdog;
+
+static uint64_t ticksFromSeconds(NSTimeInterval seconds) {
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0) {
+        mach_timebase_info(&timebase);
+    }
+    return (uint64_t)(seconds * NSEC_PER_SEC) * timebase.denom / timebase.numer;
+}
+
+static double millisecondsFromTicks(uint64_t ticks) {
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0) {
+        mach_timebase_info(&timebase);
+    }
+    return (double)ticks * timebase.numer / timebase.denom / NSEC_PER_MSEC;
+}
+
+static NSString *hangReport(uint64_t duration, uint64_t now) {
+    NSMutableString *report = [NSMutableString stringWithFormat:@"Main thread hang %.0fms", millisecondsFromTicks(duration)];
+    ShadowFrame frames[HANG_REPORT_FRAMES];
+    int32_t depth = 0;
+    int count = mainShadow ? SSSnapshot(mainShadow, frames, HANG_REPORT_FRAMES, &depth, HANG_SNAPSHOT_ATTEMPTS) : 0;
+    if (count < 0) {
+        [report appendString:@", stack changing"];
+        return report;
+    }
+    if (count == 0) {
+        [report appendString:@", no traced calls"];
+        return report;
+    }
+    [report appendFormat:@", depth %d:", depth];
+    for (int i = 0; i < count; ++i) {
+        const ShadowFrame *frame = &frames[i];
+        int level = depth - count + i;
+        if (frame->cls == NULL) { // Entered before the stack was published.
+            [report appendFormat:@"\n  #%d ?", level];
+            continue;
+        }
+        Class cls = (__bridge Class)frame->cls;
+        BOOL isMetaClass = class_isMetaClass(cls);
+        [report appendFormat:@"\n  #%d %c[%s %s] %.0fms", level, isMetaClass ? '+' : '-', class_getName(cls),
+         sel_getName((SEL)frame->sel), millisecondsFromTicks(now - frame->start)];
+    }
+    return report;
+}
+
+@implementation SLHangDetector
+
++ (dispatch_queue_t)watchdogQueue
+{
+    static dispatch_queue_t queue;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        queue = dispatch_queue_create("SmartLogger.hangWatchdog", DISPATCH_QUEUE_SERIAL);
+    });
+    return queue;
+}
+
++ (void)startWithThreshold:(NSTimeInterval)threshold
+{
+    if (threshold <= 0) {
+        return;
+    }
+    [self stop];
+    thresholdTicks = ticksFromSeconds(threshold);
+    
+    // The observer and the shadow stack belong to the main thread
+    dispatch_async(dispatch_get_main_queue(), ^{
+        if (mainShadow == NULL) {
+            mainShadow = Watcher_publishCurrentThread();
+        }
+        HangMonitorBusy(&mainMonitor, mach_absolute_time());
+        observer = CFRunLoopObserverCreateWithHandler(kCFAllocatorDefault, kCFRunLoopAllActivities, YES, LONG_MIN,
+                                                      ^(CFRunLoopObserverRef observer, CFRunLoopActivity activity) {
+            if (activity == kCFRunLoopBeforeWaiting || activity == kCFRunLoopExit) {
+                HangMonitorIdle(&mainMonitor);
+            } else {
+                HangMonitorBusy(&mainMonitor, mach_absolute_time());
+            }
+        });
+        CFRunLoopAddObserver(CFRunLoopGetMain(), observer, kCFRunLoopCommonModes);
+    });
+    
+    dispatch_source_t timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, [self watchdogQueue]);
+    uint64_t interval = (uint64_t)(threshold * NSEC_PER_SEC / 2);
+    dispatch_source_set_timer(timer, dispatch_time(DISPATCH_TIME_NOW, interval), interval, interval / 10);
+    dispatch_source_set_event_handler(timer, ^{
+        uint64_t now = mach_absolute_time();
+        uint64_t duration = HangMonitorCheck(&mainMonitor, now, thresholdTicks);
+        if (duration > 0) {
+            ++hangCount;
+            LogError(@"Hang", @"%@", hangReport(duration, now));
+        }
+    });
+    dispatch_resume(timer);
+    dispatch_sync([self watchdogQueue], ^{
+        watchdog = timer;
+    });
+}
+
++ (void)stop
+{
+    dispatch_sync([self watchdogQueue], ^{
+        if (watchdog) {
+            dispatch_source_cancel(watchdog);
+            watchdog = nil;
+        }
+    });
+    dispatch_async(dispatch_get_main_queue(), ^{
+        if (observer) {
+            CFRunLoopRemoveObserver(CFRunLoopGetMain(), observer, kCFRunLoopCommonModes);
+            CFRelease(observer);
+            observer = NULL;
+        }
+        HangMonitorIdle(&mainMonitor);
+    });
+}
+
++ (NSUInteger)hangCount
+{
+    __block NSUInteger count;
+    dispatch_sync([self watchdogQueue], ^{
+        count = hangCount;
+    });
+    return count;
+}
+
+@end
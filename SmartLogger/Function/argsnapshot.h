@@ -0,0 +1,172 @@
+#ifndef ARGSNAPSHOT_H
+#define ARGSNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#if __cplusplus
+extern "C" {
+#endif
+
+// Raw argument capture for the tracer: instead of decoding arguments inside objc_msgSend, the
+// saved register block (RegState_, see ARM64Types.h) and the first AS_STACK_BYTES of stack
+// arguments are copied into a fixed size record along with the id of the method's type encoding.
+// The record is decoded later, by a background consumer on device or offline from a dump file,
+// with the same arm64 register and stack rules as the live path (the pa_* macros).
+//
+// Records are written by the traced thread into its own ring and read by one consumer, like
+// ShadowStack: the owner never waits, a full ring drops the newest record. Rings are never freed.
+// Plain C, the decoder builds and runs on any 64-bit host.
+#define AS_REGS_BYTES 208 // sizeof(struct RegState_): x0-x8, lr, q0-q7.
+#define AS_STACK_BYTES 128 // Stack arguments kept, later ones decode as truncated.
+
+#define AS_FLAG_ARGS 0x01 // Registers and stack were captured, else only the call is recorded.
+#define AS_FLAG_META 0x02 // Class method, obj is the class.
+#define AS_FLAG_LOGGED 0x04 // Hit or nested call, else one of the calls leading to a hit.
+
+typedef struct ArgSnapshot_ {
+  uint64_t timestamp;
+  uint64_t obj;
+  uint64_t cls;
+  uint64_t sel;
+  uint32_t encoding; // ASEncodingId, 0 - unknown.
+  uint16_t depth; // Call depth, for indentation.
+  uint8_t flags;
+  uint8_t stackLength;
+  uint64_t reserved[2];
+  // Same alignment as on device, the pa_* macros align stack arguments by address.
+  unsigned char regs[AS_REGS_BYTES] __attribute__((aligned(16)));
+  unsigned char stack[AS_STACK_BYTES] __attribute__((aligned(16)));
+} ArgSnapshot;
+
+// Capture
+
+typedef struct ASRing_ {
+  uint32_t mask;
+  uint64_t head; // Written by the owner.
+  uint64_t tail; // Written by the consumer.
+  uint64_t dropped;
+  struct ASRing_ *next; // All rings, see ASRingFirst.
+  ArgSnapshot slots[];
+} ASRing;
+typedef ASRing * ASRingRef;
+
+// Creates a ring for at least capacity records and adds it to the list of rings, NULL if out of
+// memory.
+ASRingRef ASRingCreate(uint32_t capacity);
+
+// First of all rings created, in no particular order. Safe from any thread.
+ASRingRef ASRingFirst(void);
+
+// Slot for the next record, NULL if the ring is full. Called by the owner.
+static inline ArgSnapshot * ASRingReserve(ASRingRef ring) {
+  uint64_t head = ring->head;
+  if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) > ring->mask) {
+    __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+    return NULL;
+  }
+  return &ring->slots[head & ring->mask];
+}
+
+// Publishes the reserved record. Called by the owner.
+static inline void ASRingCommit(ASRingRef ring) {
+  __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+// Copies the oldest record out. Called by the consumer.
+//
+// This function returns 1 if a record was copied; 0 if the ring is empty.
+int ASRingPop(ASRingRef ring, ArgSnapshot *snapshot);
+
+// Fills the argument part of a reserved record, `regs` is the RegState_ saved by the hook and
+// `stack` the caller's stack pointer. Called by the owner.
+void ASCapture(ArgSnapshot *snapshot, const void *regs, const void *stack);
+
+// Interned id of a type encoding, 0 if the table is full. `encoding` must outlive the table, as
+// runtime type encodings do. Lock free when the encoding is known.
+uint32_t ASEncodingId(const char *encoding);
+
+// Encoding of id, NULL if unknown. Safe from any thread.
+const char * ASEncodingString(uint32_t encoding);
+
+// Decoding
+
+typedef enum ASValueKind_ {
+  ASValueObject, // pointer only, the object may be gone by now.
+  ASValueClass,
+  ASValueSelector,
+  ASValueCString, // pointer only.
+  ASValuePointer,
+  ASValueBool,
+  ASValueSigned,
+  ASValueUnsigned,
+  ASValueFloat,
+  ASValueDouble,
+  ASValueDoubles, // CGPoint, CGSize, CGRect, UIEdgeInsets, UIOffset: `count` doubles.
+  ASValueRange, // NSRange: scalar is the location.
+  ASValueIndirect, // Struct passed by reference (CGAffineTransform), pointer only.
+} ASValueKind;
+
+typedef struct ASValue_ {
+  ASValueKind kind;
+  const char *type; // Points into the method encoding.
+  size_t typeLength;
+  int count;
+  union {
+    int64_t i;
+    uint64_t u;
+    double d;
+  } scalar;
+  double doubles[4];
+  uint64_t length; // ASValueRange.
+} ASValue;
+
+#define AS_DECODE_COMPLETE 0
+#define AS_DECODE_UNSUPPORTED 1 // Type the live path bails on too, e.g. other structs.
+#define AS_DECODE_TRUNCATED 2 // Arguments beyond AS_STACK_BYTES.
+#define AS_DECODE_BAD_ENCODING 3
+
+// Decodes the explicit arguments (after self and _cmd) of a record with the method's type
+// encoding, e.g. "v48@0:8{CGPoint=dd}16q32". Stops at the first argument it can't decode.
+//
+// Returns the number of values decoded, `status` receives one of AS_DECODE_*. If it is
+// AS_DECODE_UNSUPPORTED, values[count].type and typeLength give the argument.
+int ASDecode(const ArgSnapshot *snapshot, const char *encoding, ASValue *values, int capacity, int *status);
+
+// Names for pointers the decoder can't resolve itself, NULL to print the pointer.
+typedef const char * (*ASNameLookup)(uint64_t pointer);
+
+// Formats a value like the live path (NSStringFrom... for structs). Lookups may be NULL.
+//
+// Returns the length written, as snprintf.
+int ASFormatValue(const ASValue *value, char *buffer, size_t capacity, ASNameLookup className, ASNameLookup selectorName);
+
+// Formats a record as the live path prints the call, without the newline: "***-|Class@<0x..>
+// sel:| 1 {2, 3}" for logged calls, "-|Class sel| @<0x..>" for the calls leading to a hit,
+// indented by depth. Names may be NULL, the pointer is printed then.
+//
+// Returns the length written, at most capacity - 1.
+int ASFormatRecord(const ArgSnapshot *snapshot, const char *encoding, const char *className, const char *selectorName,
+                   char *buffer, size_t capacity, ASNameLookup classLookup, ASNameLookup selectorLookup);
+
+// Dump file for offline decoding: encodings and the names of the record's class and selector
+// are written once, before the first record using them. Class and selector arguments stay
+// pointers. Names may be NULL. Returns 0 on success.
+typedef struct ASDump_ ASDump;
+ASDump * ASDumpOpen(const char *path);
+int ASDumpWrite(ASDump *dump, const ArgSnapshot *snapshot, const char *className, const char *selectorName);
+void ASDumpClose(ASDump *dump);
+
+// Calls back for every record of a dump with its encoding and names (NULL if unknown).
+//
+// Returns the number of records read, -1 if the file is not a dump.
+typedef void (*ASDumpReader)(void *context, const ArgSnapshot *snapshot, const char *encoding,
+                             const char *className, const char *selectorName);
+long ASDumpRead(FILE *file, ASDumpReader reader, void *context);
+
+#if __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,713 @@
+#include "argsnapshot.h"
+#include "pointercache.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The pa_* macros decode a snapshot exactly as they decode the live registers.
+#include "ARM64Types.h"
+
+static_assert(sizeof(struct RegState_) == AS_REGS_BYTES, "RegState_ layout changed");
+
+#define MIN_CAPACITY 16
+#define ENCODING_CHUNK 1024
+#define ENCODING_CHUNKS 64
+#define DUMP_MAGIC "SLARGS01"
+
+// Rings
+
+static ASRingRef s_rings;
+
+// Creates a ring for at least capacity records and adds it to the list of rings, NULL if out of
+// memory.
+ASRingRef ASRingCreate(uint32_t capacity) {
+  uint32_t size = MIN_CAPACITY;
+  while (size < capacity && size < (1u << 30)) {
+    size *= 2;
+  }
+  ASRingRef ring = (ASRingRef)calloc(1, sizeof(ASRing) + size * sizeof(ArgSnapshot));
+  if (ring) {
+    ring->mask = size - 1;
+    ASRingRef first = __atomic_load_n(&s_rings, __ATOMIC_RELAXED);
+    do {
+      ring->next = first;
+    } while (!__atomic_compare_exchange_n(&s_rings, &first, ring, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+  }
+  return ring;
+}
+
+// First of all rings created, in no particular order. Safe from any thread.
+ASRingRef ASRingFirst(void) {
+  return __atomic_load_n(&s_rings, __ATOMIC_ACQUIRE);
+}
+
+// Copies the oldest record out. Called by the consumer.
+//
+// This function returns 1 if a record was copied; 0 if the ring is empty.
+int ASRingPop(ASRingRef ring, ArgSnapshot *snapshot) {
+  uint64_t tail = ring->tail;
+  if (tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) {
+    return 0;
+  }
+  memcpy(snapshot, &ring->slots[tail & ring->mask], sizeof(ArgSnapshot));
+  __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+// Fills the argument part of a reserved record. Called by the owner.
+void ASCapture(ArgSnapshot *snapshot, const void *regs, const void *stack) {
+  memcpy(snapshot->regs, regs, AS_REGS_BYTES);
+  // Above the caller's stack pointer, always mapped: it is the caller's frame
+  memcpy(snapshot->stack, stack, AS_STACK_BYTES);
+  snapshot->stackLength = AS_STACK_BYTES;
+  snapshot->flags |= AS_FLAG_ARGS;
+}
+
+// Encodings
+
+static pthread_mutex_t s_encodingLock = PTHREAD_MUTEX_INITIALIZER;
+static PointerCacheRef s_encodingCache; // Encoding -> id.
+static const char **s_encodingChunks[ENCODING_CHUNKS];
+static uint32_t s_encodingCount;
+
+// Interned id of a type encoding, 0 if the table is full. Lock free when the encoding is known.
+uint32_t ASEncodingId(const char *encoding) {
+  if (encoding == NULL) {
+    return 0;
+  }
+  PointerCacheRef cache = __atomic_load_n(&s_encodingCache, __ATOMIC_ACQUIRE);
+  void *known = cache ? PCGet(cache, (void *)encoding) : NULL;
+  if (known) {
+    return (uint32_t)(uintptr_t)known;
+  }
+
+  pthread_mutex_lock(&s_encodingLock);
+  uint32_t encodingId = 0;
+  cache = s_encodingCache;
+  if (cache && (known = PCGet(cache, (void *)encoding))) {
+    encodingId = (uint32_t)(uintptr_t)known;
+  } else if (s_encodingCount + 1 < ENCODING_CHUNK * ENCODING_CHUNKS) {
+    uint32_t next = s_encodingCount + 1; // 0 is unknown
+    const char **chunk = s_encodingChunks[next / ENCODING_CHUNK];
+    if (chunk == NULL) {
+      chunk = (const char **)calloc(ENCODING_CHUNK, sizeof(const char *));
+      __atomic_store_n(&s_encodingChunks[next / ENCODING_CHUNK], chunk, __ATOMIC_RELEASE);
+    }
+    if (cache == NULL) {
+      cache = PCCreate(256, 0);
+      __atomic_store_n(&s_encodingCache, cache, __ATOMIC_RELEASE);
+    }
+    if (cache && !PCPut(cache, (void *)encoding, (void *)(uintptr_t)next)) {
+      // Half full, the old table stays readable
+      PointerCacheRef grown = PCGrow(cache);
+      if (grown && PCPut(grown, (void *)encoding, (void *)(uintptr_t)next)) {
+        __atomic_store_n(&s_encodingCache, grown, __ATOMIC_RELEASE);
+        cache = grown;
+      } else {
+        cache = NULL;
+      }
+    }
+    if (chunk && cache) {
+      __atomic_store_n(&chunk[next % ENCODING_CHUNK], encoding, __ATOMIC_RELEASE);
+      s_encodingCount = next;
+      encodingId = next;
+    }
+  }
+  pthread_mutex_unlock(&s_encodingLock);
+  return encodingId;
+}
+
+// Encoding of id, NULL if unknown. Safe from any thread.
+const char * ASEncodingString(uint32_t encoding) {
+  if (encoding == 0 || encoding >= ENCODING_CHUNK * ENCODING_CHUNKS) {
+    return NULL;
+  }
+  const char **chunk = __atomic_load_n(&s_encodingChunks[encoding / ENCODING_CHUNK], __ATOMIC_ACQUIRE);
+  return chunk ? __atomic_load_n(&chunk[encoding % ENCODING_CHUNK], __ATOMIC_ACQUIRE) : NULL;
+}
+
+// Decoding
+
+typedef struct {
+  uint64_t location;
+  uint64_t length;
+} ASTwoInts;
+
+typedef struct {
+  double a;
+  double b;
+} ASTwoDoubles;
+
+typedef struct {
+  double a;
+  double b;
+  double c;
+  double d;
+} ASFourDoubles;
+
+static const char * as_skip_quoted(const char *type) {
+  // Opening quote at type
+  const char *end = strchr(type + 1, '"');
+  return end ? end + 1 : NULL;
+}
+
+// Skips one type of an encoding, NULL if it is malformed.
+static const char * as_skip_type(const char *type) {
+  while (*type && strchr("rnNoORVA", *type)) {
+    ++type;
+  }
+  switch (*type) {
+    case '\0':
+      return NULL;
+    case '^':
+      return as_skip_type(type + 1);
+    case '@':
+      if (type[1] == '"') {
+        return as_skip_quoted(type + 1);
+      }
+      return type[1] == '?' ? type + 2 : type + 1;
+    case 'b':
+      ++type;
+      while (*type >= '0' && *type <= '9') {
+        ++type;
+      }
+      return type;
+    case '{':
+    case '(':
+    case '[': {
+      int nesting = 0;
+      do {
+        if (*type == '"') {
+          type = as_skip_quoted(type);
+          if (type == NULL) {
+            return NULL;
+          }
+          continue;
+        }
+        if (*type == '{' || *type == '(' || *type == '[') {
+          ++nesting;
+        } else if (*type == '}' || *type == ')' || *type == ']') {
+          --nesting;
+        } else if (*type == '\0') {
+          return NULL;
+        }
+        ++type;
+      } while (nesting > 0);
+      return type;
+    }
+    default:
+      return type + 1;
+  }
+}
+
+// Skips the frame offset after a type.
+static const char * as_skip_offset(const char *type) {
+  if (*type == '-' || *type == '+') {
+    ++type;
+  }
+  while (*type >= '0' && *type <= '9') {
+    ++type;
+  }
+  return type;
+}
+
+// Same cases as -[SLFunctionsWatcher logArgument:args:].
+//
+// This function returns 1 if the value was decoded; 0 if the type is not supported.
+static int as_decode_value(pa_list &args, const char *type, ASValue *value) {
+  while (*type && strchr("rnNoORV", *type)) {
+    ++type;
+  }
+  value->type = type;
+  value->count = 1;
+  switch (*type) {
+    case '#':
+      value->kind = ASValueClass;
+      value->scalar.u = (uint64_t)(uintptr_t)pa_arg(args, void *);
+      break;
+    case '@':
+      value->kind = ASValueObject;
+      value->scalar.u = (uint64_t)(uintptr_t)pa_arg(args, void *);
+      break;
+    case ':':
+      value->kind = ASValueSelector;
+      value->scalar.u = (uint64_t)(uintptr_t)pa_arg(args, void *);
+      break;
+    case '*':
+      value->kind = ASValueCString;
+      value->scalar.u = (uint64_t)(uintptr_t)pa_arg(args, const char *);
+      break;
+    case '^':
+      value->kind = ASValuePointer;
+      value->scalar.u = (uint64_t)(uintptr_t)pa_arg(args, void *);
+      break;
+    case 'B':
+      value->kind = ASValueBool;
+      value->scalar.u = pa_arg(args, bool) ? 1 : 0;
+      break;
+    case 'c':
+      value->kind = ASValueSigned;
+      value->scalar.i = pa_arg(args, signed char);
+      break;
+    case 'C':
+      value->kind = ASValueUnsigned;
+      value->scalar.u = pa_arg(args, unsigned char);
+      break;
+    case 's':
+      value->kind = ASValueSigned;
+      value->scalar.i = pa_arg(args, short);
+      break;
+    case 'S':
+      value->kind = ASValueUnsigned;
+      value->scalar.u = pa_arg(args, unsigned short);
+      break;
+    case 'i':
+    case 'l': // 32-bit on 64-bit programs.
+      value->kind = ASValueSigned;
+      value->scalar.i = pa_arg(args, int);
+      break;
+    case 'I':
+    case 'L':
+      value->kind = ASValueUnsigned;
+      value->scalar.u = pa_arg(args, unsigned int);
+      break;
+    case 'q':
+      value->kind = ASValueSigned;
+      value->scalar.i = pa_arg(args, long long);
+      break;
+    case 'Q':
+      value->kind = ASValueUnsigned;
+      value->scalar.u = pa_arg(args, unsigned long long);
+      break;
+    case 'f':
+      value->kind = ASValueFloat;
+      value->scalar.d = pa_float(args);
+      break;
+    case 'd':
+      value->kind = ASValueDouble;
+      value->scalar.d = pa_double(args);
+      break;
+    case '{':
+      if (strncmp(type, "{CGAffineTransform=", 19) == 0) {
+        // Larger than 16 bytes and not a homogeneous aggregate of 4, passed by reference
+        value->kind = ASValueIndirect;
+        value->scalar.u = (uint64_t)(uintptr_t)pa_arg(args, void *);
+      } else if (strncmp(type, "{CGPoint=", 9) == 0 || strncmp(type, "{CGSize=", 8) == 0 ||
+                 strncmp(type, "{UIOffset=", 10) == 0) {
+        pa_two_doubles(args, ASTwoDoubles, pair)
+        value->kind = ASValueDoubles;
+        value->count = 2;
+        value->doubles[0] = pair.a;
+        value->doubles[1] = pair.b;
+      } else if (strncmp(type, "{CGRect=", 8) == 0 || strncmp(type, "{UIEdgeInsets=", 14) == 0) {
+        pa_four_doubles(args, ASFourDoubles, quad)
+        value->kind = ASValueDoubles;
+        value->count = 4;
+        value->doubles[0] = quad.a;
+        value->doubles[1] = quad.b;
+        value->doubles[2] = quad.c;
+        value->doubles[3] = quad.d;
+      } else if (strncmp(type, "{_NSRange=", 10) == 0) {
+        pa_two_ints(args, ASTwoInts, range, unsigned long long);
+        value->kind = ASValueRange;
+        value->count = 2;
+        value->scalar.u = range.location;
+        value->length = range.length;
+      } else {
+        return 0;
+      }
+      break;
+    default:
+      return 0;
+  }
+  return 1;
+}
+
+int ASDecode(const ArgSnapshot *snapshot, const char *encoding, ASValue *values, int capacity, int *status) {
+  *status = AS_DECODE_BAD_ENCODING;
+  if (encoding == NULL) {
+    return 0;
+  }
+  // Return type, self and _cmd
+  const char *type = as_skip_type(encoding);
+  for (int i = 0; type && i < 2; ++i) {
+    type = as_skip_type(as_skip_offset(type));
+  }
+  if (type == NULL) {
+    return 0;
+  }
+  type = as_skip_offset(type);
+
+  // Same alignment modulo 16 as the caller's stack, with room for one argument read past the end
+  struct RegState_ regs;
+  unsigned char stack[AS_STACK_BYTES + 64] __attribute__((aligned(16)));
+  memcpy(&regs, snapshot->regs, sizeof(regs));
+  memset(stack, 0, sizeof(stack));
+  size_t stackLength = snapshot->stackLength < AS_STACK_BYTES ? snapshot->stackLength : AS_STACK_BYTES;
+  memcpy(stack, snapshot->stack, stackLength);
+  if (!(snapshot->flags & AS_FLAG_ARGS)) {
+    stackLength = 0;
+  }
+
+  pa_list args = (pa_list){ &regs, stack, 2, 0 };
+  int count = 0;
+  *status = AS_DECODE_COMPLETE;
+  while (*type) {
+    const char *next = as_skip_type(type);
+    if (next == NULL) {
+      *status = AS_DECODE_BAD_ENCODING;
+      break;
+    }
+    if (count == capacity) {
+      *status = AS_DECODE_TRUNCATED;
+      break;
+    }
+    if (!(snapshot->flags & AS_FLAG_ARGS) || (size_t)(args.stack - stack) > stackLength) {
+      *status = AS_DECODE_TRUNCATED;
+      break;
+    }
+    ASValue *value = &values[count];
+    memset(value, 0, sizeof(ASValue));
+    if (!as_decode_value(args, type, value)) {
+      value->typeLength = (size_t)(next - value->type);
+      *status = AS_DECODE_UNSUPPORTED;
+      break;
+    }
+    if ((size_t)(args.stack - stack) > stackLength) {
+      // Read past what was captured
+      *status = AS_DECODE_TRUNCATED;
+      break;
+    }
+    value->typeLength = (size_t)(next - value->type);
+    ++count;
+    type = as_skip_offset(next);
+  }
+  return count;
+}
+
+int ASFormatValue(const ASValue *value, char *buffer, size_t capacity, ASNameLookup className, ASNameLookup selectorName) {
+  const char *type = value->type;
+  uint64_t pointer = value->scalar.u;
+  const char *name;
+  switch (value->kind) {
+    case ASValueObject:
+      return pointer ? snprintf(buffer, capacity, "<%p>", (void *)(uintptr_t)pointer) : snprintf(buffer, capacity, "nil");
+    case ASValueClass:
+      if (pointer == 0) {
+        return snprintf(buffer, capacity, "nil");
+      }
+      name = className ? className(pointer) : NULL;
+      return name ? snprintf(buffer, capacity, "[%s class]", name)
+                  : snprintf(buffer, capacity, "[%p class]", (void *)(uintptr_t)pointer);
+    case ASValueSelector:
+      if (pointer == 0) {
+        return snprintf(buffer, capacity, "NULL");
+      }
+      name = selectorName ? selectorName(pointer) : NULL;
+      return name ? snprintf(buffer, capacity, "@selector(%s)", name)
+                  : snprintf(buffer, capacity, "@selector(%p)", (void *)(uintptr_t)pointer);
+    case ASValueCString:
+    case ASValuePointer:
+      return pointer ? snprintf(buffer, capacity, "%p", (void *)(uintptr_t)pointer) : snprintf(buffer, capacity, "NULL");
+    case ASValueBool:
+      return snprintf(buffer, capacity, "%s", value->scalar.u ? "true" : "false");
+    case ASValueSigned:
+      if (*type == 'i' && value->scalar.i == INT_MAX) {
+        return snprintf(buffer, capacity, "INT_MAX");
+      }
+      return snprintf(buffer, capacity, "%lld", (long long)value->scalar.i);
+    case ASValueUnsigned:
+      return snprintf(buffer, capacity, "%llu", (unsigned long long)value->scalar.u);
+    case ASValueFloat:
+    case ASValueDouble:
+      return snprintf(buffer, capacity, "%g", value->scalar.d);
+    case ASValueDoubles:
+      if (strncmp(type, "{CGRect=", 8) == 0) {
+        return snprintf(buffer, capacity, "{{%g, %g}, {%g, %g}}",
+                        value->doubles[0], value->doubles[1], value->doubles[2], value->doubles[3]);
+      }
+      if (value->count == 4) {
+        return snprintf(buffer, capacity, "{%g, %g, %g, %g}",
+                        value->doubles[0], value->doubles[1], value->doubles[2], value->doubles[3]);
+      }
+      return snprintf(buffer, capacity, "{%g, %g}", value->doubles[0], value->doubles[1]);
+    case ASValueRange:
+      return snprintf(buffer, capacity, "{%llu, %llu}", (unsigned long long)value->scalar.u, (unsigned long long)value->length);
+    case ASValueIndirect:
+      return snprintf(buffer, capacity, "{%.*s *%p}", (int)(strchr(type, '=') ? strchr(type, '=') - type - 1 : 0),
+                      type + 1, (void *)(uintptr_t)pointer);
+  }
+  return snprintf(buffer, capacity, "?");
+}
+
+#define AS_MAX_VALUES 32
+
+// Appends to buffer, keeps offset at the terminating NUL when it is full.
+static void as_append(size_t capacity, size_t *offset, int length) {
+  if (length > 0) {
+    *offset += (size_t)length;
+  }
+  if (*offset >= capacity) {
+    *offset = capacity - 1;
+  }
+}
+
+int ASFormatRecord(const ArgSnapshot *snapshot, const char *encoding, const char *className, const char *selectorName,
+                   char *buffer, size_t capacity, ASNameLookup classLookup, ASNameLookup selectorLookup) {
+  if (capacity == 0) {
+    return 0;
+  }
+  char classPointer[24], selectorPointer[24];
+  if (className == NULL) {
+    snprintf(classPointer, sizeof(classPointer), "%p", (void *)(uintptr_t)snapshot->cls);
+    className = classPointer;
+  }
+  if (selectorName == NULL) {
+    snprintf(selectorPointer, sizeof(selectorPointer), "%p", (void *)(uintptr_t)snapshot->sel);
+    selectorName = selectorPointer;
+  }
+
+  size_t offset = 0;
+  int indent = snapshot->depth * 2;
+  int meta = snapshot->flags & AS_FLAG_META;
+  void *obj = (void *)(uintptr_t)snapshot->obj;
+  buffer[0] = '\0';
+  if (!(snapshot->flags & AS_FLAG_LOGGED)) {
+    // A call leading to a hit
+    if (meta) {
+      as_append(capacity, &offset, snprintf(buffer, capacity, "%*s+|%s %s|", indent, "", className, selectorName));
+    } else {
+      as_append(capacity, &offset, snprintf(buffer, capacity, "%*s-|%s %s| @<%p>", indent, "", className, selectorName, obj));
+    }
+    return (int)offset;
+  }
+  if (meta) {
+    as_append(capacity, &offset, snprintf(buffer, capacity, "%*s***+|%s %s|", indent, "", className, selectorName));
+  } else {
+    as_append(capacity, &offset, snprintf(buffer, capacity, "%*s***-|%s@<%p> %s|", indent, "", className, obj, selectorName));
+  }
+  if (!(snapshot->flags & AS_FLAG_ARGS) || encoding == NULL) {
+    as_append(capacity, &offset, snprintf(buffer + offset, capacity - offset, " ~NO ENCODING~***"));
+    return (int)offset;
+  }
+
+  ASValue values[AS_MAX_VALUES];
+  int status;
+  int count = ASDecode(snapshot, encoding, values, AS_MAX_VALUES, &status);
+  for (int i = 0; i < count; ++i) {
+    as_append(capacity, &offset, snprintf(buffer + offset, capacity - offset, " "));
+    as_append(capacity, &offset, ASFormatValue(&values[i], buffer + offset, capacity - offset, classLookup, selectorLookup));
+  }
+  switch (status) {
+    case AS_DECODE_UNSUPPORTED:
+      as_append(capacity, &offset, snprintf(buffer + offset, capacity - offset, " ~BAIL on \"%.*s\"~",
+                                                    (int)values[count].typeLength, values[count].type));
+      break;
+    case AS_DECODE_TRUNCATED:
+      as_append(capacity, &offset, snprintf(buffer + offset, capacity - offset, " ~TRUNCATED~"));
+      break;
+    case AS_DECODE_BAD_ENCODING:
+      as_append(capacity, &offset, snprintf(buffer + offset, capacity - offset, " ~BAD ENCODING~"));
+      break;
+  }
+  return (int)offset;
+}
+
+// Dump
+
+struct ASDump_ {
+  FILE *file;
+  uint8_t *written; // One byte per encoding id.
+  uint32_t writtenCount;
+  PointerCacheRef names; // Pointers already named.
+};
+
+ASDump * ASDumpOpen(const char *path) {
+  ASDump *dump = (ASDump *)calloc(1, sizeof(ASDump));
+  if (dump == NULL || (dump->file = fopen(path, "wb")) == NULL) {
+    free(dump);
+    return NULL;
+  }
+  uint32_t recordSize = sizeof(ArgSnapshot);
+  if (fwrite(DUMP_MAGIC, 8, 1, dump->file) != 1 || fwrite(&recordSize, sizeof(recordSize), 1, dump->file) != 1) {
+    ASDumpClose(dump);
+    return NULL;
+  }
+  return dump;
+}
+
+static int as_dump_string(FILE *file, int kind, const void *key, size_t keyLength, const char *string) {
+  uint32_t length = (uint32_t)strlen(string);
+  if (fputc(kind, file) == EOF || fwrite(key, keyLength, 1, file) != 1 ||
+      fwrite(&length, sizeof(length), 1, file) != 1 || fwrite(string, 1, length, file) != length) {
+    return -1;
+  }
+  return 0;
+}
+
+static int as_dump_name(ASDump *dump, uint64_t pointer, const char *name) {
+  if (pointer == 0 || name == NULL || (dump->names && PCGet(dump->names, (void *)(uintptr_t)pointer))) {
+    return 0;
+  }
+  if (as_dump_string(dump->file, 'N', &pointer, sizeof(pointer), name) != 0) {
+    return -1;
+  }
+  // Only the consumer reads it, old tables can go
+  if (dump->names == NULL || !PCPut(dump->names, (void *)(uintptr_t)pointer, (void *)1)) {
+    PointerCacheRef grown = dump->names ? PCGrow(dump->names) : PCCreate(256, 0);
+    if (grown) {
+      PCPut(grown, (void *)(uintptr_t)pointer, (void *)1);
+      PCFree(dump->names);
+      dump->names = grown;
+    }
+  }
+  return 0;
+}
+
+int ASDumpWrite(ASDump *dump, const ArgSnapshot *snapshot, const char *className, const char *selectorName) {
+  uint32_t encoding = snapshot->encoding;
+  const char *string = ASEncodingString(encoding);
+  if (string && (encoding >= dump->writtenCount || !dump->written[encoding])) {
+    if (encoding >= dump->writtenCount) {
+      uint32_t count = dump->writtenCount ? dump->writtenCount : 256;
+      while (count <= encoding) {
+        count *= 2;
+      }
+      uint8_t *written = (uint8_t *)realloc(dump->written, count);
+      if (written == NULL) {
+        return -1;
+      }
+      memset(written + dump->writtenCount, 0, count - dump->writtenCount);
+      dump->written = written;
+      dump->writtenCount = count;
+    }
+    if (as_dump_string(dump->file, 'E', &encoding, sizeof(encoding), string) != 0) {
+      return -1;
+    }
+    dump->written[encoding] = 1;
+  }
+  if (as_dump_name(dump, snapshot->cls, className) != 0 || as_dump_name(dump, snapshot->sel, selectorName) != 0) {
+    return -1;
+  }
+  if (fputc('R', dump->file) == EOF || fwrite(snapshot, sizeof(ArgSnapshot), 1, dump->file) != 1) {
+    return -1;
+  }
+  return 0;
+}
+
+void ASDumpClose(ASDump *dump) {
+  if (dump) {
+    if (dump->file) {
+      fclose(dump->file);
+    }
+    free(dump->written);
+    PCFree(dump->names);
+    free(dump);
+  }
+}
+
+// Reads the length and string following a key, NULL at the end of the file.
+static char * as_read_string(FILE *file) {
+  uint32_t length;
+  if (fread(&length, sizeof(length), 1, file) != 1 || length > 1 << 20) {
+    return NULL;
+  }
+  char *string = (char *)malloc(length + 1);
+  if (string == NULL || fread(string, 1, length, file) != length) {
+    free(string);
+    return NULL;
+  }
+  string[length] = '\0';
+  return string;
+}
+
+// Every name ever read, freed with the reader.
+static void as_free_names(PointerCacheRef names) {
+  if (names) {
+    for (size_t i = 0; i <= names->mask; ++i) {
+      if (names->keys[i]) {
+        free(names->values[i]);
+      }
+    }
+    PCFree(names);
+  }
+}
+
+long ASDumpRead(FILE *file, ASDumpReader reader, void *context) {
+  char magic[8];
+  uint32_t recordSize;
+  if (fread(magic, 8, 1, file) != 1 || memcmp(magic, DUMP_MAGIC, 8) != 0 ||
+      fread(&recordSize, sizeof(recordSize), 1, file) != 1 || recordSize != sizeof(ArgSnapshot)) {
+    return -1;
+  }
+
+  char **encodings = NULL;
+  uint32_t encodingCount = 0;
+  PointerCacheRef names = NULL;
+  long records = 0;
+  // malloc is 16 byte aligned on the 64-bit platforms this runs on
+  ArgSnapshot *snapshot = (ArgSnapshot *)malloc(sizeof(ArgSnapshot));
+  int kind;
+  while (snapshot && (kind = fgetc(file)) != EOF) {
+    if (kind == 'E') {
+      uint32_t encoding;
+      if (fread(&encoding, sizeof(encoding), 1, file) != 1 || encoding >= ENCODING_CHUNK * ENCODING_CHUNKS) {
+        break;
+      }
+      if (encoding >= encodingCount) {
+        char **grown = (char **)realloc(encodings, (encoding + 1) * sizeof(char *));
+        if (grown == NULL) {
+          break;
+        }
+        memset(grown + encodingCount, 0, (encoding + 1 - encodingCount) * sizeof(char *));
+        encodings = grown;
+        encodingCount = encoding + 1;
+      }
+      char *string = as_read_string(file);
+      if (string == NULL) {
+        break;
+      }
+      free(encodings[encoding]);
+      encodings[encoding] = string;
+    } else if (kind == 'N') {
+      uint64_t pointer;
+      char *name;
+      if (fread(&pointer, sizeof(pointer), 1, file) != 1 || pointer == 0 || (name = as_read_string(file)) == NULL) {
+        break;
+      }
+      if (names == NULL || !PCPut(names, (void *)(uintptr_t)pointer, name)) {
+        PointerCacheRef grown = names ? PCGrow(names) : PCCreate(256, 0);
+        if (grown == NULL || !PCPut(grown, (void *)(uintptr_t)pointer, name)) {
+          free(name);
+          PCFree(grown);
+          break;
+        }
+        PCFree(names);
+        names = grown;
+      } else if (PCGet(names, (void *)(uintptr_t)pointer) != name) {
+        free(name); // Named twice, first one wins
+      }
+    } else if (kind == 'R') {
+      if (fread(snapshot, sizeof(ArgSnapshot), 1, file) != 1) {
+        break;
+      }
+      const char *className = names ? (const char *)PCGet(names, (void *)(uintptr_t)snapshot->cls) : NULL;
+      const char *selectorName = names ? (const char *)PCGet(names, (void *)(uintptr_t)snapshot->sel) : NULL;
+      reader(context, snapshot, snapshot->encoding < encodingCount ? encodings[snapshot->encoding] : NULL,
+             className, selectorName);
+      ++records;
+    } else {
+      break;
+    }
+  }
+
+  for (uint32_t i = 0; i < encodingCount; ++i) {
+    free(encodings[i]);
+  }
+  free(encodings);
+  as_free_names(names);
+  free(snapshot);
+  return records;
+}
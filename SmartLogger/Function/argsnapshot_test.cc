@@ -0,0 +1,252 @@
+// Linux test of the snapshot decoder, see SmartLogger/Makefile. Register states are fabricated
+// the way the hook saves them on device, arguments are placed by the AAPCS64 rules the live path
+// follows: x2-x7 and q0-q7 in order, then the stack with natural alignment and no padding to 8
+// for char and short.
+
+#include "argsnapshot.h"
+#include "ARM64Types.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+  if (!(condition)) { \
+    fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+    failures++; \
+  } \
+} while (0)
+
+static char text[256];
+static ArgSnapshot snapshot;
+static struct RegState_ regs;
+static unsigned char stack[AS_STACK_BYTES] __attribute__((aligned(16)));
+
+static void reset() {
+  memset(&regs, 0, sizeof(regs));
+  memset(stack, 0, sizeof(stack));
+  memset(&snapshot, 0, sizeof(snapshot));
+}
+
+static const char *format(const ASValue *value) {
+  ASFormatValue(value, text, sizeof(text), NULL, NULL);
+  return text;
+}
+
+static void testRegisters() {
+  ASValue values[16];
+  int status;
+
+  // CGRect takes q0-q3, the NSInteger after it the next general register.
+  reset();
+  for (int i = 0; i < 4; i++) {
+    regs.floating.arr[i].d.d1 = i + 1.5;
+  }
+  regs.general.arr[2] = (uint64_t)-7;
+  ASCapture(&snapshot, &regs, stack);
+  int count = ASDecode(&snapshot, "v56@0:8{CGRect={CGPoint=dd}{CGSize=dd}}16q48", values, 16, &status);
+  CHECK(count == 2 && status == AS_DECODE_COMPLETE);
+  CHECK(!strcmp(format(&values[0]), "{{1.5, 2.5}, {3.5, 4.5}}"));
+  CHECK(!strcmp(format(&values[1]), "-7"));
+
+  // NSRange fits in x2 and x3.
+  reset();
+  regs.general.arr[2] = 1;
+  regs.general.arr[3] = 2;
+  ASCapture(&snapshot, &regs, stack);
+  count = ASDecode(&snapshot, "v0@0:8{_NSRange=QQ}16", values, 16, &status);
+  CHECK(count == 1 && status == AS_DECODE_COMPLETE && !strcmp(format(&values[0]), "{1, 2}"));
+}
+
+static void testStack() {
+  ASValue values[16];
+  int status;
+
+  // Six ints fill x2-x7, the rest spill with char and short packed.
+  reset();
+  for (int i = 2; i < 8; i++) {
+    regs.general.arr[i] = i * 10;
+  }
+  stack[0] = (unsigned char)-3;
+  *(int16_t *)(stack + 2) = 1234;
+  *(int32_t *)(stack + 4) = INT32_MAX;
+  *(int64_t *)(stack + 8) = 99;
+  ASCapture(&snapshot, &regs, stack);
+  int count = ASDecode(&snapshot, "v0@0:8iiiiiicsiq", values, 16, &status);
+  CHECK(count == 10 && status == AS_DECODE_COMPLETE);
+  CHECK(values[5].scalar.i == 70 && values[6].scalar.i == -3 && values[7].scalar.i == 1234);
+  CHECK(!strcmp(format(&values[8]), "INT_MAX") && values[9].scalar.i == 99);
+
+  // The ninth float spills; NSRange doesn't fit in x7 alone and goes to the stack whole.
+  reset();
+  for (int i = 0; i < 8; i++) {
+    regs.floating.arr[i].f.f1 = i;
+  }
+  for (int i = 2; i < 7; i++) {
+    regs.general.arr[i] = i;
+  }
+  *(float *)stack = 8.5f;
+  *(uint64_t *)(stack + 8) = 5;
+  *(uint64_t *)(stack + 16) = 6;
+  ASCapture(&snapshot, &regs, stack);
+  count = ASDecode(&snapshot, "v0@0:8ffffffffflllll{_NSRange=QQ}", values, 16, &status);
+  CHECK(count == 15 && status == AS_DECODE_COMPLETE);
+  CHECK(values[8].scalar.d == 8.5);
+  CHECK(!strcmp(format(&values[14]), "{5, 6}"));
+
+  // CGAffineTransform is passed by reference; CGPoint after eight doubles goes to the stack.
+  reset();
+  regs.general.arr[2] = 0x1000;
+  *(double *)stack = 1;
+  *(double *)(stack + 8) = 2;
+  ASCapture(&snapshot, &regs, stack);
+  count = ASDecode(&snapshot, "v0@0:8{CGAffineTransform=dddddd}16dddddddd{CGPoint=dd}", values, 16, &status);
+  CHECK(count == 10 && status == AS_DECODE_COMPLETE);
+  CHECK(!strcmp(format(&values[0]), "{CGAffineTransform *0x1000}"));
+  CHECK(!strcmp(format(&values[9]), "{1, 2}"));
+}
+
+static void testStatus() {
+  ASValue values[32];
+  int status;
+
+  // Six registers and 17 stack slots, AS_STACK_BYTES keeps 16.
+  reset();
+  ASCapture(&snapshot, &regs, stack);
+  char encoding[128] = "v0@0:8";
+  for (int i = 0; i < 6 + 17; i++) {
+    strcat(encoding, "q");
+  }
+  int count = ASDecode(&snapshot, encoding, values, 32, &status);
+  CHECK(count == 6 + 16 && status == AS_DECODE_TRUNCATED);
+
+  count = ASDecode(&snapshot, "v0@0:8i{Foo=ii}", values, 16, &status);
+  CHECK(count == 1 && status == AS_DECODE_UNSUPPORTED);
+  CHECK(values[1].typeLength == 8 && !strncmp(values[1].type, "{Foo=ii}", 8));
+
+  count = ASDecode(&snapshot, "v0@0:8", values, 16, &status);
+  CHECK(count == 0 && status == AS_DECODE_COMPLETE);
+  ASDecode(&snapshot, "{Foo", values, 16, &status);
+  CHECK(status == AS_DECODE_BAD_ENCODING);
+
+  // Calls recorded without arguments.
+  snapshot.flags = 0;
+  count = ASDecode(&snapshot, "v0@0:8i", values, 16, &status);
+  CHECK(count == 0 && status == AS_DECODE_TRUNCATED);
+}
+
+static void testEncodingsAndRing() {
+  static const char *first = "v16@0:8", *second = "@24@0:8@16";
+  uint32_t a = ASEncodingId(first), b = ASEncodingId(second);
+  CHECK(a && b && a != b && ASEncodingId(first) == a);
+  CHECK(ASEncodingString(b) == second);
+  static char many[2000][8];
+  for (int i = 0; i < 2000; i++) {
+    snprintf(many[i], sizeof(many[i]), "v%d", i);
+    CHECK(ASEncodingId(many[i]) != 0);
+  }
+  CHECK(!strcmp(ASEncodingString(ASEncodingId(many[1999])), "v1999"));
+
+  ASRingRef ring = ASRingCreate(3);
+  CHECK(ring && ring->mask == 15 && ASRingFirst() == ring);
+  for (int i = 0; ring && i < 16; i++) {
+    ArgSnapshot *slot = ASRingReserve(ring);
+    CHECK(slot != NULL);
+    slot->timestamp = i;
+    ASRingCommit(ring);
+  }
+  CHECK(ring && ASRingReserve(ring) == NULL && ring->dropped == 1);
+  ArgSnapshot out;
+  for (int i = 0; ring && i < 16; i++) {
+    CHECK(ASRingPop(ring, &out) && out.timestamp == (uint64_t)i);
+  }
+  CHECK(ring && !ASRingPop(ring, &out));
+}
+
+static int dumpRecords = 0;
+
+static void readRecord(void *context, const ArgSnapshot *record, const char *encoding, const char *className,
+                       const char *selectorName) {
+  (void)context;
+  ASValue values[4];
+  int status;
+  CHECK(className && !strcmp(className, "Foo") && selectorName && !strcmp(selectorName, "bar:"));
+  CHECK(encoding && !strcmp(encoding, "v20@0:8i16"));
+  CHECK(ASDecode(record, encoding, values, 4, &status) == 1 && values[0].scalar.i == 42);
+  dumpRecords++;
+}
+
+static void testDump() {
+  char path[] = "/tmp/argsnapshot-XXXXXX";
+  int fd = mkstemp(path);
+  CHECK(fd >= 0);
+  if (fd < 0) {
+    return;
+  }
+  close(fd);
+
+  ASDump *dump = ASDumpOpen(path);
+  CHECK(dump != NULL);
+  reset();
+  regs.general.arr[2] = 42;
+  ASCapture(&snapshot, &regs, stack);
+  snapshot.encoding = ASEncodingId("v20@0:8i16");
+  snapshot.cls = 0x100;
+  snapshot.sel = 0x200;
+  for (int i = 0; dump && i < 3; i++) {
+    CHECK(ASDumpWrite(dump, &snapshot, "Foo", "bar:") == 0);
+  }
+  ASDumpClose(dump);
+
+  FILE *file = fopen(path, "rb");
+  CHECK(file != NULL);
+  if (file) {
+    CHECK(ASDumpRead(file, readRecord, NULL) == 3 && dumpRecords == 3);
+    fclose(file);
+  }
+  unlink(path);
+}
+
+static void testRecords() {
+  char line[256];
+  reset();
+  regs.general.arr[2] = 5;
+  for (int i = 0; i < 4; i++) {
+    regs.floating.arr[i].d.d1 = i;
+  }
+  snapshot.depth = 2;
+  snapshot.obj = 0x10;
+  snapshot.flags = AS_FLAG_LOGGED;
+  ASCapture(&snapshot, &regs, stack);
+  ASFormatRecord(&snapshot, "v0@0:8i{CGRect={CGPoint=dd}{CGSize=dd}}{Foo=i}", NULL, "sel:", line, sizeof(line), NULL, NULL);
+  // glibc prints a NULL %p as (nil)
+  CHECK(!strcmp(line, "    ***-|(nil)@<0x10> sel:| 5 {{0, 1}, {2, 3}} ~BAIL on \"{Foo=i}\"~"));
+
+  snapshot.flags = AS_FLAG_META;
+  ASFormatRecord(&snapshot, NULL, "K", "s", line, sizeof(line), NULL, NULL);
+  CHECK(!strcmp(line, "    +|K s|"));
+  snapshot.flags = AS_FLAG_LOGGED;
+  ASFormatRecord(&snapshot, NULL, "K", "s", line, sizeof(line), NULL, NULL);
+  CHECK(!strcmp(line, "    ***-|K@<0x10> s| ~NO ENCODING~***"));
+  snapshot.flags |= AS_FLAG_ARGS;
+  int length = ASFormatRecord(&snapshot, "v0@0:8iiii", "K", "s", line, 12, NULL, NULL);
+  CHECK(length == 11 && strlen(line) == 11);
+}
+
+int main() {
+  testRegisters();
+  testStack();
+  testStatus();
+  testEncodingsAndRing();
+  testDump();
+  testRecords();
+  if (failures > 0) {
+    fprintf(stderr, "argsnapshot_test: %d failures\n", failures);
+    return 1;
+  }
+  printf("argsnapshot_test: ok\n");
+  return 0;
+}
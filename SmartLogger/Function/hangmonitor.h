@@ -0,0 +1,47 @@
+#ifndef HANGMONITOR_H
+#define HANGMONITOR_H
+
+#include <stdint.h>
+
+#if __cplusplus
+extern "C" {
+#endif
+
+// Heartbeat of a run loop thread: the thread marks the start of each activity and when it goes
+// idle, a watchdog checks how long the current activity has been running. Two stores per
+// activity on the watched thread, no lock.
+typedef struct HangMonitor_ {
+  uint64_t activity; // Bumped on every change.
+  uint64_t busySince; // Start of the current activity, 0 while idle.
+  uint64_t reported; // Activity of the last hang reported, watchdog only.
+} HangMonitor;
+
+static inline void HangMonitorBusy(HangMonitor *monitor, uint64_t now) {
+  __atomic_store_n(&monitor->busySince, now, __ATOMIC_RELAXED);
+  __atomic_store_n(&monitor->activity, monitor->activity + 1, __ATOMIC_RELEASE);
+}
+
+static inline void HangMonitorIdle(HangMonitor *monitor) {
+  __atomic_store_n(&monitor->busySince, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&monitor->activity, monitor->activity + 1, __ATOMIC_RELEASE);
+}
+
+// Returns how long the current activity has run if it exceeds threshold and was not reported yet,
+// 0 otherwise. Called by the watchdog.
+static inline uint64_t HangMonitorCheck(HangMonitor *monitor, uint64_t now, uint64_t threshold) {
+  uint64_t activity = __atomic_load_n(&monitor->activity, __ATOMIC_ACQUIRE);
+  uint64_t busySince = __atomic_load_n(&monitor->busySince, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  if (busySince == 0 || activity == monitor->reported || now < busySince + threshold ||
+      __atomic_load_n(&monitor->activity, __ATOMIC_RELAXED) != activity) {
+    return 0;
+  }
+  monitor->reported = activity;
+  return now - busySince;
+}
+
+#if __cplusplus
+}
+#endif
+
+#endif
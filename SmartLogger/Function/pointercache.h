@@ -0,0 +1,60 @@
+#ifndef POINTERCACHE_H
+#define POINTERCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if __cplusplus
+extern "C" {
+#endif
+
+// Open addressing pointer -> pointer table for lookups on every objc_msgSend: readers take no
+// lock, writers must be serialized by the caller. Keys and values are never removed or changed,
+// a table is replaced as a whole, and since readers may still use the old one it is never freed.
+// NULL keys and values are not allowed.
+typedef struct PointerCache_ {
+  size_t mask;
+  size_t size;
+  uintptr_t generation; // Owner defined, tells a reader the table is stale.
+  void **keys;
+  void **values;
+} PointerCache;
+typedef PointerCache * PointerCacheRef;
+
+// Creates a table for at least capacity / 2 entries.
+PointerCacheRef PCCreate(size_t capacity, uintptr_t generation);
+
+// Creates a table twice as large holding the entries of cache.
+PointerCacheRef PCGrow(PointerCacheRef cache);
+
+// Frees a table no reader can see.
+void PCFree(PointerCacheRef cache);
+
+// Inserts key if not present, half full tables refuse new keys.
+//
+// This function returns 1 if key is in the table afterwards; 0 otherwise.
+int PCPut(PointerCacheRef cache, void *key, void *value);
+
+static inline size_t PCIndex(PointerCacheRef cache, void *key) {
+  // Fibonacci hashing, the low bits of object pointers are always zero
+  return (size_t)(((uint64_t)(uintptr_t)key * 0x9E3779B97F4A7C15ull) >> 40) & cache->mask;
+}
+
+// Returns the value stored for key, NULL if none.
+static inline void * PCGet(PointerCacheRef cache, void *key) {
+  for (size_t index = PCIndex(cache, key); ; index = (index + 1) & cache->mask) {
+    void *candidate = __atomic_load_n(&cache->keys[index], __ATOMIC_ACQUIRE);
+    if (candidate == key) {
+      return __atomic_load_n(&cache->values[index], __ATOMIC_RELAXED);
+    }
+    if (candidate == NULL) {
+      return NULL;
+    }
+  }
+}
+
+#if __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,67 @@
+#include "pointercache.h"
+
+#include <stdlib.h>
+
+#define MIN_CAPACITY 16
+
+// Creates a table for at least capacity / 2 entries.
+PointerCacheRef PCCreate(size_t capacity, uintptr_t generation) {
+  size_t tableSize = MIN_CAPACITY;
+  while (tableSize < capacity) {
+    tableSize *= 2;
+  }
+  PointerCacheRef cache = (PointerCacheRef)calloc(1, sizeof(PointerCache));
+  if (cache) {
+    cache->keys = (void **)calloc(tableSize, sizeof(void *));
+    cache->values = (void **)calloc(tableSize, sizeof(void *));
+    if (!cache->keys || !cache->values) { // Check for alloc failure.
+      PCFree(cache);
+      return NULL;
+    }
+    cache->mask = tableSize - 1;
+    cache->generation = generation;
+  }
+  return cache;
+}
+
+// Creates a table twice as large holding the entries of cache.
+PointerCacheRef PCGrow(PointerCacheRef cache) {
+  PointerCacheRef grown = PCCreate((cache->mask + 1) * 2, cache->generation);
+  if (grown) {
+    for (size_t index = 0; index <= cache->mask; ++index) {
+      if (cache->keys[index]) {
+        PCPut(grown, cache->keys[index], cache->values[index]);
+      }
+    }
+  }
+  return grown;
+}
+
+// Frees a table no reader can see.
+void PCFree(PointerCacheRef cache) {
+  if (cache) {
+    free(cache->keys);
+    free(cache->values);
+    free(cache);
+  }
+}
+
+// Inserts key if not present, half full tables refuse new keys.
+//
+// This function returns 1 if key is in the table afterwards; 0 otherwise.
+int PCPut(PointerCacheRef cache, void *key, void *value) {
+  size_t index = PCIndex(cache, key);
+  for (; cache->keys[index]; index = (index + 1) & cache->mask) {
+    if (cache->keys[index] == key) {
+      return 1;
+    }
+  }
+  if ((cache->size + 1) * 2 > cache->mask + 1) {
+    return 0;
+  }
+  // Value first, a reader finding the key must see it
+  __atomic_store_n(&cache->values[index], value, __ATOMIC_RELAXED);
+  __atomic_store_n(&cache->keys[index], key, __ATOMIC_RELEASE);
+  ++cache->size;
+  return 1;
+}
@@ -0,0 +1,85 @@
+#ifndef SHADOWSTACK_H
+#define SHADOWSTACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if __cplusplus
+extern "C" {
+#endif
+
+// Copy of a thread's traced call chain that other threads can read, for hang reports.
+//
+// The owner thread writes frames under a sequence lock: the sequence is odd while a frame or the
+// depth changes, a reader copies the frames and retries if the sequence moved. Writers never wait,
+// readers never block the owner. Frames hold the class and selector (never freed by the runtime),
+// not the receiver, so a copy stays valid after the call returns. Frame arrays are never freed,
+// a reader may still be copying from the previous one after a resize.
+typedef struct ShadowFrame_ {
+  const void *cls;
+  const void *sel;
+  uint64_t start; // Entry time, in the owner's time base.
+} ShadowFrame;
+
+typedef struct ShadowFrames_ {
+  int32_t capacity;
+  ShadowFrame frames[];
+} ShadowFrames;
+
+typedef struct ShadowStack_ {
+  uint32_t sequence;
+  int32_t depth;
+  ShadowFrames *frames;
+} ShadowStack;
+typedef ShadowStack * ShadowStackRef;
+
+// Creates an empty stack, NULL if out of memory.
+ShadowStackRef SSCreate(int32_t capacity);
+
+// Grows the frame array to hold index, called by the owner.
+//
+// This function returns 1 if it succeeds; 0 otherwise.
+int SSReserve(ShadowStackRef stack, int32_t index);
+
+static inline void SSWriteBegin(ShadowStackRef stack) {
+  __atomic_store_n(&stack->sequence, stack->sequence + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void SSWriteEnd(ShadowStackRef stack) {
+  __atomic_store_n(&stack->sequence, stack->sequence + 1, __ATOMIC_RELEASE);
+}
+
+// Sets the frame at index and the depth to index + 1, called by the owner.
+static inline void SSPush(ShadowStackRef stack, int32_t index, const void *cls, const void *sel, uint64_t start) {
+  if (index < 0 || (index >= stack->frames->capacity && !SSReserve(stack, index))) {
+    return;
+  }
+  ShadowFrame *frame = &stack->frames->frames[index];
+  SSWriteBegin(stack);
+  __atomic_store_n(&frame->cls, cls, __ATOMIC_RELAXED);
+  __atomic_store_n(&frame->sel, sel, __ATOMIC_RELAXED);
+  __atomic_store_n(&frame->start, start, __ATOMIC_RELAXED);
+  __atomic_store_n(&stack->depth, index + 1, __ATOMIC_RELAXED);
+  SSWriteEnd(stack);
+}
+
+// Sets the depth, called by the owner after a call returns.
+static inline void SSSetDepth(ShadowStackRef stack, int32_t depth) {
+  SSWriteBegin(stack);
+  __atomic_store_n(&stack->depth, depth < 0 ? 0 : depth, __ATOMIC_RELAXED);
+  SSWriteEnd(stack);
+}
+
+// Copies the innermost frames, outermost first, from any thread. `depth` receives the full depth.
+//
+// Returns the number of frames copied, -1 if no consistent copy was made in `attempts` tries.
+int SSSnapshot(ShadowStackRef stack, ShadowFrame *frames, int capacity, int32_t *depth, int attempts);
+
+#if __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,76 @@
+#include "shadowstack.h"
+
+#define MIN_CAPACITY 128
+
+static ShadowFrames * ss_create_frames(int32_t capacity) {
+  ShadowFrames *frames = (ShadowFrames *)calloc(1, sizeof(ShadowFrames) + capacity * sizeof(ShadowFrame));
+  if (frames) {
+    frames->capacity = capacity;
+  }
+  return frames;
+}
+
+// Creates an empty stack, NULL if out of memory.
+ShadowStackRef SSCreate(int32_t capacity) {
+  ShadowStackRef stack = (ShadowStackRef)calloc(1, sizeof(ShadowStack));
+  if (stack) {
+    stack->frames = ss_create_frames(capacity > MIN_CAPACITY ? capacity : MIN_CAPACITY);
+    if (!stack->frames) { // Check for alloc failure.
+      free(stack);
+      return NULL;
+    }
+  }
+  return stack;
+}
+
+// Grows the frame array to hold index, called by the owner.
+//
+// This function returns 1 if it succeeds; 0 otherwise.
+int SSReserve(ShadowStackRef stack, int32_t index) {
+  ShadowFrames *old = stack->frames;
+  if (index < old->capacity) {
+    return 1;
+  }
+  int32_t capacity = old->capacity;
+  while (capacity <= index) {
+    capacity *= 2;
+  }
+  ShadowFrames *frames = ss_create_frames(capacity);
+  if (!frames) {
+    return 0;
+  }
+  memcpy(frames->frames, old->frames, old->capacity * sizeof(ShadowFrame));
+  // The old array stays allocated, a reader may hold it
+  __atomic_store_n(&stack->frames, frames, __ATOMIC_RELEASE);
+  return 1;
+}
+
+// Copies the innermost frames, outermost first, from any thread. `depth` receives the full depth.
+//
+// Returns the number of frames copied, -1 if no consistent copy was made in `attempts` tries.
+int SSSnapshot(ShadowStackRef stack, ShadowFrame *frames, int capacity, int32_t *depth, int attempts) {
+  for (int attempt = 0; attempt < attempts; ++attempt) {
+    uint32_t sequence = __atomic_load_n(&stack->sequence, __ATOMIC_ACQUIRE);
+    if (sequence & 1) {
+      continue;
+    }
+    ShadowFrames *array = __atomic_load_n(&stack->frames, __ATOMIC_ACQUIRE);
+    int32_t total = __atomic_load_n(&stack->depth, __ATOMIC_RELAXED);
+    total = total < array->capacity ? total : array->capacity;
+    // Keep the innermost frames, they are the ones stuck
+    int32_t first = total > capacity ? total - capacity : 0;
+    for (int32_t i = first; i < total; ++i) {
+      ShadowFrame *frame = &array->frames[i];
+      ShadowFrame *copy = &frames[i - first];
+      copy->cls = __atomic_load_n(&frame->cls, __ATOMIC_RELAXED);
+      copy->sel = __atomic_load_n(&frame->sel, __ATOMIC_RELAXED);
+      copy->start = __atomic_load_n(&frame->start, __ATOMIC_RELAXED);
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&stack->sequence, __ATOMIC_RELAXED) == sequence) {
+      *depth = total;
+      return (int)(total - first);
+    }
+  }
+  return -1;
+}
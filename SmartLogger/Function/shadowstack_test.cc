@@ -0,0 +1,168 @@
+// Linux test of the hang detector's building blocks, see SmartLogger/Makefile. An owner thread
+// runs synthetic activities that push and pop frames on its shadow stack, a few of them longer
+// than the hang threshold. A watchdog snapshots the stack and checks the heartbeat the way
+// SLHangDetector does. Prints the snapshot cost; fails on torn snapshots, on hang reports for
+// activities shorter than the threshold and on hangs of twice the threshold that were missed.
+
+#include "shadowstack.h"
+#include "hangmonitor.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define THRESHOLD_NS 50000000ull // 50 ms
+#define RUN_NS 2000000000ull
+#define MAX_DEPTH 300
+#define MAX_ACTIVITIES 4096
+#define MAX_REPORTS 1024
+
+static int failures = 0;
+
+#define CHECK(condition, ...) do { \
+  if (!(condition)) { \
+    fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+    fprintf(stderr, __VA_ARGS__); \
+    fprintf(stderr, "\n"); \
+    failures++; \
+  } \
+} while (0)
+
+typedef struct Activity_ {
+  uint64_t start;
+  uint64_t end;
+} Activity;
+
+static ShadowStackRef stack;
+static HangMonitor monitor;
+static int stopOwner;
+// Written by the owner, read after it is joined.
+static Activity activities[MAX_ACTIVITIES];
+static int activityCount;
+
+static uint64_t now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Synthetic frames: class and selector follow from the level, so a torn copy shows.
+static const void *frameClass(int level) {
+  return (const void *)((uintptr_t)(level + 1) * 4096);
+}
+
+static const void *frameSelector(int level) {
+  return (const void *)(((uintptr_t)(level + 1) * 4096) ^ 0x55);
+}
+
+static void *owner(void *context) {
+  (void)context;
+  unsigned seed = 7;
+  int depth = 0;
+  while (!__atomic_load_n(&stopOwner, __ATOMIC_RELAXED) && activityCount < MAX_ACTIVITIES) {
+    uint64_t start = now();
+    HangMonitorBusy(&monitor, start);
+    // Mostly short activities, 3% run past the threshold by up to twice its length.
+    uint64_t duration = rand_r(&seed) % 100 < 3 ? THRESHOLD_NS + (rand_r(&seed) % 100) * (THRESHOLD_NS / 50)
+                                                 : (rand_r(&seed) % 45) * 1000000ull;
+    while (now() < start + duration) {
+      if (depth < MAX_DEPTH && (depth < 2 || rand_r(&seed) % 2)) {
+        SSPush(stack, depth, frameClass(depth), frameSelector(depth), now());
+        depth++;
+      } else {
+        depth--;
+        SSSetDepth(stack, depth);
+      }
+    }
+    HangMonitorIdle(&monitor);
+    activities[activityCount].start = start;
+    activities[activityCount].end = now();
+    activityCount++;
+    usleep(rand_r(&seed) % 3000);
+  }
+  return NULL;
+}
+
+int main() {
+  stack = SSCreate(16);
+  pthread_t thread;
+  pthread_create(&thread, NULL, owner, NULL);
+
+  ShadowFrame frames[64];
+  long snapshots = 0, torn = 0, failed = 0;
+  uint64_t snapshotTotal = 0, snapshotMax = 0;
+  uint64_t reports[MAX_REPORTS];
+  int reportCount = 0;
+  uint64_t start = now();
+  uint64_t nextCheck = start + THRESHOLD_NS / 2;
+  while (now() - start < RUN_NS) {
+    int32_t depth;
+    uint64_t before = now();
+    int count = SSSnapshot(stack, frames, 64, &depth, 16);
+    uint64_t after = now();
+    snapshots++;
+    snapshotTotal += after - before;
+    snapshotMax = after - before > snapshotMax ? after - before : snapshotMax;
+    if (count < 0) {
+      failed++;
+    }
+    for (int i = 0; i < count; i++) {
+      int level = depth - count + i;
+      if (frames[i].cls != frameClass(level) || frames[i].sel != frameSelector(level) ||
+          (i > 0 && frames[i].start < frames[i - 1].start)) {
+        torn++;
+        break;
+      }
+    }
+    // Watchdog period as in SLHangDetector: half the threshold.
+    if (after >= nextCheck) {
+      if (HangMonitorCheck(&monitor, after, THRESHOLD_NS) && reportCount < MAX_REPORTS) {
+        reports[reportCount++] = after;
+      }
+      nextCheck += THRESHOLD_NS / 2;
+    }
+    usleep(200);
+  }
+  __atomic_store_n(&stopOwner, 1, __ATOMIC_RELAXED);
+  pthread_join(thread, NULL);
+
+  long falsePositives = 0, hangs = 0, missed = 0;
+  for (int r = 0; r < reportCount; r++) {
+    int hang = 0;
+    for (int a = 0; a < activityCount && !hang; a++) {
+      const Activity *activity = &activities[a];
+      hang = activity->start <= reports[r] && reports[r] <= activity->end &&
+             activity->end - activity->start >= THRESHOLD_NS;
+    }
+    falsePositives += !hang;
+  }
+  for (int a = 0; a < activityCount; a++) {
+    const Activity *activity = &activities[a];
+    if (activity->end - activity->start < 2 * THRESHOLD_NS) {
+      continue;
+    }
+    hangs++;
+    int caught = 0;
+    for (int r = 0; r < reportCount && !caught; r++) {
+      caught = activity->start <= reports[r] && reports[r] <= activity->end;
+    }
+    missed += !caught;
+  }
+
+  printf("snapshots: %ld, %.0f ns average, %.1f us max, %ld gave up\n", snapshots,
+         (double)snapshotTotal / (snapshots ? snapshots : 1), (double)snapshotMax / 1e3, failed);
+  printf("activities: %d, reports: %d, false positives: %ld, hangs over 2x threshold: %ld, missed: %ld\n",
+         activityCount, reportCount, falsePositives, hangs, missed);
+  CHECK(torn == 0, "%ld torn snapshots", torn);
+  CHECK(falsePositives == 0, "%ld false positives", falsePositives);
+  CHECK(missed == 0, "%ld of %ld hangs missed", missed, hangs);
+
+  if (failures > 0) {
+    fprintf(stderr, "shadowstack_test: %d failures\n", failures);
+    return 1;
+  }
+  printf("shadowstack_test: ok\n");
+  return 0;
+}
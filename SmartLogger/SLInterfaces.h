@@ -21,6 +21,42 @@ static unsigned int SL_GLOBAL_LOG_LEVEL = 15;
 #endif
 #endif
 
+/**
+ * 每个调用点（call site）的运行时过滤状态，由 SL_LOG_MAYBE 在调用点静态分配.
+ *
+ * `mask` 保存该调用点当前允许的 SLLogFlag 位，只通过 relaxed atomic load 读取.
+ * 初始值为 SL_LOG_SITE_UNRESOLVED，第一次执行时由 SLLogSiteShouldLog 解析并注册，
+ * 之后过滤表更新时会直接改写已注册调用点的 `mask`.
+ *
+ * 注意: 调用点按第一次遇到的 tag 缓存结果，tag 应该是常量;
+ * 如果检测到同一调用点出现不同的 tag，会退化为每次查表（SL_LOG_SITE_DYNAMIC）.
+ */
+typedef struct SLLogSite {
+    unsigned int mask;
+    const char *file;
+    unsigned int line;
+    /// 只用于比较是否同一个 tag, 不会解引用; 通过 __atomic 读写
+    const void *tag;
+    struct SLLogSite *next;
+    /// 注册时 tag 的字符串拷贝, 规则更新时按它重新计算 mask
+    char *tagName;
+} SLLogSite;
+
+#define SL_LOG_SITE_UNRESOLVED  0xFFFFFFFFu
+#define SL_LOG_SITE_DYNAMIC     0x7FFFFFFFu
+
+#if __cplusplus
+extern "C" {
+#endif
+/**
+ * 慢路径: 解析调用点 / 动态 tag 的调用点逐条查表.
+ * 只有当调用点 mask 允许 flag 时才会被调用.
+ */
+int SLLogSiteShouldLog(SLLogSite *site, unsigned int flag, const void *tag);
+#if __cplusplus
+}
+#endif
+
 /**
  * 这个宏编译之后为以下格式:
  *
@@ -30,10 +66,16 @@ static unsigned int SL_GLOBAL_LOG_LEVEL = 15;
  *
  * (在Release输出的时候，编译器会进行优化：如果 SL_GLOBAL_LOG_LEVEL定义成常量, 编译器会检查
  *  if 分支是否可以执行, 如果不能执行，会直接从可执行文件中移除)
+ *
+ * 通过编译期过滤后，再检查调用点的运行时过滤（见 +setLevel:forTag:），
+ * 被关闭的调用点只需要一次 load 和一次分支，不会格式化也不会创建 SLLogMessage.
  */
 #define SL_LOG_MAYBE(async, lvl, flg, atag, frmt, ...)                \
 do {                                                                    \
-if(lvl & flg)                                                       \
+if(lvl & flg) {                                                     \
+static SLLogSite __sl_log_site = { SL_LOG_SITE_UNRESOLVED, __FILE__, __LINE__, NULL, NULL }; \
+if ((__atomic_load_n(&__sl_log_site.mask, __ATOMIC_RELAXED) & (flg))  \
+    && SLLogSiteShouldLog(&__sl_log_site, (flg), (__bridge const void *)(atag))) \
 [SLLogger log:async                     \
 level:lvl                                  \
 flag:flg                                  \
@@ -42,6 +84,7 @@ function:__PRETTY_FUNCTION__                  \
 line:__LINE__                             \
 tag:atag                                 \
 format:(frmt), ## __VA_ARGS__];             \
+}                                                                   \
 } while(0)
 
 
@@ -151,6 +194,24 @@ typedef NSString * _Nullable(^SLLogArchiveCompressBlock)(NSString *logFile);
         tag:(id __nullable)tag
      format:(NSString *_Nonnull)format, ... NS_FORMAT_FUNCTION(8,9);
 
+/**
+ * Appending arguments captured in binary form, formatting is deferred to logging queue.
+ * Not for directly usage, see LogInfoT in `SLLogTyped.h` (Objective-C++ only)
+ *  @param format       printf style format literal, checked at compile time
+ *  @param payload      arguments captured by SLBinaryCapture, copied
+ *  @param length       payload length in bytes
+ */
++ (void)log:(BOOL)async
+      level:(SLLogLevel)level
+       flag:(SLLogFlag)flag
+       file:(nonnull const char *)file
+   function:(nonnull const char *)function
+       line:(NSUInteger)line
+        tag:(id __nullable)tag
+binaryFormat:(nonnull const char *)format
+    payload:(nonnull const void *)payload
+     length:(NSUInteger)length;
+
 /**
  * Logging without format
  *  @param async        YES - async write log, NO - sync write log
@@ -161,6 +222,32 @@ typedef NSString * _Nullable(^SLLogArchiveCompressBlock)(NSString *logFile);
               tag:(id)tag
           message:(NSString *)message;
 
+/**
+ * Runtime level filter for tags, takes effect on all call sites immediately.
+ * Pattern ending with '*' matches by prefix, eg. @"Network*".
+ *  @param level        Allowed level, SLLogLevelOff to mute
+ *  @param tagPattern   Tag or tag prefix pattern
+ */
++ (void)setLevel:(SLLogLevel)level forTag:(NSString *)tagPattern;
+
+/**
+ * Runtime level filter for call sites, more specific than tag filters.
+ * Call site id is `"<file name>:<line>"`, eg. @"SLLogger.m:120" or @"SLLogger.m:*".
+ *  @param level        Allowed level, SLLogLevelOff to mute
+ *  @param sitePattern  Call site id or prefix pattern
+ */
++ (void)setLevel:(SLLogLevel)level forCallSite:(NSString *)sitePattern;
+
+/**
+ * Remove filter for tag or call site pattern
+ */
++ (void)removeLevelFilter:(NSString *)pattern;
+
+/**
+ * Remove all runtime level filters
+ */
++ (void)removeAllLevelFilters;
+
 /**
  * flush all cached logs
  **/
@@ -0,0 +1,148 @@
+//
+//  sllogsearch.c
+//  SmartLogger
+//
+//  Created by Li Hejun on 2019/9/12.
+//  Copyright © 2019 Hejun. All rights reserved.
+//
+//  Searches log files and archives pulled from a device, see Core/Search/SLLogSearch.h.
+//  Not part of the library, build it on the desktop (one command):
+//
+//    cc -O2 -ISmartLogger/Core/Search -ISmartLogger/Core/Appender/FileLogger
+//       SmartLogger/Tools/sllogsearch.c SmartLogger/Core/Search/SLLogSearch.c
+//       SmartLogger/Core/Appender/FileLogger/SLLogDictionary.c -lz -lpthread -o sllogsearch
+//
+//  Usage: sllogsearch [-c] [-m max] pattern file...
+//    -c      only print the number of matching lines per file
+//    -m max  stop after `max` matching lines
+//
+//  Indexes ("index-<archive>.slidx") and dictionaries ("dictionary-<id>.sldict") are looked up
+//  next to each archive. Statistics are printed to stderr.
+//
+
+#include "SLLogSearch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct SLToolFile_ {
+    const char *path;
+    char directory[4096];
+    char *dictionary;
+    size_t dictionaryLength;
+} SLToolFile;
+
+typedef struct SLToolOutput_ {
+    const char *path;
+    int countOnly;
+    int multipleFiles;
+    unsigned long long limit;       // 0 for no limit
+    unsigned long long printed;
+} SLToolOutput;
+
+static const void *sl_tool_lookup(uint32_t dictionaryID, size_t *length, void *context) {
+    SLToolFile *file = (SLToolFile *)context;
+    char path[4200];
+    snprintf(path, sizeof(path), "%sdictionary-%08x.sldict", file->directory, dictionaryID);
+    FILE *input = fopen(path, "rb");
+    if (input == NULL) {
+        fprintf(stderr, "sllogsearch: %s: dictionary %08x not found\n", file->path, dictionaryID);
+        return NULL;
+    }
+    free(file->dictionary);
+    file->dictionary = (char *)malloc(SL_LOG_DICTIONARY_MAX_SIZE);
+    file->dictionaryLength = file->dictionary ? fread(file->dictionary, 1, SL_LOG_DICTIONARY_MAX_SIZE, input) : 0;
+    fclose(input);
+    if (file->dictionaryLength == 0 || SLLogDictionaryID(file->dictionary, file->dictionaryLength) != dictionaryID) {
+        return NULL;
+    }
+    *length = file->dictionaryLength;
+    return file->dictionary;
+}
+
+static int sl_tool_match(const char *line, size_t length, void *context) {
+    SLToolOutput *output = (SLToolOutput *)context;
+    if (!output->countOnly) {
+        if (output->multipleFiles) {
+            printf("%s: ", output->path);
+        }
+        fwrite(line, 1, length, stdout);
+        putchar('\n');
+    }
+    output->printed++;
+    return output->limit && output->printed >= output->limit;
+}
+
+int main(int argc, char **argv) {
+    SLToolOutput output = { NULL, 0, 0, 0, 0 };
+    int option;
+    while ((option = getopt(argc, argv, "cm:")) != -1) {
+        switch (option) {
+            case 'c':
+                output.countOnly = 1;
+                break;
+            case 'm':
+                output.limit = strtoull(optarg, NULL, 10);
+                break;
+            default:
+                fprintf(stderr, "usage: sllogsearch [-c] [-m max] pattern file...\n");
+                return 2;
+        }
+    }
+    if (argc - optind < 2) {
+        fprintf(stderr, "usage: sllogsearch [-c] [-m max] pattern file...\n");
+        return 2;
+    }
+
+    const char *pattern = argv[optind];
+    size_t patternLength = strlen(pattern);
+    output.multipleFiles = argc - optind > 2;
+    SLLogSearchStats total;
+    memset(&total, 0, sizeof(total));
+    int status = 1;
+
+    for (int i = optind + 1; i < argc; i++) {
+        SLToolFile file;
+        memset(&file, 0, sizeof(file));
+        file.path = argv[i];
+        const char *slash = strrchr(file.path, '/');
+        snprintf(file.directory, sizeof(file.directory), "%.*s", slash ? (int)(slash - file.path + 1) : 0, file.path);
+        char indexPath[4200];
+        if (SLLogIndexPathForArchive(file.path, indexPath, sizeof(indexPath)) != 0) {
+            indexPath[0] = '\0';
+        }
+
+        SLLogSearchStats stats;
+        memset(&stats, 0, sizeof(stats));
+        output.path = file.path;
+        int result = SLLogSearchFile(file.path, indexPath[0] ? indexPath : NULL, pattern, patternLength,
+                                     sl_tool_lookup, &file, sl_tool_match, &output, &stats);
+        free(file.dictionary);
+        if (result != 0) {
+            fprintf(stderr, "sllogsearch: %s: %s\n", file.path, result == -2 ? "dictionary missing" : "read error");
+            status = 2;
+        }
+        if (output.countOnly) {
+            printf("%s: %llu\n", file.path, (unsigned long long)stats.matches);
+        }
+        if (stats.matches > 0 && status == 1) {
+            status = 0;
+        }
+        total.bytesScanned += stats.bytesScanned;
+        total.bytesSkipped += stats.bytesSkipped;
+        total.blocksScanned += stats.blocksScanned;
+        total.blocksSkipped += stats.blocksSkipped;
+        total.matches += stats.matches;
+        if (output.limit && output.printed >= output.limit) {
+            break;
+        }
+    }
+
+    fprintf(stderr, "sllogsearch: %llu lines, %llu bytes scanned, %llu bytes skipped (%llu of %llu blocks)\n",
+            (unsigned long long)total.matches, (unsigned long long)total.bytesScanned,
+            (unsigned long long)total.bytesSkipped, (unsigned long long)total.blocksSkipped,
+            (unsigned long long)(total.blocksScanned + total.blocksSkipped));
+    return status;
+}
@@ -21,32 +21,31 @@
 // OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#if defined(__ELF__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE  // dl_iterate_phdr, RTLD_DEFAULT
+#endif
+
 #include "fishhook.h"
 
 #include <dlfcn.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+
+#if defined(__APPLE__)
+#include <mach/mach_time.h>
 #include <mach-o/dyld.h>
 #include <mach-o/loader.h>
 #include <mach-o/nlist.h>
-
-#ifdef __LP64__
-typedef struct mach_header_64 mach_header_t;
-typedef struct segment_command_64 segment_command_t;
-typedef struct section_64 section_t;
-typedef struct nlist_64 nlist_t;
-#define LC_SEGMENT_ARCH_DEPENDENT LC_SEGMENT_64
+#elif defined(__ELF__)
+#include <elf.h>
+#include <link.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
 #else
-typedef struct mach_header mach_header_t;
-typedef struct segment_command segment_command_t;
-typedef struct section section_t;
-typedef struct nlist nlist_t;
-#define LC_SEGMENT_ARCH_DEPENDENT LC_SEGMENT
-#endif
-
-#ifndef SEG_DATA_CONST
-#define SEG_DATA_CONST  "__DATA_CONST"
+#error "fishhook supports Mach-O and ELF only"
 #endif
 
 struct rebindings_entry {
@@ -57,6 +56,94 @@ struct rebindings_entry {
 
 static struct rebindings_entry *_rebindings_head;
 
+// Open addressing table of rebinding names, built once per rebind_symbols call so every symbol of
+// an image costs one hash and (mostly) one strcmp instead of one strcmp per rebinding.
+struct rebindings_table {
+  size_t mask;
+  uint32_t *hashes;
+  struct rebinding **slots;
+};
+
+// All rebindings, for images loaded later. Replaced on each call, never freed: image callbacks
+// may still be using the previous one.
+static struct rebindings_table *_rebindings_table;
+
+static struct rebind_stats _rebind_stats;
+
+// Lookup
+
+static inline uint32_t hash_name(const char *name) {
+  uint32_t hash = 2166136261u;
+  for (; *name; name++) {
+    hash = (hash ^ (uint8_t)*name) * 16777619u;
+  }
+  return hash;
+}
+
+static void free_rebindings_table(struct rebindings_table *table) {
+  if (table) {
+    free(table->hashes);
+    free(table->slots);
+    free(table);
+  }
+}
+
+// Newest entry first, within an entry the first rebinding wins, as with the linear search.
+static struct rebindings_table *new_rebindings_table(struct rebindings_entry *rebindings) {
+  size_t count = 0;
+  for (struct rebindings_entry *cur = rebindings; cur; cur = cur->next) {
+    count += cur->rebindings_nel;
+  }
+  size_t capacity = 16;
+  while (capacity < count * 2) {
+    capacity *= 2;
+  }
+  struct rebindings_table *table = (struct rebindings_table *) calloc(1, sizeof(struct rebindings_table));
+  if (!table) {
+    return NULL;
+  }
+  table->mask = capacity - 1;
+  table->hashes = (uint32_t *) calloc(capacity, sizeof(uint32_t));
+  table->slots = (struct rebinding **) calloc(capacity, sizeof(struct rebinding *));
+  if (!table->hashes || !table->slots) {
+    free_rebindings_table(table);
+    return NULL;
+  }
+  for (struct rebindings_entry *cur = rebindings; cur; cur = cur->next) {
+    for (size_t j = 0; j < cur->rebindings_nel; j++) {
+      struct rebinding *rebinding = &cur->rebindings[j];
+      uint32_t hash = hash_name(rebinding->name);
+      size_t index = hash & table->mask;
+      while (table->slots[index] &&
+             (table->hashes[index] != hash || strcmp(table->slots[index]->name, rebinding->name) != 0)) {
+        index = (index + 1) & table->mask;
+      }
+      if (!table->slots[index]) {
+        table->hashes[index] = hash;
+        table->slots[index] = rebinding;
+      }
+    }
+  }
+  return table;
+}
+
+static inline struct rebinding *lookup_rebinding(const struct rebindings_table *table, const char *name) {
+  uint32_t hash = hash_name(name);
+  for (size_t index = hash & table->mask; table->slots[index]; index = (index + 1) & table->mask) {
+    if (table->hashes[index] == hash && strcmp(table->slots[index]->name, name) == 0) {
+      return table->slots[index];
+    }
+  }
+  return NULL;
+}
+
+static inline void apply_rebinding(struct rebinding *rebinding, void **binding, void *original) {
+  if (rebinding->replaced != NULL && original != rebinding->replacement) {
+    *(rebinding->replaced) = original;
+  }
+  *binding = rebinding->replacement;
+}
+
 static int prepend_rebindings(struct rebindings_entry **rebindings_head,
                               struct rebinding rebindings[],
                               size_t nel) {
@@ -76,12 +163,71 @@ static int prepend_rebindings(struct rebindings_entry **rebindings_head,
   return 0;
 }
 
-static void perform_rebinding_with_section(struct rebindings_entry *rebindings,
+// Stats
+
+static uint64_t now_ns(void) {
+#if defined(__APPLE__)
+  static mach_timebase_info_data_t timebase;
+  if (timebase.denom == 0) {
+    mach_timebase_info(&timebase);
+  }
+  return mach_absolute_time() * timebase.numer / timebase.denom;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static void record_image(uint64_t start, size_t symbols, size_t rebound) {
+  uint64_t elapsed = now_ns() - start;
+  __atomic_fetch_add(&_rebind_stats.images, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&_rebind_stats.symbols, symbols, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&_rebind_stats.rebound, rebound, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&_rebind_stats.total_ns, elapsed, __ATOMIC_RELAXED);
+  uint64_t max = __atomic_load_n(&_rebind_stats.max_image_ns, __ATOMIC_RELAXED);
+  while (elapsed > max &&
+         !__atomic_compare_exchange_n(&_rebind_stats.max_image_ns, &max, elapsed, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+}
+
+void rebind_symbols_stats(struct rebind_stats *stats) {
+  stats->images = __atomic_load_n(&_rebind_stats.images, __ATOMIC_RELAXED);
+  stats->symbols = __atomic_load_n(&_rebind_stats.symbols, __ATOMIC_RELAXED);
+  stats->rebound = __atomic_load_n(&_rebind_stats.rebound, __ATOMIC_RELAXED);
+  stats->total_ns = __atomic_load_n(&_rebind_stats.total_ns, __ATOMIC_RELAXED);
+  stats->max_image_ns = __atomic_load_n(&_rebind_stats.max_image_ns, __ATOMIC_RELAXED);
+}
+
+#if defined(__APPLE__)
+
+// Mach-O
+
+#ifdef __LP64__
+typedef struct mach_header_64 mach_header_t;
+typedef struct segment_command_64 segment_command_t;
+typedef struct section_64 section_t;
+typedef struct nlist_64 nlist_t;
+#define LC_SEGMENT_ARCH_DEPENDENT LC_SEGMENT_64
+#else
+typedef struct mach_header mach_header_t;
+typedef struct segment_command segment_command_t;
+typedef struct section section_t;
+typedef struct nlist nlist_t;
+#define LC_SEGMENT_ARCH_DEPENDENT LC_SEGMENT
+#endif
+
+#ifndef SEG_DATA_CONST
+#define SEG_DATA_CONST  "__DATA_CONST"
+#endif
+
+static void perform_rebinding_with_section(const struct rebindings_table *table,
                                            section_t *section,
                                            intptr_t slide,
                                            nlist_t *symtab,
                                            char *strtab,
-                                           uint32_t *indirect_symtab) {
+                                           uint32_t *indirect_symtab,
+                                           size_t *symbols,
+                                           size_t *rebound) {
   uint32_t *indirect_symbol_indices = indirect_symtab + section->reserved1;
   void **indirect_symbol_bindings = (void **)((uintptr_t)slide + section->addr);
   for (uint i = 0; i < section->size / sizeof(void *); i++) {
@@ -92,33 +238,27 @@ static void perform_rebinding_with_section(struct rebindings_entry *rebindings,
     }
     uint32_t strtab_offset = symtab[symtab_index].n_un.n_strx;
     char *symbol_name = strtab + strtab_offset;
-    bool symbol_name_longer_than_1 = symbol_name[0] && symbol_name[1];
-    struct rebindings_entry *cur = rebindings;
-    while (cur) {
-      for (uint j = 0; j < cur->rebindings_nel; j++) {
-        if (symbol_name_longer_than_1 &&
-            strcmp(&symbol_name[1], cur->rebindings[j].name) == 0) {
-          if (cur->rebindings[j].replaced != NULL &&
-              indirect_symbol_bindings[i] != cur->rebindings[j].replacement) {
-            *(cur->rebindings[j].replaced) = indirect_symbol_bindings[i];
-          }
-          indirect_symbol_bindings[i] = cur->rebindings[j].replacement;
-          goto symbol_loop;
-        }
-      }
-      cur = cur->next;
+    if (!symbol_name[0] || !symbol_name[1]) {
+      continue;
+    }
+    (*symbols)++;
+    struct rebinding *rebinding = lookup_rebinding(table, &symbol_name[1]);
+    if (rebinding) {
+      apply_rebinding(rebinding, &indirect_symbol_bindings[i], indirect_symbol_bindings[i]);
+      (*rebound)++;
     }
-  symbol_loop:;
   }
 }
 
-static void rebind_symbols_for_image(struct rebindings_entry *rebindings,
+static void rebind_symbols_for_image(const struct rebindings_table *table,
                                      const struct mach_header *header,
                                      intptr_t slide) {
   Dl_info info;
-  if (dladdr(header, &info) == 0) {
+  if (table == NULL || dladdr(header, &info) == 0) {
     return;
   }
+  uint64_t start = now_ns();
+  size_t symbols = 0, rebound = 0;
 
   segment_command_t *cur_seg_cmd;
   segment_command_t *linkedit_segment = NULL;
@@ -141,6 +281,7 @@ static void rebind_symbols_for_image(struct rebindings_entry *rebindings,
 
   if (!symtab_cmd || !dysymtab_cmd || !linkedit_segment ||
       !dysymtab_cmd->nindirectsyms) {
+    record_image(start, 0, 0);
     return;
   }
 
@@ -163,20 +304,19 @@ static void rebind_symbols_for_image(struct rebindings_entry *rebindings,
       for (uint j = 0; j < cur_seg_cmd->nsects; j++) {
         section_t *sect =
           (section_t *)(cur + sizeof(segment_command_t)) + j;
-        if ((sect->flags & SECTION_TYPE) == S_LAZY_SYMBOL_POINTERS) {
-          perform_rebinding_with_section(rebindings, sect, slide, symtab, strtab, indirect_symtab);
-        }
-        if ((sect->flags & SECTION_TYPE) == S_NON_LAZY_SYMBOL_POINTERS) {
-          perform_rebinding_with_section(rebindings, sect, slide, symtab, strtab, indirect_symtab);
+        if ((sect->flags & SECTION_TYPE) == S_LAZY_SYMBOL_POINTERS ||
+            (sect->flags & SECTION_TYPE) == S_NON_LAZY_SYMBOL_POINTERS) {
+          perform_rebinding_with_section(table, sect, slide, symtab, strtab, indirect_symtab, &symbols, &rebound);
         }
       }
     }
   }
+  record_image(start, symbols, rebound);
 }
 
 static void _rebind_symbols_for_image(const struct mach_header *header,
                                       intptr_t slide) {
-    rebind_symbols_for_image(_rebindings_head, header, slide);
+    rebind_symbols_for_image(__atomic_load_n(&_rebindings_table, __ATOMIC_ACQUIRE), header, slide);
 }
 
 int rebind_symbols_image(void *header,
@@ -185,7 +325,9 @@ int rebind_symbols_image(void *header,
                          size_t rebindings_nel) {
     struct rebindings_entry *rebindings_head = NULL;
     int retval = prepend_rebindings(&rebindings_head, rebindings, rebindings_nel);
-    rebind_symbols_for_image(rebindings_head, (const struct mach_header *) header, slide);
+    struct rebindings_table *table = rebindings_head ? new_rebindings_table(rebindings_head) : NULL;
+    rebind_symbols_for_image(table, (const struct mach_header *) header, slide);
+    free_rebindings_table(table);
     if (rebindings_head) {
       free(rebindings_head->rebindings);
     }
@@ -198,15 +340,323 @@ int rebind_symbols(struct rebinding rebindings[], size_t rebindings_nel) {
   if (retval < 0) {
     return retval;
   }
+  struct rebindings_table *table = new_rebindings_table(_rebindings_head);
+  if (!table) {
+    return -1;
+  }
+  __atomic_store_n(&_rebindings_table, table, __ATOMIC_RELEASE);
   // If this was the first call, register callback for image additions (which is also invoked for
   // existing images, otherwise, just run on existing images
   if (!_rebindings_head->next) {
     _dyld_register_func_for_add_image(_rebind_symbols_for_image);
   } else {
+    // Earlier rebindings are already in place, only the new ones need a pass
+    struct rebindings_entry new_entry = *_rebindings_head;
+    new_entry.next = NULL;
+    struct rebindings_table *new_table = new_rebindings_table(&new_entry);
     uint32_t c = _dyld_image_count();
     for (uint32_t i = 0; i < c; i++) {
-      _rebind_symbols_for_image(_dyld_get_image_header(i), _dyld_get_image_vmaddr_slide(i));
+      rebind_symbols_for_image(new_table ?: table, _dyld_get_image_header(i), _dyld_get_image_vmaddr_slide(i));
     }
+    free_rebindings_table(new_table);
   }
   return retval;
 }
+
+#else
+
+// ELF
+
+// GOT entries of imported functions: JUMP_SLOT (PLT calls) and GLOB_DAT (address taken, -fno-plt).
+#if defined(__x86_64__)
+#define FH_R_JUMP_SLOT R_X86_64_JUMP_SLOT
+#define FH_R_GLOB_DAT R_X86_64_GLOB_DAT
+#elif defined(__aarch64__)
+#define FH_R_JUMP_SLOT R_AARCH64_JUMP_SLOT
+#define FH_R_GLOB_DAT R_AARCH64_GLOB_DAT
+#elif defined(__i386__)
+#define FH_R_JUMP_SLOT R_386_JMP_SLOT
+#define FH_R_GLOB_DAT R_386_GLOB_DAT
+#elif defined(__arm__)
+#define FH_R_JUMP_SLOT R_ARM_JUMP_SLOT
+#define FH_R_GLOB_DAT R_ARM_GLOB_DAT
+#else
+#error "fishhook: unsupported ELF architecture"
+#endif
+
+#if defined(__LP64__)
+#define FH_R_SYM(info) ELF64_R_SYM(info)
+#define FH_R_TYPE(info) ELF64_R_TYPE(info)
+#else
+#define FH_R_SYM(info) ELF32_R_SYM(info)
+#define FH_R_TYPE(info) ELF32_R_TYPE(info)
+#endif
+
+struct elf_image {
+  ElfW(Addr) base;
+  const ElfW(Phdr) *phdr;
+  ElfW(Half) phnum;
+};
+
+struct elf_images {
+  struct elf_image *images;
+  size_t count;
+  size_t capacity;
+};
+
+// Images already rebound with the full table, by load address
+static ElfW(Addr) *_seen_images;
+static size_t _seen_count;
+static size_t _seen_capacity;
+
+static void *(*_orig_dlopen)(const char *, int);
+
+static int collect_image(struct dl_phdr_info *info, size_t size, void *context) {
+  (void)size;
+  struct elf_images *images = (struct elf_images *)context;
+  if (images->count == images->capacity) {
+    size_t capacity = images->capacity ? images->capacity * 2 : 64;
+    struct elf_image *grown = (struct elf_image *) realloc(images->images, capacity * sizeof(struct elf_image));
+    if (!grown) {
+      return 1;
+    }
+    images->images = grown;
+    images->capacity = capacity;
+  }
+  struct elf_image *image = &images->images[images->count++];
+  image->base = info->dlpi_addr;
+  image->phdr = info->dlpi_phdr;
+  image->phnum = info->dlpi_phnum;
+  return 0;
+}
+
+// Collected under the loader lock, rebound after it is released: resolving lazy entries calls dlsym.
+static void collect_images(struct elf_images *images) {
+  memset(images, 0, sizeof(struct elf_images));
+  dl_iterate_phdr(collect_image, images);
+}
+
+static inline ElfW(Addr) dynamic_address(const struct elf_image *image, ElfW(Addr) ptr) {
+  // glibc relocates most dynamic entries in place, the vDSO and other loaders don't
+  return ptr < image->base ? ptr + image->base : ptr;
+}
+
+struct elf_relro {
+  uintptr_t start;
+  uintptr_t end;
+  bool writable;
+};
+
+static void write_binding(struct elf_relro *relro, void **binding, struct rebinding *rebinding, void *original) {
+  uintptr_t address = (uintptr_t)binding;
+  if (address >= relro->start && address < relro->end && !relro->writable) {
+    // Full RELRO: the GOT was made read-only after relocation
+    if (mprotect((void *)relro->start, relro->end - relro->start, PROT_READ | PROT_WRITE) != 0) {
+      return;
+    }
+    relro->writable = true;
+  }
+  apply_rebinding(rebinding, binding, original);
+}
+
+static void *resolve_original(uintptr_t low, uintptr_t high, void *current, const char *name, unsigned type) {
+  // A lazy JUMP_SLOT still points into the image's own PLT, calling it would bind the slot again
+  if (type == FH_R_JUMP_SLOT && (uintptr_t)current >= low && (uintptr_t)current < high) {
+    void *symbol = dlsym(RTLD_DEFAULT, name);
+    return symbol ? symbol : current;
+  }
+  return current;
+}
+
+static void perform_rebinding_with_relocations(const struct rebindings_table *table,
+                                               const struct elf_image *image,
+                                               const void *relocations, size_t size, bool rela,
+                                               const ElfW(Sym) *symtab, const char *strtab,
+                                               uintptr_t low, uintptr_t high,
+                                               struct elf_relro *relro,
+                                               size_t *symbols, size_t *rebound) {
+  size_t entry_size = rela ? sizeof(ElfW(Rela)) : sizeof(ElfW(Rel));
+  for (size_t offset = 0; offset + entry_size <= size; offset += entry_size) {
+    // Rel is a prefix of Rela
+    const ElfW(Rel) *relocation = (const ElfW(Rel) *)((const char *)relocations + offset);
+    unsigned type = (unsigned)FH_R_TYPE(relocation->r_info);
+    size_t symbol_index = FH_R_SYM(relocation->r_info);
+    if ((type != FH_R_JUMP_SLOT && type != FH_R_GLOB_DAT) || symbol_index == 0) {
+      continue;
+    }
+    const char *symbol_name = strtab + symtab[symbol_index].st_name;
+    if (!symbol_name[0]) {
+      continue;
+    }
+    (*symbols)++;
+    struct rebinding *rebinding = lookup_rebinding(table, symbol_name);
+    if (rebinding) {
+      void **binding = (void **)(image->base + relocation->r_offset);
+      void *original = resolve_original(low, high, *binding, symbol_name, type);
+      write_binding(relro, binding, rebinding, original);
+      (*rebound)++;
+    }
+  }
+}
+
+static void rebind_symbols_for_elf_image(const struct rebindings_table *table, const struct elf_image *image) {
+  if (table == NULL) {
+    return;
+  }
+  uint64_t start = now_ns();
+  size_t symbols = 0, rebound = 0;
+
+  const ElfW(Dyn) *dynamic = NULL;
+  struct elf_relro relro = { 0, 0, false };
+  uintptr_t low = UINTPTR_MAX, high = 0;
+  long page = sysconf(_SC_PAGESIZE);
+  for (ElfW(Half) i = 0; i < image->phnum; i++) {
+    const ElfW(Phdr) *phdr = &image->phdr[i];
+    if (phdr->p_type == PT_DYNAMIC) {
+      dynamic = (const ElfW(Dyn) *)(image->base + phdr->p_vaddr);
+    } else if (phdr->p_type == PT_GNU_RELRO) {
+      relro.start = (image->base + phdr->p_vaddr) & ~(uintptr_t)(page - 1);
+      relro.end = (image->base + phdr->p_vaddr + phdr->p_memsz + page - 1) & ~(uintptr_t)(page - 1);
+    } else if (phdr->p_type == PT_LOAD) {
+      uintptr_t segment = image->base + phdr->p_vaddr;
+      low = segment < low ? segment : low;
+      high = segment + phdr->p_memsz > high ? segment + phdr->p_memsz : high;
+    }
+  }
+  if (!dynamic) {
+    record_image(start, 0, 0);
+    return;
+  }
+
+  const ElfW(Sym) *symtab = NULL;
+  const char *strtab = NULL;
+  const void *jmprel = NULL, *rela = NULL, *rel = NULL;
+  size_t jmprel_size = 0, rela_size = 0, rel_size = 0;
+  bool jmprel_rela = true;
+  for (const ElfW(Dyn) *entry = dynamic; entry->d_tag != DT_NULL; entry++) {
+    switch (entry->d_tag) {
+      case DT_SYMTAB: symtab = (const ElfW(Sym) *)dynamic_address(image, entry->d_un.d_ptr); break;
+      case DT_STRTAB: strtab = (const char *)dynamic_address(image, entry->d_un.d_ptr); break;
+      case DT_JMPREL: jmprel = (const void *)dynamic_address(image, entry->d_un.d_ptr); break;
+      case DT_PLTRELSZ: jmprel_size = entry->d_un.d_val; break;
+      case DT_PLTREL: jmprel_rela = entry->d_un.d_val == DT_RELA; break;
+      case DT_RELA: rela = (const void *)dynamic_address(image, entry->d_un.d_ptr); break;
+      case DT_RELASZ: rela_size = entry->d_un.d_val; break;
+      case DT_REL: rel = (const void *)dynamic_address(image, entry->d_un.d_ptr); break;
+      case DT_RELSZ: rel_size = entry->d_un.d_val; break;
+      default: break;
+    }
+  }
+  if (symtab && strtab) {
+    if (jmprel) {
+      perform_rebinding_with_relocations(table, image, jmprel, jmprel_size, jmprel_rela, symtab, strtab,
+                                         low, high, &relro, &symbols, &rebound);
+    }
+    if (rela) {
+      perform_rebinding_with_relocations(table, image, rela, rela_size, true, symtab, strtab,
+                                         low, high, &relro, &symbols, &rebound);
+    }
+    if (rel) {
+      perform_rebinding_with_relocations(table, image, rel, rel_size, false, symtab, strtab,
+                                         low, high, &relro, &symbols, &rebound);
+    }
+  }
+  if (relro.writable) {
+    mprotect((void *)relro.start, relro.end - relro.start, PROT_READ);
+  }
+  record_image(start, symbols, rebound);
+}
+
+static bool mark_image_seen(ElfW(Addr) base) {
+  for (size_t i = 0; i < _seen_count; i++) {
+    if (_seen_images[i] == base) {
+      return false;
+    }
+  }
+  if (_seen_count == _seen_capacity) {
+    size_t capacity = _seen_capacity ? _seen_capacity * 2 : 64;
+    ElfW(Addr) *grown = (ElfW(Addr) *) realloc(_seen_images, capacity * sizeof(ElfW(Addr)));
+    if (!grown) {
+      return true;
+    }
+    _seen_images = grown;
+    _seen_capacity = capacity;
+  }
+  _seen_images[_seen_count++] = base;
+  return true;
+}
+
+// No add-image callback on ELF, images loaded later are found through dlopen
+static void *_fishhook_dlopen(const char *file, int mode) {
+  void *handle = _orig_dlopen ? _orig_dlopen(file, mode) : NULL;
+  struct rebindings_table *table = __atomic_load_n(&_rebindings_table, __ATOMIC_ACQUIRE);
+  if (handle && table) {
+    struct elf_images images;
+    collect_images(&images);
+    for (size_t i = 0; i < images.count; i++) {
+      if (mark_image_seen(images.images[i].base)) {
+        rebind_symbols_for_elf_image(table, &images.images[i]);
+      }
+    }
+    free(images.images);
+  }
+  return handle;
+}
+
+int rebind_symbols_image(void *header,
+                         intptr_t slide,
+                         struct rebinding rebindings[],
+                         size_t rebindings_nel) {
+  // `header` is the image's program headers (dlpi_phdr), `slide` its load address (dlpi_addr)
+  struct rebindings_entry *rebindings_head = NULL;
+  int retval = prepend_rebindings(&rebindings_head, rebindings, rebindings_nel);
+  struct rebindings_table *table = rebindings_head ? new_rebindings_table(rebindings_head) : NULL;
+  struct elf_images images;
+  collect_images(&images);
+  for (size_t i = 0; i < images.count; i++) {
+    if (images.images[i].phdr == (const ElfW(Phdr) *)header && images.images[i].base == (ElfW(Addr))slide) {
+      rebind_symbols_for_elf_image(table, &images.images[i]);
+    }
+  }
+  free(images.images);
+  free_rebindings_table(table);
+  if (rebindings_head) {
+    free(rebindings_head->rebindings);
+  }
+  free(rebindings_head);
+  return retval;
+}
+
+int rebind_symbols(struct rebinding rebindings[], size_t rebindings_nel) {
+  if (!_rebindings_head) {
+    struct rebinding dlopen_rebinding = { "dlopen", (void *)_fishhook_dlopen, (void **)&_orig_dlopen };
+    if (prepend_rebindings(&_rebindings_head, &dlopen_rebinding, 1) < 0) {
+      return -1;
+    }
+  }
+  int retval = prepend_rebindings(&_rebindings_head, rebindings, rebindings_nel);
+  if (retval < 0) {
+    return retval;
+  }
+  struct rebindings_table *table = new_rebindings_table(_rebindings_head);
+  if (!table) {
+    return -1;
+  }
+  __atomic_store_n(&_rebindings_table, table, __ATOMIC_RELEASE);
+
+  // Seen images already have the earlier rebindings, only the new ones need a pass
+  struct rebindings_entry new_entry = *_rebindings_head;
+  new_entry.next = NULL;
+  struct rebindings_table *new_table = _seen_count ? new_rebindings_table(&new_entry) : NULL;
+  struct elf_images images;
+  collect_images(&images);
+  for (size_t i = 0; i < images.count; i++) {
+    bool seen = !mark_image_seen(images.images[i].base);
+    rebind_symbols_for_elf_image(seen && new_table ? new_table : table, &images.images[i]);
+  }
+  free(images.images);
+  free_rebindings_table(new_table);
+  return retval;
+}
+
+#endif
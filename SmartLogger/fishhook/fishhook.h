@@ -54,6 +54,11 @@ struct rebinding {
  * by the process. If rebind_functions is called more than once, the symbols to
  * rebind are added to the existing list of rebindings, and if a given symbol
  * is rebound more than once, the later rebinding will take precedence.
+ *
+ * Symbol names are looked up in a hash table, so the cost per image does not
+ * grow with the number of rebindings. On ELF (Linux, Android) the GOT entries
+ * of JUMP_SLOT and GLOB_DAT relocations are rebound, images loaded later are
+ * rebound when dlopen returns.
  */
 FISHHOOK_VISIBILITY
 int rebind_symbols(struct rebinding rebindings[], size_t rebindings_nel);
@@ -61,6 +66,8 @@ int rebind_symbols(struct rebinding rebindings[], size_t rebindings_nel);
 /*
  * Rebinds as above, but only in the specified image. The header should point
  * to the mach-o header, the slide should be the slide offset. Others as above.
+ * On ELF the header is the image's program headers (dlpi_phdr) and the slide
+ * its load address (dlpi_addr), as reported by dl_iterate_phdr.
  */
 FISHHOOK_VISIBILITY
 int rebind_symbols_image(void *header,
@@ -68,6 +75,21 @@ int rebind_symbols_image(void *header,
                          struct rebinding rebindings[],
                          size_t rebindings_nel);
 
+/*
+ * Totals of all passes over images since launch, to measure the cost of
+ * rebinding at startup and on image load.
+ */
+struct rebind_stats {
+  size_t images;            // Image passes
+  size_t symbols;           // Imported symbols looked up
+  size_t rebound;           // Pointers rewritten
+  uint64_t total_ns;
+  uint64_t max_image_ns;    // Slowest single image
+};
+
+FISHHOOK_VISIBILITY
+void rebind_symbols_stats(struct rebind_stats *stats);
+
 #ifdef __cplusplus
 }
 #endif //__cplusplus
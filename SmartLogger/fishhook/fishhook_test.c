@@ -0,0 +1,151 @@
+// Linux test of the ELF backend, see SmartLogger/Makefile. Built twice, with lazy binding and with
+// -z now (full RELRO). Rebinds getpid and strlen in every loaded image, then dlopens
+// fishhook_test_library.c, which must be rebound when it loads, and chains a second strlen hook
+// over the first. Prints rebind_symbols_stats per pass: images, symbols and microseconds per image,
+// the last pass with 256 rebindings that match nothing. Built with -fno-builtin so strlen is a call.
+
+#include "fishhook.h"
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef FISHHOOK_TEST_LIBRARY
+#error "FISHHOOK_TEST_LIBRARY must be the path of the test library"
+#endif
+
+#define ABSENT_REBINDINGS 256
+
+static int failures = 0;
+
+#define CHECK(condition, ...) do { \
+  if (!(condition)) { \
+    fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+    fprintf(stderr, __VA_ARGS__); \
+    fprintf(stderr, "\n"); \
+    failures++; \
+  } \
+} while (0)
+
+static pid_t (*originalGetpid)(void);
+static size_t (*originalStrlen)(const char *);
+static size_t (*chainedStrlen)(const char *);
+static long getpidCalls, strlenCalls, chainedStrlenCalls;
+
+static pid_t hookedGetpid(void) {
+  __atomic_fetch_add(&getpidCalls, 1, __ATOMIC_RELAXED);
+  return originalGetpid();
+}
+
+static size_t hookedStrlen(const char *string) {
+  __atomic_fetch_add(&strlenCalls, 1, __ATOMIC_RELAXED);
+  return originalStrlen(string);
+}
+
+static size_t chainedHookedStrlen(const char *string) {
+  __atomic_fetch_add(&chainedStrlenCalls, 1, __ATOMIC_RELAXED);
+  return chainedStrlen(string);
+}
+
+static long calls(long *counter) {
+  return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+static uint64_t now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Stats of the passes since `before`
+static void printPass(const char *name, const struct rebind_stats *before, uint64_t elapsed) {
+  struct rebind_stats after;
+  rebind_symbols_stats(&after);
+  size_t images = after.images - before->images;
+  printf("%-8s %3zu images, %6zu symbols, %3zu rebound, %.1f us per image, %.1f us max so far, %.1f us call\n",
+         name, images, after.symbols - before->symbols, after.rebound - before->rebound,
+         (double)(after.total_ns - before->total_ns) / 1e3 / (images ? images : 1),
+         (double)after.max_image_ns / 1e3, (double)elapsed / 1e3);
+}
+
+int main() {
+  const char *text = "fishhook_test";
+  size_t length = sizeof("fishhook_test") - 1;
+  pid_t pid = (pid_t)syscall(SYS_getpid);
+
+  struct rebind_stats before;
+  rebind_symbols_stats(&before);
+  struct rebinding rebindings[] = {
+    { "getpid", (void *)hookedGetpid, (void **)&originalGetpid },
+    { "strlen", (void *)hookedStrlen, (void **)&originalStrlen },
+  };
+  uint64_t start = now();
+  CHECK(rebind_symbols(rebindings, 2) == 0, "rebind_symbols failed");
+  printPass("startup", &before, now() - start);
+  CHECK(originalGetpid != NULL && originalStrlen != NULL, "originals not set");
+
+  // Lazy slots of the executable were never bound, their originals come from dlsym
+  long getpids = calls(&getpidCalls), strlens = calls(&strlenCalls);
+  CHECK(getpid() == pid && calls(&getpidCalls) > getpids, "getpid in the executable not rebound");
+  CHECK(strlen(text) == length && calls(&strlenCalls) > strlens, "strlen in the executable not rebound");
+
+  // Loaded later, rebound by the dlopen hook
+  rebind_symbols_stats(&before);
+  start = now();
+  void *library = dlopen(FISHHOOK_TEST_LIBRARY, RTLD_NOW | RTLD_LOCAL);
+  printPass("dlopen", &before, now() - start);
+  CHECK(library != NULL, "dlopen: %s", dlerror());
+  if (library == NULL) {
+    return 1;
+  }
+  size_t (*libraryStrlen)(const char *) = (size_t (*)(const char *))dlsym(library, "fishhook_test_library_strlen");
+  pid_t (*libraryGetpid)(void) = (pid_t (*)(void))dlsym(library, "fishhook_test_library_getpid");
+  CHECK(libraryStrlen != NULL && libraryGetpid != NULL, "library symbols missing");
+  getpids = calls(&getpidCalls);
+  strlens = calls(&strlenCalls);
+  CHECK(libraryGetpid() == pid && calls(&getpidCalls) > getpids, "getpid in the library not rebound");
+  CHECK(libraryStrlen(text) == length && calls(&strlenCalls) > strlens, "strlen in the library not rebound");
+
+  // A later rebinding takes precedence and calls through to the earlier one
+  struct rebinding chained[] = { { "strlen", (void *)chainedHookedStrlen, (void **)&chainedStrlen } };
+  rebind_symbols_stats(&before);
+  start = now();
+  CHECK(rebind_symbols(chained, 1) == 0, "chained rebind_symbols failed");
+  printPass("chained", &before, now() - start);
+  CHECK(chainedStrlen == hookedStrlen, "chained hook does not call the first one");
+  long chainedStrlens = calls(&chainedStrlenCalls);
+  strlens = calls(&strlenCalls);
+  CHECK(strlen(text) == length && libraryStrlen(text) == length, "chained strlen result");
+  CHECK(calls(&chainedStrlenCalls) >= chainedStrlens + 2 && calls(&strlenCalls) >= strlens + 2,
+        "chained strlen calls: %ld outer, %ld inner", calls(&chainedStrlenCalls) - chainedStrlens,
+        calls(&strlenCalls) - strlens);
+
+  // Lookup cost with many rebindings, none of them imported anywhere
+  static char names[ABSENT_REBINDINGS][32];
+  static struct rebinding absent[ABSENT_REBINDINGS];
+  for (int i = 0; i < ABSENT_REBINDINGS; i++) {
+    snprintf(names[i], sizeof(names[i]), "fishhook_test_absent_%d", i);
+    absent[i].name = names[i];
+    absent[i].replacement = (void *)hookedGetpid;
+    absent[i].replaced = NULL;
+  }
+  rebind_symbols_stats(&before);
+  start = now();
+  CHECK(rebind_symbols(absent, ABSENT_REBINDINGS) == 0, "absent rebind_symbols failed");
+  printPass("absent", &before, now() - start);
+  struct rebind_stats after;
+  rebind_symbols_stats(&after);
+  CHECK(after.rebound == before.rebound, "%zu absent symbols rebound", after.rebound - before.rebound);
+  CHECK(getpid() == pid && strlen(text) == length, "hooks lost after the absent pass");
+
+  dlclose(library);
+  if (failures > 0) {
+    fprintf(stderr, "fishhook_test: %d failures\n", failures);
+    return 1;
+  }
+  printf("fishhook_test: ok\n");
+  return 0;
+}
@@ -0,0 +1,13 @@
+// Library for fishhook_test, see SmartLogger/Makefile. Loaded with dlopen after the rebinding, its
+// imports of strlen and getpid must be rebound as well. Built with -fno-builtin so strlen is a call.
+
+#include <string.h>
+#include <unistd.h>
+
+size_t fishhook_test_library_strlen(const char *string) {
+  return strlen(string);
+}
+
+pid_t fishhook_test_library_getpid(void) {
+  return getpid();
+}